@@ -0,0 +1,133 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""
+Compares the ROC curves of a cascaded JetTagger (FirstStageModelPath) with the full model run on all jets.
+
+Both inputs are JetTags trees written by the JetFlavorTagWriter (writeJetTags.py --generic_writer or --compact_tags)
+for the same events, once with --first_stage_model/--first_stage_json and once without. For every binary
+discrimination (b vs ud, c vs b, ...) the table lists the AUC and the background efficiency at fixed signal
+efficiencies for both runs and their difference, with the discriminant s / (s + b) of helper_rocs.py. The fraction of
+jets escalated to the full model is read from the branch recojet_provenance of the cascade.
+
+Usage: python compare_cascade_rocs.py CASCADE.root FULL.root [--working-points 0.5 0.7 0.9] [--key JetTags]
+Needs uproot and numpy.
+"""
+import argparse
+
+import numpy as np
+import uproot
+
+# signal and background flavors; u and d are merged into "light" as in helper_rocs.py
+DISCRIMINATIONS = [("B", "UD"), ("B", "C"), ("B", "G"), ("C", "UD"), ("C", "B"), ("S", "UD"), ("G", "UD"),
+                   ("TAU", "UD")]
+# JetTagProvenance of the JetTagger
+PROVENANCE = {0: "full model", 1: "first stage", 2: "escalated", 3: "skipped"}
+SKIPPED = 3
+
+
+def load(path, key):
+    with uproot.open(path) as f:
+        return f[key].arrays(library="np")
+
+
+def flavors_of(group):
+    return ["U", "D"] if group == "UD" else [group]
+
+
+def roc(signal, background):
+    """Signal and background efficiencies for all cuts on the discriminant, from the tightest to the loosest."""
+    scores = np.concatenate([signal, background])
+    is_signal = np.concatenate([np.ones(len(signal)), np.zeros(len(background))])
+    order = np.argsort(-scores, kind="stable")
+    tpr = np.concatenate([[0.], np.cumsum(is_signal[order]) / len(signal)])
+    fpr = np.concatenate([[0.], np.cumsum(1 - is_signal[order]) / len(background)])
+    return tpr, fpr
+
+
+def evaluate(data, signal, background, working_points):
+    """AUC and background efficiencies at the working points of one discrimination, None without jets of a class."""
+    sig_flavors, bkg_flavors = flavors_of(signal), flavors_of(background)
+    if any(f"score_recojet_is{f}" not in data for f in sig_flavors + bkg_flavors):
+        return None
+    valid = np.ones(len(data[f"score_recojet_is{sig_flavors[0]}"]), dtype=bool)
+    if "recojet_provenance" in data:
+        valid &= data["recojet_provenance"] != SKIPPED
+    s = sum(data[f"score_recojet_is{f}"] for f in sig_flavors)
+    b = sum(data[f"score_recojet_is{f}"] for f in bkg_flavors)
+    with np.errstate(divide="ignore", invalid="ignore"):
+        discriminant = s / (s + b)
+    valid &= np.isfinite(discriminant)
+    is_sig = np.logical_or.reduce([data[f"recojet_is{f}"] for f in sig_flavors]) & valid
+    is_bkg = np.logical_or.reduce([data[f"recojet_is{f}"] for f in bkg_flavors]) & valid
+    if not is_sig.any() or not is_bkg.any():
+        return None
+    tpr, fpr = roc(discriminant[is_sig], discriminant[is_bkg])
+    auc = np.sum(np.diff(fpr) * (tpr[1:] + tpr[:-1]) / 2)
+    mistag = [fpr[min(np.searchsorted(tpr, wp), len(fpr) - 1)] for wp in working_points]
+    return auc, mistag
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("cascade", help="JetTags file of the cascade")
+    parser.add_argument("full", help="JetTags file of the full model on all jets")
+    parser.add_argument("--working-points", nargs="+", type=float, default=[0.5, 0.7, 0.9],
+                        help="Signal efficiencies at which the background efficiencies are compared")
+    parser.add_argument("--key", default="JetTags", help="Name of the tree")
+    args = parser.parse_args()
+
+    cascade, full = load(args.cascade, args.key), load(args.full, args.key)
+    n_cascade, n_full = (len(next(iter(d.values()))) for d in (cascade, full))
+    print(f"{n_cascade} jets in the cascade, {n_full} jets in the full-model run")
+    if n_cascade != n_full:
+        print("WARNING: the files do not hold the same jets, the comparison is only statistical")
+
+    if "recojet_provenance" in cascade:
+        provenance = cascade["recojet_provenance"]
+        tagged = provenance != SKIPPED
+        escalated = np.count_nonzero(provenance == 2)
+        print(f"Escalated to the full model: {escalated} of {np.count_nonzero(tagged)} tagged jets "
+              f"({100. * escalated / max(1, np.count_nonzero(tagged)):.1f} %)")
+        for value, name in PROVENANCE.items():
+            print(f"  {name:<12} {np.count_nonzero(provenance == value):>10}")
+    else:
+        print("No recojet_provenance branch in the cascade file, write it with the JetFlavorTagWriter")
+
+    wps = args.working_points
+    header = f"{'discrimination':<14} {'AUC full':>9} {'cascade':>9} {'diff':>9}"
+    for wp in wps:
+        header += f" | {'bkg eff @ ' + format(wp, '.2f') + ' full':>20} {'cascade':>9} {'ratio':>7}"
+    print(header)
+    print("-" * len(header))
+    for signal, background in DISCRIMINATIONS:
+        result_full = evaluate(full, signal, background, wps)
+        result_cascade = evaluate(cascade, signal, background, wps)
+        if result_full is None or result_cascade is None:
+            continue
+        (auc_full, mistag_full), (auc_cascade, mistag_cascade) = result_full, result_cascade
+        line = f"{signal.lower() + ' vs ' + background.lower():<14} {auc_full:>9.4f} {auc_cascade:>9.4f} " \
+               f"{auc_cascade - auc_full:>+9.4f}"
+        for m_full, m_cascade in zip(mistag_full, mistag_cascade):
+            ratio = m_cascade / m_full if m_full > 0 else float("nan")
+            line += f" | {m_full:>20.4g} {m_cascade:>9.4g} {ratio:>7.3f}"
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
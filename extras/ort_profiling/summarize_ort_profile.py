@@ -0,0 +1,150 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""
+Summarizes ONNX Runtime profiles (Chrome-trace JSON) into a table of the time spent per operator type.
+
+The profiles are written by the JetTagger with ORTProfileEvents > 0 (or --ort_profile_events in the steering files).
+The table lists, per operator type (MatMul, Softmax, LayerNormalization, ...), the number of calls, the total and mean
+kernel time and the share of the total kernel time, followed by the same per operator category:
+- "matrix multiplication" (MatMul, Gemm, Conv, ...): the candidates for quantization,
+- "elementwise" and "data movement" (Add, Mul, Transpose, Reshape, Concat, ...): the candidates for graph fusion,
+- "normalization and activation" (LayerNormalization, Softmax, Gelu, ...),
+- "reduction" (ReduceSum, ReduceMean, ...).
+The mean size of the constituent axis of the inputs shows how much padding the model runs on.
+The first model run of every profile is the warm-up of the profiling session done by the JetTagger, so it is skipped
+by default.
+
+Usage: python summarize_ort_profile.py PROFILE.json [PROFILE2.json ...] [--skip-runs N] [--by-node] [--csv out.csv]
+Only needs the python standard library.
+"""
+import argparse
+import csv
+import json
+from collections import defaultdict
+
+CATEGORIES = {
+    "matrix multiplication": ["MatMul", "Gemm", "Conv", "FusedMatMul", "FusedGemm", "FusedConv", "MatMulInteger",
+                              "QLinearMatMul", "QLinearConv", "ConvInteger", "MatMulNBits", "Einsum", "Attention",
+                              "MultiHeadAttention"],
+    "normalization and activation": ["LayerNormalization", "SkipLayerNormalization", "SimplifiedLayerNormalization",
+                                     "BatchNormalization", "InstanceNormalization", "Softmax", "LogSoftmax", "Gelu",
+                                     "FastGelu", "BiasGelu", "Relu", "LeakyRelu", "Sigmoid", "Tanh", "Erf", "Elu"],
+    "reduction": ["ReduceSum", "ReduceMean", "ReduceMax", "ReduceMin", "ReduceProd", "ArgMax", "ArgMin", "TopK"],
+    "elementwise": ["Add", "Sub", "Mul", "Div", "Pow", "Sqrt", "Exp", "Log", "Abs", "Neg", "Max", "Min", "Where",
+                    "Equal", "Less", "Greater", "Not", "And", "Or", "Cast", "Clip", "Reciprocal", "BiasAdd"],
+    "data movement": ["Transpose", "Reshape", "Concat", "Split", "Slice", "Gather", "GatherElements", "GatherND",
+                      "Expand", "Unsqueeze", "Squeeze", "Flatten", "Tile", "Pad", "Shape", "ConstantOfShape",
+                      "Identity", "ScatterND", "ScatterElements", "Range", "NonZero"],
+}
+CATEGORY_OF = {op: category for category, ops in CATEGORIES.items() for op in ops}
+
+
+def load_events(path):
+    with open(path) as f:
+        events = json.load(f)
+    # older ONNX Runtime versions write {"traceEvents": [...]}
+    return events["traceEvents"] if isinstance(events, dict) else events
+
+
+def select_nodes(events, skip_runs):
+    """Kernel events of the model runs after the first skip_runs ones, and the kept model runs."""
+    runs = sorted((e for e in events if e.get("cat") == "Session" and e.get("name") == "model_run"),
+                  key=lambda e: e["ts"])[skip_runs:]
+    windows = [(r["ts"], r["ts"] + r["dur"]) for r in runs]
+    nodes = []
+    for e in events:
+        if e.get("cat") != "Node" or not e.get("name", "").endswith("_kernel_time"):
+            continue
+        if any(start <= e["ts"] <= end for start, end in windows):
+            nodes.append(e)
+    return nodes, runs
+
+
+def constituent_axis(node):
+    """Size of the last axis of the first 3D float input, i.e. the (padded) number of constituents."""
+    for shape in node.get("args", {}).get("input_type_shape", []):
+        for dims in shape.values():
+            if len(dims) == 3:
+                return dims[-1]
+    return None
+
+
+def summarize(nodes, key):
+    table = defaultdict(lambda: {"calls": 0, "total_us": 0})
+    for node in nodes:
+        row = table[key(node)]
+        row["calls"] += 1
+        row["total_us"] += node["dur"]
+    return sorted(table.items(), key=lambda item: -item[1]["total_us"])
+
+
+def print_table(title, rows, total_us):
+    print(f"{title:<36} {'calls':>8} {'total [ms]':>12} {'mean [us]':>10} {'share':>7}")
+    for name, row in rows:
+        print(f"{name:<36} {row['calls']:>8} {row['total_us'] / 1e3:>12.3f} {row['total_us'] / row['calls']:>10.1f} "
+              f"{100. * row['total_us'] / total_us:>6.1f}%")
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("profiles", nargs="+", help="ONNX Runtime profile JSON file(s)")
+    parser.add_argument("--skip-runs", type=int, default=1,
+                        help="Ignore the first N model runs of every profile (default: the warm-up run)")
+    parser.add_argument("--by-node", action="store_true", help="Also list the time per node of the graph")
+    parser.add_argument("--csv", default="", help="Write the per-operator table to this CSV file")
+    args = parser.parse_args()
+
+    nodes, runs = [], []
+    for path in args.profiles:
+        file_nodes, file_runs = select_nodes(load_events(path), args.skip_runs)
+        nodes += file_nodes
+        runs += file_runs
+    if not nodes:
+        raise SystemExit("No operator (Node) events found, is this an ONNX Runtime profile?")
+
+    run_us = sum(r["dur"] for r in runs)
+    kernel_us = sum(n["dur"] for n in nodes)
+    print(f"{len(runs)} model runs: {run_us / 1e3:.3f} ms in total, {run_us / max(len(runs), 1):.1f} us per run")
+    print(f"Kernel time: {kernel_us / 1e3:.3f} ms ({100. * kernel_us / max(run_us, 1):.1f}% of the run time, "
+          "the rest is ONNX Runtime overhead)")
+    lengths = [length for length in map(constituent_axis, nodes) if length]
+    if lengths:
+        print(f"Constituent axis of the inputs: {sum(lengths) / len(lengths):.1f} on average, "
+              f"{min(lengths)}-{max(lengths)}")
+    print()
+
+    per_op = summarize(nodes, lambda n: n["args"].get("op_name", "?"))
+    print_table("operator", per_op, kernel_us)
+    print_table("category", summarize(nodes, lambda n: CATEGORY_OF.get(n["args"].get("op_name"), "other")),
+                kernel_us)
+    if args.by_node:
+        print_table("node", summarize(nodes, lambda n: n["name"][:-len("_kernel_time")]), kernel_us)
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(["op_name", "category", "calls", "total_us", "mean_us", "share"])
+            for name, row in per_op:
+                writer.writerow([name, CATEGORY_OF.get(name, "other"), row["calls"], row["total_us"],
+                                 row["total_us"] / row["calls"], row["total_us"] / kernel_us])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,93 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Checks the compact jet tags of a JetTagger run with a preselection and SkippedJetTags = Placeholder.
+
+Every jet must have exactly one tag, in the order of the jets. The jets failing the preselection (recomputed here
+from the jets, like JetPreselection) must have the placeholder tag: type JetTagProvenance::kSkipped (3) and the score
+-1 for every flavor. All other jets must have been scored by the model (type 0) with scores in [0, 1], so that no
+placeholder score ends up among the real ones. Both kinds of jets must be present.
+
+Usage: python check_preselection_tags.py --inputFile output.root [--minEnergy 0] [--maxAbsCosTheta 1]
+                                         [--minConstituents 0] [--tags RefinedJetTags]
+Needs the podio Python bindings (as set up by the Key4hep stack); exits with 77 (skipped) without them.
+"""
+import argparse
+import math
+
+SKIPPED = 77
+
+SKIPPED_JET_SCORE = -1.0  # kSkippedJetScore
+FULL_MODEL, SKIPPED_JET = 0, 3  # JetTagProvenance
+
+
+def fails_preselection(jet, args):
+    """Same cuts as JetPreselection::apply."""
+    if jet.getEnergy() < args.minEnergy:
+        return True
+    if args.maxAbsCosTheta < 1:
+        p = jet.getMomentum()
+        p_mag = math.sqrt(p.x * p.x + p.y * p.y + p.z * p.z)
+        if p_mag <= 0 or abs(p.z) > args.maxAbsCosTheta * p_mag:
+            return True
+    return jet.getParticles().size() < args.minConstituents
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--inputFile", required=True, help="EDM4hep file written by the JetTagger job")
+    parser.add_argument("--jets", default="RefinedVertexJets", help="Jet collection")
+    parser.add_argument("--tags", default="RefinedJetTags", help="Compact tag collection of the JetTagger")
+    parser.add_argument("--minEnergy", type=float, default=0.0, help="PreselectionMinEnergy of the job")
+    parser.add_argument("--maxAbsCosTheta", type=float, default=1.0, help="PreselectionMaxAbsCosTheta of the job")
+    parser.add_argument("--minConstituents", type=int, default=0, help="PreselectionMinConstituents of the job")
+    args = parser.parse_args()
+
+    try:
+        from podio.root_io import Reader
+    except ImportError as e:
+        print(f"Skipped: {e}")
+        return SKIPPED
+
+    n_tagged, n_skipped = 0, 0
+    for i_event, frame in enumerate(Reader(args.inputFile).get("events")):
+        jets = frame.get(args.jets)
+        tags = frame.get(args.tags)
+        assert len(tags) == len(jets), f"event {i_event}: {len(tags)} tags for {len(jets)} jets"
+        for i, (jet, tag) in enumerate(zip(jets, tags)):
+            where = f"event {i_event}, jet {i}"
+            particle = tag.getParticle().getObjectID()
+            assert particle.collectionID == jets.getID() and particle.index == i, f"{where}: tag of another jet"
+            scores = list(tag.getParameters())
+            assert scores, f"{where}: tag without scores"
+            if fails_preselection(jet, args):
+                assert tag.getType() == SKIPPED_JET, f"{where}: failed the preselection, type {tag.getType()}"
+                assert all(s == SKIPPED_JET_SCORE for s in scores), f"{where}: placeholder scores {scores}"
+                n_skipped += 1
+            else:
+                assert tag.getType() == FULL_MODEL, f"{where}: passed the preselection, type {tag.getType()}"
+                assert all(0 <= s <= 1 for s in scores), f"{where}: scores {scores}"
+                n_tagged += 1
+
+    print(f"{n_tagged} tagged and {n_skipped} skipped jets")
+    assert n_tagged > 0 and n_skipped > 0, "the preselection must keep some jets and skip others"
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
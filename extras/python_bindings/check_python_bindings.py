@@ -0,0 +1,102 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Checks the Python bindings of the tagging core (module k4MLJetTaggerPy) on random jets.
+
+The scores of Tagger.tag must match those of ONNX Runtime in Python run on the inputs preprocessed by
+Tagger.preprocess (the C++ preprocessing of the JetTagger), must not depend on the batch or on the values beyond the
+length of a jet, and must be the same when several Python threads tag at once. Arrays of the wrong type, layout or
+shape must be rejected.
+
+Usage: python check_python_bindings.py --moduleDir DIR --model file.onnx --json file.json [--jets 200]
+Needs numpy and onnxruntime (see extras/env_for_onnx.yml); exits with 77 (skipped) without them.
+"""
+import argparse
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+SKIPPED = 77
+
+
+def expect_error(error, function, *args):
+    try:
+        function(*args)
+    except error:
+        return
+    raise AssertionError(f"{function.__name__} did not raise {error.__name__}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--moduleDir", required=True, help="Directory of the k4MLJetTaggerPy module")
+    parser.add_argument("--model", required=True, help="ONNX model")
+    parser.add_argument("--json", required=True, help="Preprocessing JSON of the model")
+    parser.add_argument("--jets", type=int, default=200, help="Number of random jets")
+    args = parser.parse_args()
+
+    try:
+        import numpy as np
+        import onnxruntime as ort
+    except ImportError as e:
+        print(f"Skipped: {e}")
+        return SKIPPED
+    sys.path.insert(0, args.moduleDir)
+    import k4MLJetTaggerPy
+
+    tagger = k4MLJetTaggerPy.Tagger(args.model, args.json, max_batch_size=16)
+    n_vars, n_flavors, max_constituents = len(tagger.variables), len(tagger.flavor_names), 90
+
+    rng = np.random.default_rng(1)
+    lengths = rng.integers(1, max_constituents + 1, size=args.jets)
+    values = rng.normal(size=(args.jets, n_vars, max_constituents)).astype(np.float32)
+    padded = values.copy()
+    for i, length in enumerate(lengths):
+        padded[i, :, length:] = np.nan  # must be ignored
+
+    scores = tagger.tag(padded, lengths)
+    assert scores.shape == (args.jets, n_flavors) and scores.dtype == np.float32, scores.shape
+    assert np.all(np.isfinite(scores)), "scores that are not finite"
+    assert np.allclose(scores, tagger(values, lengths)), "the values beyond the lengths change the scores"
+
+    # same model in python on the inputs preprocessed in C++
+    inputs = tagger.preprocess(values, lengths)
+    session = ort.InferenceSession(args.model, providers=["CPUExecutionProvider"])
+    expected = session.run(None, {name: inputs[name] for name in (i.name for i in session.get_inputs())})[0]
+    assert np.allclose(scores, expected, rtol=1e-4, atol=1e-6), np.abs(scores - expected).max()
+
+    # the batch must not matter, nor the threads
+    assert np.allclose(tagger.tag(values[5:12], lengths[5:12]), scores[5:12], rtol=1e-4, atol=1e-6)
+    chunks = np.array_split(np.arange(args.jets), 8)
+    with ThreadPoolExecutor(4) as pool:
+        threaded = list(pool.map(lambda c: tagger.tag(values[c[0]:c[-1] + 1], lengths[c[0]:c[-1] + 1]), chunks))
+    assert np.allclose(np.concatenate(threaded), scores, rtol=1e-4, atol=1e-6), "different scores with threads"
+    assert tagger.tag(values[:0], lengths[:0]).shape == (0, n_flavors)
+
+    # the values are never converted or copied
+    expect_error(TypeError, tagger.tag, values.astype(np.float64), lengths)
+    expect_error(TypeError, tagger.tag, values[:, :, ::2], lengths)
+    expect_error(ValueError, tagger.tag, np.ascontiguousarray(values[:, 1:]), lengths)
+    expect_error(ValueError, tagger.tag, values, lengths[1:])
+    expect_error(ValueError, tagger.tag, np.ascontiguousarray(values[:, :, :10]), lengths)
+
+    print(f"Tagged {args.jets} jets with {n_vars} variables into {n_flavors} flavors, same scores as ONNX Runtime")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
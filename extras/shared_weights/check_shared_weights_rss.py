@@ -0,0 +1,183 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""
+Checks that several JetTagger jobs on one node share the weights of the model with SharedModelWeights.
+
+A model with the inputs of the tiny tagger but large weights (two hidden layers, --hidden 4096: 64 MB) is made with
+make_tiny_model.py, converted to ORT format with ONNX Runtime and put into a bundle with k4MLJetTagger_bundle. Then
+--jobs k4run jobs of syntheticJetTagging.py are started at the same time, first with private weights (the ORT-format
+bundle without --shared_model_weights) and then with shared weights (staged in the work directory as with
+/dev/shm). Once all of them are tagging, the proportional set size (PSS: the private memory plus an equal share of the
+shared pages) of every job is read from /proc/<pid>/smaps_rollup and the jobs are stopped. With shared weights, the
+total PSS must be lower by at least half of the weights of all but one job.
+
+Usage: python check_shared_weights_rss.py --workDir DIR [--bundleTool k4MLJetTagger_bundle] [--jobs 4] [--hidden 4096]
+Run from the top directory of the repository, with k4run in the PATH. Needs numpy, onnx and onnxruntime (see
+extras/env_for_onnx.yml); exits with 77 (skipped) without them or without /proc/<pid>/smaps_rollup (Linux >= 4.14).
+"""
+import argparse
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+
+SKIPPED = 77
+
+
+def make_model(work_dir, hidden):
+    """Writes the large model in ONNX and ORT format and its preprocessing JSON, returns the paths."""
+    sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tiny_model"))
+    import json
+
+    import make_tiny_model
+    import onnx
+    import onnxruntime as ort
+
+    onnx_path = os.path.join(work_dir, "shared_weights_tagger.onnx")
+    ort_path = os.path.join(work_dir, "shared_weights_tagger.ort")
+    json_path = os.path.join(work_dir, "preprocess_shared_weights_tagger.json")
+    onnx.save(make_tiny_model.make_model(seed=1, hidden=hidden), onnx_path)
+    with open(json_path, "w") as f:
+        json.dump(make_tiny_model.make_json(75), f, indent=2)
+    # the basic optimizations only, so that the ORT-format model runs on any CPU
+    options = ort.SessionOptions()
+    options.graph_optimization_level = ort.GraphOptimizationLevel.ORT_ENABLE_BASIC
+    options.optimized_model_filepath = ort_path
+    options.add_session_config_entry("session.save_model_format", "ORT")
+    ort.InferenceSession(onnx_path, options, providers=["CPUExecutionProvider"])
+    return ort_path, json_path
+
+
+def pss_kb(pid):
+    with open(f"/proc/{pid}/smaps_rollup") as f:
+        for line in f:
+            if line.startswith("Pss:"):
+                return int(line.split()[1])
+    raise RuntimeError(f"No Pss in /proc/{pid}/smaps_rollup")
+
+
+class Job:
+    """A k4run job whose output is read in the background until the startup report of the JetTagger."""
+
+    def __init__(self, command, log_path):
+        self.log = open(log_path, "w")
+        self.started = threading.Event()
+        self.process = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        self.thread = threading.Thread(target=self._read, daemon=True)
+        self.thread.start()
+
+    def _read(self):
+        for line in self.process.stdout:
+            self.log.write(line)
+            if "Startup of the tagger" in line:
+                self.started.set()
+
+    def stop(self):
+        if self.process.poll() is None:
+            self.process.kill()
+        self.process.wait()
+        self.thread.join()
+        self.log.close()
+
+
+def measure(mode, args, bundle):
+    """Starts the jobs, waits for all of them to tag and returns their PSS in kB (None if a job failed)."""
+    jobs = []
+    for i in range(args.jobs):
+        command = ["k4run", "k4MLJetTagger/options/syntheticJetTagging.py", "--num_ev=10000000", "--warm_up_runs=1",
+                   f"--seed={i + 1}", f"--model_bundle={bundle}",
+                   f"--outputFile={os.path.join(args.workDir, f'output_{mode}_{i}.root')}"]
+        if mode == "shared":
+            command += ["--shared_model_weights", f"--bundle_stage_dir={os.path.join(args.workDir, 'stage')}"]
+        jobs.append(Job(command, os.path.join(args.workDir, f"job_{mode}_{i}.log")))
+    try:
+        deadline = time.monotonic() + args.timeout
+        for job in jobs:
+            while not job.started.wait(1.):
+                if job.process.poll() is not None or time.monotonic() > deadline:
+                    return None
+        time.sleep(args.settle)  # a few events with the arena grown
+        if any(job.process.poll() is not None for job in jobs):
+            return None
+        return [pss_kb(job.process.pid) for job in jobs]
+    finally:
+        for job in jobs:
+            job.stop()
+        for i in range(args.jobs):
+            output = os.path.join(args.workDir, f"output_{mode}_{i}.root")
+            if os.path.exists(output):
+                os.remove(output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--workDir", required=True, help="Directory for the model, the bundle and the job logs")
+    parser.add_argument("--bundleTool", default="k4MLJetTagger_bundle", help="Path to k4MLJetTagger_bundle")
+    parser.add_argument("--jobs", type=int, default=4, help="Number of concurrent jobs")
+    parser.add_argument("--hidden", type=int, default=4096, help="Width of the hidden layers of the model")
+    parser.add_argument("--settle", type=float, default=3., help="Seconds of tagging before the PSS is read")
+    parser.add_argument("--timeout", type=float, default=600., help="Seconds to wait for the startup of the jobs")
+    args = parser.parse_args()
+
+    if not os.path.exists("/proc/self/smaps_rollup"):
+        print("/proc/self/smaps_rollup is not available, skipping")
+        return SKIPPED
+    try:
+        import numpy  # noqa: F401
+        import onnx  # noqa: F401
+        import onnxruntime  # noqa: F401
+    except ImportError as e:
+        print(f"{e}, skipping")
+        return SKIPPED
+
+    os.makedirs(os.path.join(args.workDir, "stage"), exist_ok=True)
+    ort_path, json_path = make_model(args.workDir, args.hidden)
+    bundle = os.path.join(args.workDir, "shared_weights_tagger.k4jtb")
+    subprocess.run([args.bundleTool, "create", "--model", ort_path, "--json", json_path, "--output", bundle],
+                   check=True)
+    weights_kb = os.path.getsize(ort_path) / 1024  # nearly all of it
+
+    pss = {}
+    for mode in ["private", "shared"]:
+        pss[mode] = measure(mode, args, bundle)
+        if pss[mode] is None:
+            log = os.path.join(args.workDir, f"job_{mode}_0.log")
+            with open(log) as f:
+                text = f.read()
+            # an ORT-format model from a newer python ONNX Runtime than the one of the stack
+            if re.search(r"ORT format (model )?version", text):
+                print(f"The ORT-format model cannot be read by the ONNX Runtime of the JetTagger, skipping:\n{text}")
+                return SKIPPED
+            print(f"The {mode} jobs did not start tagging, see {log}:\n{text[-4000:]}")
+            return 1
+
+    print(f"{args.jobs} jobs, {weights_kb / 1024:.1f} MB of weights")
+    for mode in ["private", "shared"]:
+        print(f"  {mode:8s} PSS per job: " + ", ".join(f"{kb / 1024:.1f} MB" for kb in pss[mode]) +
+              f", total {sum(pss[mode]) / 1024:.1f} MB")
+    saved_kb = sum(pss["private"]) - sum(pss["shared"])
+    expected_kb = 0.5 * (args.jobs - 1) * weights_kb
+    print(f"Shared weights save {saved_kb / 1024:.1f} MB (at least {expected_kb / 1024:.1f} MB expected)")
+    return 0 if saved_kb > expected_kb else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
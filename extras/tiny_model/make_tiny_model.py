@@ -0,0 +1,146 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+"""
+Creates the tiny ONNX model and its preprocessing JSON bundled in this directory.
+
+The model has the same inputs (names, variables, shapes) and outputs as the Particle Transformer trained for CLD
+(see extras/config_for_weaver_training.yaml), so it can replace it in the JetTagger for tests and benchmarks without
+external data. It is NOT a physics model: it averages every input variable over the constituents (masked), applies a
+fixed random linear layer and a softmax over the seven flavors. With --hidden H, two hidden layers of width H are
+added before it, e.g. to get a model with realistic weight sizes (H=4096: 64 MB) for memory tests.
+
+Usage: python make_tiny_model.py [--outputDir DIR] [--length 75] [--seed 1] [--hidden 0] [--name tiny_tagger]
+Needs numpy and onnx (see extras/env_for_onnx.yml).
+"""
+import argparse
+import json
+import os
+
+import numpy as np
+import onnx
+from onnx import TensorProto, helper, numpy_helper
+
+# variable names in the FCCAnalyses convention, as in the preprocessing JSON of the CLD model
+PF_POINTS = ["pfcand_thetarel", "pfcand_phirel"]
+PF_FEATURES = [
+    "pfcand_erel_log", "pfcand_thetarel", "pfcand_phirel",
+    "pfcand_dptdpt", "pfcand_detadeta", "pfcand_dphidphi", "pfcand_dxydxy", "pfcand_dzdz", "pfcand_dxydz",
+    "pfcand_dphidxy", "pfcand_dlambdadz", "pfcand_dxyc", "pfcand_dxyctgtheta", "pfcand_phic", "pfcand_phidz",
+    "pfcand_phictgtheta", "pfcand_cdz", "pfcand_cctgtheta",
+    "pfcand_charge", "pfcand_isMu", "pfcand_isEl", "pfcand_isChargedHad", "pfcand_isGamma", "pfcand_isNeutralHad",
+    "pfcand_dxy", "pfcand_dz", "pfcand_btagSip2dVal", "pfcand_btagSip2dSig", "pfcand_btagSip3dVal",
+    "pfcand_btagSip3dSig", "pfcand_btagJetDistVal", "pfcand_btagJetDistSig",
+    "pfcand_type",
+]
+PF_VECTORS = ["pfcand_e", "pfcand_p", "pfcand_e", "pfcand_e"]
+PF_MASK = ["pfcand_mask"]
+OUTPUT_NAMES = ["recojet_isG", "recojet_isU", "recojet_isS", "recojet_isC", "recojet_isB", "recojet_isD",
+                "recojet_isTAU"]
+
+# rough scales of the variables, so that the normalized inputs are O(1)
+SCALES = {"pfcand_erel_log": (-1.5, 1.), "pfcand_dxy": (0., 10.), "pfcand_dz": (0., 10.),
+          "pfcand_btagSip2dVal": (0., 10.), "pfcand_btagSip3dVal": (0., 10.), "pfcand_btagJetDistVal": (0., 10.),
+          "pfcand_btagSip2dSig": (0., 0.1), "pfcand_btagSip3dSig": (0., 0.1), "pfcand_btagJetDistSig": (0., 0.1),
+          "pfcand_type": (0., 0.01)}
+
+
+def group(var_names, length, standardize):
+    var_infos = {}
+    for name in var_names:
+        median, norm_factor = SCALES.get(name, (0., 1.)) if standardize else (0., 1.)
+        var_infos[name] = {"median": median, "norm_factor": norm_factor, "replace_inf_value": 0,
+                           "lower_bound": -5 if standardize else -1e32, "upper_bound": 5 if standardize else 1e32,
+                           "pad": 0}
+    return {"var_names": var_names, "var_infos": var_infos, "var_length": length}
+
+
+def make_json(length):
+    return {
+        "output_names": OUTPUT_NAMES,
+        "input_names": ["pf_points", "pf_features", "pf_vectors", "pf_mask"],
+        "pf_points": group(PF_POINTS, length, True),
+        "pf_features": group(PF_FEATURES, length, True),
+        "pf_vectors": group(PF_VECTORS, length, False),
+        "pf_mask": group(PF_MASK, length, False),
+    }
+
+
+def make_model(seed, hidden=0):
+    n_in = len(PF_POINTS) + len(PF_FEATURES) + len(PF_VECTORS)
+    rng = np.random.default_rng(seed)
+    n_last = hidden if hidden > 0 else n_in
+    weights = (rng.standard_normal((n_last, len(OUTPUT_NAMES))) / np.sqrt(n_last)).astype(np.float32)
+    bias = (0.1 * rng.standard_normal(len(OUTPUT_NAMES))).astype(np.float32)
+
+    def inp(name, n_vars):
+        return helper.make_tensor_value_info(name, TensorProto.FLOAT, ["N", n_vars, "L"])
+
+    inputs = [inp("pf_points", len(PF_POINTS)), inp("pf_features", len(PF_FEATURES)),
+              inp("pf_vectors", len(PF_VECTORS)), inp("pf_mask", len(PF_MASK))]
+    output = helper.make_tensor_value_info("softmax", TensorProto.FLOAT, ["N", len(OUTPUT_NAMES)])
+    initializers = [numpy_helper.from_array(weights, "W"), numpy_helper.from_array(bias, "b"),
+                    numpy_helper.from_array(np.array([2], dtype=np.int64), "axis_L"),
+                    numpy_helper.from_array(np.array([1.], dtype=np.float32), "one")]
+    nodes = [
+        # masked mean of every variable over the constituents: [N, C, L] -> [N, C]
+        helper.make_node("Concat", ["pf_points", "pf_features", "pf_vectors"], ["x"], axis=1),
+        helper.make_node("Mul", ["x", "pf_mask"], ["x_masked"]),
+        helper.make_node("ReduceSum", ["x_masked", "axis_L"], ["x_sum"], keepdims=0),
+        helper.make_node("ReduceSum", ["pf_mask", "axis_L"], ["n"], keepdims=0),
+        helper.make_node("Max", ["n", "one"], ["n_safe"]),
+        helper.make_node("Div", ["x_sum", "n_safe"], ["x_mean"]),
+    ]
+    if hidden > 0:
+        # hidden layers without bias, only there for their weights: [N, C] -> [N, H] -> [N, H]
+        for i, n_from in enumerate([n_in, hidden]):
+            w = (rng.standard_normal((n_from, hidden)) / np.sqrt(n_from)).astype(np.float32)
+            initializers.append(numpy_helper.from_array(w, f"W_hidden{i}"))
+            x = "x_mean" if i == 0 else f"h{i - 1}"
+            nodes += [helper.make_node("MatMul", [x, f"W_hidden{i}"], [f"z{i}"]),
+                      helper.make_node("Relu", [f"z{i}"], [f"h{i}"])]
+    nodes += [
+        # linear layer and softmax over the flavors
+        helper.make_node("Gemm", ["h1" if hidden > 0 else "x_mean", "W", "b"], ["logits"]),
+        helper.make_node("Softmax", ["logits"], ["softmax"], axis=1),
+    ]
+    graph = helper.make_graph(nodes, "tiny_jet_tagger", inputs, [output], initializers)
+    model = helper.make_model(graph, opset_imports=[helper.make_opsetid("", 13)],
+                              producer_name="k4MLJetTagger make_tiny_model.py")
+    model.ir_version = 8  # readable by older ONNX Runtime versions
+    onnx.checker.check_model(model)
+    return model
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--outputDir", default=os.path.dirname(os.path.abspath(__file__)), help="Output directory")
+    parser.add_argument("--length", type=int, default=75, help="Maximum number of constituents per jet")
+    parser.add_argument("--seed", type=int, default=1, help="Seed of the random weights")
+    parser.add_argument("--hidden", type=int, default=0, help="Width of the two hidden layers (0: none)")
+    parser.add_argument("--name", default="tiny_tagger", help="Name of the model, <name>.onnx and preprocess_<name>.json")
+    args = parser.parse_args()
+
+    onnx.save(make_model(args.seed, args.hidden), os.path.join(args.outputDir, args.name + ".onnx"))
+    with open(os.path.join(args.outputDir, "preprocess_" + args.name + ".json"), "w") as f:
+        json.dump(make_json(args.length), f, indent=2)
+        f.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,384 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Micro-benchmarks of the tagging hot path (the steps the JetTagger runs for every jet).
+ *
+ * The inputs are synthetic jets from the SyntheticEventGenerator with a fixed number of constituents, the model is the
+ * tiny bundled model (extras/tiny_model) unless another one is given. Every case runs for a grid of constituent
+ * multiplicities and batch sizes. For the per-jet steps, the batch size is the number of jets handled per timed
+ * iteration (like the jets of one event); for ONNXRuntime::run, it is the batch dimension of the input tensors. The
+ * inputs of every step are prepared outside of the timing, so each case only measures its own step. Each case reports
+ * the wall time and the number of heap allocations (operator new) per jet.
+ *
+ * Cases:
+ *   retrieve_input_observables  JetObservablesRetriever::retrieve_input_observables
+ *   calculate_helix_params      JetObservablesRetriever::calculate_helix_params for all charged constituents
+ *   from_Jet_to_onnx_input      from_Jet_to_onnx_input
+ *   center_norm_pad             WeaverPreprocessor::center_norm_pad for all input variables
+ *   weaver_run                  WeaverInterface::run (preprocessing and inference of one jet)
+ *   onnx_run                    ONNXRuntime::run on a batch of preprocessed jets
+ *   rdf_tag                     RDFJetTagger::operator() on the columns of all jets (not run by default)
+ *
+ * Usage: k4MLJetTagger_bench [--cases a,b,...] [--multiplicities 10,30,75,150] [--batch-sizes 1,16,128]
+ *                            [--min-time seconds] [--model file.onnx] [--json file.json] [--csv file]
+ */
+
+#include "Helpers.h"
+#include "JetObservablesRetriever.h"
+#include "ONNXRuntime.h"
+#include "RDFJetTagger.h"
+#include "Structs.h"
+#include "SyntheticEventGenerator.h"
+#include "WeaverInterface.h"
+#include "WeaverPreprocessor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifndef K4MLJETTAGGER_TINY_MODEL_DIR
+#define K4MLJETTAGGER_TINY_MODEL_DIR "extras/tiny_model"
+#endif
+
+// count all heap allocations through operator new
+namespace {
+std::atomic<std::uint64_t> g_nAllocs{0};
+
+void* countedAlloc(std::size_t size) {
+  g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+
+void* countedAlignedAlloc(std::size_t size, std::align_val_t al) {
+  g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+  const auto alignment = std::max(static_cast<std::size_t>(al), sizeof(void*));
+  return std::aligned_alloc(alignment, (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment);
+}
+} // namespace
+
+void* operator new(std::size_t size) {
+  if (void* p = countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new(std::size_t size, std::align_val_t al) {
+  if (void* p = countedAlignedAlloc(size, al))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t al) { return operator new(size, al); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+namespace {
+
+volatile float g_sink = 0; ///< keeps the compiler from dropping the benchmarked calls
+
+struct Options {
+  std::vector<std::string> cases{"retrieve_input_observables", "calculate_helix_params", "from_Jet_to_onnx_input",
+                                 "center_norm_pad", "weaver_run", "onnx_run"};
+  std::vector<int> multiplicities{10, 30, 75, 150};
+  std::vector<int> batch_sizes{1, 16, 128};
+  double min_time{0.5};
+  std::string model{K4MLJETTAGGER_TINY_MODEL_DIR "/tiny_tagger.onnx"};
+  std::string json{K4MLJETTAGGER_TINY_MODEL_DIR "/preprocess_tiny_tagger.json"};
+  std::string csv;
+};
+
+struct Result {
+  double ns_per_jet{0};
+  double allocs_per_jet{0};
+  std::uint64_t iterations{0};
+};
+
+/// Objects shared by all workloads: the retriever and the model, as the JetTagger holds them.
+struct Context {
+  Context(const std::string& model, const std::string& json) {
+    auto json_config = loadJsonFile(json);
+    for (const auto& var : json_config["pf_features"]["var_names"])
+      vars.push_back(var.get<std::string>());
+    for (const auto& var : json_config["pf_vectors"]["var_names"])
+      vars.push_back(var.get<std::string>());
+    weaver = std::make_unique<WeaverInterface>(model, WeaverPreprocessor(json_config, vars));
+    onnx = std::make_unique<ONNXRuntime>(model, weaver->preprocessor().inputNames());
+    rdf = std::make_unique<RDFJetTagger>(model, json, std::vector<std::string>(vars.begin(), vars.end()), 1, 128);
+    retriever.Bz = 2.0;
+  }
+
+  rv::RVec<std::string> vars;
+  JetObservablesRetriever retriever;
+  std::unique_ptr<WeaverInterface> weaver;
+  std::unique_ptr<ONNXRuntime> onnx;
+  std::unique_ptr<RDFJetTagger> rdf;
+};
+
+/// One call of WeaverPreprocessor::center_norm_pad as done by WeaverPreprocessor::preprocess.
+struct PadCall {
+  const rv::RVec<float>* input;
+  WeaverPreprocessor::PreprocessParams::VarInfo info;
+  size_t min_length, max_length;
+};
+
+/// Inputs of every step for one multiplicity and batch size.
+struct Workload {
+  Workload(Context& ctx, int multiplicity, int batch_size) : batch_size(batch_size) {
+    SyntheticEventConfig config;
+    config.n_jets = batch_size;
+    config.multiplicity_distribution = MultiplicityDistribution::kFixed;
+    config.mean_multiplicity = multiplicity;
+    config.min_multiplicity = 1;
+    config.max_multiplicity = multiplicity;
+    event = SyntheticEventGenerator(config).generate(0);
+    pv = ctx.retriever.get_primary_vertex(event.vertices);
+
+    const auto& preprocessor = ctx.weaver->preprocessor();
+    for (const auto& jet : event.jets) {
+      jets.push_back(ctx.retriever.retrieve_input_observables(jet, event.vertices));
+      inputs.push_back(from_Jet_to_onnx_input(jets.back(), ctx.vars));
+    }
+    // the same inputs as RDataFrame columns, [variable][jet][constituent]
+    rdf_columns.resize(ctx.vars.size());
+    for (const auto& input : inputs) {
+      for (size_t v = 0; v < input.size(); ++v)
+        rdf_columns[v].push_back(input[v]);
+    }
+    masks.reserve(inputs.size()); // pointers into it are kept in pad_calls
+    for (const auto& input : inputs) {
+      masks.emplace_back(input.at(0).size(), 1.f);
+      for (const auto& group : preprocessor.inputNames()) {
+        const auto& params = preprocessor.params(group);
+        for (const auto& var : params.var_names) {
+          const bool is_mask = var.find("_mask") != std::string::npos;
+          const size_t pos = std::find(ctx.vars.begin(), ctx.vars.end(), var) - ctx.vars.begin();
+          pad_calls.push_back(
+              {is_mask ? &masks.back() : &input.at(pos), params.info(var), params.min_length, params.max_length});
+        }
+      }
+    }
+
+    // batch of preprocessed jets, padded to the maximum length: [batch, n_vars, max_length] per input group
+    const auto& groups = preprocessor.inputNames();
+    batch_tensor.resize(groups.size());
+    WeaverPreprocessor::Tensor jet_tensor;
+    for (const auto& input : inputs) {
+      preprocessor.preprocess(input, jet_tensor, true);
+      for (size_t g = 0; g < groups.size(); ++g)
+        batch_tensor[g].insert(batch_tensor[g].end(), jet_tensor[g].begin(), jet_tensor[g].end());
+    }
+    for (const auto& group : groups) {
+      const auto& params = preprocessor.params(group);
+      batch_shapes.push_back(
+          {batch_size, static_cast<long>(params.var_names.size()), static_cast<long>(params.max_length)});
+    }
+  }
+
+  int batch_size;
+  SyntheticEvent event;
+  edm4hep::Vector3f pv;
+  std::vector<Jet> jets;
+  std::vector<rv::RVec<rv::RVec<float>>> inputs;
+  rv::RVec<RDFJetTagger::Column> rdf_columns;
+  std::vector<rv::RVec<float>> masks;
+  std::vector<PadCall> pad_calls;
+  ONNXRuntime::Tensor<float> batch_tensor;
+  ONNXRuntime::Tensor<long> batch_shapes;
+};
+
+/// Runs one timed iteration (a batch of jets) of a case.
+std::function<void()> makeIteration(const std::string& name, Context& ctx, Workload& w) {
+  if (name == "retrieve_input_observables")
+    return [&] {
+      for (const auto& jet : w.event.jets)
+        g_sink = g_sink + ctx.retriever.retrieve_input_observables(jet, w.event.vertices).constituents.size();
+    };
+  if (name == "calculate_helix_params")
+    return [&] {
+      for (const auto& jet : w.event.jets) {
+        for (const auto& particle : jet.getParticles()) {
+          if (particle.getTracks().size() == 1)
+            g_sink = g_sink + ctx.retriever.calculate_helix_params(particle, w.pv).d0;
+        }
+      }
+    };
+  if (name == "from_Jet_to_onnx_input")
+    return [&] {
+      for (auto& jet : w.jets)
+        g_sink = g_sink + from_Jet_to_onnx_input(jet, ctx.vars).size();
+    };
+  if (name == "center_norm_pad")
+    return [&] {
+      for (const auto& call : w.pad_calls) {
+        const auto& info = call.info;
+        g_sink = g_sink + WeaverPreprocessor::center_norm_pad(*call.input, info.center, info.norm_factor,
+                                                              call.min_length, call.max_length, info.pad,
+                                                              info.replace_inf_value, info.lower_bound,
+                                                              info.upper_bound)[0];
+      }
+    };
+  if (name == "weaver_run")
+    return [&] {
+      for (const auto& input : w.inputs)
+        g_sink = g_sink + ctx.weaver->run(input)[0];
+    };
+  if (name == "onnx_run")
+    return [&] { g_sink = g_sink + ctx.onnx->run<float>(w.batch_tensor, w.batch_shapes, w.batch_size)[0][0]; };
+  if (name == "rdf_tag")
+    return [&] { g_sink = g_sink + (*ctx.rdf)(0, w.rdf_columns)[0][0]; };
+  throw std::invalid_argument("Unknown benchmark case '" + name + "'");
+}
+
+Result measure(const std::function<void()>& iteration, int jets_per_iteration, double min_time) {
+  iteration(); // warm-up: first touch of reused buffers, lazy initialization
+  Result result;
+  const auto allocs_before = g_nAllocs.load();
+  const auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  do {
+    iteration();
+    ++result.iterations;
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (elapsed < min_time);
+  const double n_jets = static_cast<double>(result.iterations) * jets_per_iteration;
+  result.ns_per_jet = elapsed * 1e9 / n_jets;
+  result.allocs_per_jet = (g_nAllocs.load() - allocs_before) / n_jets;
+  return result;
+}
+
+template <typename T>
+std::vector<T> parseList(const std::string& arg) {
+  std::vector<T> values;
+  std::stringstream stream(arg);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if constexpr (std::is_same_v<T, int>)
+      values.push_back(std::stoi(item));
+    else
+      values.push_back(item);
+  }
+  return values;
+}
+
+Options parseOptions(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      std::cout << "Usage: " << argv[0]
+                << " [--cases a,b,...] [--multiplicities 10,30,75,150] [--batch-sizes 1,16,128] [--min-time seconds]"
+                   " [--model file.onnx] [--json file.json] [--csv file]"
+                << std::endl;
+      std::exit(0);
+    }
+    if (i + 1 >= argc)
+      throw std::invalid_argument("Missing value for " + arg);
+    const std::string value = argv[++i];
+    if (arg == "--cases")
+      options.cases = parseList<std::string>(value);
+    else if (arg == "--multiplicities")
+      options.multiplicities = parseList<int>(value);
+    else if (arg == "--batch-sizes")
+      options.batch_sizes = parseList<int>(value);
+    else if (arg == "--min-time")
+      options.min_time = std::stod(value);
+    else if (arg == "--model")
+      options.model = value;
+    else if (arg == "--json")
+      options.json = value;
+    else if (arg == "--csv")
+      options.csv = value;
+    else
+      throw std::invalid_argument("Unknown option " + arg);
+  }
+  for (const int n : options.multiplicities) {
+    if (n < 1)
+      throw std::invalid_argument("Multiplicities must be at least 1");
+  }
+  for (const int n : options.batch_sizes) {
+    if (n < 1)
+      throw std::invalid_argument("Batch sizes must be at least 1");
+  }
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  Context ctx(options.model, options.json);
+  std::ofstream csv;
+  if (!options.csv.empty()) {
+    csv.open(options.csv);
+    csv << "case,multiplicity,batch_size,ns_per_jet,allocs_per_jet,iterations\n";
+  }
+
+  std::cout << "Model " << options.model << std::endl;
+  std::printf("%-28s %12s %10s %14s %14s %12s\n", "case", "multiplicity", "batch", "ns/jet", "allocs/jet",
+              "iterations");
+  for (const int multiplicity : options.multiplicities) {
+    for (const int batch_size : options.batch_sizes) {
+      Workload workload(ctx, multiplicity, batch_size);
+      for (const auto& name : options.cases) {
+        std::function<void()> iteration;
+        try {
+          iteration = makeIteration(name, ctx, workload);
+        } catch (const std::invalid_argument& e) {
+          std::cerr << e.what() << std::endl;
+          return 1;
+        }
+        const auto r = measure(iteration, batch_size, options.min_time);
+        std::printf("%-28s %12d %10d %14.1f %14.2f %12llu\n", name.c_str(), multiplicity, batch_size, r.ns_per_jet,
+                    r.allocs_per_jet, static_cast<unsigned long long>(r.iterations));
+        if (csv.is_open())
+          csv << name << "," << multiplicity << "," << batch_size << "," << r.ns_per_jet << "," << r.allocs_per_jet
+              << "," << r.iterations << "\n";
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Benchmark of the output tree I/O settings of the writers (see TreeIOSettings.h).
+ *
+ * Writes a fixed synthetic workload with the same branch layout as the JetObsWriter output (37 vector branches per
+ * jet with a realistic number of constituents) for a grid of compression algorithms/levels, basket sizes and
+ * auto-flush settings, and reports for each of them the write throughput (uncompressed MB/s), the file size, the
+ * compression factor and the time to read all branches back.
+ *
+ * Usage: k4MLJetTagger_writer_io_benchmark [n_jets] [output_dir] [csv_file]
+ */
+
+#include "TreeIOSettings.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kNFloatBranches = 30;
+constexpr int kNIntBranches = 7;
+
+struct Result {
+  TreeIOSettings settings;
+  double write_s{0};
+  double read_s{0};
+  double raw_mb{0};
+  double file_mb{0};
+};
+
+/// Fills one jet with constituent values of similar entropy as the real observables.
+class JetGenerator {
+public:
+  explicit JetGenerator(unsigned int seed) : m_rng(seed) {}
+
+  void next(std::vector<std::vector<float>>& floats, std::vector<std::vector<int>>& ints) {
+    const int n = std::max(1, m_nConstituents(m_rng));
+    for (size_t b = 0; b < floats.size(); ++b) {
+      floats[b].clear();
+      for (int i = 0; i < n; ++i) {
+        // first few branches are kinematics, the others resemble track parameters and covariances
+        const float value = b < 5 ? std::abs(m_gauss(m_rng)) * 10.f : m_gauss(m_rng) * 1e-3f;
+        // neutral particles have no track, hence many exact zeros / -9 in the track related branches
+        floats[b].push_back(b >= 12 && i % 3 == 0 ? -9.f : value);
+      }
+    }
+    for (size_t b = 0; b < ints.size(); ++b) {
+      ints[b].clear();
+      for (int i = 0; i < n; ++i)
+        ints[b].push_back(b < 2 ? m_type(m_rng) : (m_type(m_rng) == 0 ? 1 : 0));
+    }
+  }
+
+private:
+  std::mt19937 m_rng;
+  std::poisson_distribution<int> m_nConstituents{30};
+  std::normal_distribution<float> m_gauss{0.f, 1.f};
+  std::uniform_int_distribution<int> m_type{0, 4};
+};
+
+Result runOne(const TreeIOSettings& settings, long n_jets, const std::string& path) {
+  Result result{settings};
+  std::vector<std::vector<float>> floats(kNFloatBranches);
+  std::vector<std::vector<int>> ints(kNIntBranches);
+
+  {
+    TFile file(path.c_str(), "RECREATE");
+    auto* tree = new TTree("JetConstituentObservables", "Jet-Constituent Observables"); // owned by the file
+    for (int b = 0; b < kNFloatBranches; ++b)
+      tree->Branch(("float_" + std::to_string(b)).c_str(), &floats[b]);
+    for (int b = 0; b < kNIntBranches; ++b)
+      tree->Branch(("int_" + std::to_string(b)).c_str(), &ints[b]);
+    applyTreeIOSettings(tree, settings);
+
+    JetGenerator generator(42); // identical workload for every setting
+    const auto start = std::chrono::steady_clock::now();
+    for (long j = 0; j < n_jets; ++j) {
+      generator.next(floats, ints);
+      tree->Fill();
+    }
+    tree->Write();
+    result.raw_mb = tree->GetTotBytes() / 1e6;
+    file.Close();
+    result.write_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  {
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<TFile> file(TFile::Open(path.c_str(), "READ"));
+    result.file_mb = file->GetSize() / 1e6;
+    auto* tree = file->Get<TTree>("JetConstituentObservables");
+    const auto n_entries = tree->GetEntries();
+    for (Long64_t i = 0; i < n_entries; ++i)
+      tree->GetEntry(i);
+    result.read_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  std::remove(path.c_str());
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const long n_jets = argc > 1 ? std::stol(argv[1]) : 20000;
+  const std::string output_dir = argc > 2 ? argv[2] : ".";
+  const std::string csv_path = argc > 3 ? argv[3] : "";
+
+  std::vector<TreeIOSettings> grid;
+  for (const auto& [algorithm, levels] : std::vector<std::pair<std::string, std::vector<int>>>{
+           {"ZLIB", {1, 6}}, {"LZ4", {1, 4}}, {"ZSTD", {1, 5, 9}}, {"LZMA", {1, 7}}}) {
+    for (const int level : levels)
+      grid.push_back({algorithm, level, 0, 0});
+  }
+  grid.push_back({"ZLIB", 0, 0, 0}); // uncompressed reference
+  for (const int basket_size : {8000, 256000, 1024000})
+    grid.push_back({"ZSTD", 5, basket_size, 0});
+  for (const long long auto_flush : {1000LL, -5000000LL, -100000000LL})
+    grid.push_back({"ZSTD", 5, 0, auto_flush});
+
+  std::cout << "Writing " << n_jets << " synthetic jets per setting" << std::endl;
+  std::printf("%-60s %10s %10s %10s %8s %10s\n", "settings", "write MB/s", "write [s]", "size [MB]", "factor",
+              "read [s]");
+  std::ofstream csv;
+  if (!csv_path.empty()) {
+    csv.open(csv_path);
+    csv << "algorithm,level,basket_size,auto_flush,write_s,raw_mb,file_mb,read_s\n";
+  }
+
+  for (const auto& settings : grid) {
+    const auto r = runOne(settings, n_jets, output_dir + "/k4MLJetTagger_writer_io_benchmark.root");
+    std::printf("%-60s %10.1f %10.2f %10.2f %8.2f %10.2f\n", settings.toString().c_str(), r.raw_mb / r.write_s,
+                r.write_s, r.file_mb, r.raw_mb / r.file_mb, r.read_s);
+    if (csv.is_open())
+      csv << settings.compressionAlgorithm << "," << settings.compressionLevel << "," << settings.basketSize << ","
+          << settings.autoFlush << "," << r.write_s << "," << r.raw_mb << "," << r.file_mb << "," << r.read_s << "\n";
+  }
+  return 0;
+}
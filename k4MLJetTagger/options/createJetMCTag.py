@@ -30,6 +30,7 @@ parser_group.add_argument("--inputFiles", nargs="+", metavar=("file1", "file2"),
                         default=["/eos/experiment/fcc/prod/fcc/ee/test_spring2024/240gev/Hbb/CLD_o2_v05/rec/00016783/000/Hbb_rec_16783_99.root"])
 parser_group.add_argument("--outputFile", help="Output file name", default="output_jetMCtags.root")
 parser_group.add_argument("--num_ev", type=int, help="Number of events to process (-1 means all)", default=-1)
+parser_group.add_argument("--mc_labelling", choices=["HiggsDaughters", "DeltaR", "Links"], default="HiggsDaughters", help="MC jet labelling: HiggsDaughters (H(jj)Z(vv) events only), DeltaR or Links (any events)")
 
 args = parser.parse_known_args()[0]
 
@@ -40,6 +41,8 @@ svc.Output = args.outputFile
 transformer = JetMCTagger("JetMCTagger",
                         InputJets=["RefinedVertexJets"],
                         MCParticles=["MCParticles"],
+                        Labelling=args.mc_labelling,
+                        RecoMCLinks=["RecoMCTruthLink"] if args.mc_labelling == "Links" else [],
                         )
 
 ApplicationMgr(TopAlg=[transformer],
@@ -16,6 +16,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 #
+import os
 from Gaudi.Configuration import INFO
 from Configurables import JetTagger
 from Configurables import k4DataSvc
@@ -31,7 +32,26 @@ parser_group.add_argument("--inputFiles", nargs="+", metavar=("file1", "file2"),
 parser_group.add_argument("--outputFile", help="Output file name", default="output_jettags.root")
 parser_group.add_argument("--onnx_model", help="Path to ONNX model used for tagging", default="/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/fullsimCLD240_2mio.onnx")
 parser_group.add_argument("--json_onnx_config", help="Path to JSON config file for ONNX model used for tagging", default="/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/preprocess_fullsimCLD240_2mio.json")
+parser_group.add_argument("--model_bundle", help="Path to a model bundle made with k4MLJetTagger_bundle, replaces --onnx_model and --json_onnx_config", default="")
+parser_group.add_argument("--shared_model_weights", action="store_true", help="Use the weights of the ORT-format model in the bundle in place, shared by the jobs of a node")
+parser_group.add_argument("--bundle_stage_dir", help="Copy the model bundle to this directory of the node (e.g. /dev/shm) before mapping it", default="")
+parser_group.add_argument("--tagging_server", help="Unix socket of a k4MLJetTagger_server to send the jets to (needs --model_bundle)", default="")
 parser_group.add_argument("--num_ev", type=int, help="Number of events to process (-1 means all)", default=-1)
+parser_group.add_argument("--compact_tags", action="store_true", help="Store all flavor scores of a jet in one ParticleID (collection RefinedJetTags)")
+parser_group.add_argument("--ort_profile_events", type=int, help="Number of events to profile with ONNX Runtime, the profile is written next to the output file", default=0)
+parser_group.add_argument("--memory_report_interval", type=int, help="Store the memory usage of every N-th event in the metadata of the output file (0: off)", default=0)
+parser_group.add_argument("--max_batch_size", type=int, help="Maximum number of jets per ONNX Runtime run", default=1)
+parser_group.add_argument("--memory_budget_mb", type=float, help="Maximum size of the ONNX Runtime arena in MB, also limits the batch size (0: no limit)", default=0.)
+parser_group.add_argument("--warm_up_runs", type=int, help="Number of times a synthetic event is tagged in initialize() to warm up ONNX Runtime (0: no warm-up)", default=2)
+parser_group.add_argument("--preselection_min_energy", type=float, help="Tag only the jets with at least this energy in GeV, the others skip the inference (0: no cut)", default=0.)
+parser_group.add_argument("--preselection_max_abs_cos_theta", type=float, help="Tag only the jets with at most this |cos theta| (1: no cut)", default=1.)
+parser_group.add_argument("--preselection_min_constituents", type=int, help="Tag only the jets with at least this number of constituents (0: no cut)", default=0)
+parser_group.add_argument("--skipped_jet_tags", choices=["Placeholder", "None"], help="Tags of the jets failing the preselection: a tag with the score -1 for every flavor, or none", default="Placeholder")
+parser_group.add_argument("--first_stage_model", help="ONNX model of a fast first stage that tags every jet, only the ambiguous jets go to the full model (empty: no cascade)", default="")
+parser_group.add_argument("--first_stage_json", help="JSON config file of the first-stage model", default="")
+parser_group.add_argument("--cascade_flavor", help="First-stage score deciding the escalation to the full model, e.g. recojet_isB (empty: the highest score)", default="")
+parser_group.add_argument("--cascade_range", nargs=2, type=float, metavar=("low", "high"), help="Jets with a first-stage score in [low, high] go to the full model", default=[0.1, 0.9])
+parser_group.add_argument("--cascade_first_stage_weight", type=float, help="Weight of the first-stage score in the score of an escalated jet", default=0.)
 
 args = parser.parse_known_args()[0]
 
@@ -50,10 +70,30 @@ flavor_collection_names = ["RefinedJetTag_G", "RefinedJetTag_U", "RefinedJetTag_
 transformer = JetTagger("JetTagger",
                         model_path=args.onnx_model,
                         json_path=args.json_onnx_config,
+                        bundle_path=args.model_bundle,
+                        SharedModelWeights=args.shared_model_weights,
+                        BundleStageDir=args.bundle_stage_dir,
+                        ServerSocket=args.tagging_server,
                         flavor_collection_names = flavor_collection_names, # to make sure the order and nameing is correct
                         InputJets=["RefinedVertexJets"],
                         InputPrimaryVertices=["PrimaryVertices"],
-                        OutputIDCollections=flavor_collection_names,
+                        OutputIDCollections=["RefinedJetTags"] if args.compact_tags else flavor_collection_names,
+                        CompactOutput=args.compact_tags,
+                        ORTProfileEvents=args.ort_profile_events,
+                        ORTProfilePrefix=os.path.splitext(args.outputFile)[0] + "_ort_profile",
+                        MemoryReportInterval=args.memory_report_interval,
+                        MaxBatchSize=args.max_batch_size,
+                        MemoryBudgetMB=args.memory_budget_mb,
+                        WarmUpRuns=args.warm_up_runs,
+                        PreselectionMinEnergy=args.preselection_min_energy,
+                        PreselectionMaxAbsCosTheta=args.preselection_max_abs_cos_theta,
+                        PreselectionMinConstituents=args.preselection_min_constituents,
+                        SkippedJetTags=args.skipped_jet_tags,
+                        FirstStageModelPath=args.first_stage_model,
+                        FirstStageJsonPath=args.first_stage_json,
+                        CascadeFlavor=args.cascade_flavor,
+                        CascadeAmbiguousRange=args.cascade_range,
+                        CascadeFirstStageWeight=args.cascade_first_stage_weight,
                         )
 
 ApplicationMgr(TopAlg=[transformer],
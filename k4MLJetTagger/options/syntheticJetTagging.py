@@ -0,0 +1,134 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+import os
+from Gaudi.Configuration import INFO, WARNING
+from Configurables import EventHeaderCreator
+from Configurables import SyntheticJetProducer
+from Configurables import JetTagger
+from Configurables import JetObsWriter
+from Configurables import k4DataSvc
+from Configurables import EventDataSvc
+from Configurables import THistSvc
+from k4FWCore import ApplicationMgr, IOSvc
+from k4FWCore.parseArgs import parser
+
+# parse the custom arguments
+parser_group = parser.add_argument_group("syntheticJetTagging.py custom options")
+parser_group.add_argument("--outputFile", help="Output file name for the synthetic events and their tags", default="output_synthetic_jettags.root")
+parser_group.add_argument("--jetObsOutputFile", help="If given, also run the JetObsWriter and write the jet constituent observables to this file", default="")
+parser_group.add_argument("--onnx_model", help="Path to ONNX model used for tagging", default="extras/tiny_model/tiny_tagger.onnx")
+parser_group.add_argument("--json_onnx_config", help="Path to JSON config file for ONNX model used for tagging", default="extras/tiny_model/preprocess_tiny_tagger.json")
+parser_group.add_argument("--model_bundle", help="Path to a model bundle made with k4MLJetTagger_bundle, replaces --onnx_model and --json_onnx_config", default="")
+parser_group.add_argument("--shared_model_weights", action="store_true", help="Use the weights of the ORT-format model in the bundle in place, shared by the jobs of a node")
+parser_group.add_argument("--bundle_stage_dir", help="Copy the model bundle to this directory of the node (e.g. /dev/shm) before mapping it", default="")
+parser_group.add_argument("--tagging_server", help="Unix socket of a k4MLJetTagger_server to send the jets to (needs --model_bundle)", default="")
+parser_group.add_argument("--num_ev", type=int, help="Number of events to generate", default=100)
+parser_group.add_argument("--seed", type=int, help="Seed of the synthetic events", default=42)
+parser_group.add_argument("--jets_per_event", type=int, help="Number of jets per event", default=2)
+parser_group.add_argument("--multiplicity", choices=["Fixed", "Poisson", "Uniform"], help="Distribution of the number of constituents per jet", default="Poisson")
+parser_group.add_argument("--mean_multiplicity", type=float, help="Mean number of constituents per jet", default=35.)
+parser_group.add_argument("--max_multiplicity", type=int, help="Maximum number of constituents per jet", default=150)
+parser_group.add_argument("--charged_fraction", type=float, help="Fraction of charged constituents", default=0.6)
+parser_group.add_argument("--compact_tags", action="store_true", help="Store all flavor scores of a jet in one ParticleID (collection RefinedJetTags)")
+parser_group.add_argument("--ort_profile_events", type=int, help="Number of events to profile with ONNX Runtime, the profile is written next to the output file", default=0)
+parser_group.add_argument("--memory_report_interval", type=int, help="Store the memory usage of every N-th event in the metadata of the output file (0: off)", default=0)
+parser_group.add_argument("--max_batch_size", type=int, help="Maximum number of jets per ONNX Runtime run", default=1)
+parser_group.add_argument("--memory_budget_mb", type=float, help="Maximum size of the ONNX Runtime arena in MB, also limits the batch size (0: no limit)", default=0.)
+parser_group.add_argument("--warm_up_runs", type=int, help="Number of times a synthetic event is tagged in initialize() to warm up ONNX Runtime (0: no warm-up)", default=2)
+parser_group.add_argument("--preselection_min_energy", type=float, help="Tag only the jets with at least this energy in GeV, the others skip the inference (0: no cut)", default=0.)
+parser_group.add_argument("--preselection_max_abs_cos_theta", type=float, help="Tag only the jets with at most this |cos theta| (1: no cut)", default=1.)
+parser_group.add_argument("--preselection_min_constituents", type=int, help="Tag only the jets with at least this number of constituents (0: no cut)", default=0)
+parser_group.add_argument("--skipped_jet_tags", choices=["Placeholder", "None"], help="Tags of the jets failing the preselection: a tag with the score -1 for every flavor, or none", default="Placeholder")
+parser_group.add_argument("--first_stage_model", help="ONNX model of a fast first stage that tags every jet, only the ambiguous jets go to the full model (empty: no cascade)", default="")
+parser_group.add_argument("--first_stage_json", help="JSON config file of the first-stage model", default="")
+parser_group.add_argument("--cascade_flavor", help="First-stage score deciding the escalation to the full model, e.g. recojet_isB (empty: the highest score)", default="")
+parser_group.add_argument("--cascade_range", nargs=2, type=float, metavar=("low", "high"), help="Jets with a first-stage score in [low, high] go to the full model", default=[0.1, 0.9])
+parser_group.add_argument("--cascade_first_stage_weight", type=float, help="Weight of the first-stage score in the score of an escalated jet", default=0.)
+
+args = parser.parse_known_args()[0]
+
+svc = IOSvc("IOSvc")
+svc.Output = args.outputFile
+
+algList = []
+
+# event numbers for the writers
+algList.append(EventHeaderCreator("EventHeaderCreator"))
+
+producer = SyntheticJetProducer("SyntheticJetProducer",
+                                Seed=args.seed,
+                                JetsPerEvent=args.jets_per_event,
+                                MultiplicityDistribution=args.multiplicity,
+                                MeanMultiplicity=args.mean_multiplicity,
+                                MaxMultiplicity=args.max_multiplicity,
+                                ChargedFraction=args.charged_fraction,
+                                OutputJets=["RefinedVertexJets"],
+                                OutputPrimaryVertices=["PrimaryVertices"],
+                                )
+algList.append(producer)
+
+flavor_collection_names = ["RefinedJetTag_G", "RefinedJetTag_U", "RefinedJetTag_S", "RefinedJetTag_C", "RefinedJetTag_B", "RefinedJetTag_D", "RefinedJetTag_TAU"]
+transformer = JetTagger("JetTagger",
+                        model_path=args.onnx_model,
+                        json_path=args.json_onnx_config,
+                        bundle_path=args.model_bundle,
+                        SharedModelWeights=args.shared_model_weights,
+                        BundleStageDir=args.bundle_stage_dir,
+                        ServerSocket=args.tagging_server,
+                        flavor_collection_names = flavor_collection_names, # to make sure the order and nameing is correct
+                        InputJets=["RefinedVertexJets"],
+                        InputPrimaryVertices=["PrimaryVertices"],
+                        OutputIDCollections=["RefinedJetTags"] if args.compact_tags else flavor_collection_names,
+                        CompactOutput=args.compact_tags,
+                        ORTProfileEvents=args.ort_profile_events,
+                        ORTProfilePrefix=os.path.splitext(args.outputFile)[0] + "_ort_profile",
+                        MemoryReportInterval=args.memory_report_interval,
+                        MaxBatchSize=args.max_batch_size,
+                        MemoryBudgetMB=args.memory_budget_mb,
+                        WarmUpRuns=args.warm_up_runs,
+                        PreselectionMinEnergy=args.preselection_min_energy,
+                        PreselectionMaxAbsCosTheta=args.preselection_max_abs_cos_theta,
+                        PreselectionMinConstituents=args.preselection_min_constituents,
+                        SkippedJetTags=args.skipped_jet_tags,
+                        FirstStageModelPath=args.first_stage_model,
+                        FirstStageJsonPath=args.first_stage_json,
+                        CascadeFlavor=args.cascade_flavor,
+                        CascadeAmbiguousRange=args.cascade_range,
+                        CascadeFirstStageWeight=args.cascade_first_stage_weight,
+                        )
+algList.append(transformer)
+
+if args.jetObsOutputFile:
+    MyJetObsWriter = JetObsWriter("MyJetObsWriter")
+    MyJetObsWriter.InputJets = "RefinedVertexJets"
+    MyJetObsWriter.InputPrimaryVertices = "PrimaryVertices"
+    # define root output file
+    THistSvc().Output =["rec DATAFILE='{}' TYP='ROOT' OPT='RECREATE'".format(args.jetObsOutputFile)]
+    THistSvc().OutputLevel = WARNING
+    THistSvc().PrintAll = False
+    THistSvc().AutoSave = True
+    THistSvc().AutoFlush = True
+    algList.append(MyJetObsWriter)
+
+ApplicationMgr(TopAlg=algList,
+               EvtSel="NONE",
+               EvtMax=args.num_ev,
+               ExtSvc=[k4DataSvc("EventDataSvc")],
+               OutputLevel=INFO,
+               )
@@ -17,7 +17,7 @@
 # limitations under the License.
 #
 from Gaudi.Configuration import INFO, WARNING
-from Configurables import JetTagWriter, JetTagger, JetMCTagger
+from Configurables import JetTagWriter, JetFlavorTagWriter, JetTagger, JetMCTagger
 from Configurables import k4DataSvc
 from Configurables import EventDataSvc
 from Configurables import CollectionMerger
@@ -33,6 +33,14 @@ parser_group.add_argument("--outputFile", help="Output file name", default="outp
 parser_group.add_argument("--onnx_model", help="Path to ONNX model used for tagging", default="/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/fullsimCLD240_2mio.onnx")
 parser_group.add_argument("--json_onnx_config", help="Path to JSON config file for ONNX model used for tagging", default="/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/preprocess_fullsimCLD240_2mio.json")
 parser_group.add_argument("--num_ev", help="Number of events to process (-1 means all)", default=-1)
+parser_group.add_argument("--mc_labelling", choices=["HiggsDaughters", "DeltaR", "Links"], default="HiggsDaughters", help="MC jet labelling: HiggsDaughters (H(jj)Z(vv) events only), DeltaR or Links (any events)")
+parser_group.add_argument("--generic_writer", action="store_true", help="Use the JetFlavorTagWriter, which writes any list of flavor collections")
+parser_group.add_argument("--compact_tags", action="store_true", help="Store all flavor scores of a jet in one ParticleID (collection RefinedJetTags), implies --generic_writer")
+parser_group.add_argument("--first_stage_model", help="ONNX model of a fast first stage that tags every jet, only the ambiguous jets go to the full model (empty: no cascade)", default="")
+parser_group.add_argument("--first_stage_json", help="JSON config file of the first-stage model", default="")
+parser_group.add_argument("--cascade_flavor", help="First-stage score deciding the escalation to the full model, e.g. recojet_isB (empty: the highest score)", default="")
+parser_group.add_argument("--cascade_range", nargs=2, type=float, metavar=("low", "high"), help="Jets with a first-stage score in [low, high] go to the full model", default=[0.1, 0.9])
+parser_group.add_argument("--cascade_first_stage_weight", type=float, help="Weight of the first-stage score in the score of an escalated jet", default=0.)
 
 args = parser.parse_known_args()[0]
 
@@ -49,25 +57,41 @@ transformer_recojets = JetTagger("JetTagger",
                         flavor_collection_names = flavor_collection_names, # to make sure the order and nameing is correct
                         InputJets=["RefinedVertexJets"],
                         InputPrimaryVertices=["PrimaryVertices"],
-                        OutputIDCollections=flavor_collection_names,
+                        OutputIDCollections=["RefinedJetTags"] if args.compact_tags else flavor_collection_names,
+                        CompactOutput=args.compact_tags,
+                        FirstStageModelPath=args.first_stage_model,
+                        FirstStageJsonPath=args.first_stage_json,
+                        CascadeFlavor=args.cascade_flavor,
+                        CascadeAmbiguousRange=args.cascade_range,
+                        CascadeFirstStageWeight=args.cascade_first_stage_weight,
                         )
 # run MC tagger
 transformer_mcjets = JetMCTagger("JetMCTagger",
                         InputJets=["RefinedVertexJets"],
                         MCParticles=["MCParticles"],
+                        Labelling=args.mc_labelling,
+                        RecoMCLinks=["RecoMCTruthLink"] if args.mc_labelling == "Links" else [],
                         )
 
 # retrieve jet PID
-MyJetTagWriter = JetTagWriter("JetTagWriter")
-MyJetTagWriter.InputJets = "RefinedVertexJets"
-MyJetTagWriter.RefinedJetTag_G = "RefinedJetTag_G"
-MyJetTagWriter.RefinedJetTag_U = "RefinedJetTag_U"
-MyJetTagWriter.RefinedJetTag_D = "RefinedJetTag_D"
-MyJetTagWriter.RefinedJetTag_S = "RefinedJetTag_S"
-MyJetTagWriter.RefinedJetTag_C = "RefinedJetTag_C"
-MyJetTagWriter.RefinedJetTag_B = "RefinedJetTag_B"
-MyJetTagWriter.RefinedJetTag_TAU = "RefinedJetTag_TAU"
-MyJetTagWriter.MCJetTag = "MCJetTag"
+if args.generic_writer or args.compact_tags:
+    MyJetTagWriter = JetFlavorTagWriter("JetFlavorTagWriter",
+                            InputJets=["RefinedVertexJets"],
+                            FlavorTagCollections=["RefinedJetTags"] if args.compact_tags else flavor_collection_names,
+                            CompactInput=args.compact_tags,
+                            MCJetTag=["MCJetTag"],
+                            )
+else:
+    MyJetTagWriter = JetTagWriter("JetTagWriter")
+    MyJetTagWriter.InputJets = "RefinedVertexJets"
+    MyJetTagWriter.RefinedJetTag_G = "RefinedJetTag_G"
+    MyJetTagWriter.RefinedJetTag_U = "RefinedJetTag_U"
+    MyJetTagWriter.RefinedJetTag_D = "RefinedJetTag_D"
+    MyJetTagWriter.RefinedJetTag_S = "RefinedJetTag_S"
+    MyJetTagWriter.RefinedJetTag_C = "RefinedJetTag_C"
+    MyJetTagWriter.RefinedJetTag_B = "RefinedJetTag_B"
+    MyJetTagWriter.RefinedJetTag_TAU = "RefinedJetTag_TAU"
+    MyJetTagWriter.MCJetTag = "MCJetTag"
 THistSvc().Output =["rec DATAFILE='{}' TYP='ROOT' OPT='RECREATE'".format(args.outputFile)]
 # define root output file
 THistSvc().OutputLevel = WARNING
@@ -0,0 +1,67 @@
+#
+# Copyright (c) 2020-2024 Key4hep-Project.
+#
+# This file is part of Key4hep.
+# See https://key4hep.github.io/key4hep-doc/ for further info.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+from Gaudi.Configuration import INFO
+from Configurables import JetTensorWriter, JetMCTagger
+from Configurables import k4DataSvc
+from Configurables import EventDataSvc
+from k4FWCore import ApplicationMgr, IOSvc
+from k4FWCore.parseArgs import parser
+
+# parse the custom arguments
+parser_group = parser.add_argument_group("writeJetTensors.py custom options")
+parser_group.add_argument("--inputFiles", nargs="+", metavar=("file1", "file2"), help="One or multiple input files",
+                        default=["/eos/experiment/fcc/prod/fcc/ee/test_spring2024/240gev/Hbb/CLD_o2_v05/rec/00016783/000/Hbb_rec_16783_99.root"])
+parser_group.add_argument("--outputPrefix", help="Prefix of the .npy shards and of the index file", default="jet_tensors")
+parser_group.add_argument("--json_onnx_config", help="Path to JSON preprocessing config of the model to train", default="/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/preprocess_fullsimCLD240_2mio.json")
+parser_group.add_argument("--shardSize", type=int, help="Maximum number of jets per shard", default=100000)
+parser_group.add_argument("--num_ev", type=int, help="Number of events to process (-1 means all)", default=-1)
+parser_group.add_argument("--mc_labelling", choices=["HiggsDaughters", "DeltaR", "Links"], default="HiggsDaughters", help="MC jet labelling: HiggsDaughters (H(jj)Z(vv) events only), DeltaR or Links (any events)")
+args = parser.parse_known_args()[0]
+
+svc = IOSvc("IOSvc")
+svc.Input = args.inputFiles
+
+algList = []
+
+# run MC tagger to get the labels
+transformer_mcjets = JetMCTagger("JetMCTagger",
+                        InputJets=["RefinedVertexJets"],
+                        MCParticles=["MCParticles"],
+                        Labelling=args.mc_labelling,
+                        RecoMCLinks=["RecoMCTruthLink"] if args.mc_labelling == "Links" else [],
+                        )
+
+# write standardized and padded input tensors + labels
+MyJetTensorWriter = JetTensorWriter("JetTensorWriter")
+MyJetTensorWriter.InputJets = "RefinedVertexJets"
+MyJetTensorWriter.InputPrimaryVertices = "PrimaryVertices"
+MyJetTensorWriter.MCJetTag = "MCJetTag"
+MyJetTensorWriter.json_path = args.json_onnx_config
+MyJetTensorWriter.OutputPrefix = args.outputPrefix
+MyJetTensorWriter.ShardSize = args.shardSize
+
+algList.append(transformer_mcjets)
+algList.append(MyJetTensorWriter)
+
+ApplicationMgr(TopAlg=algList,
+               EvtSel="NONE",
+               EvtMax=args.num_ev,
+               ExtSvc=[k4DataSvc("EventDataSvc")],
+               OutputLevel=INFO,
+               )
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Python bindings of the tagging core (module k4MLJetTaggerPy): the preprocessing of the WeaverPreprocessor and the
+ * inference of the WeaverInterface, on many jets per call.
+ *
+ * The jets are one contiguous float32 NumPy array [jets, variables, constituents] with the number of constituents of
+ * every jet. The array is read in place (an array of another type or layout is rejected, not converted) and the GIL
+ * is released while the jets are preprocessed and run, so several Python threads can tag at once. The scores are
+ * returned as a float32 array [jets, flavors] that owns the buffer filled by C++.
+ *
+ *   import k4MLJetTaggerPy
+ *   tagger = k4MLJetTaggerPy.Tagger("fullsimCLD240_2mio.k4jtb")
+ *   scores = tagger.tag(values, lengths)  # values: [jets, len(tagger.variables), constituents], float32
+ */
+
+#include "ModelBundle.h"
+#include "TaggingEngine.h"
+#include "WeaverInterface.h"
+#include "WeaverPreprocessor.h"
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace {
+
+// the values are read in place (noconvert: the wrong type or layout is an error, not a copy), the lengths are small
+// and converted if needed
+using Values = py::array_t<float, py::array::c_style>;
+using Lengths = py::array_t<std::int64_t, py::array::c_style | py::array::forcecast>;
+
+/// Array viewing a buffer filled by C++, which it owns from then on.
+py::array_t<float> toArray(std::vector<float>&& buffer, std::vector<py::ssize_t> shape) {
+  auto* owned = new std::vector<float>(std::move(buffer));
+  py::capsule owner(owned, [](void* p) { delete static_cast<std::vector<float>*>(p); });
+  return py::array_t<float>(std::move(shape), owned->data(), owner);
+}
+
+/// Tagger of the jets of NumPy arrays, over the TaggingEngine of a bundle or of an ONNX model with its JSON.
+class PyTagger {
+public:
+  PyTagger(const std::string& bundle_path, size_t max_batch_size)
+      : m_engine(std::make_shared<const ModelBundle>(bundle_path), engineOptions(max_batch_size)) {}
+  PyTagger(const std::string& model_path, const std::string& json_path, size_t max_batch_size)
+      : m_engine(model_path, json_path, engineOptions(max_batch_size)) {}
+
+  py::array_t<float> tag(const Values& values, const Lengths& lengths) {
+    const size_t n_jets = checkShapes(values, lengths);
+    std::vector<float> scores;
+    {
+      py::gil_scoped_release release;
+      scores = weaver().runContiguous(values.data(), lengths.data(), n_jets, values.shape(2), maxBatchSize());
+    }
+    const size_t n_flavors = m_engine.flavorNames().size();
+    if (scores.size() != n_jets * n_flavors)
+      throw std::runtime_error("The model returned " + std::to_string(scores.size()) + " scores for " +
+                               std::to_string(n_jets) + " jets and " + std::to_string(n_flavors) + " flavors");
+    return toArray(std::move(scores), {static_cast<py::ssize_t>(n_jets), static_cast<py::ssize_t>(n_flavors)});
+  }
+
+  py::dict preprocess(const Values& values, const Lengths& lengths) {
+    const size_t n_jets = checkShapes(values, lengths);
+    const auto& preprocessor = weaver().preprocessor();
+    WeaverPreprocessor::Tensor batch;
+    {
+      py::gil_scoped_release release;
+      preprocessor.preprocessBatch(values.data(), lengths.data(), n_jets, values.shape(2), batch);
+    }
+    py::dict inputs;
+    for (size_t g = 0; g < batch.size(); ++g) {
+      const auto& name = preprocessor.inputNames()[g];
+      const auto& params = preprocessor.params(name);
+      inputs[py::str(name)] = toArray(std::move(batch[g]), {static_cast<py::ssize_t>(n_jets),
+                                                            static_cast<py::ssize_t>(params.var_names.size()),
+                                                            static_cast<py::ssize_t>(params.max_length)});
+    }
+    return inputs;
+  }
+
+  std::vector<std::string> variables() const { return {m_engine.variables().begin(), m_engine.variables().end()}; }
+  const std::vector<std::string>& flavorNames() const { return m_engine.flavorNames(); }
+  const std::vector<int>& pdgCodes() const { return m_engine.pdgCodes(); }
+  size_t maxBatchSize() const { return m_engine.options().max_batch_size; }
+
+private:
+  static TaggingEngine::Options engineOptions(size_t max_batch_size) {
+    TaggingEngine::Options options;
+    options.max_batch_size = max_batch_size;
+    return options;
+  }
+
+  /// Only runContiguous() and the preprocessor are used, which are const and use no buffer of the WeaverInterface.
+  const WeaverInterface& weaver() { return m_engine.weaver(); }
+
+  /// Checks the shapes of the inputs, returns the number of jets.
+  size_t checkShapes(const Values& values, const Lengths& lengths) const {
+    if (values.ndim() != 3)
+      throw std::invalid_argument("values must have the shape [jets, variables, constituents], not " +
+                                  std::to_string(values.ndim()) + " dimensions");
+    const auto n_vars = static_cast<py::ssize_t>(m_engine.variables().size());
+    if (values.shape(1) != n_vars)
+      throw std::invalid_argument("values has " + std::to_string(values.shape(1)) + " variables, the model needs " +
+                                  std::to_string(n_vars) + " (see Tagger.variables)");
+    if (lengths.ndim() != 1 || lengths.shape(0) != values.shape(0))
+      throw std::invalid_argument("lengths must have one entry per jet (" + std::to_string(values.shape(0)) + ")");
+    return values.shape(0);
+  }
+
+  TaggingEngine m_engine;
+};
+
+} // namespace
+
+PYBIND11_MODULE(k4MLJetTaggerPy, m) {
+  m.doc() = "Preprocessing and inference of the k4MLJetTagger on NumPy arrays of many jets";
+
+  py::class_<PyTagger>(m, "Tagger")
+      .def(py::init<const std::string&, size_t>(), py::arg("bundle"), py::arg("max_batch_size") = 256,
+           "Tagger for the model of a bundle made with k4MLJetTagger_bundle.")
+      .def(py::init<const std::string&, const std::string&, size_t>(), py::arg("model"), py::arg("json"),
+           py::arg("max_batch_size") = 256, "Tagger for an ONNX model and its weaver JSON configuration.")
+      .def("tag", &PyTagger::tag, py::arg("values").noconvert(), py::arg("lengths"),
+           "Flavor probabilities [jets, flavors] of the jets in values (float32, C-contiguous, "
+           "[jets, variables, constituents]) with lengths[i] constituents each.")
+      .def("__call__", &PyTagger::tag, py::arg("values").noconvert(), py::arg("lengths"))
+      .def("preprocess", &PyTagger::preprocess, py::arg("values").noconvert(), py::arg("lengths"),
+           "Preprocessed network inputs of the jets, {input name: [jets, variables, max_length]}.")
+      .def_property_readonly("variables", &PyTagger::variables, "Constituent variables, in the order of values.")
+      .def_property_readonly("flavor_names", &PyTagger::flavorNames, "Flavors, in the order of the scores.")
+      .def_property_readonly("pdg_codes", &PyTagger::pdgCodes)
+      .def_property_readonly("max_batch_size", &PyTagger::maxBatchSize);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "AsyncTreeFiller.h"
+
+#include <chrono>
+#include <stdexcept>
+
+AsyncTreeFiller::AsyncTreeFiller(size_t capacity)
+    : m_capacity(capacity > 0 ? capacity
+                              : throw std::invalid_argument("AsyncTreeFiller: the queue capacity must be positive")),
+      m_thread(&AsyncTreeFiller::run, this) {}
+
+AsyncTreeFiller::~AsyncTreeFiller() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_notEmpty.notify_one();
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+void AsyncTreeFiller::submit(std::function<void()> task) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  rethrowError();
+  if (m_queue.size() >= m_capacity) {
+    const auto start = std::chrono::steady_clock::now();
+    m_notFull.wait(lock, [this] { return m_queue.size() < m_capacity || m_error; });
+    ++m_nBlocked;
+    m_blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    rethrowError();
+  }
+  m_queue.push_back(std::move(task));
+  if (m_queue.size() > m_maxQueueDepth)
+    m_maxQueueDepth = m_queue.size();
+  lock.unlock();
+  m_notEmpty.notify_one();
+}
+
+void AsyncTreeFiller::flush() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this] { return (m_queue.empty() && !m_busy) || m_error; });
+  rethrowError();
+}
+
+size_t AsyncTreeFiller::maxQueueDepth() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_maxQueueDepth;
+}
+
+size_t AsyncTreeFiller::nBlocked() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_nBlocked;
+}
+
+double AsyncTreeFiller::blockedSeconds() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_blockedSeconds;
+}
+
+void AsyncTreeFiller::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_notEmpty.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+    if (m_queue.empty() || m_error) // stop requested and everything done, or a task failed
+      break;
+    auto task = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_busy = true;
+    lock.unlock();
+    m_notFull.notify_one();
+
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    m_busy = false;
+    if (error) {
+      m_error = error;
+      m_queue.clear();
+      m_notFull.notify_all();
+    }
+    if (m_queue.empty())
+      m_idle.notify_all();
+  }
+  m_idle.notify_all();
+}
+
+void AsyncTreeFiller::rethrowError() {
+  if (m_error)
+    std::rethrow_exception(m_error);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ASYNCTREEFILLER_H
+#define ASYNCTREEFILLER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @class AsyncTreeFiller
+ * @brief Runs the tree filling of a writer (TTree::Fill and the basket compression and disk writes it triggers) on a
+ * background thread.
+ *
+ * The event thread hands over one task per tree entry. A task owns a copy of the entry and copies it into the branch
+ * buffers before calling Fill(), so the branch buffers are only ever touched by the background thread. Tasks are
+ * executed in submission order. The queue is bounded: if the background thread falls behind, submit() blocks until
+ * there is space again (back-pressure), which keeps the memory use bounded.
+ *
+ * An exception thrown by a task stops the processing and is rethrown on the event thread by the next submit() or
+ * flush().
+ *
+ * @note ROOT::EnableThreadSafety() has to be called before the first task is submitted.
+ */
+class AsyncTreeFiller {
+public:
+  /**
+   * @brief Starts the background thread.
+   * @param capacity Maximum number of queued entries before submit() blocks.
+   */
+  explicit AsyncTreeFiller(size_t capacity);
+
+  /// Processes all queued entries and stops the background thread.
+  ~AsyncTreeFiller();
+
+  AsyncTreeFiller(const AsyncTreeFiller&) = delete;
+  AsyncTreeFiller& operator=(const AsyncTreeFiller&) = delete;
+
+  /// Queues a task, blocking while the queue is full.
+  void submit(std::function<void()> task);
+
+  /// Blocks until all queued tasks are done.
+  void flush();
+
+  /// Largest number of queued entries seen.
+  size_t maxQueueDepth() const;
+  /// Number of submit() calls that had to wait for space in the queue.
+  size_t nBlocked() const;
+  /// Total time in seconds that submit() waited for space in the queue.
+  double blockedSeconds() const;
+
+private:
+  void run();
+  void rethrowError(); // requires m_mutex to be held
+
+  const size_t m_capacity;
+  mutable std::mutex m_mutex;
+  std::condition_variable m_notEmpty; ///< signalled when a task was queued or on stop
+  std::condition_variable m_notFull;  ///< signalled when a task was taken from the queue
+  std::condition_variable m_idle;     ///< signalled when the queue is empty and no task is running
+  std::deque<std::function<void()>> m_queue;
+  bool m_busy{false};
+  bool m_stop{false};
+  std::exception_ptr m_error;
+  size_t m_maxQueueDepth{0};
+  size_t m_nBlocked{0};
+  double m_blockedSeconds{0.};
+  std::thread m_thread; ///< started last, after all members are initialized
+};
+
+#endif // ASYNCTREEFILLER_H
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "EtaPhiGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+EtaPhiGrid::EtaPhiGrid(double cell_size, double max_eta) : m_maxEta(max_eta) {
+  if (!(cell_size > 0.) || !(max_eta > 0.))
+    throw std::invalid_argument("EtaPhiGrid: cell size and maximum eta must be positive");
+  // round the number of cells down, so that the cells are at least cell_size wide
+  m_nEta = std::max(1, static_cast<int>(2. * max_eta / cell_size));
+  m_nPhi = std::max(1, static_cast<int>(2. * M_PI / cell_size));
+  m_etaWidth = 2. * max_eta / m_nEta;
+  m_phiWidth = 2. * M_PI / m_nPhi;
+  m_cellStart.resize(static_cast<size_t>(m_nEta) * m_nPhi + 1);
+}
+
+int EtaPhiGrid::etaBin(double eta) const {
+  const int bin = static_cast<int>(std::floor((eta + m_maxEta) / m_etaWidth));
+  return std::clamp(bin, 0, m_nEta - 1);
+}
+
+int EtaPhiGrid::phiBin(double phi) const {
+  const int bin = static_cast<int>(std::floor((phi + M_PI) / m_phiWidth));
+  return ((bin % m_nPhi) + m_nPhi) % m_nPhi; // also for phi slightly outside [-pi, pi)
+}
+
+void EtaPhiGrid::build(const std::vector<float>& eta, const std::vector<float>& phi) {
+  if (eta.size() != phi.size())
+    throw std::invalid_argument("EtaPhiGrid: eta and phi have different sizes");
+  m_eta = eta;
+  m_phi = phi;
+
+  // counting sort of the points into the cells
+  const size_t n_cells = m_cellStart.size() - 1;
+  std::fill(m_cellStart.begin(), m_cellStart.end(), 0);
+  m_cellOf.resize(eta.size());
+  for (size_t i = 0; i < eta.size(); ++i) {
+    m_cellOf[i] = static_cast<size_t>(etaBin(eta[i])) * m_nPhi + phiBin(phi[i]);
+    ++m_cellStart[m_cellOf[i] + 1];
+  }
+  for (size_t c = 0; c < n_cells; ++c)
+    m_cellStart[c + 1] += m_cellStart[c];
+  m_items.resize(eta.size());
+  m_cellFill.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+  for (size_t i = 0; i < eta.size(); ++i)
+    m_items[m_cellFill[m_cellOf[i]]++] = i;
+}
+
+double EtaPhiGrid::deltaR2(size_t i, double eta, double phi) const {
+  const double deta = m_eta[i] - eta;
+  const double dphi = std::remainder(m_phi[i] - phi, 2. * M_PI);
+  return deta * deta + dphi * dphi;
+}
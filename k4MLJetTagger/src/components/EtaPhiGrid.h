@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ETAPHIGRID_H
+#define ETAPHIGRID_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class EtaPhiGrid
+ * @brief Spatial index of points in the eta-phi plane for fast Delta R searches.
+ *
+ * The plane is divided into cells of at least cell_size x cell_size (phi wraps around), and the points are sorted into
+ * the cells with a counting sort, so that building the grid is linear in the number of points. All points within
+ * Delta R < cell_size of a position lie in the 3x3 cells around it, so a search only visits these cells instead of all
+ * points. |eta| is clamped to max_eta; points along the beam axis end up in the outermost cells.
+ *
+ * Example:
+ *   EtaPhiGrid grid(0.4);
+ *   grid.build(etas, phis);
+ *   grid.forEachCandidate(jet_eta, jet_phi, [&](size_t i) { if (grid.deltaR2(i, jet_eta, jet_phi) < 0.16) ... });
+ */
+class EtaPhiGrid {
+public:
+  /**
+   * @param cell_size Minimum size of a cell, i.e. the largest Delta R that can be searched.
+   * @param max_eta Points with larger |eta| are put into the outermost cells.
+   */
+  explicit EtaPhiGrid(double cell_size, double max_eta = 10.);
+
+  /// Sorts the points into the cells. The memory of the previous build is reused.
+  void build(const std::vector<float>& eta, const std::vector<float>& phi);
+
+  /// Calls f(i) for every point i in the 3x3 cells around (eta, phi), a superset of the points within cell_size.
+  template <typename F>
+  void forEachCandidate(double eta, double phi, F&& f) const {
+    const int ieta = etaBin(eta);
+    const int iphi = phiBin(phi);
+    for (int de = -1; de <= 1; ++de) {
+      const int e = ieta + de;
+      if (e < 0 || e >= m_nEta)
+        continue;
+      // with fewer than 3 phi cells, the neighbours wrap onto the same cells
+      const int n_dphi = m_nPhi < 3 ? m_nPhi : 3;
+      for (int k = 0; k < n_dphi; ++k) {
+        const int p = n_dphi == 3 ? (iphi + k - 1 + m_nPhi) % m_nPhi : k;
+        const size_t cell = static_cast<size_t>(e) * m_nPhi + p;
+        for (size_t j = m_cellStart[cell]; j < m_cellStart[cell + 1]; ++j)
+          f(m_items[j]);
+      }
+    }
+  }
+
+  /// Delta R^2 between point i and (eta, phi).
+  double deltaR2(size_t i, double eta, double phi) const;
+
+  /// Number of points.
+  size_t size() const { return m_eta.size(); }
+
+private:
+  int etaBin(double eta) const;
+  int phiBin(double phi) const;
+
+  double m_maxEta;
+  int m_nEta;
+  int m_nPhi;
+  double m_etaWidth;
+  double m_phiWidth;
+  std::vector<float> m_eta, m_phi;
+  std::vector<size_t> m_cellStart; ///< index of the first item of every cell in m_items, plus the end
+  std::vector<size_t> m_items;     ///< point indices sorted by cell
+  std::vector<size_t> m_cellOf;    ///< cell of every point
+  std::vector<size_t> m_cellFill;  ///< next free slot of every cell during build()
+};
+
+#endif // ETAPHIGRID_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "EventMCTruth.h"
+#include "EtaPhiGrid.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath> // For std::abs
+#include <limits>
+#include <set>
+#include <unordered_map>
+
+namespace {
+constexpr double kMaxEta = 10.; ///< |eta| of particles along the beam axis is clamped to this value
+
+/// Flavor of the heaviest quark of a hadron (PDG numbering scheme), 0 if the particle is not a hadron.
+int heaviestQuark(int pdg) {
+  pdg = std::abs(pdg);
+  if (pdg < 100 || pdg >= 1000000000) // not a hadron, or a nucleus
+    return 0;
+  const int q1 = (pdg / 1000) % 10; // 0 for mesons
+  const int q2 = (pdg / 100) % 10;
+  const int q3 = (pdg / 10) % 10;
+  return std::max({q1, q2, q3});
+}
+
+/// Flavor relevant part of the MC ancestry of a particle (including the particle itself).
+struct Ancestry {
+  bool fromB{false};     ///< has a b hadron among its ancestors
+  bool fromC{false};     ///< has a c hadron among its ancestors
+  bool fromTau{false};   ///< has a tau among its ancestors
+  int partonFlavor{0};   ///< |PDG| of the closest quark or gluon ancestor (the most energetic one if several)
+  float partonEnergy{-1};
+};
+
+/// Walks up the ancestry of an MC particle, memoized per event in the cache.
+const Ancestry& walkAncestry(const edm4hep::MCParticle& particle, std::unordered_map<std::uint64_t, Ancestry>& cache) {
+  // references to the elements of an unordered_map stay valid when it grows. The entry exists while the walk is in
+  // progress, which also stops the walk at (invalid) loops in the MC record.
+  auto [it, inserted] = cache.try_emplace(object_key(particle.getObjectID()));
+  Ancestry& ancestry = it->second;
+  if (!inserted)
+    return ancestry;
+
+  const int pdg = particle.getPDG();
+  const int abs_pdg = std::abs(pdg);
+  const int heaviest_quark = heaviestQuark(pdg);
+  ancestry.fromB = heaviest_quark == 5;
+  ancestry.fromC = heaviest_quark == 4;
+  ancestry.fromTau = abs_pdg == 15;
+  const bool is_parton = (abs_pdg >= 1 && abs_pdg <= 5) || abs_pdg == 21;
+  if (is_parton) {
+    ancestry.partonFlavor = abs_pdg;
+    ancestry.partonEnergy = particle.getEnergy();
+  }
+  for (const auto& parent : particle.getParents()) {
+    const Ancestry& parent_ancestry = walkAncestry(parent, cache);
+    ancestry.fromB |= parent_ancestry.fromB;
+    ancestry.fromC |= parent_ancestry.fromC;
+    ancestry.fromTau |= parent_ancestry.fromTau;
+    if (!is_parton && parent_ancestry.partonEnergy > ancestry.partonEnergy) {
+      ancestry.partonFlavor = parent_ancestry.partonFlavor;
+      ancestry.partonEnergy = parent_ancestry.partonEnergy;
+    }
+  }
+  return ancestry;
+}
+
+void etaPhi(double px, double py, double pz, float& eta, float& phi) {
+  const double pt = std::hypot(px, py);
+  eta = pt > 0. ? std::clamp(std::asinh(pz / pt), -kMaxEta, kMaxEta) : std::copysign(kMaxEta, pz);
+  phi = std::atan2(py, px);
+}
+} // namespace
+
+EventMCTruth::EventMCTruth(const edm4hep::MCParticleCollection& mcParticles) {
+  // find the MC Higgs Boson and its daughters
+  const int HiggsPID = 25;
+  for (const auto& MCParticle : mcParticles) {
+    const int pdg = MCParticle.getPDG();
+    if (pdg == HiggsPID) {
+      for (const auto& daughter : MCParticle.getDaughters()) {
+        m_higgsDaughterPDGs.push_back(daughter.getPDG());
+      }
+    }
+
+    // flavor particles for the Delta R labelling
+    const int abs_pdg = std::abs(pdg);
+    FlavorParticle particle{};
+    const int heaviest_quark = heaviestQuark(pdg);
+    if (heaviest_quark == 5) {
+      particle.flavor = 5;
+      particle.kind = kBHadron;
+    } else if (heaviest_quark == 4) {
+      particle.flavor = 4;
+      particle.kind = kCHadron;
+    } else if (abs_pdg == 15) {
+      particle.flavor = 15;
+      particle.kind = kTau;
+    } else if ((abs_pdg >= 1 && abs_pdg <= 5) || abs_pdg == 21) {
+      particle.flavor = abs_pdg;
+      particle.kind = kParton;
+    } else {
+      continue;
+    }
+    const auto& momentum = MCParticle.getMomentum();
+    etaPhi(momentum.x, momentum.y, momentum.z, particle.eta, particle.phi);
+    particle.energy = MCParticle.getEnergy();
+    m_flavorParticles.push_back(particle);
+  }
+
+  // check if the daughters are all the same (ignoring signs)
+  const std::set<int> expectedFlavors = {1, 2, 3, 4, 5, 15, 21}; // u,d,s,c,b,tau,g
+  const auto& pdgs = m_higgsDaughterPDGs;
+  if (pdgs.size() == 2 && pdgs[0] == -pdgs[1]) {
+    const int j_pid = std::abs(pdgs[0]);
+    if (expectedFlavors.count(j_pid) == 1) {
+      m_higgsDaughterFlavor = j_pid;
+    } else {
+      m_higgsDaughterProblem = "Higgs daughters with unexpected PDG " + std::to_string(j_pid);
+    }
+  } else if (pdgs.size() == 2 && pdgs[0] == 21 && pdgs[1] == 21) {
+    // if the daughters are gluons they don't have opposite sign
+    m_higgsDaughterFlavor = 21;
+  } else {
+    m_higgsDaughterProblem = "Higgs Boson has more than 2 daughters or they are not the same";
+  }
+}
+
+std::vector<int> EventMCTruth::jetFlavorsDeltaR(const edm4hep::ReconstructedParticleCollection& jets,
+                                                double max_dr) const {
+  const size_t n_jets = jets.size();
+  std::vector<int> flavors(n_jets, 0);
+  if (n_jets == 0 || m_flavorParticles.empty())
+    return flavors;
+
+  std::vector<float> eta(m_flavorParticles.size()), phi(m_flavorParticles.size());
+  for (size_t i = 0; i < m_flavorParticles.size(); ++i) {
+    eta[i] = m_flavorParticles[i].eta;
+    phi[i] = m_flavorParticles[i].phi;
+  }
+  EtaPhiGrid grid(max_dr, kMaxEta);
+  grid.build(eta, phi);
+
+  // associate every flavor particle to the closest jet within max_dr
+  const double max_dr2 = max_dr * max_dr;
+  std::vector<double> best_dr2(m_flavorParticles.size(), std::numeric_limits<double>::max());
+  std::vector<int> best_jet(m_flavorParticles.size(), -1);
+  for (size_t j = 0; j < n_jets; ++j) {
+    const auto& momentum = jets[j].getMomentum();
+    float jet_eta, jet_phi;
+    etaPhi(momentum.x, momentum.y, momentum.z, jet_eta, jet_phi);
+    grid.forEachCandidate(jet_eta, jet_phi, [&](size_t i) {
+      const double dr2 = grid.deltaR2(i, jet_eta, jet_phi);
+      if (dr2 < max_dr2 && dr2 < best_dr2[i]) {
+        best_dr2[i] = dr2;
+        best_jet[i] = static_cast<int>(j);
+      }
+    });
+  }
+
+  // label of every jet: associated particle with the highest precedence, the most energetic among partons
+  std::vector<int> best_kind(n_jets, kParton + 1);
+  std::vector<float> best_energy(n_jets, -1.);
+  for (size_t i = 0; i < m_flavorParticles.size(); ++i) {
+    if (best_jet[i] < 0)
+      continue;
+    const auto& particle = m_flavorParticles[i];
+    const size_t j = best_jet[i];
+    if (particle.kind < best_kind[j] || (particle.kind == best_kind[j] && particle.energy > best_energy[j])) {
+      best_kind[j] = particle.kind;
+      best_energy[j] = particle.energy;
+      flavors[j] = particle.flavor;
+    }
+  }
+  return flavors;
+}
+
+std::vector<int>
+EventMCTruth::jetFlavorsFromLinks(const edm4hep::ReconstructedParticleCollection& jets,
+                                  const std::vector<const edm4hep::RecoMCParticleLinkCollection*>& links,
+                                  double min_fraction) {
+  // reco particle -> its links, as singly linked lists through the link indices
+  struct LinkRef {
+    const edm4hep::RecoMCParticleLinkCollection* coll;
+    size_t index;
+    int next;
+  };
+  std::vector<LinkRef> link_refs;
+  std::unordered_map<std::uint64_t, int> first_link; // reco particle -> first entry in link_refs
+  size_t n_links = 0;
+  for (const auto* coll : links)
+    n_links += coll->size();
+  link_refs.reserve(n_links);
+  first_link.reserve(n_links);
+  for (const auto* coll : links) {
+    for (size_t i = 0; i < coll->size(); ++i) {
+      auto [it, inserted] = first_link.try_emplace(object_key((*coll)[i].getFrom().getObjectID()), -1);
+      link_refs.push_back({coll, i, it->second});
+      it->second = static_cast<int>(link_refs.size() - 1);
+    }
+  }
+
+  std::unordered_map<std::uint64_t, Ancestry> ancestry_cache; // shared by all jets of the event
+  ancestry_cache.reserve(4 * n_links);
+
+  std::vector<int> flavors(jets.size(), 0);
+  for (size_t j = 0; j < jets.size(); ++j) {
+    double e_total = 0, e_b = 0, e_c = 0, e_tau = 0;
+    std::array<double, 22> e_parton{}; // indexed by |PDG| of the parton (1-5, 21), 0 for no parton ancestor
+    for (const auto& constituent : jets[j].getParticles()) {
+      const auto it = first_link.find(object_key(constituent.getObjectID()));
+      if (it == first_link.end())
+        continue;
+      double weight_sum = 0;
+      size_t n_constituent_links = 0;
+      for (int l = it->second; l >= 0; l = link_refs[l].next) {
+        weight_sum += (*link_refs[l].coll)[link_refs[l].index].getWeight();
+        ++n_constituent_links;
+      }
+
+      for (int l = it->second; l >= 0; l = link_refs[l].next) {
+        const auto link = (*link_refs[l].coll)[link_refs[l].index];
+        if (!link.getTo().isAvailable())
+          continue;
+        // share of the constituent energy; equal shares if the links have no weights
+        const double share = weight_sum > 0 ? link.getWeight() / weight_sum : 1. / n_constituent_links;
+        const double energy = share * constituent.getEnergy();
+        const Ancestry& ancestry = walkAncestry(link.getTo(), ancestry_cache);
+        e_total += energy;
+        e_b += ancestry.fromB ? energy : 0.;
+        e_c += ancestry.fromC ? energy : 0.;
+        e_tau += ancestry.fromTau ? energy : 0.;
+        e_parton[ancestry.partonFlavor] += energy;
+      }
+    }
+    if (e_total <= 0)
+      continue;
+
+    if (e_b >= min_fraction * e_total) {
+      flavors[j] = 5;
+    } else if (e_c >= min_fraction * e_total) {
+      flavors[j] = 4;
+    } else if (e_tau >= min_fraction * e_total) {
+      flavors[j] = 15;
+    } else {
+      const auto max_it = std::max_element(e_parton.begin() + 1, e_parton.end());
+      flavors[j] = *max_it > 0 ? static_cast<int>(std::distance(e_parton.begin(), max_it)) : 0;
+    }
+  }
+  return flavors;
+}
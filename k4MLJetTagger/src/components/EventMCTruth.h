@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef EVENTMCTRUTH_H
+#define EVENTMCTRUTH_H
+
+#include <edm4hep/MCParticleCollection.h>
+#include <edm4hep/RecoMCParticleLinkCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * @class EventMCTruth
+ * @brief MC truth information of one event, collected in a single pass over the MC particles.
+ *
+ * The truth information only depends on the event, not on the jet. Algorithms labelling jets build this object once
+ * per event and look up the label of every jet in it, instead of scanning the MC record again for every jet. The
+ * class has no Gaudi dependencies, so it can be used by any algorithm (or outside of Gaudi).
+ *
+ * Three labellings are provided:
+ * - jetFlavor(): the flavor of the daughters of the Higgs boson.
+ *   WARNING: This uses the assumption of H(jj)Z(vv) events, where every jet has the flavor of the Higgs daughters!
+ * - jetFlavorsDeltaR(): a general hadron/parton based labelling for any event topology. Every flavor particle (b and c
+ *   hadrons, taus, quarks and gluons) is associated to the closest jet within Delta R < max_dr, using an EtaPhiGrid
+ *   over the flavor particles so that the cost is linear in the number of jets and particles. A jet is labelled b if a
+ *   b hadron is associated to it, else c if a c hadron is, else tau if a tau is, else with the flavor of the most
+ *   energetic associated quark or gluon, else 0.
+ * - jetFlavorsFromLinks(): jet-by-jet labelling from the reco-to-MC links of the jet constituents (see there).
+ */
+class EventMCTruth {
+public:
+  /// Collects the truth information of the event in one pass over the MC particles.
+  explicit EventMCTruth(const edm4hep::MCParticleCollection& mcParticles);
+
+  /// Flavor (PDG without sign: 1-5, 15 or 21) of the Higgs daughters, 0 if it could not be determined.
+  int higgsDaughterFlavor() const { return m_higgsDaughterFlavor; }
+  /// Why the flavor of the Higgs daughters could not be determined, empty if it could.
+  const std::string& higgsDaughterProblem() const { return m_higgsDaughterProblem; }
+  /// PDGs of the daughters of all Higgs bosons in the event.
+  const std::vector<int>& higgsDaughterPDGs() const { return m_higgsDaughterPDGs; }
+
+  /// MC jet flavor of a jet of this event. Under the H(jj)Z(vv) assumption, the same for all jets.
+  int jetFlavor() const { return m_higgsDaughterFlavor; }
+
+  /// Kind of MC particle defining the flavor of a jet, in order of precedence.
+  enum FlavorParticleKind { kBHadron = 0, kCHadron = 1, kTau = 2, kParton = 3 };
+  /// MC particle relevant for the flavor of a jet.
+  struct FlavorParticle {
+    float eta;
+    float phi;
+    float energy;
+    int flavor; ///< 5 (b hadron), 4 (c hadron), 15 (tau) or |PDG| of the quark or gluon
+    FlavorParticleKind kind;
+  };
+  /// b and c hadrons, taus, quarks and gluons of the event.
+  const std::vector<FlavorParticle>& flavorParticles() const { return m_flavorParticles; }
+
+  /**
+   * @brief MC flavor of every jet from the flavor particles associated to it (see class description).
+   * @param jets Jets to label.
+   * @param max_dr Maximum Delta R between a flavor particle and the jet axis.
+   * @return Flavor (PDG without sign) of every jet in the order of the collection, 0 if no flavor particle is
+   * associated.
+   */
+  std::vector<int> jetFlavorsDeltaR(const edm4hep::ReconstructedParticleCollection& jets, double max_dr) const;
+
+  /**
+   * @brief MC flavor of every jet from the MC ancestry of its constituents.
+   *
+   * Every constituent is followed through the links to its MC particles. The energy of the constituent is shared
+   * among them in proportion to the link weights. The ancestry of every MC particle is walked up once per event and
+   * cached, so that particles shared by several constituents or jets are walked only once. The jet is labelled b if the
+   * energy fraction from b hadron decays is at least min_fraction, else c (c hadrons), else tau, else with the flavor
+   * of the quark or gluon that most of the energy comes from, else 0.
+   *
+   * @param jets Jets to label.
+   * @param links Reco-to-MC link collections of the jet constituents (e.g. RecoMCTruthLink).
+   * @param min_fraction Minimum energy fraction for a b, c or tau label.
+   * @return Flavor (PDG without sign) of every jet in the order of the collection.
+   */
+  static std::vector<int> jetFlavorsFromLinks(const edm4hep::ReconstructedParticleCollection& jets,
+                                              const std::vector<const edm4hep::RecoMCParticleLinkCollection*>& links,
+                                              double min_fraction);
+
+private:
+  std::vector<int> m_higgsDaughterPDGs;
+  int m_higgsDaughterFlavor{0};
+  std::string m_higgsDaughterProblem;
+  std::vector<FlavorParticle> m_flavorParticles;
+};
+
+#endif // EVENTMCTRUTH_H
@@ -20,6 +20,9 @@
 
 #include <DD4hep/DD4hepUnits.h>
 
+#include <cmath>
+#include <cstring>
+
 double getBzAtOrigin(dd4hep::Detector* theDetector) {
   double bfield(0.0);
   if (not(theDetector->state() == dd4hep::Detector::READY)) {
@@ -126,6 +129,63 @@ rv::RVec<rv::RVec<float>> from_Jet_to_onnx_input(Jet& jet, const rv::RVec<std::s
 
 // converstion from FCCAnalyses to key4hep and vice versa
 
+float truncate_mantissa(float value, int mantissa_bits) {
+  if (mantissa_bits < 0 || mantissa_bits > 23)
+    throw std::invalid_argument("Number of mantissa bits must be within [0, 23], got " + std::to_string(mantissa_bits));
+  if (mantissa_bits == 23 || !std::isfinite(value))
+    return value;
+
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const int drop = 23 - mantissa_bits;
+  // add half of the dropped range (minus one if the last kept bit is even) to round to nearest, ties to even
+  bits += (std::uint32_t(1) << (drop - 1)) - 1 + ((bits >> drop) & 1);
+  bits &= ~((std::uint32_t(1) << drop) - 1);
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+std::uint8_t pack_pid_flags(const Pfcand& pfc) {
+  return static_cast<std::uint8_t>((pfc.pfcand_isEl != 0) << kIsEl | (pfc.pfcand_isMu != 0) << kIsMu |
+                                   (pfc.pfcand_isGamma != 0) << kIsGamma |
+                                   (pfc.pfcand_isChargedHad != 0) << kIsChargedHad |
+                                   (pfc.pfcand_isNeutralHad != 0) << kIsNeutralHad);
+}
+
+std::uint64_t object_key(const podio::ObjectID& id) {
+  return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(id.collectionID)) << 32) |
+         static_cast<std::uint32_t>(id.index);
+}
+
+JetPreselection::Result JetPreselection::apply(const edm4hep::ReconstructedParticle& jet) const {
+  if (jet.getEnergy() < min_energy)
+    return kEnergy;
+  if (max_abs_cos_theta < 1) {
+    const auto& p = jet.getMomentum();
+    const double p_mag = std::sqrt(double(p.x) * p.x + double(p.y) * p.y + double(p.z) * p.z);
+    if (p_mag <= 0 || std::abs(p.z) > max_abs_cos_theta * p_mag)
+      return kCosTheta;
+  }
+  if (static_cast<int>(jet.getParticles().size()) < min_constituents)
+    return kConstituents;
+  return kPassed;
+}
+
+const char* JetPreselection::name(Result result) {
+  switch (result) {
+  case kPassed:
+    return "passed";
+  case kEnergy:
+    return "energy";
+  case kCosTheta:
+    return "|cos theta|";
+  case kConstituents:
+    return "constituents";
+  default:
+    return "unknown";
+  }
+}
+
 VarMapper::VarMapper() {
   m_mapToFCCAn["pfcand_erel_log"] = "pfcand_erel_log";
   m_mapToFCCAn["pfcand_thetarel"] = "pfcand_thetarel";
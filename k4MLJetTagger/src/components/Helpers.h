@@ -19,6 +19,7 @@
 #ifndef HELPERS_H
 #define HELPERS_H
 
+#include <cstdint>
 #include <nlohmann/json.hpp> // Include a JSON parsing library
 #include <string>
 #include <unordered_map>
@@ -26,6 +27,9 @@
 #include "ROOT/RVec.hxx"
 #include "Structs.h"
 
+#include <edm4hep/ReconstructedParticle.h>
+#include <podio/ObjectID.h>
+
 #include <DD4hep/Detector.h> // for Bfield
 
 namespace rv = ROOT::VecOps;
@@ -67,6 +71,62 @@ extern const std::map<std::string, int> to_PDGflavor;
  */
 bool check_flavors(std::vector<std::string>& flavorNames, const std::vector<std::string>& flavor_collection_names);
 
+/**
+ * Round a float to the given number of explicit mantissa bits (round to nearest, ties to even). The dropped low bits
+ * are set to zero, so the values stay plain floats in the output file but compress much better.
+ * @param value: the value to round
+ * @param mantissa_bits: the number of mantissa bits to keep (0-23, 23 returns the value unchanged)
+ * @return: the rounded value
+ */
+float truncate_mantissa(float value, int mantissa_bits);
+
+/**
+ * Bit positions of the PID flags of a jet constituent in the packed representation of pack_pid_flags().
+ */
+enum PIDFlagBit : std::uint8_t { kIsEl = 0, kIsMu = 1, kIsGamma = 2, kIsChargedHad = 3, kIsNeutralHad = 4 };
+
+/**
+ * Pack the five 0/1 PID flags of a jet constituent (isEl, isMu, isGamma, isChargedHad, isNeutralHad) into one byte.
+ * @param pfc: the jet constituent
+ * @return: the flags, bit i being set if the flag with PIDFlagBit i is non-zero
+ */
+std::uint8_t pack_pid_flags(const Pfcand& pfc);
+
+/**
+ * Key of a podio object for hash maps, unique within an event: collection ID in the upper, object index in the lower
+ * 32 bits.
+ * @param id: the object ID, e.g. particle.getObjectID()
+ * @return: the key
+ */
+std::uint64_t object_key(const podio::ObjectID& id);
+
+/**
+ * @struct JetPreselection
+ * @brief Cuts on a jet before it is tagged, e.g. to skip soft or near-empty jets. The defaults pass every jet.
+ */
+struct JetPreselection {
+  /// Outcome of apply(): kPassed or the first cut the jet failed.
+  enum Result : std::uint8_t { kPassed, kEnergy, kCosTheta, kConstituents, kNResults };
+
+  double min_energy{0};        ///< Minimum jet energy in GeV.
+  double max_abs_cos_theta{1}; ///< Maximum |cos theta| of the jet momentum.
+  int min_constituents{0};     ///< Minimum number of constituents.
+
+  /// Whether any cut is set.
+  bool active() const { return min_energy > 0 || max_abs_cos_theta < 1 || min_constituents > 0; }
+
+  /**
+   * Apply the cuts in the order energy, |cos theta|, constituents. Only the jet itself is read, not its constituents.
+   * A jet without momentum fails the |cos theta| cut.
+   * @param jet: the jet
+   * @return: kPassed or the first cut the jet failed
+   */
+  Result apply(const edm4hep::ReconstructedParticle& jet) const;
+
+  /// Name of a cut for the reports, e.g. "energy".
+  static const char* name(Result result);
+};
+
 /**
  * @class VarMapper
  * @brief A utility class for mapping variable names between FCCAnalyses and Key4HEP conventions.
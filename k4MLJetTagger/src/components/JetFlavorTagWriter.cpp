@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Gaudi/Accumulators.h"
+#include "Gaudi/Property.h"
+#include "GaudiKernel/ITHistSvc.h"
+#include "GaudiKernel/MsgStream.h"
+#include "k4FWCore/Consumer.h"
+#include "k4FWCore/MetadataUtils.h"
+#include <edm4hep/Constants.h>
+#include <edm4hep/ParticleIDCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <podio/FrameCategories.h>
+
+#include "TROOT.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AsyncTreeFiller.h"
+#include "Helpers.h"
+#include "JetTagReader.h"
+#include "MemoryUsage.h"
+#include "TreeIOSettings.h"
+
+/**
+ * @class JetFlavorTagWriter
+ * @brief Gaudi consumer that writes the flavor scores of any number of jet flavors and the MC jet flavor to a TTree.
+ *
+ * Generic version of JetTagWriter: the flavor tag collections are given as a list (FlavorTagCollections), e.g. the
+ * same list as the OutputIDCollections of the JetTagger. The flavor of a collection is the part of its name after the
+ * last underscore (RefinedJetTag_B -> B). For every flavor X, the tree has the branches score_recojet_isX (likelihood
+ * of the tag) and recojet_isX (true if the MC jet flavor is X).
+ *
+ * JetTagger and JetMCTagger create their tags in the order of the jets, so that the i-th tag belongs to the i-th jet.
+ * For such index-aligned collections the scores are read directly by index, checking only that the tag points to the
+ * jet. No edm4hep::utils::PIDHandler is built, so that the per-event overhead does not grow with the number of
+ * flavors. Only if a collection is not index-aligned, a single hash index from the jets to their position is built for
+ * the event and used for all collections that need it (see JetTagMatcher).
+ *
+ * With CompactInput, FlavorTagCollections is the single collection written by the JetTagger with CompactOutput, which
+ * holds the scores of all flavors of a jet in the parameters of one ParticleID. The flavor order is taken from
+ * FlavorNames or, if empty, from the ParticleID metadata of the collection. Both layouts are read with JetTagTable.
+ *
+ * The branch recojet_provenance holds the JetTagProvenance of the tags, i.e. which model of a cascade scored the jet.
+ *
+ * Jets without exactly one tag per flavor or without a known MC flavor are skipped.
+ * Jets without reco tags, e.g. failing the preselection of a JetTagger with SkippedJetTags = None, are skipped and
+ * counted (counter "Jets without reco tags"), as are the jets with its placeholder tags (SkippedJetTags = Placeholder,
+ * counter "Jets skipped by the preselection").
+ *
+ * @author Sara Aumiller
+ */
+struct JetFlavorTagWriter
+    : k4FWCore::Consumer<void(const edm4hep::ReconstructedParticleCollection&,
+                              const std::vector<const edm4hep::ParticleIDCollection*>&,
+                              const edm4hep::ParticleIDCollection&)> {
+  JetFlavorTagWriter(const std::string& name, ISvcLocator* svcLoc)
+      : Consumer(name, svcLoc,
+                 {KeyValues("InputJets", {"RefinedVertexJets"}),
+                  KeyValues("FlavorTagCollections",
+                            {"RefinedJetTag_G", "RefinedJetTag_U", "RefinedJetTag_S", "RefinedJetTag_C",
+                             "RefinedJetTag_B", "RefinedJetTag_D", "RefinedJetTag_TAU"}),
+                  KeyValues("MCJetTag", {"MCJetTag"})}) {}
+
+  /// Destructor. Finishes pending entries before the branch buffers go away.
+  ~JetFlavorTagWriter() { m_asyncFiller.reset(); }
+
+  // operator
+  void operator()(const edm4hep::ReconstructedParticleCollection& jets,
+                  const std::vector<const edm4hep::ParticleIDCollection*>& tagCollections,
+                  const edm4hep::ParticleIDCollection& mcTags) const override {
+    const size_t n_jets = jets.size();
+    const size_t n_flavors = m_pdgFlavors.size();
+    try {
+      if (m_compactInput) {
+        m_table->fillCompact(jets, *tagCollections[0]);
+      } else {
+        m_table->fillPerFlavor(jets, tagCollections);
+      }
+    } catch (const std::invalid_argument& exc) {
+      error() << exc.what() << endmsg;
+      return;
+    }
+
+    // MC flavor, matched to the jets in the same way as the reco tags
+    m_mcPDGs.assign(n_jets, 0);
+    m_nMCTags.assign(n_jets, 0);
+    m_mcMatcher.reset();
+    m_mcMatcher.match(jets, mcTags, [&](size_t jet_pos, const edm4hep::ParticleID& tag) {
+      m_mcPDGs[jet_pos] = tag.getPDG();
+      ++m_nMCTags[jet_pos];
+    });
+    if (m_table->usedIndex() || m_mcMatcher.usedIndex()) {
+      ++m_nFallbackEvents;
+      debug() << "Tags are not aligned with the jets, used the hash index" << endmsg;
+    }
+
+    for (size_t i = 0; i < n_jets; ++i) {
+      bool untagged = true, missing = false, duplicate = m_nMCTags[i] > 1;
+      for (size_t f = 0; f < n_flavors; ++f) {
+        untagged &= m_table->nTags(i, f) == 0;
+        missing |= m_table->nTags(i, f) == 0;
+        duplicate |= m_table->nTags(i, f) > 1;
+      }
+      if (untagged) {
+        // e.g. skipped by the preselection of the JetTagger with SkippedJetTags = None
+        debug() << "No reco PID info found for jet" << endmsg;
+        ++m_untaggedJets;
+        continue;
+      }
+      if (m_table->isSkipped(i)) {
+        debug() << "Jet was skipped by the preselection" << endmsg;
+        ++m_skippedJets;
+        continue;
+      }
+      if (missing || m_nMCTags[i] == 0) {
+        error() << "No PID info found for jet!" << endmsg;
+        continue;
+      }
+      if (duplicate) {
+        error() << "More than one PID info for one flavor found for jet!" << endmsg;
+        continue;
+      }
+
+      bool known_flavor = false;
+      for (size_t f = 0; f < n_flavors; ++f) {
+        m_row.scores[f] = m_table->score(i, f);
+        m_row.isFlavor[f] = m_mcPDGs[i] == m_pdgFlavors[f];
+        known_flavor |= m_row.isFlavor[f] != 0;
+      }
+      m_row.provenance = static_cast<std::int32_t>(m_table->provenance(i));
+      if (!known_flavor) {
+        error() << "MC jet flavor " << m_mcPDGs[i] << " not found!" << endmsg;
+        continue;
+      }
+
+      fillTree();
+    }
+  }
+
+  // initialize
+  StatusCode initialize() override {
+    const auto memory_before = read_memory_usage();
+    if (Consumer::initialize().isFailure())
+      return StatusCode::FAILURE;
+
+    const auto& collection_names = inputLocations("FlavorTagCollections");
+    std::vector<std::string> flavor_names;
+    if (m_compactInput) {
+      if (collection_names.size() != 1) {
+        error() << "CompactInput requires exactly one collection in FlavorTagCollections" << endmsg;
+        return StatusCode::FAILURE;
+      }
+      // flavor order from the property or from the metadata written by the JetTagger
+      flavor_names = m_compactFlavorNames.value();
+      if (flavor_names.empty()) {
+        const auto param_names = k4FWCore::getParameter<std::vector<std::string>>(
+            podio::collMetadataParamName(collection_names[0], edm4hep::labels::PIDParameterNames), this);
+        if (!param_names) {
+          error() << "No flavor names found in the metadata of " << collection_names[0] << ", set FlavorNames"
+                  << endmsg;
+          return StatusCode::FAILURE;
+        }
+        flavor_names = *param_names;
+      }
+    } else {
+      // flavor of each collection from its name, e.g. RefinedJetTag_B -> recojet_isB
+      for (const auto& collection_name : collection_names) {
+        const auto pos = collection_name.find_last_of('_');
+        flavor_names.push_back("recojet_is" +
+                               (pos == std::string::npos ? collection_name : collection_name.substr(pos + 1)));
+      }
+    }
+    for (const auto& flavor : flavor_names) {
+      const auto pdg_it = to_PDGflavor.find(flavor);
+      if (pdg_it == to_PDGflavor.end()) {
+        error() << "Unknown jet flavor " << flavor << ", must be recojet_isX with X one of G, U, D, S, C, B, TAU"
+                << endmsg;
+        return StatusCode::FAILURE;
+      }
+      m_flavorNames.push_back(flavor);
+      m_pdgFlavors.push_back(pdg_it->second);
+    }
+    m_table = std::make_unique<JetTagTable>(m_flavorNames.size());
+
+    m_ths = service("THistSvc", true);
+    if (!m_ths) {
+      error() << "Couldn't get THistSvc" << endmsg;
+      return StatusCode::FAILURE;
+    }
+
+    m_jettag = new TTree("JetTags", "Jet flavor tags");
+    if (m_ths->regTree("/rec/jetflags", m_jettag).isFailure()) {
+      error() << "Couldn't register jet flags tree" << endmsg;
+      return StatusCode::FAILURE;
+    }
+
+    // the branch buffers must not be resized after the branches were created
+    m_row.scores.resize(m_flavorNames.size());
+    m_row.isFlavor.resize(m_flavorNames.size());
+    m_treeRow = m_row;
+    for (size_t f = 0; f < m_flavorNames.size(); ++f) {
+      const std::string& flavor = m_flavorNames[f];
+      m_jettag->Branch(flavor.c_str(), &m_treeRow.isFlavor[f], (flavor + "/O").c_str());
+      m_jettag->Branch(("score_" + flavor).c_str(), &m_treeRow.scores[f], ("score_" + flavor + "/F").c_str());
+    }
+    m_jettag->Branch("recojet_provenance", &m_treeRow.provenance, "recojet_provenance/I");
+
+    const TreeIOSettings io_settings{m_compressionAlgorithm.value(), m_compressionLevel.value(), m_basketSize.value(),
+                                     m_autoFlush.value()};
+    try {
+      applyTreeIOSettings(m_jettag, io_settings);
+    } catch (const std::invalid_argument& exc) {
+      error() << "Invalid I/O settings for the output tree: " << exc.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (!io_settings.isDefault())
+      info() << "Output tree I/O settings: " << io_settings.toString() << endmsg;
+
+    if (m_asyncWrite) {
+      if (m_asyncQueueSize <= 0) {
+        error() << "AsyncQueueSize must be positive" << endmsg;
+        return StatusCode::FAILURE;
+      }
+      ROOT::EnableThreadSafety();
+      m_asyncFiller = std::make_unique<AsyncTreeFiller>(m_asyncQueueSize.value());
+    }
+
+    info() << "Writing the scores of " << m_flavorNames.size() << " flavors: " << m_flavorNames << endmsg;
+
+    m_initMemory = {memory_before, read_memory_usage()};
+    return StatusCode::SUCCESS;
+  }
+
+  // finalize
+  StatusCode finalize() override {
+    // all entries have to be in the tree before THistSvc writes the output file
+    if (m_asyncFiller) {
+      try {
+        m_asyncFiller->flush();
+      } catch (const std::exception& exc) {
+        error() << "Filling the output tree on the background thread failed: " << exc.what() << endmsg;
+        return StatusCode::FAILURE;
+      }
+      m_asyncFiller.reset();
+    }
+    if (m_nFallbackEvents > 0) {
+      info() << "Tags were not index-aligned with the jets in " << m_nFallbackEvents
+             << " events, the hash index was used" << endmsg;
+    }
+    if (m_untaggedJets.nEntries() > 0) {
+      info() << m_untaggedJets.nEntries() << " jets without reco tags were not written (e.g. skipped by the "
+             << "preselection of the JetTagger with SkippedJetTags = None)" << endmsg;
+    }
+    if (m_skippedJets.nEntries() > 0) {
+      info() << m_skippedJets.nEntries() << " jets with the placeholder tags of the preselection were not written"
+             << endmsg;
+    }
+    info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+
+    return Consumer::finalize();
+  }
+
+private:
+  /// Fill the tree with the current entry, on the background thread if AsyncWrite is set.
+  void fillTree() const {
+    auto fill = [this](const Row& row) {
+      std::copy(row.scores.begin(), row.scores.end(), m_treeRow.scores.begin());
+      std::copy(row.isFlavor.begin(), row.isFlavor.end(), m_treeRow.isFlavor.begin());
+      m_treeRow.provenance = row.provenance;
+      m_jettag->Fill();
+    };
+    if (m_asyncFiller) {
+      m_asyncFiller->submit([fill, row = m_row]() { fill(row); });
+    } else {
+      fill(m_row);
+    }
+  }
+
+  /// Values of one tree entry.
+  struct Row {
+    std::vector<float> scores;
+    std::vector<char> isFlavor; ///< stored as bool (/O); std::vector<bool> has no addressable elements
+    std::int32_t provenance{0}; ///< JetTagProvenance
+  };
+
+  std::vector<std::string> m_flavorNames; // e.g. "recojet_isX" with X being the jet flavor (G, U, S, C, B, D, TAU)
+  std::vector<int> m_pdgFlavors;
+
+  SmartIF<ITHistSvc> m_ths; ///< THistogram service
+  mutable TTree* m_jettag{nullptr};
+  mutable Row m_row;     ///< current entry, filled on the event thread
+  mutable Row m_treeRow; ///< branch buffers, only touched by the thread filling the tree
+  mutable std::unique_ptr<AsyncTreeFiller> m_asyncFiller; ///< only used with AsyncWrite
+
+  // per-event buffers, kept as members to reuse their memory
+  mutable std::unique_ptr<JetTagTable> m_table; ///< reco scores [jet][flavor]
+  mutable JetTagMatcher m_mcMatcher;
+  mutable std::vector<int> m_mcPDGs;           ///< [jet]
+  mutable std::vector<std::uint8_t> m_nMCTags; ///< [jet]
+  mutable size_t m_nFallbackEvents{0};
+  mutable Gaudi::Accumulators::Counter<> m_untaggedJets{this, "Jets without reco tags"};
+  mutable Gaudi::Accumulators::Counter<> m_skippedJets{this, "Jets skipped by the preselection"};
+  MemoryDelta m_initMemory; ///< RSS taken by initialize()
+
+  Gaudi::Property<bool> m_compactInput{
+      this, "CompactInput", false,
+      "FlavorTagCollections is one collection with the scores of all flavors in the ParticleID parameters"};
+  Gaudi::Property<std::vector<std::string>> m_compactFlavorNames{
+      this, "FlavorNames", {}, "Flavor order of the CompactInput (e.g. recojet_isG), empty to read it from metadata"};
+  Gaudi::Property<std::string> m_compressionAlgorithm{
+      this, "CompressionAlgorithm", "",
+      "Compression algorithm of the output tree (ZLIB, LZMA, LZ4, ZSTD), empty to use the setting of the output file"};
+  Gaudi::Property<int> m_compressionLevel{this, "CompressionLevel", -1,
+                                          "Compression level (0-9) of the output tree, -1 for the algorithm default"};
+  Gaudi::Property<int> m_basketSize{this, "BasketSize", 0, "Basket size in bytes of every branch, 0 for ROOT default"};
+  Gaudi::Property<long long> m_autoFlush{
+      this, "AutoFlush", 0,
+      "Flush the baskets every N entries (N > 0) or every -N bytes (N < 0), 0 for ROOT default. Overrides THistSvc"};
+  Gaudi::Property<bool> m_asyncWrite{
+      this, "AsyncWrite", false,
+      "Fill the tree (basket compression and disk writes) on a background thread instead of the event thread"};
+  Gaudi::Property<int> m_asyncQueueSize{
+      this, "AsyncQueueSize", 1000,
+      "Maximum number of jets queued for the background thread before the event thread waits (AsyncWrite only)"};
+};
+
+DECLARE_COMPONENT(JetFlavorTagWriter)
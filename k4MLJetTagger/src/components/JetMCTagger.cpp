@@ -23,89 +23,110 @@
 
 #include "edm4hep/MCParticleCollection.h"
 #include <edm4hep/ParticleIDCollection.h>
+#include <edm4hep/RecoMCParticleLinkCollection.h>
 #include <edm4hep/ReconstructedParticleCollection.h>
 
-#include <cmath> // For std::abs
-#include <fstream>
-
-#include "Helpers.h"
-#include "WeaverInterface.h"
-
-int findMCPIDfromHiggsDaughters(const edm4hep::MCParticleCollection& MCParticles, MsgStream& log) {
-  // find the MC PID of the jet by looking at the MC Higgs Boson and finding its daughters
-  // WARNING: This uses the assumption of H(jj)Z(vv) events!!!
-
-  // find the MC Higgs Boson
-  int HiggsPID = 25;
-  std::set<int> expectedFlavors = {1, 2, 3, 4, 5, 15, 21}; // u,d,s,c,b,tau,g
-  std::vector<int> HiggsDaughtersPDG;
-  for (const auto& MCParticle : MCParticles) {                 // loop over all MC particles
-    if (MCParticle.getPDG() == HiggsPID) {                     // find the Higgs
-      for (const auto& daughter : MCParticle.getDaughters()) { // find the daughters of the Higgs Boson
-        int daughterPID = daughter.getPDG();
-        HiggsDaughtersPDG.push_back(daughterPID);
-      }
-    }
-  }
-  // check if the daughters are all the same (ignoring signs)
-  if (HiggsDaughtersPDG.size() == 2 && HiggsDaughtersPDG[0] == -HiggsDaughtersPDG[1]) {
-    int j_pid = std::abs(HiggsDaughtersPDG[0]);
-    if (expectedFlavors.count(j_pid) == 1) {
-      return j_pid;
-    }
-  } else if (HiggsDaughtersPDG.size() == 2 && HiggsDaughtersPDG[0] == 21 && HiggsDaughtersPDG[1] == 21) {
-    // if the daughters are gluons they don't have opposite sign
-    return 21;
-
-  } else {
-    log << MSG::WARNING
-        << "Higgs Boson has more than 2 daughters or they are not the same. Returning dummy value 0 for MC jet flavor."
-        << endmsg;
-    return 0; // dummy value
-  }
-  log << MSG::WARNING
-      << "Something went wrong with determining the Higgs daughters. Returning dummy value 0 for MC jet flavor."
-      << endmsg;
-  return 0; // dummy value
-}
+#include <string>
+#include <vector>
+
+#include "EventMCTruth.h"
+#include "MemoryUsage.h"
 
 /**
  * @class JetMCTagger
  * @brief Gaudi transformer that attaches a edm4hep::ParticleIDCollection object "MCJetTag" to each jet in the input
  * collection "RefinedVertexJets".
  *
- * WARNING: This uses the assumption of H(jj)Z(vv) events!!!
- * The function loops over all jets in the input collection and attaches a ParticleID object to each jet by looking at
- * the MC Higgs Boson and finding its daughters. In the future, the function "findMCPIDfromHiggsDaughters" should be
- * replaced by a more general function that can be used for any event topology.
+ * The truth information is collected once per event in EventMCTruth (one pass over the MC particles), the label of
+ * each jet is then a lookup. The labelling is chosen with the property Labelling:
+ * - "HiggsDaughters" (default): every jet gets the flavor of the daughters of the MC Higgs Boson.
+ *   WARNING: This uses the assumption of H(jj)Z(vv) events!!!
+ * - "DeltaR": general hadron/parton based labelling for any event topology. b and c hadrons, taus, quarks and gluons
+ *   are associated to the closest jet within MaxDeltaR through an eta-phi grid, so that large inclusive samples can be
+ *   labelled in linear time (see EventMCTruth::jetFlavorsDeltaR()).
+ * - "Links": jet-by-jet labelling from the energy-weighted MC ancestry of the jet constituents, followed through the
+ *   reco-to-MC link collections given in RecoMCLinks (see EventMCTruth::jetFlavorsFromLinks()). Suited for multi-jet
+ *   topologies, where the jets of an event have different flavors.
  *
  * @author Sara Aumiller
  */
-struct JetMCTagger : k4FWCore::Transformer<edm4hep::ParticleIDCollection(
-                         const edm4hep::ReconstructedParticleCollection&, const edm4hep::MCParticleCollection&)> {
+struct JetMCTagger
+    : k4FWCore::Transformer<edm4hep::ParticleIDCollection(
+          const edm4hep::ReconstructedParticleCollection&, const edm4hep::MCParticleCollection&,
+          const std::vector<const edm4hep::RecoMCParticleLinkCollection*>&)> {
   JetMCTagger(const std::string& name, ISvcLocator* svcLoc)
       : Transformer(name, svcLoc,
-                    {KeyValues("InputJets", {"RefinedVertexJets"}), KeyValues("MCParticles", {"MCParticles"})},
+                    {KeyValues("InputJets", {"RefinedVertexJets"}), KeyValues("MCParticles", {"MCParticles"}),
+                     KeyValues("RecoMCLinks", {})},
                     {KeyValues("OutputIDCollection", {"MCJetTag"})}) {}
 
   // initialize
 
   StatusCode initialize() override {
-    warning() << "!!! Finding the MC PID of jets uses the assumption of H(jj)Z(vv) events!!! " << endmsg;
+    const auto memory_before = read_memory_usage();
+    if (m_labelling == "DeltaR") {
+      if (m_maxDeltaR <= 0.) {
+        error() << "MaxDeltaR must be positive" << endmsg;
+        return StatusCode::FAILURE;
+      }
+      m_mode = Mode::kDeltaR;
+      info() << "Labelling jets with the b/c hadrons, taus and partons within Delta R < " << m_maxDeltaR.value()
+             << endmsg;
+    } else if (m_labelling == "Links") {
+      if (inputLocations("RecoMCLinks").empty()) {
+        error() << "The Links labelling needs at least one collection in RecoMCLinks" << endmsg;
+        return StatusCode::FAILURE;
+      }
+      m_mode = Mode::kLinks;
+      info() << "Labelling jets with the MC ancestry of their constituents from " << inputLocations("RecoMCLinks")
+             << endmsg;
+    } else if (m_labelling == "HiggsDaughters") {
+      warning() << "!!! Finding the MC PID of jets uses the assumption of H(jj)Z(vv) events!!! " << endmsg;
+    } else {
+      error() << "Unknown Labelling '" << m_labelling.value() << "', must be HiggsDaughters, DeltaR or Links"
+              << endmsg;
+      return StatusCode::FAILURE;
+    }
 
+    m_initMemory = {memory_before, read_memory_usage()};
     return StatusCode::SUCCESS;
   }
 
+  // finalize
+
+  StatusCode finalize() override {
+    info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+    return Transformer::finalize();
+  }
+
   // operator
 
-  edm4hep::ParticleIDCollection operator()(const edm4hep::ReconstructedParticleCollection& inputJets,
-                                           const edm4hep::MCParticleCollection& MCParticles) const override {
+  edm4hep::ParticleIDCollection
+  operator()(const edm4hep::ReconstructedParticleCollection& inputJets,
+             const edm4hep::MCParticleCollection& MCParticles,
+             const std::vector<const edm4hep::RecoMCParticleLinkCollection*>& recoMCLinks) const override {
     // info() << "Finding MC PID of " << inputJets.size() << " input jets" << endmsg;
 
     auto tagCollection = edm4hep::ParticleIDCollection();
 
-    for (const auto& jet : inputJets) {
-      int MCflavor = findMCPIDfromHiggsDaughters(MCParticles, msg());
+    std::vector<int> jetFlavors;
+    if (m_mode == Mode::kLinks) {
+      // walks up from the linked MC particles only, no pass over the whole MC record
+      jetFlavors = EventMCTruth::jetFlavorsFromLinks(inputJets, recoMCLinks, m_minEnergyFraction);
+    } else if (const EventMCTruth truth(MCParticles); m_mode == Mode::kDeltaR) {
+      // truth information of the event, independent of the jet
+      jetFlavors = truth.jetFlavorsDeltaR(inputJets, m_maxDeltaR);
+    } else {
+      if (!truth.higgsDaughterProblem().empty() && !inputJets.empty()) {
+        warning() << truth.higgsDaughterProblem() << ". Returning dummy value 0 for MC jet flavor of "
+                  << inputJets.size() << " jets." << endmsg;
+      }
+      jetFlavors.assign(inputJets.size(), truth.jetFlavor());
+    }
+
+    for (size_t i = 0; i < inputJets.size(); ++i) {
+      const auto jet = inputJets[i];
+      const int MCflavor = jetFlavors[i];
 
       auto jetTag = tagCollection.create();
       jetTag.setParticle(jet);
@@ -114,6 +135,20 @@ struct JetMCTagger : k4FWCore::Transformer<edm4hep::ParticleIDCollection(
 
     return tagCollection;
   };
+
+private:
+  Gaudi::Property<std::string> m_labelling{
+      this, "Labelling", "HiggsDaughters",
+      "MC jet labelling: HiggsDaughters (H(jj)Z(vv) events only), DeltaR or Links"};
+  Gaudi::Property<double> m_maxDeltaR{
+      this, "MaxDeltaR", 1.0, "Maximum Delta R between a flavor particle and the jet axis (DeltaR labelling only)"};
+  Gaudi::Property<double> m_minEnergyFraction{
+      this, "MinEnergyFraction", 0.1,
+      "Minimum fraction of the jet energy from b hadron (c hadron, tau) decays for a b (c, tau) label (Links only)"};
+
+  enum class Mode { kHiggsDaughters, kDeltaR, kLinks };
+  Mode m_mode{Mode::kHiggsDaughters};
+  MemoryDelta m_initMemory; ///< RSS taken by initialize()
 };
 
 DECLARE_COMPONENT(JetMCTagger)
@@ -18,6 +18,7 @@
  */
 
 #include "JetObsWriter.h"
+#include "Helpers.h"
 #include "Structs.h"
 
 #include <edm4hep/ParticleIDCollection.h>
@@ -26,8 +27,83 @@
 
 #include "GaudiKernel/MsgStream.h"
 
+#include "TROOT.h"
 #include "TTree.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "TreeIOSettings.h"
+
+namespace {
+// all observables of a jet constituent, stored in the order of Pfcand::get_attribute_names()
+const std::map<std::string, float Pfcand::*> kFloatObservables = {
+    {"pfcand_erel_log", &Pfcand::pfcand_erel_log},
+    {"pfcand_thetarel", &Pfcand::pfcand_thetarel},
+    {"pfcand_phirel", &Pfcand::pfcand_phirel},
+    {"pfcand_e", &Pfcand::pfcand_e},
+    {"pfcand_p", &Pfcand::pfcand_p},
+    {"pfcand_dndx", &Pfcand::pfcand_dndx},
+    {"pfcand_tof", &Pfcand::pfcand_tof},
+    {"pfcand_cov_omegaomega", &Pfcand::pfcand_cov_omegaomega},
+    {"pfcand_cov_tanLambdatanLambda", &Pfcand::pfcand_cov_tanLambdatanLambda},
+    {"pfcand_cov_phiphi", &Pfcand::pfcand_cov_phiphi},
+    {"pfcand_cov_d0d0", &Pfcand::pfcand_cov_d0d0},
+    {"pfcand_cov_z0z0", &Pfcand::pfcand_cov_z0z0},
+    {"pfcand_cov_d0z0", &Pfcand::pfcand_cov_d0z0},
+    {"pfcand_cov_phid0", &Pfcand::pfcand_cov_phid0},
+    {"pfcand_cov_tanLambdaz0", &Pfcand::pfcand_cov_tanLambdaz0},
+    {"pfcand_cov_d0omega", &Pfcand::pfcand_cov_d0omega},
+    {"pfcand_cov_d0tanLambda", &Pfcand::pfcand_cov_d0tanLambda},
+    {"pfcand_cov_phiomega", &Pfcand::pfcand_cov_phiomega},
+    {"pfcand_cov_phiz0", &Pfcand::pfcand_cov_phiz0},
+    {"pfcand_cov_phitanLambda", &Pfcand::pfcand_cov_phitanLambda},
+    {"pfcand_cov_omegaz0", &Pfcand::pfcand_cov_omegaz0},
+    {"pfcand_cov_omegatanLambda", &Pfcand::pfcand_cov_omegatanLambda},
+    {"pfcand_d0", &Pfcand::pfcand_d0},
+    {"pfcand_z0", &Pfcand::pfcand_z0},
+    {"pfcand_Sip2dVal", &Pfcand::pfcand_Sip2dVal},
+    {"pfcand_Sip2dSig", &Pfcand::pfcand_Sip2dSig},
+    {"pfcand_Sip3dVal", &Pfcand::pfcand_Sip3dVal},
+    {"pfcand_Sip3dSig", &Pfcand::pfcand_Sip3dSig},
+    {"pfcand_JetDistVal", &Pfcand::pfcand_JetDistVal},
+    {"pfcand_JetDistSig", &Pfcand::pfcand_JetDistSig},
+};
+const std::map<std::string, int Pfcand::*> kIntObservables = {
+    {"pfcand_type", &Pfcand::pfcand_type},
+    {"pfcand_charge", &Pfcand::pfcand_charge},
+    {"pfcand_isEl", &Pfcand::pfcand_isEl},
+    {"pfcand_isMu", &Pfcand::pfcand_isMu},
+    {"pfcand_isGamma", &Pfcand::pfcand_isGamma},
+    {"pfcand_isChargedHad", &Pfcand::pfcand_isChargedHad},
+    {"pfcand_isNeutralHad", &Pfcand::pfcand_isNeutralHad},
+};
+// replaced by the pfcand_pidFlags bitfield if PackPIDFlags is set
+bool isPIDFlag(const std::string& name) {
+  return name == "pfcand_isEl" || name == "pfcand_isMu" || name == "pfcand_isGamma" || name == "pfcand_isChargedHad" ||
+         name == "pfcand_isNeutralHad";
+}
+
+/// Mantissa bits of an observable from the MantissaBits property: exact name first, then the longest prefix pattern.
+int mantissaBitsFor(const std::string& name, const std::map<std::string, int>& config) {
+  if (const auto it = config.find(name); it != config.end())
+    return it->second;
+  int bits = 23;
+  size_t best_length = 0;
+  for (const auto& [pattern, pattern_bits] : config) {
+    if (pattern.empty() || pattern.back() != '*')
+      continue;
+    const auto prefix = pattern.substr(0, pattern.size() - 1);
+    if (name.compare(0, prefix.size(), prefix) == 0 && prefix.size() >= best_length) {
+      bits = pattern_bits;
+      best_length = prefix.size();
+    }
+  }
+  return bits;
+}
+} // namespace
+
 DECLARE_COMPONENT(JetObsWriter)
 
 JetObsWriter::JetObsWriter(const std::string& name, ISvcLocator* svcLoc) : Gaudi::Algorithm(name, svcLoc) {
@@ -36,6 +112,7 @@ JetObsWriter::JetObsWriter(const std::string& name, ISvcLocator* svcLoc) : Gaudi
 }
 
 StatusCode JetObsWriter::initialize() {
+  const auto memory_before = read_memory_usage();
   if (Gaudi::Algorithm::initialize().isFailure())
     return StatusCode::FAILURE;
 
@@ -45,6 +122,54 @@ StatusCode JetObsWriter::initialize() {
     return StatusCode::FAILURE;
   }
 
+  for (const auto& [pattern, bits] : m_mantissaBits) {
+    if (bits < 0 || bits > 23) {
+      error() << "MantissaBits for '" << pattern << "' must be within [0, 23], got " << bits << endmsg;
+      return StatusCode::FAILURE;
+    }
+    const bool is_prefix = !pattern.empty() && pattern.back() == '*';
+    const auto prefix = is_prefix ? pattern.substr(0, pattern.size() - 1) : pattern;
+    const bool matches = std::any_of(kFloatObservables.begin(), kFloatObservables.end(), [&](const auto& obs) {
+      return is_prefix ? obs.first.compare(0, prefix.size(), prefix) == 0 : obs.first == pattern;
+    });
+    if (!matches) {
+      error() << "MantissaBits entry '" << pattern << "' does not match any float observable" << endmsg;
+      return StatusCode::FAILURE;
+    }
+  }
+
+  // observables to write: all, or the ones requested explicitly and/or needed by the model
+  std::vector<std::string> requested = m_variables.value();
+  if (!m_jsonPath.empty()) {
+    const auto json_config = loadJsonFile(m_jsonPath);
+    if (json_config.is_null()) {
+      error() << "Could not load the preprocessing JSON file " << m_jsonPath.value() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    try {
+      for (const auto& input : json_config.at("input_names")) { // pf_points, pf_features, pf_vectors, pf_mask
+        for (const auto& var : json_config.at(input.get<std::string>()).at("var_names")) {
+          requested.push_back(var.get<std::string>());
+        }
+      }
+    } catch (const nlohmann::json::exception& exc) {
+      error() << "Failed to read the input variables from " << m_jsonPath.value() << ": " << exc.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+  }
+  VarMapper mapper;
+  for (const auto& name : requested) {
+    const bool is_key4hep = kFloatObservables.count(name) || kIntObservables.count(name);
+    const std::string key4hep_name = is_key4hep ? name : mapper.mapFCCAnToKey4hep(name);
+    if (key4hep_name.empty()) {
+      if (name.find("_mask") != std::string::npos)
+        continue; // the mask is created by the preprocessing
+      error() << "Unknown constituent observable '" << name << "'" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    m_selectedObservables.insert(key4hep_name);
+  }
+
   m_jetcst = new TTree("JetConstituentObservables", "Jet-Constituent Observables");
   if (m_ths->regTree("/rec/jetconst", m_jetcst).isFailure()) {
     error() << "Couldn't register jet constituent tree" << endmsg;
@@ -52,11 +177,42 @@ StatusCode JetObsWriter::initialize() {
   }
 
   initializeTree();
+  m_row.floats.resize(m_floatColumns.size());
+  m_row.ints.resize(m_intColumns.size());
+
+  const TreeIOSettings io_settings{m_compressionAlgorithm.value(), m_compressionLevel.value(), m_basketSize.value(),
+                                   m_autoFlush.value()};
+  try {
+    applyTreeIOSettings(m_jetcst, io_settings);
+  } catch (const std::invalid_argument& exc) {
+    error() << "Invalid I/O settings for the output tree: " << exc.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
+  if (!io_settings.isDefault())
+    info() << "Output tree I/O settings: " << io_settings.toString() << endmsg;
+
+  if (m_asyncWrite) {
+    if (m_asyncQueueSize <= 0) {
+      error() << "AsyncQueueSize must be positive" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    ROOT::EnableThreadSafety();
+    m_asyncFiller = std::make_unique<AsyncTreeFiller>(m_asyncQueueSize.value());
+    info() << "Filling the output tree on a background thread (queue size " << m_asyncQueueSize.value() << ")"
+           << endmsg;
+  }
 
   // JetObservablesRetriever object
   m_retriever = new JetObservablesRetriever();
   m_retriever->Bz = 2.0; // hardcoded for now
+  if (!m_selectedObservables.empty()) {
+    m_retriever->groups = JetObservablesRetriever::needed_groups(
+        std::vector<std::string>(m_selectedObservables.begin(), m_selectedObservables.end()));
+    info() << "Writing " << m_floatColumns.size() + m_intColumns.size() << " constituent observables"
+           << (m_pfcandPIDFlags ? " and the packed PID flags" : "") << endmsg;
+  }
 
+  m_initMemory = {memory_before, read_memory_usage()};
   return StatusCode::SUCCESS;
 }
 
@@ -76,190 +232,185 @@ StatusCode JetObsWriter::execute(const EventContext&) const {
   for (const auto& jet : jet_coll) { // loop over all jets in the event
     cleanTree();
     Jet j = m_retriever->retrieve_input_observables(jet, prim_vertex_coll); // get all observables
-    for (const auto& pfc : j.constituents) {                                // loop over all jet constituents / pfcands
-      m_pfcandErelLog->push_back(pfc.pfcand_erel_log);
-      m_pfcandThetarel->push_back(pfc.pfcand_thetarel);
-      m_pfcandPhirel->push_back(pfc.pfcand_phirel);
-      m_pfcandE->push_back(pfc.pfcand_e);
-      m_pfcandP->push_back(pfc.pfcand_p);
-      m_pfcandType->push_back(pfc.pfcand_type);
-      m_pfcandCharge->push_back(pfc.pfcand_charge);
-      m_pfcandIsEl->push_back(pfc.pfcand_isEl);
-      m_pfcandIsMu->push_back(pfc.pfcand_isMu);
-      m_pfcandIsGamma->push_back(pfc.pfcand_isGamma);
-      m_pfcandIsChargedHad->push_back(pfc.pfcand_isChargedHad);
-      m_pfcandIsNeutralHad->push_back(pfc.pfcand_isNeutralHad);
-      m_pfcandDndx->push_back(pfc.pfcand_dndx);
-      m_pfcandTof->push_back(pfc.pfcand_tof);
-      m_pfcandCovOmegaOmega->push_back(pfc.pfcand_cov_omegaomega);
-      m_pfcandCovTanLambdaTanLambda->push_back(pfc.pfcand_cov_tanLambdatanLambda);
-      m_pfcandCovPhiPhi->push_back(pfc.pfcand_cov_phiphi);
-      m_pfcandCovD0D0->push_back(pfc.pfcand_cov_d0d0);
-      m_pfcandCovZ0Z0->push_back(pfc.pfcand_cov_z0z0);
-      m_pfcandCovD0Z0->push_back(pfc.pfcand_cov_d0z0);
-      m_pfcandCovPhiD0->push_back(pfc.pfcand_cov_phid0);
-      m_pfcandCovTanLambdaZ0->push_back(pfc.pfcand_cov_tanLambdaz0);
-      m_pfcandCovD0Omega->push_back(pfc.pfcand_cov_d0omega);
-      m_pfcandCovD0TanLambda->push_back(pfc.pfcand_cov_d0tanLambda);
-      m_pfcandCovPhiOmega->push_back(pfc.pfcand_cov_phiomega);
-      m_pfcandCovPhiZ0->push_back(pfc.pfcand_cov_phiz0);
-      m_pfcandCovPhiTanLambda->push_back(pfc.pfcand_cov_phitanLambda);
-      m_pfcandCovOmegaZ0->push_back(pfc.pfcand_cov_omegaz0);
-      m_pfcandCovOmegaTanLambda->push_back(pfc.pfcand_cov_omegatanLambda);
-      m_pfcandD0->push_back(pfc.pfcand_d0);
-      m_pfcandZ0->push_back(pfc.pfcand_z0);
-      m_pfcandSip2dVal->push_back(pfc.pfcand_Sip2dVal);
-      m_pfcandSip2dSig->push_back(pfc.pfcand_Sip2dSig);
-      m_pfcandSip3dVal->push_back(pfc.pfcand_Sip3dVal);
-      m_pfcandSip3dSig->push_back(pfc.pfcand_Sip3dSig);
-      m_pfcandJetDistVal->push_back(pfc.pfcand_JetDistVal);
-      m_pfcandJetDistSig->push_back(pfc.pfcand_JetDistSig);
+    for (size_t i = 0; i < m_floatColumns.size(); ++i) {
+      auto& column = m_floatColumns[i];
+      auto& values = m_row.floats[i];
+      for (const auto& pfc : j.constituents) { // loop over all jet constituents / pfcands
+        const float value = pfc.*column.member;
+        if (column.mantissaBits == 23) {
+          values.push_back(value);
+          continue;
+        }
+        const float stored = truncate_mantissa(value, column.mantissaBits);
+        values.push_back(stored);
+        // quantization error
+        const double abs_error = std::abs(double(stored) - double(value));
+        const double rel_error = value != 0 ? abs_error / std::abs(double(value)) : 0.;
+        column.maxAbsError = std::max(column.maxAbsError, abs_error);
+        column.maxRelError = std::max(column.maxRelError, rel_error);
+        column.sumRelError2 += rel_error * rel_error;
+        ++column.nValues;
+      }
+    }
+    for (size_t i = 0; i < m_intColumns.size(); ++i) {
+      for (const auto& pfc : j.constituents) {
+        m_row.ints[i].push_back(pfc.*m_intColumns[i].member);
+      }
+    }
+    if (m_pfcandPIDFlags) {
+      for (const auto& pfc : j.constituents) {
+        const std::uint8_t flags = pack_pid_flags(pfc);
+        for (const int flag : {pfc.pfcand_isEl, pfc.pfcand_isMu, pfc.pfcand_isGamma, pfc.pfcand_isChargedHad,
+                               pfc.pfcand_isNeutralHad}) {
+          if (flag != 0 && flag != 1) {
+            ++m_nLossyPIDFlags;
+            break;
+          }
+        }
+        m_row.pidFlags.push_back(flags);
+      }
     }
     // PV variables
-    const edm4hep::Vector3f prim_vertex = m_retriever->get_primary_vertex(prim_vertex_coll);
-    m_jetPVx = prim_vertex.x;
-    m_jetPVy = prim_vertex.y;
-    m_jetPVz = prim_vertex.z;
+    if (m_writePrimaryVertex) {
+      const edm4hep::Vector3f prim_vertex = m_retriever->get_primary_vertex(prim_vertex_coll);
+      m_row.pvX = prim_vertex.x;
+      m_row.pvY = prim_vertex.y;
+      m_row.pvZ = prim_vertex.z;
+    }
 
-    m_jetcst->Fill();
+    size_t row_bytes = m_row.pidFlags.capacity();
+    for (const auto& values : m_row.floats)
+      row_bytes += values.capacity() * sizeof(float);
+    for (const auto& values : m_row.ints)
+      row_bytes += values.capacity() * sizeof(int);
+    m_maxRowBytes = std::max(m_maxRowBytes, row_bytes);
+
+    fillTree();
   }
 
   return StatusCode::SUCCESS;
 }
 
 void JetObsWriter::initializeTree() {
-  m_pfcandErelLog = new std::vector<float>();
-  m_pfcandThetarel = new std::vector<float>();
-  m_pfcandPhirel = new std::vector<float>();
-  m_pfcandE = new std::vector<float>();
-  m_pfcandP = new std::vector<float>();
-  m_pfcandType = new std::vector<int>();
-  m_pfcandCharge = new std::vector<int>();
-  m_pfcandIsEl = new std::vector<int>();
-  m_pfcandIsMu = new std::vector<int>();
-  m_pfcandIsGamma = new std::vector<int>();
-  m_pfcandIsChargedHad = new std::vector<int>();
-  m_pfcandIsNeutralHad = new std::vector<int>();
-  m_pfcandDndx = new std::vector<float>();
-  m_pfcandTof = new std::vector<float>();
-  m_pfcandCovOmegaOmega = new std::vector<float>();
-  m_pfcandCovTanLambdaTanLambda = new std::vector<float>();
-  m_pfcandCovPhiPhi = new std::vector<float>();
-  m_pfcandCovD0D0 = new std::vector<float>();
-  m_pfcandCovZ0Z0 = new std::vector<float>();
-  m_pfcandCovD0Z0 = new std::vector<float>();
-  m_pfcandCovPhiD0 = new std::vector<float>();
-  m_pfcandCovTanLambdaZ0 = new std::vector<float>();
-  m_pfcandCovD0Omega = new std::vector<float>();
-  m_pfcandCovD0TanLambda = new std::vector<float>();
-  m_pfcandCovPhiOmega = new std::vector<float>();
-  m_pfcandCovPhiZ0 = new std::vector<float>();
-  m_pfcandCovPhiTanLambda = new std::vector<float>();
-  m_pfcandCovOmegaZ0 = new std::vector<float>();
-  m_pfcandCovOmegaTanLambda = new std::vector<float>();
-  m_pfcandD0 = new std::vector<float>();
-  m_pfcandZ0 = new std::vector<float>();
-  m_pfcandSip2dVal = new std::vector<float>();
-  m_pfcandSip2dSig = new std::vector<float>();
-  m_pfcandSip3dVal = new std::vector<float>();
-  m_pfcandSip3dSig = new std::vector<float>();
-  m_pfcandJetDistVal = new std::vector<float>();
-  m_pfcandJetDistSig = new std::vector<float>();
-
-  m_jetcst->Branch("pfcand_erel_log", &m_pfcandErelLog);
-  m_jetcst->Branch("pfcand_thetarel", &m_pfcandThetarel);
-  m_jetcst->Branch("pfcand_phirel", &m_pfcandPhirel);
-  m_jetcst->Branch("pfcand_e", &m_pfcandE);
-  m_jetcst->Branch("pfcand_p", &m_pfcandP);
-  m_jetcst->Branch("pfcand_type", &m_pfcandType);
-  m_jetcst->Branch("pfcand_charge", &m_pfcandCharge);
-  m_jetcst->Branch("pfcand_isEl", &m_pfcandIsEl);
-  m_jetcst->Branch("pfcand_isMu", &m_pfcandIsMu);
-  m_jetcst->Branch("pfcand_isGamma", &m_pfcandIsGamma);
-  m_jetcst->Branch("pfcand_isChargedHad", &m_pfcandIsChargedHad);
-  m_jetcst->Branch("pfcand_isNeutralHad", &m_pfcandIsNeutralHad);
-  m_jetcst->Branch("pfcand_dndx", &m_pfcandDndx);
-  m_jetcst->Branch("pfcand_tof", &m_pfcandTof);
-  m_jetcst->Branch("pfcand_cov_omegaomega", &m_pfcandCovOmegaOmega);
-  m_jetcst->Branch("pfcand_cov_tanLambdatanLambda", &m_pfcandCovTanLambdaTanLambda);
-  m_jetcst->Branch("pfcand_cov_phiphi", &m_pfcandCovPhiPhi);
-  m_jetcst->Branch("pfcand_cov_d0d0", &m_pfcandCovD0D0);
-  m_jetcst->Branch("pfcand_cov_z0z0", &m_pfcandCovZ0Z0);
-  m_jetcst->Branch("pfcand_cov_d0z0", &m_pfcandCovD0Z0);
-  m_jetcst->Branch("pfcand_cov_phid0", &m_pfcandCovPhiD0);
-  m_jetcst->Branch("pfcand_cov_tanLambdaz0", &m_pfcandCovTanLambdaZ0);
-  m_jetcst->Branch("pfcand_cov_d0omega", &m_pfcandCovD0Omega);
-  m_jetcst->Branch("pfcand_cov_d0tanLambda", &m_pfcandCovD0TanLambda);
-  m_jetcst->Branch("pfcand_cov_phiomega", &m_pfcandCovPhiOmega);
-  m_jetcst->Branch("pfcand_cov_phiz0", &m_pfcandCovPhiZ0);
-  m_jetcst->Branch("pfcand_cov_phitanLambda", &m_pfcandCovPhiTanLambda);
-  m_jetcst->Branch("pfcand_cov_omegaz0", &m_pfcandCovOmegaZ0);
-  m_jetcst->Branch("pfcand_cov_omegatanLambda", &m_pfcandCovOmegaTanLambda);
-  m_jetcst->Branch("pfcand_d0", &m_pfcandD0);
-  m_jetcst->Branch("pfcand_z0", &m_pfcandZ0);
-  m_jetcst->Branch("pfcand_Sip2dVal", &m_pfcandSip2dVal);
-  m_jetcst->Branch("pfcand_Sip2dSig", &m_pfcandSip2dSig);
-  m_jetcst->Branch("pfcand_Sip3dVal", &m_pfcandSip3dVal);
-  m_jetcst->Branch("pfcand_Sip3dSig", &m_pfcandSip3dSig);
-  m_jetcst->Branch("pfcand_JetDistVal", &m_pfcandJetDistVal);
-  m_jetcst->Branch("pfcand_JetDistSig", &m_pfcandJetDistSig);
+  // branches are booked in the order of Pfcand::get_attribute_names(); reserve so the column buffers never move
+  const auto names = Pfcand().get_attribute_names();
+  m_floatColumns.reserve(names.size());
+  m_intColumns.reserve(names.size());
+  for (const auto& name : names) {
+    if (!m_selectedObservables.empty() && !m_selectedObservables.count(name))
+      continue;
+    const auto float_it = kFloatObservables.find(name);
+    const auto int_it = kIntObservables.find(name);
+    if (float_it != kFloatObservables.end()) {
+      const int bits = mantissaBitsFor(name, m_mantissaBits.value());
+      auto& column = m_floatColumns.emplace_back(FloatColumn{name, float_it->second, bits});
+      column.values = new std::vector<float>();
+      m_jetcst->Branch(name.c_str(), &column.values);
+    } else if (int_it != kIntObservables.end() && !(m_packPIDFlags && isPIDFlag(name))) {
+      auto& column = m_intColumns.emplace_back(IntColumn{name, int_it->second});
+      column.values = new std::vector<int>();
+      m_jetcst->Branch(name.c_str(), &column.values);
+    } else if (isPIDFlag(name) && !m_pfcandPIDFlags) { // the bitfield replaces the PID flags at the first position
+      m_pfcandPIDFlags = new std::vector<std::uint8_t>();
+      m_jetcst->Branch("pfcand_pidFlags", &m_pfcandPIDFlags);
+    }
+  }
 
   // PV variables
-  m_jetcst->Branch("jet_PV_x", &m_jetPVx);
-  m_jetcst->Branch("jet_PV_y", &m_jetPVy);
-  m_jetcst->Branch("jet_PV_z", &m_jetPVz);
+  if (m_writePrimaryVertex) {
+    m_jetcst->Branch("jet_PV_x", &m_jetPVx);
+    m_jetcst->Branch("jet_PV_y", &m_jetPVy);
+    m_jetcst->Branch("jet_PV_z", &m_jetPVz);
+  }
 
   return;
 }
 
 void JetObsWriter::cleanTree() const {
-  m_pfcandErelLog->clear();
-  m_pfcandThetarel->clear();
-  m_pfcandPhirel->clear();
-  m_pfcandE->clear();
-  m_pfcandP->clear();
-  m_pfcandType->clear();
-  m_pfcandCharge->clear();
-  m_pfcandIsEl->clear();
-  m_pfcandIsMu->clear();
-  m_pfcandIsGamma->clear();
-  m_pfcandIsChargedHad->clear();
-  m_pfcandIsNeutralHad->clear();
-  m_pfcandDndx->clear();
-  m_pfcandTof->clear();
-  m_pfcandCovOmegaOmega->clear();
-  m_pfcandCovTanLambdaTanLambda->clear();
-  m_pfcandCovPhiPhi->clear();
-  m_pfcandCovD0D0->clear();
-  m_pfcandCovZ0Z0->clear();
-  m_pfcandCovD0Z0->clear();
-  m_pfcandCovPhiD0->clear();
-  m_pfcandCovTanLambdaZ0->clear();
-  m_pfcandCovD0Omega->clear();
-  m_pfcandCovD0TanLambda->clear();
-  m_pfcandCovPhiOmega->clear();
-  m_pfcandCovPhiZ0->clear();
-  m_pfcandCovPhiTanLambda->clear();
-  m_pfcandCovOmegaZ0->clear();
-  m_pfcandCovOmegaTanLambda->clear();
-  m_pfcandD0->clear();
-  m_pfcandZ0->clear();
-  m_pfcandSip2dVal->clear();
-  m_pfcandSip2dSig->clear();
-  m_pfcandSip3dVal->clear();
-  m_pfcandSip3dSig->clear();
-  m_pfcandJetDistVal->clear();
-  m_pfcandJetDistSig->clear();
+  for (auto& values : m_row.floats) {
+    values.clear();
+  }
+  for (auto& values : m_row.ints) {
+    values.clear();
+  }
+  m_row.pidFlags.clear();
 
   float dummy_value = -999.0;
-  m_jetPVx = dummy_value;
-  m_jetPVy = dummy_value;
-  m_jetPVz = dummy_value;
+  m_row.pvX = dummy_value;
+  m_row.pvY = dummy_value;
+  m_row.pvZ = dummy_value;
 
   return;
 }
 
+void JetObsWriter::fillTree() const {
+  // swap the entry into the branch buffers; this keeps the allocated capacity of both
+  auto fill = [this](Row& row) {
+    for (size_t i = 0; i < m_floatColumns.size(); ++i) {
+      m_floatColumns[i].values->swap(row.floats[i]);
+    }
+    for (size_t i = 0; i < m_intColumns.size(); ++i) {
+      m_intColumns[i].values->swap(row.ints[i]);
+    }
+    if (m_pfcandPIDFlags) {
+      m_pfcandPIDFlags->swap(row.pidFlags);
+    }
+    m_jetPVx = row.pvX;
+    m_jetPVy = row.pvY;
+    m_jetPVz = row.pvZ;
+    m_jetcst->Fill();
+  };
+
+  if (m_asyncFiller) {
+    // the background thread gets its own copy, m_row is reused for the next jet
+    m_asyncFiller->submit([fill, row = m_row]() mutable { fill(row); });
+  } else {
+    fill(m_row);
+  }
+}
+
 StatusCode JetObsWriter::finalize() {
+  // all entries have to be in the tree before THistSvc writes the output file
+  if (m_asyncFiller) {
+    try {
+      m_asyncFiller->flush();
+    } catch (const std::exception& exc) {
+      error() << "Filling the output tree on the background thread failed: " << exc.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    info() << "Background tree filling: max. queue depth " << m_asyncFiller->maxQueueDepth() << ", event thread waited "
+           << m_asyncFiller->nBlocked() << " times for " << m_asyncFiller->blockedSeconds() << " s" << endmsg;
+    info() << "Largest entry in the queue: " << format_bytes(m_maxRowBytes) << ", up to "
+           << format_bytes(double(m_maxRowBytes) * m_asyncFiller->maxQueueDepth()) << " queued" << endmsg;
+    m_asyncFiller.reset();
+  }
+  info() << "Largest entry buffer (one jet): " << format_bytes(m_maxRowBytes) << endmsg;
+
+  // report the quantization error of all observables stored with reduced precision
+  bool header = true;
+  for (const auto& column : m_floatColumns) {
+    if (column.mantissaBits == 23)
+      continue;
+    if (header) {
+      info() << "Quantization error of observables stored with reduced precision:" << endmsg;
+      info() << std::setw(32) << std::left << "observable" << std::setw(6) << std::right << "bits" << std::setw(14)
+             << "max abs err" << std::setw(14) << "max rel err" << std::setw(14) << "rms rel err" << endmsg;
+      header = false;
+    }
+    const double rms_rel_error = column.nValues ? std::sqrt(column.sumRelError2 / column.nValues) : 0.;
+    info() << std::setw(32) << std::left << column.name << std::setw(6) << std::right << column.mantissaBits
+           << std::setw(14) << std::setprecision(3) << column.maxAbsError << std::setw(14) << column.maxRelError
+           << std::setw(14) << rms_rel_error << endmsg;
+  }
+  if (m_packPIDFlags) {
+    if (m_nLossyPIDFlags)
+      warning() << m_nLossyPIDFlags << " constituents had PID flags other than 0/1, stored as set bits" << endmsg;
+    else
+      info() << "PID flags packed into pfcand_pidFlags without loss" << endmsg;
+  }
+
+  info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+
   if (Gaudi::Algorithm::finalize().isFailure())
     return StatusCode::FAILURE;
 
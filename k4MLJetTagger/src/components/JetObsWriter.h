@@ -20,6 +20,7 @@
 #define JETOBSWRITER_H
 
 #include "Gaudi/Algorithm.h"
+#include "Gaudi/Property.h"
 #include "GaudiKernel/ITHistSvc.h"
 #include "k4FWCore/DataHandle.h"
 
@@ -27,7 +28,17 @@
 #include <edm4hep/ReconstructedParticleCollection.h>
 #include <edm4hep/VertexCollection.h>
 
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "AsyncTreeFiller.h"
+#include "MemoryUsage.h"
 #include "JetObservablesRetriever.h"
+#include "Structs.h"
 
 /**
  * @class JetObsWriter
@@ -41,6 +52,17 @@
  * JetObservablesRetriever. It then dumps all the information into a TTree. The output root file can be used for
  * training a neural network for jet tagging.
  *
+ * The written observables can be restricted to a list of Variables or to the inputs of a model given by its
+ * preprocessing JSON file (json_path). Only these branches are created, and the retriever skips the computation of
+ * observable groups (angles, covariance matrix, impact parameters) that are not needed.
+ *
+ * With AsyncWrite, the tree is filled on a background thread, so that the basket compression and the disk writes
+ * overlap with the computation of the observables of the next events.
+ *
+ * To reduce the size of large training samples, the storage precision can be reduced per observable: the PID flags
+ * can be packed into one bitfield (PackPIDFlags) and float observables can be rounded to fewer mantissa bits
+ * (MantissaBits). The resulting quantization error per observable is reported in finalize().
+ *
  * @note The naming convention for the observables follows the key4hep implementation (see Structs.h and for the
  * conversion to the old FCCAnalyses convention Helpers.cpp).
  *
@@ -52,43 +74,12 @@ public:
   JetObsWriter(const std::string& name, ISvcLocator* svcLoc);
   /// Destructor.
   ~JetObsWriter() {
-    delete m_pfcandErelLog;
-    delete m_pfcandThetarel;
-    delete m_pfcandPhirel;
-    delete m_pfcandE;
-    delete m_pfcandP;
-    delete m_pfcandType;
-    delete m_pfcandCharge;
-    delete m_pfcandIsEl;
-    delete m_pfcandIsMu;
-    delete m_pfcandIsGamma;
-    delete m_pfcandIsChargedHad;
-    delete m_pfcandIsNeutralHad;
-    delete m_pfcandDndx;
-    delete m_pfcandTof;
-    delete m_pfcandCovOmegaOmega;
-    delete m_pfcandCovTanLambdaTanLambda;
-    delete m_pfcandCovPhiPhi;
-    delete m_pfcandCovD0D0;
-    delete m_pfcandCovZ0Z0;
-    delete m_pfcandCovD0Z0;
-    delete m_pfcandCovPhiD0;
-    delete m_pfcandCovTanLambdaZ0;
-    delete m_pfcandCovD0Omega;
-    delete m_pfcandCovD0TanLambda;
-    delete m_pfcandCovPhiOmega;
-    delete m_pfcandCovPhiZ0;
-    delete m_pfcandCovPhiTanLambda;
-    delete m_pfcandCovOmegaZ0;
-    delete m_pfcandCovOmegaTanLambda;
-    delete m_pfcandD0;
-    delete m_pfcandZ0;
-    delete m_pfcandSip2dVal;
-    delete m_pfcandSip2dSig;
-    delete m_pfcandSip3dVal;
-    delete m_pfcandSip3dSig;
-    delete m_pfcandJetDistVal;
-    delete m_pfcandJetDistSig;
+    m_asyncFiller.reset(); // finish pending entries before the branch buffers are deleted
+    for (auto& column : m_floatColumns)
+      delete column.values;
+    for (auto& column : m_intColumns)
+      delete column.values;
+    delete m_pfcandPIDFlags;
   };
   /// Initialize.
   virtual StatusCode initialize();
@@ -96,6 +87,8 @@ public:
   void initializeTree();
   /// Clean tree.
   void cleanTree() const;
+  /// Fill the tree with the current entry, on the background thread if AsyncWrite is set.
+  void fillTree() const;
   /// Execute function.
   virtual StatusCode execute(const EventContext&) const;
   /// Finalize.
@@ -109,50 +102,87 @@ private:
   mutable k4FWCore::DataHandle<edm4hep::VertexCollection> m_inputPrimaryVerticesHandle{"InputPrimaryVertices",
                                                                                        Gaudi::DataHandle::Reader, this};
 
+  Gaudi::Property<std::string> m_compressionAlgorithm{
+      this, "CompressionAlgorithm", "",
+      "Compression algorithm of the output tree (ZLIB, LZMA, LZ4, ZSTD), empty to use the setting of the output file"};
+  Gaudi::Property<int> m_compressionLevel{this, "CompressionLevel", -1,
+                                          "Compression level (0-9) of the output tree, -1 for the algorithm default"};
+  Gaudi::Property<int> m_basketSize{this, "BasketSize", 0, "Basket size in bytes of every branch, 0 for ROOT default"};
+  Gaudi::Property<long long> m_autoFlush{
+      this, "AutoFlush", 0,
+      "Flush the baskets every N entries (N > 0) or every -N bytes (N < 0), 0 for ROOT default. Overrides THistSvc"};
+
+  Gaudi::Property<std::vector<std::string>> m_variables{
+      this,
+      "Variables",
+      {},
+      "Constituent observables to write (key4hep or FCCAnalyses names). If neither Variables nor json_path is set, "
+      "all observables are written"};
+  Gaudi::Property<std::string> m_jsonPath{
+      this, "json_path", "",
+      "Preprocessing JSON of a model; if set, the input variables of the model are written (in addition to Variables)"};
+  Gaudi::Property<bool> m_writePrimaryVertex{this, "WritePrimaryVertex", true,
+                                             "Write the primary vertex position (jet_PV_x, jet_PV_y, jet_PV_z)"};
+  Gaudi::Property<bool> m_packPIDFlags{
+      this, "PackPIDFlags", false,
+      "Store the five PID flags (isEl, isMu, isGamma, isChargedHad, isNeutralHad) as bits of one uint8 branch "
+      "pfcand_pidFlags instead of five int branches"};
+  Gaudi::Property<std::map<std::string, int>> m_mantissaBits{
+      this,
+      "MantissaBits",
+      {},
+      "Number of mantissa bits (0-23) to keep for float observables, e.g. {'pfcand_cov_*': 10}. A trailing '*' matches "
+      "all observables with that prefix; the exact name takes precedence. Unlisted observables keep full precision"};
+
+  Gaudi::Property<bool> m_asyncWrite{
+      this, "AsyncWrite", false,
+      "Fill the tree (basket compression and disk writes) on a background thread instead of the event thread"};
+  Gaudi::Property<int> m_asyncQueueSize{
+      this, "AsyncQueueSize", 1000,
+      "Maximum number of jets queued for the background thread before the event thread waits (AsyncWrite only)"};
+
   mutable JetObservablesRetriever* m_retriever;
 
   SmartIF<ITHistSvc> m_ths; ///< THistogram service
 
   mutable TTree* m_jetcst{nullptr};
 
-  mutable std::vector<float>* m_pfcandErelLog = nullptr;
-  mutable std::vector<float>* m_pfcandThetarel = nullptr;
-  mutable std::vector<float>* m_pfcandPhirel = nullptr;
-  mutable std::vector<float>* m_pfcandE = nullptr;
-  mutable std::vector<float>* m_pfcandP = nullptr;
-  mutable std::vector<int>* m_pfcandType = nullptr;
-  mutable std::vector<int>* m_pfcandCharge = nullptr;
-  mutable std::vector<int>* m_pfcandIsEl = nullptr;
-  mutable std::vector<int>* m_pfcandIsMu = nullptr;
-  mutable std::vector<int>* m_pfcandIsGamma = nullptr;
-  mutable std::vector<int>* m_pfcandIsChargedHad = nullptr;
-  mutable std::vector<int>* m_pfcandIsNeutralHad = nullptr;
-  mutable std::vector<float>* m_pfcandDndx = nullptr;
-  mutable std::vector<float>* m_pfcandTof = nullptr;
-  mutable std::vector<float>* m_pfcandCovOmegaOmega = nullptr;
-  mutable std::vector<float>* m_pfcandCovTanLambdaTanLambda = nullptr;
-  mutable std::vector<float>* m_pfcandCovPhiPhi = nullptr;
-  mutable std::vector<float>* m_pfcandCovD0D0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovZ0Z0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovD0Z0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovPhiD0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovTanLambdaZ0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovD0Omega = nullptr;
-  mutable std::vector<float>* m_pfcandCovD0TanLambda = nullptr;
-  mutable std::vector<float>* m_pfcandCovPhiOmega = nullptr;
-  mutable std::vector<float>* m_pfcandCovPhiZ0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovPhiTanLambda = nullptr;
-  mutable std::vector<float>* m_pfcandCovOmegaZ0 = nullptr;
-  mutable std::vector<float>* m_pfcandCovOmegaTanLambda = nullptr;
-  mutable std::vector<float>* m_pfcandD0 = nullptr;
-  mutable std::vector<float>* m_pfcandZ0 = nullptr;
-  mutable std::vector<float>* m_pfcandSip2dVal = nullptr;
-  mutable std::vector<float>* m_pfcandSip2dSig = nullptr;
-  mutable std::vector<float>* m_pfcandSip3dVal = nullptr;
-  mutable std::vector<float>* m_pfcandSip3dSig = nullptr;
-  mutable std::vector<float>* m_pfcandJetDistVal = nullptr;
-  mutable std::vector<float>* m_pfcandJetDistSig = nullptr;
-  // Not input to network but good to check:
+  /// A vector branch with one float observable of all jet constituents.
+  struct FloatColumn {
+    std::string name;
+    float Pfcand::*member;                ///< observable in Pfcand
+    int mantissaBits{23};                 ///< mantissa bits kept, 23 is full float precision
+    std::vector<float>* values = nullptr; ///< branch buffer
+    // quantization error, only filled if mantissaBits < 23
+    size_t nValues{0};
+    double maxAbsError{0.}, maxRelError{0.}, sumRelError2{0.};
+  };
+  /// A vector branch with one int observable of all jet constituents.
+  struct IntColumn {
+    std::string name;
+    int Pfcand::*member;                ///< observable in Pfcand
+    std::vector<int>* values = nullptr; ///< branch buffer
+  };
+
+  std::set<std::string> m_selectedObservables; ///< key4hep names of the observables to write, empty for all
+  mutable std::vector<FloatColumn> m_floatColumns;
+  mutable std::vector<IntColumn> m_intColumns;
+  mutable std::vector<std::uint8_t>* m_pfcandPIDFlags = nullptr; ///< only used with PackPIDFlags
+  mutable size_t m_nLossyPIDFlags{0}; ///< constituents with PID flags other than 0/1 (not representable as bits)
+
+  /// Values of one tree entry. Filled on the event thread and swapped into the branch buffers by fillTree().
+  struct Row {
+    std::vector<std::vector<float>> floats; ///< one per float column
+    std::vector<std::vector<int>> ints;     ///< one per int column
+    std::vector<std::uint8_t> pidFlags;
+    float pvX, pvY, pvZ;
+  };
+  mutable Row m_row;
+  std::unique_ptr<AsyncTreeFiller> m_asyncFiller; ///< only used with AsyncWrite
+  mutable size_t m_maxRowBytes{0};                ///< largest entry in m_row, held once per queued entry
+  MemoryDelta m_initMemory;                       ///< RSS taken by initialize()
+
+  // Not input to network but good to check (branch buffers, m_row holds the values of the current entry):
   mutable float m_jetPVx;
   mutable float m_jetPVy;
   mutable float m_jetPVz;
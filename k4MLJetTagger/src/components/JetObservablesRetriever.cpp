@@ -36,8 +36,13 @@ Jet JetObservablesRetriever::retrieve_input_observables(const edm4hep::Reconstru
 
     // kinematics
     p.pfcand_erel_log = get_relative_erel(jet, particle);
-    p.pfcand_phirel = get_relative_angle(jet, particle, "phi");
-    p.pfcand_thetarel = get_relative_angle(jet, particle, "theta");
+    if (groups.angles) {
+      p.pfcand_phirel = get_relative_angle(jet, particle, "phi");
+      p.pfcand_thetarel = get_relative_angle(jet, particle, "theta");
+    } else {
+      p.pfcand_phirel = -9;
+      p.pfcand_thetarel = -9;
+    }
 
     p.pfcand_e = particle.getEnergy();
     p.pfcand_p = std::sqrt(particle.getMomentum().x * particle.getMomentum().x +
@@ -53,12 +58,17 @@ Jet JetObservablesRetriever::retrieve_input_observables(const edm4hep::Reconstru
 
     // track parameters
     int n_tracks = particle.getTracks().size();
-    if (n_tracks == 1) {            // charged particle
-      fill_cov_matrix(p, particle); // covariance matrix
-      Helix h = calculate_helix_params(particle,
-                                       prim_vertex); // calculate track parameters described by a helix parametrization
-      fill_track_IP(jet, particle, p, h);            // impact parameters
-    } else if (n_tracks == 0) {                      // neutral particle
+    if (n_tracks == 1) { // charged particle
+      if (!groups.covariance || !groups.impactParameters)
+        fill_track_params_neutral(p); // dummy values for the skipped observables
+      if (groups.covariance || groups.impactParameters)
+        fill_cov_matrix(p, particle); // covariance matrix
+      if (groups.impactParameters) {
+        Helix h = calculate_helix_params(
+            particle, prim_vertex);         // calculate track parameters described by a helix parametrization
+        fill_track_IP(jet, particle, p, h); // impact parameters
+      }
+    } else if (n_tracks == 0) { // neutral particle
       fill_track_params_neutral(p);
     } else {
       throw std::invalid_argument("Particle has more than one track");
@@ -73,6 +83,22 @@ Jet JetObservablesRetriever::retrieve_input_observables(const edm4hep::Reconstru
   return j;
 }
 
+JetObservablesRetriever::ObservableGroups
+JetObservablesRetriever::needed_groups(const std::vector<std::string>& observables) {
+  ObservableGroups g{false, false, false};
+  for (const auto& name : observables) {
+    if (name == "pfcand_thetarel" || name == "pfcand_phirel") {
+      g.angles = true;
+    } else if (name.rfind("pfcand_cov_", 0) == 0) {
+      g.covariance = true;
+    } else if (name == "pfcand_d0" || name == "pfcand_z0" || name.rfind("pfcand_Sip", 0) == 0 ||
+               name.rfind("pfcand_JetDist", 0) == 0) {
+      g.impactParameters = true;
+    }
+  }
+  return g;
+}
+
 // private functions
 
 float JetObservablesRetriever::get_relative_erel(const edm4hep::ReconstructedParticle& jet,
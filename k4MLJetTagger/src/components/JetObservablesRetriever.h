@@ -25,9 +25,31 @@
 
 #include "Structs.h"
 
+#include <string>
+#include <vector>
+
 class JetObservablesRetriever {
 public:
-  double Bz = 2.0; // magnetic field B in z direction in Tesla
+  /**
+   * Groups of observables whose computation can be switched off if they are not needed (e.g. by a writer that only
+   * stores some of the observables). Skipped observables are set to the dummy value -9. Kinematic energies and PID
+   * are always filled as they are cheap.
+   */
+  struct ObservableGroups {
+    bool angles = true;           ///< pfcand_thetarel, pfcand_phirel
+    bool covariance = true;       ///< pfcand_cov_*
+    bool impactParameters = true; ///< pfcand_d0, pfcand_z0, pfcand_Sip*, pfcand_JetDist* (needs the covariance)
+  };
+
+  double Bz = 2.0;         // magnetic field B in z direction in Tesla
+  ObservableGroups groups; // observables to compute, all by default
+
+  /**
+   * Determine the observable groups needed to fill the given observables.
+   * @param observables: names of the observables in the key4hep convention (see Structs.h)
+   * @return: the groups that have to be computed
+   */
+  static ObservableGroups needed_groups(const std::vector<std::string>& observables);
 
   /**
    * Function that retrieves the input observables for a jet and its constituents. The input observables are the 35
@@ -47,6 +69,16 @@ public:
    */
   const edm4hep::Vector3f get_primary_vertex(const edm4hep::VertexCollection& prim_vertex);
 
+  /**
+   * We must extract the helix parametrisation of the track with respect to the PRIMARY VERTEX.
+   * This is done like in:
+   * https://github.com/HEP-FCC/FCCAnalyses/blob/63d346103159c4fc88cdee7884e09b3966cfeca4/analyzers/dataframe/src/ReconstructedParticle2Track.cc#L64
+   * @param particle: the charged particle / jet constituent which track should be parametrized
+   * @param pv_pos: the primary vertex position of the event
+   * @return: helix object filled with track parametrization with respect to the primary vertex
+   */
+  Helix calculate_helix_params(const edm4hep::ReconstructedParticle& particle, const edm4hep::Vector3f& pv_pos);
+
 private:
   /**
    * Calculate the relative energy of a particle with respect to a jet.
@@ -91,16 +123,6 @@ private:
    */
   void fill_cov_matrix(Pfcand& p, const edm4hep::ReconstructedParticle& particle);
 
-  /**
-   * We must extract the helix parametrisation of the track with respect to the PRIMARY VERTEX.
-   * This is done like in:
-   * https://github.com/HEP-FCC/FCCAnalyses/blob/63d346103159c4fc88cdee7884e09b3966cfeca4/analyzers/dataframe/src/ReconstructedParticle2Track.cc#L64
-   * @param particle: the charged particle / jet constituent which track should be parametrized
-   * @param pv_pos: the primary vertex position of the event
-   * @return: helix object filled with track parametrization with respect to the primary vertex
-   */
-  Helix calculate_helix_params(const edm4hep::ReconstructedParticle& particle, const edm4hep::Vector3f& pv_pos);
-
   /**
     Calculate the impact parameters of the track with respect to the primary vertex. The helix parametrization of the
     particle track is with respect to the primary vertex.
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "JetTagReader.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+bool JetTagMatcher::isAligned(const edm4hep::ReconstructedParticleCollection& jets,
+                              const edm4hep::ParticleIDCollection& tags) {
+  if (tags.size() != jets.size())
+    return false;
+  for (size_t i = 0; i < tags.size(); ++i) {
+    if (!(tags[i].getParticle().getObjectID() == jets[i].getObjectID()))
+      return false;
+  }
+  return true;
+}
+
+void JetTagMatcher::buildIndex(const edm4hep::ReconstructedParticleCollection& jets) {
+  if (!m_jetIndex.empty())
+    return;
+  m_jetIndex.reserve(jets.size());
+  for (size_t i = 0; i < jets.size(); ++i)
+    m_jetIndex.emplace(object_key(jets[i].getObjectID()), i);
+}
+
+void JetTagTable::reset(size_t n_jets) {
+  m_nJets = n_jets;
+  m_scores.assign(n_jets * m_nFlavors, -9.0);
+  m_nTags.assign(n_jets * m_nFlavors, 0);
+  m_provenance.assign(n_jets, static_cast<std::int32_t>(JetTagProvenance::kFullModel));
+  m_matcher.reset();
+}
+
+void JetTagTable::fillPerFlavor(const edm4hep::ReconstructedParticleCollection& jets,
+                                const std::vector<const edm4hep::ParticleIDCollection*>& tag_collections) {
+  if (tag_collections.size() != m_nFlavors)
+    throw std::invalid_argument("Expected " + std::to_string(m_nFlavors) + " flavor tag collections, got " +
+                                std::to_string(tag_collections.size()));
+  reset(jets.size());
+  for (size_t f = 0; f < m_nFlavors; ++f) {
+    m_matcher.match(jets, *tag_collections[f], [&](size_t jet_pos, const edm4hep::ParticleID& tag) {
+      m_scores[jet_pos * m_nFlavors + f] = tag.getLikelihood();
+      ++m_nTags[jet_pos * m_nFlavors + f];
+      m_provenance[jet_pos] = tag.getType();
+    });
+  }
+}
+
+void JetTagTable::fillCompact(const edm4hep::ReconstructedParticleCollection& jets,
+                              const edm4hep::ParticleIDCollection& tags) {
+  reset(jets.size());
+  m_matcher.match(jets, tags, [&](size_t jet_pos, const edm4hep::ParticleID& tag) {
+    const auto params = tag.getParameters();
+    if (params.size() < m_nFlavors)
+      return;
+    for (size_t f = 0; f < m_nFlavors; ++f) {
+      m_scores[jet_pos * m_nFlavors + f] = params[f];
+      ++m_nTags[jet_pos * m_nFlavors + f];
+    }
+    m_provenance[jet_pos] = tag.getType();
+  });
+}
+
+bool JetTagTable::isValid(size_t jet_pos) const {
+  const auto begin = m_nTags.begin() + jet_pos * m_nFlavors;
+  return std::all_of(begin, begin + m_nFlavors, [](std::uint8_t n) { return n == 1; });
+}
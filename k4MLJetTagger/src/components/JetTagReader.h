@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef JETTAGREADER_H
+#define JETTAGREADER_H
+
+#include <edm4hep/ParticleIDCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+
+#include "Helpers.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Name of the algorithm recorded in the ParticleID metadata of the compact JetTagger output.
+inline const std::string kJetTaggerAlgoName = "JetTagger";
+
+/// Score of every flavor in the placeholder tag the JetTagger writes for a jet failing its preselection.
+inline constexpr float kSkippedJetScore = -1.f;
+
+/// Which model scored a jet, stored by the JetTagger in the type of its ParticleID(s).
+enum class JetTagProvenance : std::int32_t {
+  kFullModel = 0,  ///< the (only) model, without a cascade
+  kFirstStage = 1, ///< the first-stage model of a cascade, its score was not ambiguous
+  kEscalated = 2,  ///< the full model of a cascade, after an ambiguous first-stage score
+  kSkipped = 3,    ///< placeholder tag of a jet failing the preselection
+};
+
+/**
+ * @class JetTagMatcher
+ * @brief Assigns the tags of a ParticleIDCollection to the positions of their jets in the jet collection.
+ *
+ * The taggers of this repository create their tags in the order of the jets, so that the i-th tag belongs to the i-th
+ * jet. This is checked and used directly (no lookup). Only if a collection is not index-aligned, a hash index from the
+ * jets to their position is built, once per event (see reset()) and shared by all collections matched afterwards.
+ */
+class JetTagMatcher {
+public:
+  /// Forget the jets of the previous event. Has to be called once per event before match().
+  void reset() { m_jetIndex.clear(); }
+
+  /**
+   * @brief Calls f(jet_pos, tag) for every tag that belongs to one of the jets.
+   * @return true if the tags were index-aligned with the jets, false if the hash index was used.
+   */
+  template <typename F>
+  bool match(const edm4hep::ReconstructedParticleCollection& jets, const edm4hep::ParticleIDCollection& tags, F&& f) {
+    if (isAligned(jets, tags)) {
+      for (size_t i = 0; i < tags.size(); ++i) {
+        f(i, tags[i]);
+      }
+      return true;
+    }
+    buildIndex(jets);
+    for (const auto& tag : tags) {
+      const auto it = m_jetIndex.find(object_key(tag.getParticle().getObjectID()));
+      if (it != m_jetIndex.end()) {
+        f(it->second, tag);
+      }
+    }
+    return false;
+  }
+
+  /// Whether the hash index was built since the last reset().
+  bool usedIndex() const { return !m_jetIndex.empty(); }
+
+private:
+  static bool isAligned(const edm4hep::ReconstructedParticleCollection& jets,
+                        const edm4hep::ParticleIDCollection& tags);
+  void buildIndex(const edm4hep::ReconstructedParticleCollection& jets);
+
+  std::unordered_map<std::uint64_t, size_t> m_jetIndex; ///< jet object -> position, kept to reuse its memory
+};
+
+/**
+ * @class JetTagTable
+ * @brief Flavor scores of all jets of an event, independent of the output layout of the JetTagger.
+ *
+ * The JetTagger writes its scores either
+ * - per flavor: one ParticleIDCollection per flavor with one ParticleID per jet, the score being the likelihood, or
+ * - compact (CompactOutput = True): one ParticleIDCollection with one ParticleID per jet holding the scores of all
+ *   flavors in its parameters. The flavor order is stored in the ParticleID metadata of the collection (algorithm
+ *   kJetTaggerAlgoName, parameter names = flavor names), see edm4hep::utils::PIDHandler::getAlgoInfo().
+ *
+ * Both layouts are read into the same [jet][flavor] table, so that downstream code does not need to know which one
+ * was used. Example:
+ *   JetTagTable table(n_flavors);
+ *   table.fillCompact(jets, tags); // or table.fillPerFlavor(jets, per_flavor_collections)
+ *   for (size_t i = 0; i < jets.size(); ++i)
+ *     if (table.isValid(i) && !table.isSkipped(i)) use(table.score(i, flavor));
+ */
+class JetTagTable {
+public:
+  /// @param n_flavors Number of flavors (columns of the table).
+  explicit JetTagTable(size_t n_flavors) : m_nFlavors(n_flavors) {}
+
+  /// Reads the per-flavor layout. Throws std::invalid_argument if the number of collections is not n_flavors.
+  void fillPerFlavor(const edm4hep::ReconstructedParticleCollection& jets,
+                     const std::vector<const edm4hep::ParticleIDCollection*>& tag_collections);
+  /// Reads the compact layout. Tags with fewer than n_flavors parameters are ignored.
+  void fillCompact(const edm4hep::ReconstructedParticleCollection& jets, const edm4hep::ParticleIDCollection& tags);
+
+  /// Number of flavors.
+  size_t nFlavors() const { return m_nFlavors; }
+  /// Number of jets of the last fill.
+  size_t nJets() const { return m_nJets; }
+  /// Number of tags found for a jet and flavor.
+  std::uint8_t nTags(size_t jet_pos, size_t flavor) const { return m_nTags[jet_pos * m_nFlavors + flavor]; }
+  /// Whether exactly one score was found for every flavor of the jet.
+  bool isValid(size_t jet_pos) const;
+  /// Whether the jet has the placeholder tag of a jet that failed the preselection of the JetTagger.
+  bool isSkipped(size_t jet_pos) const { return isValid(jet_pos) && score(jet_pos, 0) == kSkippedJetScore; }
+  /// Score of a jet (position in the jet collection) and flavor, -9 if not found.
+  float score(size_t jet_pos, size_t flavor) const { return m_scores[jet_pos * m_nFlavors + flavor]; }
+  /// Which model scored the jet, from the type of its tag (of the last flavor read in the per-flavor layout).
+  JetTagProvenance provenance(size_t jet_pos) const { return static_cast<JetTagProvenance>(m_provenance[jet_pos]); }
+  /// Pointer to the n_flavors scores of a jet.
+  const float* scores(size_t jet_pos) const { return m_scores.data() + jet_pos * m_nFlavors; }
+  /// Whether the tags of the last fill were not index-aligned with the jets.
+  bool usedIndex() const { return m_matcher.usedIndex(); }
+
+private:
+  void reset(size_t n_jets);
+
+  size_t m_nFlavors;
+  size_t m_nJets{0};
+  std::vector<float> m_scores;            ///< [jet][flavor]
+  std::vector<std::uint8_t> m_nTags;      ///< [jet][flavor]
+  std::vector<std::int32_t> m_provenance; ///< [jet]
+  JetTagMatcher m_matcher;
+};
+
+#endif // JETTAGREADER_H
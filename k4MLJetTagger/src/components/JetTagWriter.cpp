@@ -22,8 +22,12 @@
 #include <edm4hep/ParticleIDCollection.h>
 #include <edm4hep/utils/ParticleIDUtils.h>
 
+#include "TROOT.h"
 #include "TTree.h"
 
+#include "JetTagReader.h"
+#include "TreeIOSettings.h"
+
 DECLARE_COMPONENT(JetTagWriter)
 
 JetTagWriter::JetTagWriter(const std::string& name, ISvcLocator* svcLoc) : Gaudi::Algorithm(name, svcLoc) {
@@ -39,6 +43,7 @@ JetTagWriter::JetTagWriter(const std::string& name, ISvcLocator* svcLoc) : Gaudi
 }
 
 StatusCode JetTagWriter::initialize() {
+  const auto memory_before = read_memory_usage();
   if (Gaudi::Algorithm::initialize().isFailure())
     return StatusCode::FAILURE;
 
@@ -56,6 +61,29 @@ StatusCode JetTagWriter::initialize() {
 
   initializeTree();
 
+  const TreeIOSettings io_settings{m_compressionAlgorithm.value(), m_compressionLevel.value(), m_basketSize.value(),
+                                   m_autoFlush.value()};
+  try {
+    applyTreeIOSettings(m_jettag, io_settings);
+  } catch (const std::invalid_argument& exc) {
+    error() << "Invalid I/O settings for the output tree: " << exc.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
+  if (!io_settings.isDefault())
+    info() << "Output tree I/O settings: " << io_settings.toString() << endmsg;
+
+  if (m_asyncWrite) {
+    if (m_asyncQueueSize <= 0) {
+      error() << "AsyncQueueSize must be positive" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    ROOT::EnableThreadSafety();
+    m_asyncFiller = std::make_unique<AsyncTreeFiller>(m_asyncQueueSize.value());
+    info() << "Filling the output tree on a background thread (queue size " << m_asyncQueueSize.value() << ")"
+           << endmsg;
+  }
+
+  m_initMemory = {memory_before, read_memory_usage()};
   return StatusCode::SUCCESS;
 }
 
@@ -108,10 +136,20 @@ StatusCode JetTagWriter::execute(const EventContext&) const {
     auto jetTags_TAU = jetTag_TAU_Handler.getPIDs(jet);
     auto mcJetTags = mcJetTag_Handler.getPIDs(jet);
 
-    // check if the PID info is available
+    // check if the PID info is available; jets skipped by the preselection of the JetTagger may have no reco tags
+    if (jetTags_G.empty() && jetTags_U.empty() && jetTags_D.empty() && jetTags_S.empty() && jetTags_C.empty() &&
+        jetTags_B.empty() && jetTags_TAU.empty()) {
+      debug() << "No reco PID info found for jet" << endmsg;
+      ++m_untaggedJets;
+      continue;
+    }
     if (jetTags_G.empty() || jetTags_U.empty() || jetTags_D.empty() || jetTags_S.empty() || jetTags_C.empty() ||
-        jetTags_B.empty() || jetTags_TAU.empty() || mcJetTags.empty()) {
-      error() << "No PID info found for jet!" << endmsg;
+        jetTags_B.empty() || jetTags_TAU.empty()) {
+      error() << "No reco PID info found for jet for some flavors!" << endmsg;
+      continue;
+    }
+    if (mcJetTags.empty()) {
+      error() << "No MC PID info found for jet!" << endmsg;
       continue;
     }
     // check if the jetTags have only one value each
@@ -120,20 +158,26 @@ StatusCode JetTagWriter::execute(const EventContext&) const {
       error() << "More than one PID info for one flavor found for jet!" << endmsg;
       continue;
     }
+    // placeholder tags (score kSkippedJetScore) of a jet that failed the preselection of the JetTagger
+    if (jetTags_G[0].getType() == static_cast<std::int32_t>(JetTagProvenance::kSkipped)) {
+      debug() << "Jet was skipped by the preselection" << endmsg;
+      ++m_skippedJets;
+      continue;
+    }
 
     // get the PID likelihoods
-    m_scoreRecojetIsG = jetTags_G[0].getLikelihood();
-    m_scoreRecoJetIsU = jetTags_U[0].getLikelihood();
-    m_scoreRecoJetIsD = jetTags_D[0].getLikelihood();
-    m_scoreRecoJetIsS = jetTags_S[0].getLikelihood();
-    m_scoreRecoJetIsC = jetTags_C[0].getLikelihood();
-    m_scoreRecoJetIsB = jetTags_B[0].getLikelihood();
-    m_scoreRecoJetIsTau = jetTags_TAU[0].getLikelihood();
+    m_row.scoreRecojetIsG = jetTags_G[0].getLikelihood();
+    m_row.scoreRecoJetIsU = jetTags_U[0].getLikelihood();
+    m_row.scoreRecoJetIsD = jetTags_D[0].getLikelihood();
+    m_row.scoreRecoJetIsS = jetTags_S[0].getLikelihood();
+    m_row.scoreRecoJetIsC = jetTags_C[0].getLikelihood();
+    m_row.scoreRecoJetIsB = jetTags_B[0].getLikelihood();
+    m_row.scoreRecoJetIsTau = jetTags_TAU[0].getLikelihood();
 
     // check if no dummy value is left
-    if (m_scoreRecojetIsG == -9.0 || m_scoreRecoJetIsU == -9.0 || m_scoreRecoJetIsD == -9.0 ||
-        m_scoreRecoJetIsS == -9.0 || m_scoreRecoJetIsC == -9.0 || m_scoreRecoJetIsB == -9.0 ||
-        m_scoreRecoJetIsTau == -9.0) {
+    if (m_row.scoreRecojetIsG == -9.0 || m_row.scoreRecoJetIsU == -9.0 || m_row.scoreRecoJetIsD == -9.0 ||
+        m_row.scoreRecoJetIsS == -9.0 || m_row.scoreRecoJetIsC == -9.0 || m_row.scoreRecoJetIsB == -9.0 ||
+        m_row.scoreRecoJetIsTau == -9.0) {
       error() << "Dummy value for probability scores still seems to be set!" << endmsg;
       continue;
     }
@@ -141,72 +185,107 @@ StatusCode JetTagWriter::execute(const EventContext&) const {
     // get MC jet flavor and set the corresponding bool to true
     int mc_flavor = mcJetTags[0].getPDG();
     if (mc_flavor == 21) {
-      m_recojetIsG = true;
+      m_row.recojetIsG = true;
     } else if (mc_flavor == 2) {
-      m_recoJetIsU = true;
+      m_row.recoJetIsU = true;
     } else if (mc_flavor == 1) {
-      m_recoJetIsD = true;
+      m_row.recoJetIsD = true;
     } else if (mc_flavor == 3) {
-      m_recoJetIsS = true;
+      m_row.recoJetIsS = true;
     } else if (mc_flavor == 4) {
-      m_recoJetIsC = true;
+      m_row.recoJetIsC = true;
     } else if (mc_flavor == 5) {
-      m_recoJetIsB = true;
+      m_row.recoJetIsB = true;
     } else if (mc_flavor == 15) {
-      m_recoJetIsTAU = true;
+      m_row.recoJetIsTAU = true;
     } else {
       error() << "MC jet flavor not found!" << endmsg;
       continue;
     }
 
     // fill the tree
-    m_jettag->Fill();
+    fillTree();
   }
 
   return StatusCode::SUCCESS;
 }
 
 void JetTagWriter::initializeTree() {
-  m_jettag->Branch("recojet_isG", &m_recojetIsG, "recojet_isG/O");
-  m_jettag->Branch("score_recojet_isG", &m_scoreRecojetIsG, "score_recojet_isG/F");
-  m_jettag->Branch("m_recoJetIsU", &m_recoJetIsU, "m_recoJetIsU/O");
-  m_jettag->Branch("m_scoreRecoJetIsU", &m_scoreRecoJetIsU, "m_scoreRecoJetIsU/F");
-  m_jettag->Branch("m_recoJetIsD", &m_recoJetIsD, "m_recoJetIsD/O");
-  m_jettag->Branch("m_scoreRecoJetIsD", &m_scoreRecoJetIsD, "m_scoreRecoJetIsD/F");
-  m_jettag->Branch("m_recoJetIsS", &m_recoJetIsS, "m_recoJetIsS/O");
-  m_jettag->Branch("m_scoreRecoJetIsS", &m_scoreRecoJetIsS, "m_scoreRecoJetIsS/F");
-  m_jettag->Branch("m_recoJetIsC", &m_recoJetIsC, "m_recoJetIsC/O");
-  m_jettag->Branch("m_scoreRecoJetIsC", &m_scoreRecoJetIsC, "m_scoreRecoJetIsC/F");
-  m_jettag->Branch("m_recoJetIsB", &m_recoJetIsB, "m_recoJetIsB/O");
-  m_jettag->Branch("m_scoreRecoJetIsB", &m_scoreRecoJetIsB, "m_scoreRecoJetIsB/F");
-  m_jettag->Branch("m_recoJetIsTAU", &m_recoJetIsTAU, "m_recoJetIsTAU/O");
-  m_jettag->Branch("m_scoreRecoJetIsTAU", &m_scoreRecoJetIsTau, "m_scoreRecoJetIsTAU/F");
+  m_jettag->Branch("recojet_isG", &m_treeRow.recojetIsG, "recojet_isG/O");
+  m_jettag->Branch("score_recojet_isG", &m_treeRow.scoreRecojetIsG, "score_recojet_isG/F");
+  m_jettag->Branch("m_recoJetIsU", &m_treeRow.recoJetIsU, "m_recoJetIsU/O");
+  m_jettag->Branch("m_scoreRecoJetIsU", &m_treeRow.scoreRecoJetIsU, "m_scoreRecoJetIsU/F");
+  m_jettag->Branch("m_recoJetIsD", &m_treeRow.recoJetIsD, "m_recoJetIsD/O");
+  m_jettag->Branch("m_scoreRecoJetIsD", &m_treeRow.scoreRecoJetIsD, "m_scoreRecoJetIsD/F");
+  m_jettag->Branch("m_recoJetIsS", &m_treeRow.recoJetIsS, "m_recoJetIsS/O");
+  m_jettag->Branch("m_scoreRecoJetIsS", &m_treeRow.scoreRecoJetIsS, "m_scoreRecoJetIsS/F");
+  m_jettag->Branch("m_recoJetIsC", &m_treeRow.recoJetIsC, "m_recoJetIsC/O");
+  m_jettag->Branch("m_scoreRecoJetIsC", &m_treeRow.scoreRecoJetIsC, "m_scoreRecoJetIsC/F");
+  m_jettag->Branch("m_recoJetIsB", &m_treeRow.recoJetIsB, "m_recoJetIsB/O");
+  m_jettag->Branch("m_scoreRecoJetIsB", &m_treeRow.scoreRecoJetIsB, "m_scoreRecoJetIsB/F");
+  m_jettag->Branch("m_recoJetIsTAU", &m_treeRow.recoJetIsTAU, "m_recoJetIsTAU/O");
+  m_jettag->Branch("m_scoreRecoJetIsTAU", &m_treeRow.scoreRecoJetIsTau, "m_scoreRecoJetIsTAU/F");
 
   return;
 }
 
 void JetTagWriter::cleanTree() const {
-  m_recojetIsG = false;
-  m_recoJetIsU = false;
-  m_recoJetIsD = false;
-  m_recoJetIsS = false;
-  m_recoJetIsC = false;
-  m_recoJetIsB = false;
-  m_recoJetIsTAU = false;
+  m_row.recojetIsG = false;
+  m_row.recoJetIsU = false;
+  m_row.recoJetIsD = false;
+  m_row.recoJetIsS = false;
+  m_row.recoJetIsC = false;
+  m_row.recoJetIsB = false;
+  m_row.recoJetIsTAU = false;
 
   float dummy_score = -9.0;
-  m_scoreRecoJetIsTau = dummy_score;
-  m_scoreRecojetIsG = dummy_score;
-  m_scoreRecoJetIsU = dummy_score;
-  m_scoreRecoJetIsD = dummy_score;
-  m_scoreRecoJetIsS = dummy_score;
-  m_scoreRecoJetIsC = dummy_score;
-  m_scoreRecoJetIsB = dummy_score;
+  m_row.scoreRecoJetIsTau = dummy_score;
+  m_row.scoreRecojetIsG = dummy_score;
+  m_row.scoreRecoJetIsU = dummy_score;
+  m_row.scoreRecoJetIsD = dummy_score;
+  m_row.scoreRecoJetIsS = dummy_score;
+  m_row.scoreRecoJetIsC = dummy_score;
+  m_row.scoreRecoJetIsB = dummy_score;
 
   return;
 }
 
+void JetTagWriter::fillTree() const {
+  if (m_asyncFiller) {
+    m_asyncFiller->submit([this, row = m_row]() {
+      m_treeRow = row;
+      m_jettag->Fill();
+    });
+  } else {
+    m_treeRow = m_row;
+    m_jettag->Fill();
+  }
+}
+
 StatusCode JetTagWriter::finalize() {
+  // all entries have to be in the tree before THistSvc writes the output file
+  if (m_asyncFiller) {
+    try {
+      m_asyncFiller->flush();
+    } catch (const std::exception& exc) {
+      error() << "Filling the output tree on the background thread failed: " << exc.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    info() << "Background tree filling: max. queue depth " << m_asyncFiller->maxQueueDepth() << ", event thread waited "
+           << m_asyncFiller->nBlocked() << " times for " << m_asyncFiller->blockedSeconds() << " s" << endmsg;
+    m_asyncFiller.reset();
+  }
+
+  if (m_untaggedJets.nEntries() > 0) {
+    info() << m_untaggedJets.nEntries() << " jets without reco tags were not written (e.g. skipped by the preselection "
+           << "of the JetTagger with SkippedJetTags = None)" << endmsg;
+  }
+  if (m_skippedJets.nEntries() > 0) {
+    info() << m_skippedJets.nEntries() << " jets with the placeholder tags of the preselection were not written"
+           << endmsg;
+  }
+  info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+
   if (Gaudi::Algorithm::finalize().isFailure())
     return StatusCode::FAILURE;
 
@@ -19,7 +19,9 @@
 #ifndef JETTAGWRITER_H
 #define JETTAGWRITER_H
 
+#include "Gaudi/Accumulators.h"
 #include "Gaudi/Algorithm.h"
+#include "Gaudi/Property.h"
 #include "GaudiKernel/ITHistSvc.h"
 #include "k4FWCore/DataHandle.h"
 
@@ -30,6 +32,11 @@
 #include <edm4hep/ParticleIDCollection.h>
 #include <edm4hep/utils/ParticleIDUtils.h>
 
+#include <memory>
+
+#include "AsyncTreeFiller.h"
+#include "MemoryUsage.h"
+
 /**
  * @class JetTagWriter
  * @brief This class is a Gaudi algorithm for writing jet PIDs to a TTree.
@@ -42,14 +49,22 @@
  *
  * The output root file can be used for creating ROC curves to check the tagging performance.
  *
+ * With AsyncWrite, the tree is filled on a background thread, so that the basket compression and the disk writes
+ * overlap with the processing of the next events.
+ *
+ * Jets without reco tags, e.g. failing the preselection of a JetTagger with SkippedJetTags = None, are skipped and
+ * counted (counter "Jets without reco tags"). Jets with the placeholder tags of a failed preselection (SkippedJetTags
+ * = Placeholder) are skipped as well (counter "Jets skipped by the preselection"), so that their scores of -1 do not
+ * end up in the ROC curves.
+ *
  * @author Sara Aumiller
  */
 class JetTagWriter : public Gaudi::Algorithm {
 public:
   /// Constructor.
   JetTagWriter(const std::string& name, ISvcLocator* svcLoc);
-  /// Destructor.
-  ~JetTagWriter() {};
+  /// Destructor. Finishes pending entries before the branch buffers go away.
+  ~JetTagWriter() { m_asyncFiller.reset(); };
   /// Initialize.
   StatusCode initialize() override;
   /// Execute function.
@@ -62,6 +77,8 @@ private:
   void initializeTree();
   /// Clean tree.
   void cleanTree() const;
+  /// Fill the tree with the current entry, on the background thread if AsyncWrite is set.
+  void fillTree() const;
 
   mutable k4FWCore::DataHandle<edm4hep::EventHeaderCollection> m_eventHeaderHandle{"EventHeader",
                                                                                    Gaudi::DataHandle::Reader, this};
@@ -84,26 +101,52 @@ private:
   mutable k4FWCore::DataHandle<edm4hep::ParticleIDCollection> m_mcJettagHandle{"MCJetTag", Gaudi::DataHandle::Reader,
                                                                                this};
 
+  Gaudi::Property<std::string> m_compressionAlgorithm{
+      this, "CompressionAlgorithm", "",
+      "Compression algorithm of the output tree (ZLIB, LZMA, LZ4, ZSTD), empty to use the setting of the output file"};
+  Gaudi::Property<int> m_compressionLevel{this, "CompressionLevel", -1,
+                                          "Compression level (0-9) of the output tree, -1 for the algorithm default"};
+  Gaudi::Property<int> m_basketSize{this, "BasketSize", 0, "Basket size in bytes of every branch, 0 for ROOT default"};
+  Gaudi::Property<long long> m_autoFlush{
+      this, "AutoFlush", 0,
+      "Flush the baskets every N entries (N > 0) or every -N bytes (N < 0), 0 for ROOT default. Overrides THistSvc"};
+
+  Gaudi::Property<bool> m_asyncWrite{
+      this, "AsyncWrite", false,
+      "Fill the tree (basket compression and disk writes) on a background thread instead of the event thread"};
+  Gaudi::Property<int> m_asyncQueueSize{
+      this, "AsyncQueueSize", 1000,
+      "Maximum number of jets queued for the background thread before the event thread waits (AsyncWrite only)"};
+
   SmartIF<ITHistSvc> m_ths; ///< THistogram service
 
   mutable TTree* m_jettag{nullptr};
 
-  mutable bool m_recojetIsG;
-  mutable float m_scoreRecojetIsG;
-  mutable bool m_recoJetIsU;
-  mutable float m_scoreRecoJetIsU;
-  mutable bool m_recoJetIsD;
-  mutable float m_scoreRecoJetIsD;
-  mutable bool m_recoJetIsS;
-  mutable float m_scoreRecoJetIsS;
-  mutable bool m_recoJetIsC;
-  mutable float m_scoreRecoJetIsC;
-  mutable bool m_recoJetIsB;
-  mutable float m_scoreRecoJetIsB;
-  mutable bool m_recoJetIsTAU;
-  mutable float m_scoreRecoJetIsTau;
+  /// Values of one tree entry.
+  struct Row {
+    bool recojetIsG;
+    float scoreRecojetIsG;
+    bool recoJetIsU;
+    float scoreRecoJetIsU;
+    bool recoJetIsD;
+    float scoreRecoJetIsD;
+    bool recoJetIsS;
+    float scoreRecoJetIsS;
+    bool recoJetIsC;
+    float scoreRecoJetIsC;
+    bool recoJetIsB;
+    float scoreRecoJetIsB;
+    bool recoJetIsTAU;
+    float scoreRecoJetIsTau;
+  };
+  mutable Row m_row;     ///< current entry, filled on the event thread
+  mutable Row m_treeRow; ///< branch buffers, only touched by the thread filling the tree
+  std::unique_ptr<AsyncTreeFiller> m_asyncFiller; ///< only used with AsyncWrite
+  MemoryDelta m_initMemory;                       ///< RSS taken by initialize()
 
   mutable std::int32_t m_evNum;
+  mutable Gaudi::Accumulators::Counter<> m_untaggedJets{this, "Jets without reco tags"};
+  mutable Gaudi::Accumulators::Counter<> m_skippedJets{this, "Jets skipped by the preselection"};
 };
 
 #endif // JETTAGWRITER_H
@@ -17,20 +17,43 @@
  * limitations under the License.
  */
 
+#include "Gaudi/Accumulators.h"
 #include "Gaudi/Property.h"
 #include "GaudiKernel/MsgStream.h"
+#include "k4FWCore/MetadataUtils.h"
 #include "k4FWCore/Transformer.h"
 #include "k4Interface/IGeoSvc.h" // for Bfield
+#include <edm4hep/Constants.h>
 #include <edm4hep/ParticleIDCollection.h>
 #include <edm4hep/ReconstructedParticleCollection.h>
 #include <edm4hep/VertexCollection.h>
+#include <edm4hep/utils/ParticleIDUtils.h>
+#include <podio/FrameCategories.h>
 
 #include <nlohmann/json.hpp> // Include a JSON parsing library
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <utility>
+
 #include "Helpers.h"
 #include "JetObservablesRetriever.h"
+#include "JetTagReader.h"
+#include "MemoryUsage.h"
+#include "ModelBundle.h"
+#include "StageLatency.h"
 #include "Structs.h"
+#include "SyntheticEventGenerator.h"
+#include "TaggingClient.h"
 #include "WeaverInterface.h"
+#include "WeaverPreprocessor.h"
 
 /**
  * @class JetTagger
@@ -42,6 +65,60 @@
  * jet flavor. We create one ParticleID collection per flavor create, link it to the jet and set the likelihood and PDG
  * number.
  *
+ * With CompactOutput, a single collection (the only entry of OutputIDCollections) is written instead, with one
+ * ParticleID per jet: the PDG and likelihood of the most probable flavor, and the scores of all flavors in the
+ * parameters. The flavor order is stored in the ParticleID metadata of the collection (edm4hep::utils::ParticleIDMeta
+ * with the flavor names as parameter names). This replaces seven objects and seven relations per jet by one. Use
+ * JetTagTable to read either layout.
+ *
+ * With StageTiming (default), the time spent per jet in each stage (feature extraction, transpose, preprocessing, ORT
+ * run, output fill) is recorded in lock-free histograms and Gaudi counters. finalize() prints the p50/p90/p99
+ * latencies and the jets/s per constituent multiplicity class (LatencyMultiplicityBins) and per event.
+ *
+ * With ORTProfileEvents > 0, the built-in profiling of ONNX Runtime runs for the events [ORTProfileFirstEvent,
+ * ORTProfileFirstEvent + ORTProfileEvents) and writes a Chrome-trace JSON file starting with ORTProfilePrefix. The
+ * profiling session is warmed up with one padded jet before the first profiled event; this run is the first one in the
+ * profile. extras/ort_profiling/summarize_ort_profile.py skips it and turns the rest into a table of the time per ONNX
+ * operator.
+ *
+ * finalize() also reports the memory footprint: the RSS taken by initialize(), by loading the model into the ONNX
+ * Runtime session and by its first run (arena), and the per-event high-water marks of the buffers of the tagger. With
+ * MemoryReportInterval = N > 0, the RSS, the peak RSS and the buffer sizes of every N-th event are stored as a time
+ * series in the metadata of the output file (parameters <name>_memory_*).
+ *
+ * With MaxBatchSize > 1, the jets of an event are run in batches (WeaverInterface::runBatch()). For memory-constrained
+ * jobs, MemoryBudgetMB caps the ONNX Runtime arena and the batch size; a batch that does not fit is split in halves
+ * instead of the process growing. CpuArena, ArenaExtendStrategy, ArenaInitialChunkMB and MemoryPattern tune the
+ * memory use of ONNX Runtime further.
+ *
+ * With bundle_path, the model, its preprocessing, the variable order and the flavor mapping (PDG codes and output
+ * collections) are all read from one memory-mapped, checksummed ModelBundle made with k4MLJetTagger_bundle, instead of
+ * model_path, json_path and flavor_collection_names. OutputIDCollections must then match the collections of the bundle.
+ * With SharedModelWeights and a model in ORT format, ONNX Runtime uses the weights in place in the mapped bundle, so
+ * all jobs of a node share them; BundleStageDir (e.g. /dev/shm) first copies the bundle off a network file system.
+ *
+ * With ServerSocket, the tagger runs no model of its own: it preprocesses the jets of an event and sends them to the
+ * k4MLJetTagger_server of the node (TaggingClient), which serves the model of the same bundle to all jobs and batches
+ * their jets together. MaxBatchSize and the memory options of ONNX Runtime then belong to the server.
+ *
+ * With PreselectionMinEnergy, PreselectionMaxAbsCosTheta or PreselectionMinConstituents, the jets failing the cuts
+ * (JetPreselection) skip the feature extraction and the network. They get a placeholder tag with the score
+ * kSkippedJetScore for every flavor (SkippedJetTags = Placeholder, keeps the tags aligned with the jets) or no tag
+ * (None). finalize() reports how many jets were skipped and on which cut.
+ *
+ * With FirstStageModelPath, the tagger is a cascade: a small, fast first-stage model (FirstStageJsonPath, same
+ * flavors) scores every jet, and only the jets whose first-stage score of CascadeFlavor (or, if empty, the highest
+ * score) lies in CascadeAmbiguousRange are escalated to the full model. The score of an escalated jet is the full-model
+ * score, mixed with CascadeFirstStageWeight of the first-stage score. The type of every ParticleID records which model
+ * scored the jet (JetTagProvenance, written by the JetFlavorTagWriter as recojet_provenance). finalize() reports the
+ * fraction of escalated jets and the inference time of both stages against the full model on all jets;
+ * extras/cascade/compare_cascade_rocs.py compares the ROC curves of a cascade with a run of the full model.
+ *
+ * The JSON configuration is parsed once and handed to the WeaverInterface. initialize() then tags a synthetic event
+ * WarmUpRuns times (see warmUp()) and prints how long the startup took: parsing the JSON, setting up the preprocessing,
+ * creating the ONNX Runtime session (or loading the bundle) and the warm-up. With StageTiming, finalize() compares the
+ * first event to the median one.
+ *
  * @author Sara Aumiller
  */
 struct JetTagger : k4FWCore::Transformer<std::vector<edm4hep::ParticleIDCollection>(
@@ -57,19 +134,71 @@ struct JetTagger : k4FWCore::Transformer<std::vector<edm4hep::ParticleIDCollecti
                                                         const edm4hep::VertexCollection& primVerticies) const override {
     info() << "Tagging " << inputJets.size() << " input jets" << endmsg;
 
+    const long eventIndex = m_eventIndex++;
+    if (m_weaver && m_ortProfileEvents > 0 && eventIndex == m_ortProfileFirstEvent) {
+      info() << "Starting the ONNX Runtime profiling for " << m_ortProfileEvents.value() << " events" << endmsg;
+      // warmed up with one padded jet, the first run in the profile
+      m_weaver->onnxRuntime().startProfiling(m_ortProfilePrefix, m_weaver->paddedInputShapes(1));
+    }
+
     // create n ParticleIDCollection objects, one for each flavor & retrieve the PDG number for each flavor
     std::vector<edm4hep::ParticleIDCollection> tagCollections;
-    tagCollections.resize(m_flavorNames.size());
+    tagCollections.resize(m_compactOutput ? 1 : m_flavorNames.size());
+
+    std::array<std::uint64_t, StageClock::kMaxStages> eventNs{};
+    // inputs of all jets of the event, so that they can be run in batches
+    std::vector<StageClock> clocks;
+    std::vector<rv::RVec<WeaverInterface::ConstituentVars>> jetConstData;
+    clocks.reserve(inputJets.size());
+    jetConstData.reserve(inputJets.size());
+    std::vector<size_t> eventBufferBytes(kNBuffers, 0);
+    std::vector<Jet> cascadeJets; // observables of the jets with a first stage, for the inputs of the escalated ones
+    // position of every jet in jetConstData, -1 if it failed the preselection (no extraction, no inference)
+    std::vector<int> taggedIndex(inputJets.size(), -1);
+    for (size_t iJet = 0; iJet < inputJets.size(); ++iJet) {
+      const auto jet = inputJets[iJet];
+      if (m_preselection.active()) {
+        const auto result = m_preselection.apply(jet);
+        m_preselectionCounter += (result == JetPreselection::kPassed);
+        if (result != JetPreselection::kPassed) {
+          ++m_preselectionCutCounters[result - 1];
+          continue;
+        }
+      }
+      taggedIndex[iJet] = static_cast<int>(jetConstData.size());
+      auto& clock = clocks.emplace_back(m_stageTiming);
 
-    for (const auto& jet : inputJets) {
       // retrieve the input observables to the network from the jet
       Jet j = m_retriever->retrieve_input_observables(jet, primVerticies);
+      clock.lap(kFeatureExtraction);
 
-      // Convert the Jet object to the input format for the ONNX model
-      const auto jet_const_data = from_Jet_to_onnx_input(j, m_vars);
+      // Convert the Jet object to the input format for the ONNX model (the first-stage model in a cascade)
+      jetConstData.push_back(from_Jet_to_onnx_input(j, m_firstStage ? m_firstStageVars : m_vars));
+      clock.lap(kTranspose);
+      updateBufferBytes(eventBufferBytes, j, jetConstData.back());
+      if (m_firstStage) {
+        cascadeJets.push_back(std::move(j));
+      }
+    }
 
-      // Run inference on the input variables - returns the 7 probabilities for each jet flavor
-      const auto probabilities = m_weaver->run(jet_const_data);
+    // Run inference on the input variables - returns the 7 probabilities for each jet flavor
+    std::vector<JetTagProvenance> provenance(jetConstData.size(), JetTagProvenance::kFullModel);
+    const auto jetProbabilities =
+        m_firstStage ? runCascade(cascadeJets, jetConstData, clocks, provenance) : runInference(jetConstData, clocks);
+    eventBufferBytes[kInputTensor] = m_weaver ? m_weaver->inputTensorBytes() : m_client->inputTensorBytes();
+
+    for (size_t iJet = 0; iJet < inputJets.size(); ++iJet) {
+      const auto jet = inputJets[iJet];
+      if (taggedIndex[iJet] < 0) {
+        if (m_skippedJetTags.value() == "Placeholder") {
+          fillPlaceholderTags(tagCollections, jet);
+        }
+        continue;
+      }
+      const auto& probabilities = jetProbabilities[taggedIndex[iJet]];
+      const auto type = static_cast<std::int32_t>(provenance[taggedIndex[iJet]]);
+      auto& clock = clocks[taggedIndex[iJet]];
+      clock.restart();
 
       // For debugging: Compute the highest probability & its flavor
       auto maxIt = std::max_element(probabilities.begin(), probabilities.end());
@@ -84,13 +213,49 @@ struct JetTagger : k4FWCore::Transformer<std::vector<edm4hep::ParticleIDCollecti
       }
 
       // fill the ParticleIDCollection objects
-      for (unsigned int i = 0; i < m_flavorNames.size(); i++) {
-        auto jetTag = tagCollections[i].create();
+      if (m_compactOutput) {
+        auto jetTag = tagCollections[0].create();
         jetTag.setParticle(jet);
-        jetTag.setLikelihood(probabilities[i]);
-        jetTag.setPDG(m_pdgFlavors[i]);
+        jetTag.setAlgorithmType(m_pidMeta.algoType());
+        jetTag.setType(type);
+        jetTag.setLikelihood(maxProb);
+        jetTag.setPDG(m_pdgFlavors[maxIndex]);
+        for (const auto prob : probabilities) {
+          jetTag.addToParameters(prob);
+        }
+      } else {
+        for (unsigned int i = 0; i < m_flavorNames.size(); i++) {
+          auto jetTag = tagCollections[i].create();
+          jetTag.setParticle(jet);
+          jetTag.setType(type);
+          jetTag.setLikelihood(probabilities[i]);
+          jetTag.setPDG(m_pdgFlavors[i]);
+        }
+      }
+      clock.lap(kOutputFill);
+
+      if (m_stageTiming) {
+        m_latency->recordJet(jet.getParticles().size(), clock.ns());
+        for (size_t s = 0; s < kNStages; ++s) {
+          m_stageCounters[s] += clock.ns()[s] / 1e3;
+          eventNs[s] += clock.ns()[s];
+        }
+      }
+    }
+    if (m_stageTiming && !clocks.empty()) {
+      m_latency->recordEvent(eventNs);
+      if (eventIndex == 0) {
+        m_firstEventNs = std::accumulate(eventNs.begin(), eventNs.end(), std::uint64_t{0});
       }
     }
+    m_bufferHighWater->recordEvent(eventBufferBytes);
+    if (m_memoryReportInterval > 0 && eventIndex % m_memoryReportInterval == 0) {
+      recordMemory(eventIndex, eventBufferBytes);
+    }
+    if (m_weaver && m_weaver->onnxRuntime().isProfiling() &&
+        eventIndex + 1 == m_ortProfileFirstEvent + m_ortProfileEvents) {
+      endOrtProfiling();
+    }
 
     // For debugging: print if the ParticleIDCollection objects are filled correctly
     for (unsigned int i = 0; i < tagCollections.size(); i++) {
@@ -104,33 +269,187 @@ struct JetTagger : k4FWCore::Transformer<std::vector<edm4hep::ParticleIDCollecti
 
   // initialize
   StatusCode initialize() override {
-    // Load the JSON configuration file and retrieve the flavor names
-    auto json_config = loadJsonFile(m_jsonPath);
-    m_flavorNames =
-        json_config["output_names"]; // e.g. "recojet_isX" with X being the jet flavor (G, U, S, C, B, D, TAU)
+    const auto memoryBefore = read_memory_usage();
+    const auto startInitialize = std::chrono::steady_clock::now();
 
-    // check if flavorNames matches order and size of the output collections
-    if (!check_flavors(m_flavorNames, m_flavorCollectionNames)) {
+    std::vector<std::pair<std::string, double>> startupSteps; // for the startup report
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const ModelBundle> bundle;
+    nlohmann::json json_config;
+    if (m_sharedModelWeights && m_bundlePath.empty()) {
+      error() << "SharedModelWeights needs a model bundle (bundle_path) with a model in ORT format" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (!m_serverSocket.empty() && m_bundlePath.empty()) {
+      error() << "ServerSocket needs the model bundle (bundle_path) the server was started with" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (!m_bundlePath.empty()) {
+      // everything comes from the bundle: model, preprocessing, variable order and flavor mapping
+      std::string bundlePath = m_bundlePath;
+      try {
+        if (!m_bundleStageDir.empty()) {
+          bundlePath = ModelBundle::stage(m_bundlePath, m_bundleStageDir);
+          startupSteps.emplace_back("staging the model bundle", msSince(start));
+          start = std::chrono::steady_clock::now();
+        }
+        // a client only reads the small sections, the server has verified the model bytes
+        bundle = std::make_shared<const ModelBundle>(bundlePath, m_serverSocket.empty());
+      } catch (const std::exception& e) {
+        error() << e.what() << endmsg;
+        return StatusCode::FAILURE;
+      }
+      startupSteps.emplace_back("loading the model bundle", msSince(start));
+      info() << "Using the model bundle " << bundlePath << " (format version " << bundle->formatVersion() << ", "
+             << bundle->model().size() << " bytes of " << (bundle->modelIsOrtFormat() ? "ORT-format" : "ONNX")
+             << " model" << (m_sharedModelWeights ? ", weights shared" : "") << ")" << endmsg;
+      m_flavorNames = bundle->flavorNames();
+      m_pdgFlavors = bundle->pdgCodes();
+      m_vars = rv::RVec<std::string>(bundle->variables().begin(), bundle->variables().end());
+    } else {
+      // Load the JSON configuration file and retrieve the flavor names, it is also handed to the WeaverInterface
+      json_config = loadJsonFile(m_jsonPath);
+      if (json_config.is_null()) {
+        error() << "Could not load the JSON configuration file " << m_jsonPath.value() << endmsg;
+        return StatusCode::FAILURE;
+      }
+      startupSteps.emplace_back("parsing the JSON configuration", msSince(start));
+      m_flavorNames =
+          json_config["output_names"]; // e.g. "recojet_isX" with X being the jet flavor (G, U, S, C, B, D, TAU)
+      for (const auto& flavor : m_flavorNames) {
+        m_pdgFlavors.push_back(to_PDGflavor.at(flavor)); // retrieve the PDG number from the flavor name
+      }
+
+      // retrieve the input variable to onnx model from json file
+      for (const auto& var : json_config["pf_features"]["var_names"]) {
+        m_vars.push_back(var.get<std::string>());
+      }
+      for (const auto& var : json_config["pf_vectors"]["var_names"]) { // not sure if this is the solution here
+        m_vars.push_back(var.get<std::string>());
+      }
+      // variables in pf_points are already included in pf_features
+    }
+
+    if (m_compactOutput) {
+      const auto& output_names = outputLocations("OutputIDCollections");
+      if (output_names.size() != 1) {
+        error() << "CompactOutput requires exactly one collection in OutputIDCollections" << endmsg;
+        return StatusCode::FAILURE;
+      }
+      // record the flavor order of the parameters like edm4hep::utils::PIDHandler::setAlgoInfo
+      m_pidMeta = edm4hep::utils::ParticleIDMeta(kJetTaggerAlgoName, m_flavorNames);
+      const auto& coll = output_names[0];
+      k4FWCore::putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDAlgoName), m_pidMeta.algoName,
+                             this);
+      k4FWCore::putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDAlgoType), m_pidMeta.algoType(),
+                             this);
+      k4FWCore::putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDParameterNames),
+                             m_pidMeta.paramNames, this);
+      info() << "Writing the scores of all flavors into the parameters of one ParticleID per jet in " << coll
+             << endmsg;
+    } else if (bundle) {
+      // the bundle fixes the output collection of every flavor
+      const auto& output_names = outputLocations("OutputIDCollections");
+      const std::vector<std::string> outputs(output_names.begin(), output_names.end());
+      if (outputs != bundle->collectionNames()) {
+        error() << "OutputIDCollections must be " << bundle->collectionNames() << " as given by the model bundle"
+                << endmsg;
+        return StatusCode::FAILURE;
+      }
+    } else if (!check_flavors(m_flavorNames, m_flavorCollectionNames)) {
+      // check if flavorNames matches order and size of the output collections
       error() << "ATTENTION! Output flavor collection names MUST match ONNX model output flavors!" << endmsg;
       info() << "Flavors expected from network in this order: " << m_flavorNames << endmsg;
     }
-    for (const auto& flavor : m_flavorNames) {
-      m_pdgFlavors.push_back(to_PDGflavor.at(flavor)); // retrieve the PDG number from the flavor name
-    }
 
-    // WeaverInterface object
+    if (m_skippedJetTags.value() != "Placeholder" && m_skippedJetTags.value() != "None") {
+      error() << "SkippedJetTags must be Placeholder or None, not " << m_skippedJetTags.value() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    m_preselection.min_energy = m_preselectionMinEnergy;
+    m_preselection.max_abs_cos_theta = m_preselectionMaxAbsCosTheta;
+    m_preselection.min_constituents = m_preselectionMinConstituents;
+    if (m_preselection.active()) {
+      info() << "Tagging only the jets with E >= " << m_preselection.min_energy << " GeV, |cos theta| <= "
+             << m_preselection.max_abs_cos_theta << " and at least " << m_preselection.min_constituents
+             << " constituents, the others get "
+             << (m_skippedJetTags.value() == "Placeholder" ? "placeholder tags" : "no tags") << endmsg;
+      for (int cut = JetPreselection::kPassed + 1; cut < JetPreselection::kNResults; ++cut) {
+        m_preselectionCutCounters.emplace_back(
+            this, std::string("Jets failing the preselection on ") +
+                      JetPreselection::name(static_cast<JetPreselection::Result>(cut)));
+      }
+    }
 
-    // retrieve the input variable to onnx model from json file
-    for (const auto& var : json_config["pf_features"]["var_names"]) {
-      m_vars.push_back(var.get<std::string>());
+    // the sizes are converted to bytes (size_t), and ONNX Runtime takes the initial chunk as an int
+    const double maxBytes = static_cast<double>(std::numeric_limits<size_t>::max());
+    if (!(m_memoryBudgetMB >= 0.) || m_memoryBudgetMB * 1024 * 1024 >= maxBytes) {
+      error() << "MemoryBudgetMB must be non-negative, got " << m_memoryBudgetMB.value() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (!(m_arenaInitialChunkMB >= 0.) ||
+        m_arenaInitialChunkMB * 1024 * 1024 > static_cast<double>(std::numeric_limits<int>::max())) {
+      error() << "ArenaInitialChunkMB must be between 0 and " << std::numeric_limits<int>::max() / (1024 * 1024)
+              << " MB, got " << m_arenaInitialChunkMB.value() << endmsg;
+      return StatusCode::FAILURE;
     }
-    for (const auto& var : json_config["pf_vectors"]["var_names"]) { // not sure if this is the solution here
-      m_vars.push_back(var.get<std::string>());
+    if (m_memoryBudgetMB > 0 && !m_cpuArena) {
+      error() << "MemoryBudgetMB caps the ONNX Runtime arena and needs CpuArena = True" << endmsg;
+      return StatusCode::FAILURE;
     }
-    // variables in pf_points are already included in pf_features
 
     // Create the WeaverInterface object
-    m_weaver = std::make_unique<WeaverInterface>(m_modelPath, m_jsonPath, m_vars);
+    ONNXRuntime::MemoryOptions memoryOptions;
+    memoryOptions.budget_bytes = static_cast<size_t>(m_memoryBudgetMB * 1024 * 1024);
+    memoryOptions.cpu_arena = m_cpuArena;
+    memoryOptions.arena_extend_strategy = m_arenaExtendStrategy;
+    memoryOptions.arena_initial_chunk_bytes = static_cast<size_t>(m_arenaInitialChunkMB * 1024 * 1024);
+    memoryOptions.memory_pattern = m_memoryPattern;
+    memoryOptions.share_model_bytes = m_sharedModelWeights;
+    try {
+      if (!m_serverSocket.empty()) {
+        start = std::chrono::steady_clock::now();
+        m_client = std::make_unique<TaggingClient>(m_serverSocket, bundle);
+        startupSteps.emplace_back("connecting to the tagging server", msSince(start));
+        info() << "Sending the jets to the tagging server at " << m_serverSocket.value() << endmsg;
+      } else if (bundle) {
+        start = std::chrono::steady_clock::now();
+        m_weaver = std::make_unique<WeaverInterface>(bundle, memoryOptions);
+        startupSteps.emplace_back("creating the ONNX Runtime session", msSince(start));
+      } else {
+        start = std::chrono::steady_clock::now();
+        WeaverPreprocessor preprocessor(json_config, m_vars);
+        startupSteps.emplace_back("setting up the preprocessing", msSince(start));
+        start = std::chrono::steady_clock::now();
+        m_weaver = std::make_unique<WeaverInterface>(m_modelPath, std::move(preprocessor), memoryOptions);
+        startupSteps.emplace_back("creating the ONNX Runtime session", msSince(start));
+      }
+    } catch (const std::exception& e) {
+      error() << "Could not set up the inference with " << (bundle ? m_bundlePath.value() : m_modelPath.value())
+              << ": " << e.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (m_client && (m_maxBatchSize > 1 || m_memoryBudgetMB > 0 || m_ortProfileEvents > 0)) {
+      warning() << "MaxBatchSize, MemoryBudgetMB and ORTProfileEvents have no effect with ServerSocket, the server "
+                   "runs the model"
+                << endmsg;
+    }
+    if (m_weaver && m_maxBatchSize > 1) {
+      const size_t batchSize = m_weaver->setMaxBatchSize(m_maxBatchSize);
+      info() << "Running up to " << batchSize << " jets per ONNX Runtime run"
+             << (batchSize < static_cast<size_t>(m_maxBatchSize) ? " (limited by the memory budget)" : "") << endmsg;
+    }
+    if (m_weaver && m_memoryBudgetMB > 0) {
+      info() << "ONNX Runtime arena limited to " << m_memoryBudgetMB.value() << " MB" << endmsg;
+    }
+    if (!m_firstStageModelPath.empty()) {
+      // the first-stage model is not in a bundle; with a custom arena, it uses the one of the full model (same
+      // settings, registered once per process) and shares its budget
+      memoryOptions.share_model_bytes = false;
+      if (setUpCascade(memoryOptions, startupSteps).isFailure()) {
+        return StatusCode::FAILURE;
+      }
+    }
 
     // JetObservablesRetriever object
     m_retriever = std::make_unique<JetObservablesRetriever>();
@@ -140,18 +459,449 @@ struct JetTagger : k4FWCore::Transformer<std::vector<edm4hep::ParticleIDCollecti
 
     m_retriever->Bz = 2.0; // hardcoded for now
 
+    start = std::chrono::steady_clock::now();
+    std::vector<double> warmUpMs;
+    try {
+      warmUpMs = warmUp();
+    } catch (const std::exception& e) {
+      error() << "The warm-up inference failed: " << e.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    startupSteps.emplace_back("warm-up, " + std::to_string(warmUpMs.size()) + " runs", msSince(start));
+    if (!warmUpMs.empty()) {
+      startupSteps.emplace_back("  of which the first run", warmUpMs.front());
+    }
+    if (warmUpMs.size() > 1) {
+      startupSteps.emplace_back("  of which the last run", warmUpMs.back());
+    }
+
+    if (m_stageTiming) {
+      try {
+        m_latency = std::make_unique<StageLatency>(
+            std::vector<std::string>{"feature extraction", "transpose", "preprocessing", "ORT run", "output fill"},
+            m_latencyMultiplicityBins.value());
+      } catch (const std::invalid_argument& e) {
+        error() << e.what() << endmsg;
+        return StatusCode::FAILURE;
+      }
+      for (size_t s = 0; s < kNStages; ++s) {
+        m_stageCounters.emplace_back(this, "Latency " + m_latency->stageName(s) + " [us/jet]");
+      }
+    }
+    m_bufferHighWater = std::make_unique<BufferHighWater>(
+        std::vector<std::string>{"jet observables", "network inputs of the event", "input tensors"});
+
+    m_initMemory = {memoryBefore, read_memory_usage()};
+
+    startupSteps.emplace_back("total initialize()", msSince(startInitialize));
+    std::string startupReport;
+    for (const auto& [step, ms] : startupSteps) {
+      startupReport += startupLine(step, ms);
+    }
+    info() << "Startup of the tagger:\n" << startupReport << endmsg;
     return StatusCode::SUCCESS;
   }
 
+  // finalize
+  StatusCode finalize() override {
+    if (m_weaver && m_weaver->onnxRuntime().isProfiling()) {
+      warning() << "The job ended before the last profiled event" << endmsg;
+      endOrtProfiling();
+    }
+    if (m_latency) {
+      info() << "Stage latencies of the tagging:\n" << m_latency->report() << endmsg;
+      if (m_firstEventNs > 0) {
+        info() << "Tagging the first event took " << m_firstEventNs / 1e6 << " ms, the median event "
+               << m_latency->eventHistogram(kNStages).percentileNs(0.5) / 1e6 << " ms" << endmsg;
+      }
+    }
+    if (m_preselection.active() && m_preselectionCounter.nEntries() > 0) {
+      const auto nJets = m_preselectionCounter.nEntries();
+      const auto nSkipped = nJets - m_preselectionCounter.nTrueEntries();
+      std::string cuts;
+      for (size_t cut = 0; cut < m_preselectionCutCounters.size(); ++cut) {
+        const auto name = JetPreselection::name(static_cast<JetPreselection::Result>(cut + 1));
+        cuts += std::string(cut > 0 ? ", " : "") + name + " " +
+                std::to_string(m_preselectionCutCounters[cut].nEntries());
+      }
+      info() << "The preselection skipped " << nSkipped << " of " << nJets << " jets (" << 100. * nSkipped / nJets
+             << " %), first failed cut: " << cuts << endmsg;
+    }
+    if (m_firstStage && m_escalationCounter.nEntries() > 0) {
+      const auto nJets = m_escalationCounter.nEntries();
+      const auto nEscalated = m_escalationCounter.nTrueEntries();
+      info() << "Cascade: " << nEscalated << " of " << nJets << " jets (" << 100. * nEscalated / nJets
+             << " %) were escalated to the full model. Inference time: first stage " << m_firstStageNs / 1e6 / nJets
+             << " ms/jet, full model " << (nEscalated > 0 ? m_fullModelNs / 1e6 / nEscalated : 0.)
+             << " ms/escalated jet" << endmsg;
+      if (nEscalated > 0) {
+        // the full model on all jets, extrapolated from its time per escalated jet
+        const double fullModelOnAllNs = static_cast<double>(m_fullModelNs) / nEscalated * nJets;
+        info() << "The cascade took " << 100. * (m_firstStageNs + m_fullModelNs) / fullModelOnAllNs
+               << " % of the inference time of the full model on all jets. Compare the ROC curves to a run of the "
+                  "full model with extras/cascade/compare_cascade_rocs.py"
+               << endmsg;
+      }
+    }
+    info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+    if (m_weaver && m_weaver->nBatchReductions() > 0) {
+      warning() << "The batch size was reduced " << m_weaver->nBatchReductions() << " times to "
+                << m_weaver->maxBatchSize() << " jets to stay within the memory budget" << endmsg;
+    }
+    if (m_weaver) {
+      info() << "  of which loading the ONNX model: " << m_weaver->onnxRuntime().loadMemory().toString() << endmsg;
+      info() << "Memory taken by the first ONNX Runtime run (arena): "
+             << m_weaver->onnxRuntime().firstRunMemory().toString() << endmsg;
+    }
+    if (m_bufferHighWater && m_bufferHighWater->nEvents() > 0) {
+      info() << "High-water marks of the tagger buffers in " << m_bufferHighWater->nEvents() << " events:\n"
+             << m_bufferHighWater->report() << endmsg;
+    }
+    info() << "Memory at the end of the job: " << MemoryDelta{m_initMemory.after, read_memory_usage()}.toString()
+           << " since initialize()" << endmsg;
+    if (!m_memorySeries.event.empty()) {
+      k4FWCore::putParameter(name() + "_memory_event", m_memorySeries.event, this);
+      k4FWCore::putParameter(name() + "_memory_rss_MB", m_memorySeries.rssMB, this);
+      k4FWCore::putParameter(name() + "_memory_peak_rss_MB", m_memorySeries.peakRssMB, this);
+      k4FWCore::putParameter(name() + "_memory_buffers_kB", m_memorySeries.buffersKB, this);
+    }
+    return Transformer::finalize();
+  }
+
   // properties
 private:
+  /// Timed stages of the tagging of a jet, in the order they run.
+  enum Stage : size_t { kFeatureExtraction, kTranspose, kPreprocessing, kInference, kOutputFill, kNStages };
+
+  /// Buffers of the tagger with a per-event high-water mark.
+  enum Buffer : size_t { kJetObservables, kNetworkInputs, kInputTensor, kNBuffers };
+
+  /// Updates the per-event high-water mark of the jet observables and adds the network inputs of the current jet.
+  void updateBufferBytes(std::vector<size_t>& bytes, const Jet& j,
+                         const rv::RVec<WeaverInterface::ConstituentVars>& jet_const_data) const {
+    size_t inputs = jet_const_data.capacity() * sizeof(WeaverInterface::ConstituentVars);
+    for (const auto& vars : jet_const_data)
+      inputs += vars.capacity() * sizeof(float);
+    bytes[kJetObservables] = std::max(bytes[kJetObservables], j.constituents.capacity() * sizeof(Pfcand));
+    bytes[kNetworkInputs] += inputs; // the inputs of all jets of the event are kept until the inference
+  }
+
+  /// Tags a jet that failed the preselection with kSkippedJetScore for every flavor, in the layout of the output.
+  void fillPlaceholderTags(std::vector<edm4hep::ParticleIDCollection>& tagCollections,
+                           const edm4hep::ReconstructedParticle& jet) const {
+    if (m_compactOutput) {
+      auto jetTag = tagCollections[0].create();
+      jetTag.setParticle(jet);
+      jetTag.setAlgorithmType(m_pidMeta.algoType());
+      jetTag.setType(static_cast<std::int32_t>(JetTagProvenance::kSkipped));
+      jetTag.setLikelihood(kSkippedJetScore);
+      jetTag.setPDG(0);
+      for (size_t i = 0; i < m_flavorNames.size(); ++i) {
+        jetTag.addToParameters(kSkippedJetScore);
+      }
+    } else {
+      for (size_t i = 0; i < m_flavorNames.size(); ++i) {
+        auto jetTag = tagCollections[i].create();
+        jetTag.setParticle(jet);
+        jetTag.setType(static_cast<std::int32_t>(JetTagProvenance::kSkipped));
+        jetTag.setLikelihood(kSkippedJetScore);
+        jetTag.setPDG(m_pdgFlavors[i]);
+      }
+    }
+  }
+
+  /// Adds an entry to the memory time series.
+  void recordMemory(long eventIndex, const std::vector<size_t>& bufferBytes) const {
+    const auto memory = read_memory_usage();
+    size_t buffers = 0;
+    for (const auto bytes : bufferBytes)
+      buffers += bytes;
+    std::lock_guard lock(m_memorySeriesMutex);
+    m_memorySeries.event.push_back(eventIndex);
+    m_memorySeries.rssMB.push_back(memory.rss_kb / 1024.);
+    m_memorySeries.peakRssMB.push_back(memory.peak_rss_kb / 1024.);
+    m_memorySeries.buffersKB.push_back(buffers / 1024.);
+  }
+
+  /**
+   * Runs the network on the inputs of the jets of an event, jet by jet or in batches of up to MaxBatchSize jets, or
+   * sends them all to the tagging server.
+   */
+  std::vector<rv::RVec<float>> runInference(const std::vector<rv::RVec<WeaverInterface::ConstituentVars>>& jetConstData,
+                                            std::vector<StageClock>& clocks) const {
+    std::vector<rv::RVec<float>> jetProbabilities;
+    if (!m_client && m_maxBatchSize <= 1) {
+      for (size_t i = 0; i < jetConstData.size(); ++i) {
+        clocks[i].restart();
+        m_weaver->preprocess(jetConstData[i]);
+        clocks[i].lap(kPreprocessing);
+        jetProbabilities.push_back(m_weaver->infer());
+        clocks[i].lap(kInference);
+      }
+    } else if (!jetConstData.empty()) {
+      WeaverInterface::BatchTiming timing;
+      if (m_client) {
+        // one request per event, the server batches it with the requests of the other jobs
+        jetProbabilities = m_client->tag(jetConstData, m_stageTiming ? &timing : nullptr);
+      } else {
+        const size_t nReductions = m_weaver->nBatchReductions();
+        jetProbabilities = m_weaver->runBatch(jetConstData, m_stageTiming ? &timing : nullptr);
+        if (m_weaver->nBatchReductions() != nReductions) {
+          warning() << "ONNX Runtime ran out of memory, reduced the batch size to " << m_weaver->maxBatchSize()
+                    << " jets" << endmsg;
+        }
+      }
+      // the batches are timed as a whole, every jet gets an equal share
+      for (auto& clock : clocks) {
+        clock.add(kPreprocessing, timing.preprocess_ns / clocks.size());
+        clock.add(kInference, timing.inference_ns / clocks.size());
+      }
+    }
+    return jetProbabilities;
+  }
+
+  /// Runs the first-stage model of the cascade on the inputs of jets, jet by jet or in batches of up to MaxBatchSize.
+  std::vector<rv::RVec<float>>
+  runFirstStage(const std::vector<rv::RVec<WeaverInterface::ConstituentVars>>& jetConstData,
+                WeaverInterface::BatchTiming* timing) const {
+    if (m_maxBatchSize > 1) {
+      return m_firstStage->runBatch(jetConstData, timing);
+    }
+    std::vector<rv::RVec<float>> scores;
+    scores.reserve(jetConstData.size());
+    for (const auto& jet : jetConstData) {
+      const auto start = std::chrono::steady_clock::now();
+      m_firstStage->preprocess(jet);
+      const auto preprocessed = std::chrono::steady_clock::now();
+      scores.push_back(m_firstStage->infer());
+      if (timing) {
+        timing->preprocess_ns += nsBetween(start, preprocessed);
+        timing->inference_ns += nsBetween(preprocessed, std::chrono::steady_clock::now());
+      }
+    }
+    return scores;
+  }
+
+  /// Whether the first-stage scores of a jet are in the ambiguous range, so that it goes to the full model.
+  bool isAmbiguous(const rv::RVec<float>& scores) const {
+    const float score = m_cascadeFlavorIndex < scores.size() ? scores[m_cascadeFlavorIndex] : rv::Max(scores);
+    return score >= m_cascadeAmbiguousRange.value()[0] && score <= m_cascadeAmbiguousRange.value()[1];
+  }
+
+  /**
+   * Cascade: runs the first-stage model on the inputs of all jets (firstStageData), then makes the full-model inputs
+   * of the jets with an ambiguous first-stage score from their observables and runs the full model on these only
+   * (runInference()). Returns the merged scores and sets the provenance of every jet.
+   */
+  std::vector<rv::RVec<float>> runCascade(std::vector<Jet>& jets,
+                                          const std::vector<rv::RVec<WeaverInterface::ConstituentVars>>& firstStageData,
+                                          std::vector<StageClock>& clocks,
+                                          std::vector<JetTagProvenance>& provenance) const {
+    if (jets.empty()) {
+      return {};
+    }
+    auto start = std::chrono::steady_clock::now();
+    WeaverInterface::BatchTiming timing;
+    auto scores = runFirstStage(firstStageData, m_stageTiming ? &timing : nullptr);
+    m_firstStageNs += nsBetween(start, std::chrono::steady_clock::now());
+    for (auto& clock : clocks) {
+      clock.add(kPreprocessing, timing.preprocess_ns / clocks.size());
+      clock.add(kInference, timing.inference_ns / clocks.size());
+    }
+
+    std::vector<size_t> escalated;
+    std::vector<rv::RVec<WeaverInterface::ConstituentVars>> fullModelData;
+    for (size_t i = 0; i < jets.size(); ++i) {
+      const bool ambiguous = isAmbiguous(scores[i]);
+      m_escalationCounter += ambiguous;
+      provenance[i] = ambiguous ? JetTagProvenance::kEscalated : JetTagProvenance::kFirstStage;
+      if (ambiguous) {
+        clocks[i].restart();
+        escalated.push_back(i);
+        fullModelData.push_back(from_Jet_to_onnx_input(jets[i], m_vars));
+        clocks[i].lap(kTranspose);
+      }
+    }
+    if (escalated.empty()) {
+      return scores;
+    }
+
+    std::vector<StageClock> fullModelClocks(escalated.size(), StageClock(m_stageTiming));
+    start = std::chrono::steady_clock::now();
+    const auto fullModelScores = runInference(fullModelData, fullModelClocks);
+    m_fullModelNs += nsBetween(start, std::chrono::steady_clock::now());
+    const float firstStageWeight = m_cascadeFirstStageWeight;
+    for (size_t k = 0; k < escalated.size(); ++k) {
+      auto& merged = scores[escalated[k]];
+      merged = firstStageWeight * merged + (1.f - firstStageWeight) * fullModelScores[k];
+      clocks[escalated[k]].add(kPreprocessing, fullModelClocks[k].ns()[kPreprocessing]);
+      clocks[escalated[k]].add(kInference, fullModelClocks[k].ns()[kInference]);
+    }
+    return scores;
+  }
+
+  /// Creates the session of the first-stage model and checks the cascade properties.
+  StatusCode setUpCascade(const ONNXRuntime::MemoryOptions& memoryOptions,
+                          std::vector<std::pair<std::string, double>>& startupSteps) {
+    const auto start = std::chrono::steady_clock::now();
+    auto json_config = loadJsonFile(m_firstStageJsonPath);
+    if (json_config.is_null()) {
+      error() << "Could not load the JSON configuration file of the first stage " << m_firstStageJsonPath.value()
+              << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (json_config.value("output_names", std::vector<std::string>{}) != m_flavorNames) {
+      error() << "The first-stage model must have the flavors of the full model: " << m_flavorNames << endmsg;
+      return StatusCode::FAILURE;
+    }
+    const auto& range = m_cascadeAmbiguousRange.value();
+    if (range.size() != 2 || range[0] > range[1]) {
+      error() << "CascadeAmbiguousRange must be [low, high] with low <= high" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (m_cascadeFirstStageWeight < 0 || m_cascadeFirstStageWeight > 1) {
+      error() << "CascadeFirstStageWeight must be in [0, 1]" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    m_cascadeFlavorIndex = std::string::npos;
+    if (!m_cascadeFlavor.empty()) {
+      const auto it = std::find(m_flavorNames.begin(), m_flavorNames.end(), m_cascadeFlavor.value());
+      if (it == m_flavorNames.end()) {
+        error() << "CascadeFlavor " << m_cascadeFlavor.value() << " is not one of " << m_flavorNames << endmsg;
+        return StatusCode::FAILURE;
+      }
+      m_cascadeFlavorIndex = std::distance(m_flavorNames.begin(), it);
+    }
+
+    // same variable order as the full model: pf_features, then pf_vectors
+    for (const auto& var : json_config["pf_features"]["var_names"]) {
+      m_firstStageVars.push_back(var.get<std::string>());
+    }
+    for (const auto& var : json_config["pf_vectors"]["var_names"]) {
+      m_firstStageVars.push_back(var.get<std::string>());
+    }
+    try {
+      m_firstStage = std::make_unique<WeaverInterface>(
+          m_firstStageModelPath, WeaverPreprocessor(json_config, m_firstStageVars), memoryOptions);
+    } catch (const std::exception& e) {
+      error() << "Could not set up the first-stage model " << m_firstStageModelPath.value() << ": " << e.what()
+              << endmsg;
+      return StatusCode::FAILURE;
+    }
+    if (m_maxBatchSize > 1) {
+      m_firstStage->setMaxBatchSize(m_maxBatchSize);
+    }
+    startupSteps.emplace_back("setting up the first-stage model", msSince(start));
+    info() << "Cascade: the first-stage model " << m_firstStageModelPath.value()
+           << " tags every jet, the full model the jets whose "
+           << (m_cascadeFlavor.empty() ? "highest score" : m_cascadeFlavor.value() + " score") << " is in [" << range[0]
+           << ", " << range[1] << "]" << endmsg;
+    return StatusCode::SUCCESS;
+  }
+
+  /**
+   * Tags a synthetic event WarmUpRuns times, so that the first real event does not pay for the lazy allocations of
+   * ONNX Runtime (arena, memory pattern, kernel selection), the page faults on the model weights and the first use of
+   * the code of the feature extraction. The jets have as many constituents as the longest input group of the model and
+   * there are as many of them as fit in a batch, i.e. the largest input shapes the tagger can run. Returns the time of
+   * every run in ms.
+   */
+  std::vector<double> warmUp() const {
+    const auto& preprocessor = m_weaver ? m_weaver->preprocessor() : m_client->preprocessor();
+    size_t maxLength = 1;
+    for (const auto& input : preprocessor.inputNames()) {
+      maxLength = std::max(maxLength, preprocessor.params(input).max_length);
+    }
+    SyntheticEventConfig config;
+    config.n_jets = m_weaver && m_maxBatchSize > 1 ? static_cast<int>(m_weaver->maxBatchSize()) : 1;
+    config.multiplicity_distribution = MultiplicityDistribution::kFixed;
+    config.mean_multiplicity = maxLength;
+    config.max_multiplicity = static_cast<int>(maxLength);
+    config.bz = m_retriever->Bz;
+    const auto event = SyntheticEventGenerator(config).generate(0);
+
+    std::vector<double> runMs;
+    for (int run = 0; run < m_warmUpRuns; ++run) {
+      const auto start = std::chrono::steady_clock::now();
+      std::vector<StageClock> clocks(event.jets.size(), StageClock(false));
+      std::vector<rv::RVec<WeaverInterface::ConstituentVars>> jetConstData, firstStageData;
+      for (const auto& jet : event.jets) {
+        Jet j = m_retriever->retrieve_input_observables(jet, event.vertices);
+        jetConstData.push_back(from_Jet_to_onnx_input(j, m_vars));
+        if (m_firstStage) {
+          firstStageData.push_back(from_Jet_to_onnx_input(j, m_firstStageVars));
+        }
+      }
+      runInference(jetConstData, clocks);
+      if (m_firstStage) { // both models of a cascade, whatever the first stage decides
+        runFirstStage(firstStageData, nullptr);
+      }
+      runMs.push_back(msSince(start));
+    }
+    return runMs;
+  }
+
+  static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  static std::uint64_t nsBetween(std::chrono::steady_clock::time_point start,
+                                 std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  }
+
+  /// One line of the startup report.
+  static std::string startupLine(const std::string& step, double ms) {
+    char line[96];
+    std::snprintf(line, sizeof(line), "  %-36s %10.1f ms\n", step.c_str(), ms);
+    return line;
+  }
+
+  void endOrtProfiling() const {
+    const auto profile_file = m_weaver->onnxRuntime().endProfiling();
+    info() << "ONNX Runtime profile written to " << profile_file
+           << " (summarize with extras/ort_profiling/summarize_ort_profile.py)" << endmsg;
+  }
+
   std::vector<std::string> m_flavorNames; // e.g. "recojet_isX" with X being the jet flavor (G, U, S, C, B, D, TAU)
   std::vector<int> m_pdgFlavors;
   rv::RVec<std::string> m_vars; // e.g. pfcand_isEl, ... input names that onnx model expects
 
-  mutable std::unique_ptr<WeaverInterface> m_weaver;
+  edm4hep::utils::ParticleIDMeta m_pidMeta; ///< only used with CompactOutput
+  JetPreselection m_preselection;
+
+  mutable Gaudi::Accumulators::BinomialCounter<> m_preselectionCounter{this, "Jets passing the preselection"};
+  mutable std::deque<Gaudi::Accumulators::Counter<>> m_preselectionCutCounters; ///< one per failed cut, if active
+
+  mutable std::unique_ptr<WeaverInterface> m_weaver; ///< not with ServerSocket
+  mutable std::unique_ptr<TaggingClient> m_client;   ///< only with ServerSocket
   mutable std::unique_ptr<JetObservablesRetriever> m_retriever;
 
+  // cascade, only with FirstStageModelPath
+  mutable std::unique_ptr<WeaverInterface> m_firstStage;
+  rv::RVec<std::string> m_firstStageVars;
+  size_t m_cascadeFlavorIndex{std::string::npos}; ///< npos: the highest score decides
+  mutable Gaudi::Accumulators::BinomialCounter<> m_escalationCounter{this, "Jets escalated to the full model"};
+  mutable std::atomic<std::uint64_t> m_firstStageNs{0}; ///< wall time of the first-stage inference
+  mutable std::atomic<std::uint64_t> m_fullModelNs{0};  ///< wall time of the full-model inference in a cascade
+
+  std::unique_ptr<StageLatency> m_latency;                                      ///< only with StageTiming
+  mutable std::deque<Gaudi::Accumulators::StatCounter<double>> m_stageCounters; ///< one per Stage, in us per jet
+  mutable std::atomic<long> m_eventIndex{0};
+  mutable std::atomic<std::uint64_t> m_firstEventNs{0}; ///< sum of the stages of the first event, with StageTiming
+
+  MemoryDelta m_initMemory;
+  std::unique_ptr<BufferHighWater> m_bufferHighWater; ///< one entry per Buffer
+  /// Memory every MemoryReportInterval events, written to the metadata in finalize
+  struct MemorySeries {
+    std::vector<int> event;
+    std::vector<double> rssMB;
+    std::vector<double> peakRssMB;
+    std::vector<double> buffersKB;
+  };
+  mutable MemorySeries m_memorySeries;
+  mutable std::mutex m_memorySeriesMutex;
+
   Gaudi::Property<std::string> m_modelPath{
       this, "model_path", "/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/fullsimCLD240_2mio.onnx",
       "Path to the ONNX model"};
@@ -159,12 +909,103 @@ private:
       this, "json_path",
       "/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/preprocess_fullsimCLD240_2mio.json",
       "Path to the JSON configuration file for the ONNX model"};
+  Gaudi::Property<std::string> m_bundlePath{
+      this, "bundle_path", "",
+      "Path to a model bundle made with k4MLJetTagger_bundle. If given, it replaces model_path, json_path and "
+      "flavor_collection_names"};
+  Gaudi::Property<bool> m_sharedModelWeights{
+      this, "SharedModelWeights", false,
+      "Use the weights in place in the memory-mapped bundle instead of copying them, so that the jobs of a node "
+      "share them. Needs bundle_path with a model in ORT format"};
+  Gaudi::Property<std::string> m_bundleStageDir{
+      this, "BundleStageDir", "",
+      "Directory on the node, e.g. /dev/shm, to copy the bundle to (once per node) before mapping it (empty: map "
+      "bundle_path directly)"};
+  Gaudi::Property<std::string> m_serverSocket{
+      this, "ServerSocket", "",
+      "Unix socket of a k4MLJetTagger_server serving the model of bundle_path. If given, the jets are sent there "
+      "instead of running the model in this job"};
   Gaudi::Property<std::vector<std::string>> m_flavorCollectionNames{
       this,
       "flavor_collection_names",
       {"RefinedJetTag_G", "RefinedJetTag_U", "RefinedJetTag_S", "RefinedJetTag_C", "RefinedJetTag_B", "RefinedJetTag_D",
        "RefinedJetTag_TAU"},
       "Names of the output collections. Order, size and flavor labels _X must match the network configuration."};
+  Gaudi::Property<bool> m_compactOutput{
+      this, "CompactOutput", false,
+      "Write one collection with one ParticleID per jet holding the scores of all flavors in its parameters"};
+  Gaudi::Property<bool> m_stageTiming{
+      this, "StageTiming", true,
+      "Time the stages of the tagging per jet and print their latency percentiles in finalize"};
+  Gaudi::Property<std::vector<int>> m_latencyMultiplicityBins{
+      this,
+      "LatencyMultiplicityBins",
+      {10, 20, 30, 50, 75},
+      "Upper edges of the constituent multiplicity classes of the latency report"};
+  Gaudi::Property<int> m_ortProfileEvents{this, "ORTProfileEvents", 0,
+                                          "Number of events to run with the ONNX Runtime profiling (0: no profiling)"};
+  Gaudi::Property<int> m_ortProfileFirstEvent{
+      this, "ORTProfileFirstEvent", 1,
+      "First profiled event (counting from 0), skipping the first event(s) with one-off allocations"};
+  Gaudi::Property<std::string> m_ortProfilePrefix{
+      this, "ORTProfilePrefix", "jettagger_ort_profile",
+      "Prefix (may include a directory) of the ONNX Runtime profile, completed with a time stamp and .json"};
+  Gaudi::Property<int> m_memoryReportInterval{
+      this, "MemoryReportInterval", 0,
+      "Store the memory usage of every N-th event as time series in the output file metadata (0: off)"};
+  Gaudi::Property<int> m_maxBatchSize{
+      this, "MaxBatchSize", 1,
+      "Maximum number of jets of an event per ONNX Runtime run. With more than 1, the jets are padded to the maximum "
+      "length of the model inputs"};
+  Gaudi::Property<double> m_memoryBudgetMB{
+      this, "MemoryBudgetMB", 0.,
+      "Maximum size of the ONNX Runtime arena in MB (0: no limit). Also limits the batch size; batches that do not "
+      "fit are split instead of growing the process"};
+  Gaudi::Property<bool> m_cpuArena{this, "CpuArena", true,
+                                   "Pool the ONNX Runtime tensors in an arena (faster) instead of malloc/free"};
+  Gaudi::Property<std::string> m_arenaExtendStrategy{
+      this, "ArenaExtendStrategy", "NextPowerOfTwo",
+      "Growth of the ONNX Runtime arena: NextPowerOfTwo (fewer, larger chunks) or SameAsRequested (tighter RSS)"};
+  Gaudi::Property<double> m_arenaInitialChunkMB{
+      this, "ArenaInitialChunkMB", 0.,
+      "Size of the first chunk of the ONNX Runtime arena in MB, below 2048 MB (0: ONNX Runtime default)"};
+  Gaudi::Property<bool> m_memoryPattern{
+      this, "MemoryPattern", true,
+      "Let ONNX Runtime plan and preallocate the intermediate tensors for every input shape (faster, more memory)"};
+  Gaudi::Property<double> m_preselectionMinEnergy{
+      this, "PreselectionMinEnergy", 0.,
+      "Minimum jet energy in GeV to be tagged (0: no cut). Jets failing the preselection are not run through the "
+      "feature extraction and the network, see SkippedJetTags"};
+  Gaudi::Property<double> m_preselectionMaxAbsCosTheta{this, "PreselectionMaxAbsCosTheta", 1.,
+                                                       "Maximum |cos theta| of a jet to be tagged (1: no cut)"};
+  Gaudi::Property<int> m_preselectionMinConstituents{
+      this, "PreselectionMinConstituents", 0, "Minimum number of constituents of a jet to be tagged (0: no cut)"};
+  Gaudi::Property<std::string> m_skippedJetTags{
+      this, "SkippedJetTags", "Placeholder",
+      "Tags of the jets failing the preselection: Placeholder (a tag with the score -1 for every flavor, keeps the "
+      "tags aligned with the jets) or None (no tag)"};
+  Gaudi::Property<std::string> m_firstStageModelPath{
+      this, "FirstStageModelPath", "",
+      "Path to the ONNX model of a fast first stage that tags every jet, escalating only the ambiguous ones to the "
+      "full model (empty: no cascade)"};
+  Gaudi::Property<std::string> m_firstStageJsonPath{
+      this, "FirstStageJsonPath", "",
+      "Path to the JSON configuration file of the first-stage model, which must have the flavors of the full model"};
+  Gaudi::Property<std::string> m_cascadeFlavor{
+      this, "CascadeFlavor", "",
+      "First-stage score deciding the escalation, e.g. recojet_isB (empty: the highest score of the jet)"};
+  Gaudi::Property<std::vector<double>> m_cascadeAmbiguousRange{
+      this,
+      "CascadeAmbiguousRange",
+      {0.1, 0.9},
+      "Jets with a first-stage score in [low, high] are escalated to the full model"};
+  Gaudi::Property<double> m_cascadeFirstStageWeight{
+      this, "CascadeFirstStageWeight", 0.,
+      "Weight of the first-stage score in the score of an escalated jet, the rest is the full-model score"};
+  Gaudi::Property<int> m_warmUpRuns{
+      this, "WarmUpRuns", 2,
+      "Number of times a synthetic event with the largest input shapes is tagged in initialize(), so that the first "
+      "event does not pay for the lazy allocations of ONNX Runtime (0: no warm-up)"};
 };
 
 DECLARE_COMPONENT(JetTagger)
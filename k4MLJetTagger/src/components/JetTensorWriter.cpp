@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "JetTensorWriter.h"
+#include "Helpers.h"
+#include "Structs.h"
+
+#include <edm4hep/utils/ParticleIDUtils.h>
+
+#include "GaudiKernel/MsgStream.h"
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+DECLARE_COMPONENT(JetTensorWriter)
+
+JetTensorWriter::JetTensorWriter(const std::string& name, ISvcLocator* svcLoc) : Gaudi::Algorithm(name, svcLoc) {
+  declareProperty("InputJets", m_inputJetsHandle, "Collection for input Jets");
+  declareProperty("InputPrimaryVertices", m_inputPrimaryVerticesHandle, "Collection for input Primary Vertices");
+  declareProperty("MCJetTag", m_mcJettagHandle, "Collection for MC Jet Tag used as label");
+}
+
+StatusCode JetTensorWriter::initialize() {
+  const auto memory_before = read_memory_usage();
+  if (Gaudi::Algorithm::initialize().isFailure())
+    return StatusCode::FAILURE;
+
+  if (m_shardSize <= 0) {
+    error() << "ShardSize must be positive" << endmsg;
+    return StatusCode::FAILURE;
+  }
+
+  // same input variables and label order as the JetTagger
+  auto json_config = loadJsonFile(m_jsonPath);
+  if (json_config.is_null()) {
+    error() << "Could not load the preprocessing JSON file " << m_jsonPath.value() << endmsg;
+    return StatusCode::FAILURE;
+  }
+  m_flavorNames = json_config["output_names"].get<std::vector<std::string>>();
+  for (const auto& flavor : m_flavorNames) {
+    m_pdgFlavors.push_back(to_PDGflavor.at(flavor)); // retrieve the PDG number from the flavor name
+  }
+  for (const auto& var : json_config["pf_features"]["var_names"]) {
+    m_vars.push_back(var.get<std::string>());
+  }
+  for (const auto& var : json_config["pf_vectors"]["var_names"]) {
+    m_vars.push_back(var.get<std::string>());
+  }
+
+  try {
+    m_preprocessor = std::make_unique<WeaverPreprocessor>(json_config, m_vars);
+  } catch (const std::exception& exc) {
+    error() << "Failed to set up the preprocessing: " << exc.what() << endmsg;
+    return StatusCode::FAILURE;
+  }
+
+  // JetObservablesRetriever object
+  m_retriever = std::make_unique<JetObservablesRetriever>();
+  m_retriever->Bz = 2.0; // hardcoded for now
+
+  info() << "Writing tensors of " << m_preprocessor->inputNames().size() << " input groups in shards of "
+         << m_shardSize.value() << " jets with prefix " << m_outputPrefix.value() << endmsg;
+
+  m_initMemory = {memory_before, read_memory_usage()};
+  return StatusCode::SUCCESS;
+}
+
+StatusCode JetTensorWriter::execute(const EventContext&) const {
+  const edm4hep::ReconstructedParticleCollection& jet_coll = *m_inputJetsHandle.get();
+  const edm4hep::VertexCollection& prim_vertex_coll = *m_inputPrimaryVerticesHandle.get();
+  const edm4hep::ParticleIDCollection& mc_jettag_coll = *m_mcJettagHandle.get();
+
+  auto mcJetTag_Handler = edm4hep::utils::PIDHandler::from(mc_jettag_coll);
+
+  for (const auto& jet : jet_coll) {
+    // label: index of the MC flavor in the output names of the network
+    auto mcJetTags = mcJetTag_Handler.getPIDs(jet);
+    if (mcJetTags.size() != 1) {
+      error() << "Expected exactly one MC jet tag per jet, found " << mcJetTags.size() << endmsg;
+      ++m_nSkipped;
+      continue;
+    }
+    const auto label_it = std::find(m_pdgFlavors.begin(), m_pdgFlavors.end(), mcJetTags[0].getPDG());
+    if (label_it == m_pdgFlavors.end()) {
+      debug() << "MC jet flavor " << mcJetTags[0].getPDG() << " is not a network output, skipping jet" << endmsg;
+      ++m_nSkipped;
+      continue;
+    }
+
+    Jet j = m_retriever->retrieve_input_observables(jet, prim_vertex_coll);
+    if (j.constituents.empty()) {
+      debug() << "Jet without constituents, skipping jet" << endmsg;
+      ++m_nSkipped;
+      continue;
+    }
+
+    // exactly the same preprocessing as for inference, padded to the maximum length
+    const auto jet_const_data = from_Jet_to_onnx_input(j, m_vars);
+    m_preprocessor->preprocess(jet_const_data, m_data, true);
+    size_t data_bytes = 0;
+    for (const auto& input : m_data)
+      data_bytes += input.capacity() * sizeof(float);
+    m_maxDataBytes = std::max(m_maxDataBytes, data_bytes);
+
+    if (m_inputWriters.empty()) {
+      openShard();
+    }
+    for (size_t i = 0; i < m_inputWriters.size(); ++i) {
+      m_inputWriters[i]->append(m_data[i]);
+    }
+    m_label[0] = std::distance(m_pdgFlavors.begin(), label_it);
+    m_labelWriter->append(m_label);
+    ++m_nJets;
+
+    if (m_labelWriter->rows() >= static_cast<size_t>(m_shardSize.value())) {
+      closeShard();
+    }
+  }
+
+  return StatusCode::SUCCESS;
+}
+
+void JetTensorWriter::openShard() const {
+  char shard_id[16];
+  std::snprintf(shard_id, sizeof(shard_id), "%05zu", m_shards.size());
+  const std::string shard_prefix = m_outputPrefix.value() + "_" + shard_id + "_";
+
+  for (const auto& input : m_preprocessor->inputNames()) {
+    const auto& params = m_preprocessor->params(input);
+    m_inputWriters.push_back(std::make_unique<NpyArrayWriter>(shard_prefix + input + ".npy", NpyArrayWriter::kFloat32,
+                                                              std::vector<size_t>{params.var_names.size(),
+                                                                                  params.max_length}));
+  }
+  m_labelWriter = std::make_unique<NpyArrayWriter>(shard_prefix + "label.npy", NpyArrayWriter::kInt32,
+                                                   std::vector<size_t>{});
+}
+
+void JetTensorWriter::closeShard() const {
+  if (!m_labelWriter) {
+    return;
+  }
+  Shard shard{m_labelWriter->rows(), {}};
+  for (auto& writer : m_inputWriters) {
+    writer->close();
+    shard.files.push_back(writer->path());
+  }
+  m_labelWriter->close();
+  shard.files.push_back(m_labelWriter->path());
+  m_shards.push_back(shard);
+
+  debug() << "Closed shard " << m_shards.size() - 1 << " with " << shard.n_jets << " jets" << endmsg;
+  m_inputWriters.clear();
+  m_labelWriter.reset();
+}
+
+void JetTensorWriter::writeIndex() const {
+  // file names are stored relative to the index file so that the directory can be moved
+  auto basename = [](const std::string& path) {
+    const auto pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+  };
+
+  nlohmann::json index;
+  index["format"] = "k4MLJetTagger-tensors";
+  index["version"] = 1;
+  index["preprocessing_json"] = m_jsonPath.value();
+  index["n_jets"] = m_nJets;
+  for (const auto& input : m_preprocessor->inputNames()) {
+    const auto& params = m_preprocessor->params(input);
+    index["inputs"].push_back({{"name", input},
+                               {"dtype", NpyArrayWriter::kFloat32},
+                               {"shape", {params.var_names.size(), params.max_length}},
+                               {"var_names", params.var_names}});
+  }
+  index["label"] = {{"dtype", NpyArrayWriter::kInt32}, {"names", m_flavorNames}, {"pdg", m_pdgFlavors}};
+  index["shards"] = nlohmann::json::array();
+  for (const auto& shard : m_shards) {
+    nlohmann::json files;
+    for (size_t i = 0; i < m_preprocessor->inputNames().size(); ++i) {
+      files[m_preprocessor->inputNames()[i]] = basename(shard.files[i]);
+    }
+    files["label"] = basename(shard.files.back());
+    index["shards"].push_back({{"n_jets", shard.n_jets}, {"files", files}});
+  }
+
+  const std::string index_path = m_outputPrefix.value() + "_index.json";
+  std::ofstream index_file(index_path);
+  index_file << index.dump(2) << std::endl;
+  info() << "Wrote " << m_nJets << " jets in " << m_shards.size() << " shards, index: " << index_path << endmsg;
+}
+
+StatusCode JetTensorWriter::finalize() {
+  closeShard();
+  if (m_preprocessor) {
+    writeIndex();
+  }
+  if (m_nSkipped > 0) {
+    info() << "Skipped " << m_nSkipped << " jets without constituents or valid MC label" << endmsg;
+  }
+
+  info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+  info() << "Largest preprocessed jet buffer: " << format_bytes(m_maxDataBytes) << endmsg;
+
+  if (Gaudi::Algorithm::finalize().isFailure())
+    return StatusCode::FAILURE;
+
+  return StatusCode::SUCCESS;
+}
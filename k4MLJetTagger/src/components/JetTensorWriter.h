@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef JETTENSORWRITER_H
+#define JETTENSORWRITER_H
+
+#include "Gaudi/Algorithm.h"
+#include "Gaudi/Property.h"
+#include "k4FWCore/DataHandle.h"
+
+#include <edm4hep/ParticleIDCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <edm4hep/VertexCollection.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "JetObservablesRetriever.h"
+#include "MemoryUsage.h"
+#include "NpyWriter.h"
+#include "WeaverPreprocessor.h"
+
+/**
+ * @class JetTensorWriter
+ * @brief Gaudi algorithm that exports training-ready tensors of the jet constituent observables.
+ *
+ * Instead of the ragged TTree written by JetObsWriter, this algorithm writes the inputs exactly as the network sees
+ * them at inference: the observables retrieved with JetObservablesRetriever are standardized and padded with the
+ * WeaverPreprocessor built from the preprocessing JSON of the model. Every input group (e.g. pf_points, pf_features,
+ * pf_vectors, pf_mask) is written as a float32 array of shape [jets, vars, max_length] and the MC label (index of
+ * the jet flavor in the "output_names" of the JSON file) as an int32 array of shape [jets].
+ *
+ * The arrays are split into shards of at most ShardSize jets, each shard being one .npy file per input group plus one
+ * for the labels. An index file <OutputPrefix>_index.json lists the shards, the shapes and the variable names. All
+ * files can be memory-mapped with numpy.load(..., mmap_mode="r") and streamed into the training without copies. As
+ * the preprocessing code is shared with WeaverInterface, training and inference see bit-identical inputs.
+ *
+ * Jets without constituents or without a known MC flavor are skipped.
+ *
+ * @author Sara Aumiller
+ */
+class JetTensorWriter : public Gaudi::Algorithm {
+public:
+  /// Constructor.
+  JetTensorWriter(const std::string& name, ISvcLocator* svcLoc);
+  /// Destructor.
+  ~JetTensorWriter() {};
+  /// Initialize.
+  StatusCode initialize() override;
+  /// Execute function.
+  StatusCode execute(const EventContext&) const override;
+  /// Finalize.
+  StatusCode finalize() override;
+
+private:
+  /// Open the .npy files of the next shard.
+  void openShard() const;
+  /// Close the .npy files of the current shard and remember them for the index file.
+  void closeShard() const;
+  /// Write the index file describing all shards.
+  void writeIndex() const;
+
+  mutable k4FWCore::DataHandle<edm4hep::ReconstructedParticleCollection> m_inputJetsHandle{
+      "InputJets", Gaudi::DataHandle::Reader, this};
+  mutable k4FWCore::DataHandle<edm4hep::VertexCollection> m_inputPrimaryVerticesHandle{"InputPrimaryVertices",
+                                                                                       Gaudi::DataHandle::Reader, this};
+  mutable k4FWCore::DataHandle<edm4hep::ParticleIDCollection> m_mcJettagHandle{"MCJetTag", Gaudi::DataHandle::Reader,
+                                                                               this};
+
+  Gaudi::Property<std::string> m_jsonPath{
+      this, "json_path",
+      "/eos/experiment/fcc/ee/jet_flavour_tagging/fullsim_test_spring2024/preprocess_fullsimCLD240_2mio.json",
+      "Path to the JSON preprocessing configuration of the model the tensors are meant for"};
+  Gaudi::Property<std::string> m_outputPrefix{this, "OutputPrefix", "jet_tensors",
+                                              "Prefix (may include a directory) of the .npy shards and index file"};
+  Gaudi::Property<int> m_shardSize{this, "ShardSize", 100000, "Maximum number of jets per shard"};
+
+  std::unique_ptr<JetObservablesRetriever> m_retriever;
+  std::unique_ptr<WeaverPreprocessor> m_preprocessor;
+  rv::RVec<std::string> m_vars;           // e.g. pfcand_isEl, ... input names that onnx model expects
+  std::vector<std::string> m_flavorNames; // e.g. "recojet_isX" with X being the jet flavor (G, U, S, C, B, D, TAU)
+  std::vector<int> m_pdgFlavors;          // PDG of each flavor, the label is the index in this list
+
+  struct Shard {
+    size_t n_jets;
+    std::vector<std::string> files; // one per input group, followed by the label file
+  };
+
+  mutable std::vector<std::unique_ptr<NpyArrayWriter>> m_inputWriters; // one per input group of the current shard
+  mutable std::unique_ptr<NpyArrayWriter> m_labelWriter;
+  mutable std::vector<Shard> m_shards;
+  mutable WeaverPreprocessor::Tensor m_data;
+  mutable size_t m_maxDataBytes{0}; ///< high-water mark of m_data
+  MemoryDelta m_initMemory;         ///< RSS taken by initialize()
+  mutable std::vector<std::int32_t> m_label{0};
+  mutable size_t m_nJets{0};
+  mutable size_t m_nSkipped{0};
+};
+
+#endif // JETTENSORWRITER_H
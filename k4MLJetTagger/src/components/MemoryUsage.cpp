@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "MemoryUsage.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+MemorySnapshot read_memory_usage() {
+  MemorySnapshot snapshot;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    // e.g. "VmRSS:	  412345 kB"
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      snapshot.rss_kb = std::stol(line.substr(6));
+    else if (line.compare(0, 6, "VmHWM:") == 0)
+      snapshot.peak_rss_kb = std::stol(line.substr(6));
+    else if (line.compare(0, 8, "RssAnon:") == 0)
+      snapshot.rss_anon_kb = std::stol(line.substr(8));
+  }
+  return snapshot;
+}
+
+std::string format_bytes(double bytes) {
+  const char* units[] = {"B", "kB", "MB", "GB", "TB"};
+  size_t unit = 0;
+  while ((bytes >= 1024. || bytes <= -1024.) && unit + 1 < std::size(units)) {
+    bytes /= 1024.;
+    ++unit;
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+  return text;
+}
+
+std::string MemoryDelta::toString() const {
+  if (!valid())
+    return "not available";
+  const auto signed_bytes = [](long kb) { return (kb >= 0 ? "+" : "") + format_bytes(1024. * kb); };
+  auto text = "RSS " + signed_bytes(after.rss_kb - before.rss_kb) + " (" + format_bytes(1024. * after.rss_kb) +
+              "), peak RSS " + signed_bytes(after.peak_rss_kb - before.peak_rss_kb) + " (" +
+              format_bytes(1024. * after.peak_rss_kb) + ")";
+  // the weights of a model used in place from a mapped file are in the RSS, but not in the anonymous RSS
+  if (before.rss_anon_kb >= 0 && after.rss_anon_kb >= 0)
+    text += ", anonymous RSS " + signed_bytes(after.rss_anon_kb - before.rss_anon_kb);
+  return text;
+}
+
+BufferHighWater::BufferHighWater(std::vector<std::string> names) : m_names(std::move(names)) {
+  m_max.resize(m_names.size());
+  m_sum.resize(m_names.size());
+}
+
+void BufferHighWater::recordEvent(const std::vector<size_t>& bytes) {
+  if (bytes.size() != m_names.size())
+    throw std::invalid_argument("BufferHighWater: expected " + std::to_string(m_names.size()) + " buffer sizes, got " +
+                                std::to_string(bytes.size()));
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    size_t current = m_max[i].load(std::memory_order_relaxed);
+    while (bytes[i] > current && !m_max[i].compare_exchange_weak(current, bytes[i], std::memory_order_relaxed)) {
+    }
+    m_sum[i].fetch_add(bytes[i], std::memory_order_relaxed);
+  }
+  m_nEvents.fetch_add(1, std::memory_order_relaxed);
+}
+
+double BufferHighWater::meanBytes(size_t buffer) const {
+  const size_t n = nEvents();
+  return n > 0 ? static_cast<double>(m_sum[buffer].load(std::memory_order_relaxed)) / n : 0.;
+}
+
+std::string BufferHighWater::report() const {
+  std::string out;
+  char line[160];
+  for (size_t i = 0; i < size(); ++i) {
+    std::snprintf(line, sizeof(line), "  %-28s max %12s, mean %12s per event\n", m_names[i].c_str(),
+                  format_bytes(maxBytes(i)).c_str(), format_bytes(meanBytes(i)).c_str());
+    out += line;
+  }
+  return out;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+/// Resident set size (RSS) of the process and its peak so far, in kB. Negative if not available (non-Linux).
+struct MemorySnapshot {
+  long rss_kb{-1};
+  long peak_rss_kb{-1};
+  long rss_anon_kb{-1}; ///< the part of the RSS private to the process (not mapped files or shared memory)
+
+  bool valid() const { return rss_kb >= 0; }
+};
+
+/// Reads the current and peak RSS of the process from /proc/self/status.
+MemorySnapshot read_memory_usage();
+
+/// Change of the memory usage between two snapshots, e.g. around initialize().
+struct MemoryDelta {
+  MemorySnapshot before;
+  MemorySnapshot after;
+
+  bool valid() const { return before.valid() && after.valid(); }
+  /// e.g. "RSS +120.3 MB (412.0 MB), peak RSS +150.1 MB (450.2 MB), anonymous RSS +20.1 MB", or "not available".
+  std::string toString() const;
+};
+
+/// Formats a number of bytes with a unit, e.g. "1.5 MB".
+std::string format_bytes(double bytes);
+
+/**
+ * @class BufferHighWater
+ * @brief High-water marks of the size of named buffers, per event and over the whole job.
+ *
+ * The caller tracks the largest size of every buffer within an event and records it with recordEvent(). The class
+ * keeps the maximum and the mean of these per-event high-water marks. recordEvent() only uses relaxed atomics, so it
+ * can be called from several threads.
+ */
+class BufferHighWater {
+public:
+  explicit BufferHighWater(std::vector<std::string> names);
+
+  size_t size() const { return m_names.size(); }
+  const std::string& name(size_t buffer) const { return m_names[buffer]; }
+
+  /// Records the high-water marks (bytes) of one event, one entry per buffer.
+  void recordEvent(const std::vector<size_t>& bytes);
+
+  size_t maxBytes(size_t buffer) const { return m_max[buffer].load(std::memory_order_relaxed); }
+  double meanBytes(size_t buffer) const;
+  size_t nEvents() const { return m_nEvents.load(std::memory_order_relaxed); }
+
+  /// One line per buffer with the maximum and mean per-event high-water mark.
+  std::string report() const;
+
+private:
+  std::vector<std::string> m_names;
+  std::deque<std::atomic<size_t>> m_max; ///< atomics cannot be moved
+  std::deque<std::atomic<size_t>> m_sum;
+  std::atomic<size_t> m_nEvents{0};
+};
+
+#endif // MEMORYUSAGE_H
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "ModelBundle.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::endian::native == std::endian::little, "ModelBundle reads and writes little-endian data directly");
+
+namespace {
+
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kSectionEntrySize = 24; // type, reserved, offset, size
+constexpr size_t kAlignment = 64;
+
+size_t align(size_t offset) { return (offset + kAlignment - 1) / kAlignment * kAlignment; }
+
+/// Appends little-endian values and strings to a section.
+class Encoder {
+public:
+  template <typename T>
+  void put(T value) {
+    static_assert(std::is_arithmetic_v<T>);
+    m_data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  void putString(const std::string& value) {
+    put<std::uint32_t>(value.size());
+    m_data += value;
+  }
+  std::string& data() { return m_data; }
+
+private:
+  std::string m_data;
+};
+
+/// Reads what the Encoder wrote, with bounds checks.
+class Decoder {
+public:
+  Decoder(std::string_view data, const char* section) : m_data(data), m_section(section) {}
+
+  template <typename T>
+  T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+  std::string getString() {
+    const auto size = get<std::uint32_t>();
+    return std::string(take(size), size);
+  }
+  bool done() const { return m_pos == m_data.size(); }
+
+private:
+  const char* take(size_t size) {
+    if (size > m_data.size() - m_pos)
+      throw std::runtime_error(std::string("Truncated ") + m_section + " section");
+    const char* data = m_data.data() + m_pos;
+    m_pos += size;
+    return data;
+  }
+
+  std::string_view m_data;
+  const char* m_section;
+  size_t m_pos{0};
+};
+
+std::string encodePreprocessing(const std::vector<WeaverPreprocessor::PreprocessParams>& groups) {
+  Encoder out;
+  out.put<std::uint32_t>(groups.size());
+  for (const auto& group : groups) {
+    out.putString(group.name);
+    out.put<std::uint64_t>(group.min_length);
+    out.put<std::uint64_t>(group.max_length);
+    out.put<std::uint8_t>(group.fixed_length);
+    out.put<std::uint32_t>(group.var_names.size());
+    for (const auto& name : group.var_names) {
+      const auto& info = group.info(name);
+      out.putString(name);
+      for (const float value :
+           {info.center, info.norm_factor, info.replace_inf_value, info.lower_bound, info.upper_bound, info.pad})
+        out.put<float>(value);
+    }
+  }
+  return std::move(out.data());
+}
+
+std::vector<WeaverPreprocessor::PreprocessParams> decodePreprocessing(std::string_view data) {
+  Decoder in(data, "preprocessing");
+  std::vector<WeaverPreprocessor::PreprocessParams> groups(in.get<std::uint32_t>());
+  for (auto& group : groups) {
+    group.name = in.getString();
+    group.min_length = in.get<std::uint64_t>();
+    group.max_length = in.get<std::uint64_t>();
+    group.fixed_length = in.get<std::uint8_t>() != 0;
+    group.var_names.resize(in.get<std::uint32_t>());
+    for (auto& name : group.var_names) {
+      name = in.getString();
+      std::array<float, 6> values;
+      for (auto& value : values)
+        value = in.get<float>();
+      group.var_info_map[name] = {values[0], values[1], values[2], values[3], values[4], values[5]};
+    }
+    if (group.min_length > group.max_length)
+      throw std::runtime_error("Input group '" + group.name + "' has min_length > max_length");
+  }
+  if (!in.done())
+    throw std::runtime_error("Unexpected data at the end of the preprocessing section");
+  return groups;
+}
+
+std::string encodeStrings(const std::vector<std::string>& strings) {
+  Encoder out;
+  out.put<std::uint32_t>(strings.size());
+  for (const auto& value : strings)
+    out.putString(value);
+  return std::move(out.data());
+}
+
+std::vector<std::string> decodeStrings(std::string_view data, const char* section) {
+  Decoder in(data, section);
+  std::vector<std::string> strings(in.get<std::uint32_t>());
+  for (auto& value : strings)
+    value = in.getString();
+  if (!in.done())
+    throw std::runtime_error(std::string("Unexpected data at the end of the ") + section + " section");
+  return strings;
+}
+
+std::string encodeFlavors(const std::vector<BundleFlavor>& flavors) {
+  Encoder out;
+  out.put<std::uint32_t>(flavors.size());
+  for (const auto& flavor : flavors) {
+    out.putString(flavor.name);
+    out.put<std::int32_t>(flavor.pdg);
+    out.putString(flavor.collection);
+  }
+  return std::move(out.data());
+}
+
+std::vector<BundleFlavor> decodeFlavors(std::string_view data) {
+  Decoder in(data, "flavors");
+  std::vector<BundleFlavor> flavors(in.get<std::uint32_t>());
+  for (auto& flavor : flavors) {
+    flavor.name = in.getString();
+    flavor.pdg = in.get<std::int32_t>();
+    flavor.collection = in.getString();
+  }
+  if (!in.done())
+    throw std::runtime_error("Unexpected data at the end of the flavors section");
+  return flavors;
+}
+
+std::string encodeMetadata(const std::map<std::string, std::string>& metadata) {
+  Encoder out;
+  out.put<std::uint32_t>(metadata.size());
+  for (const auto& [key, value] : metadata) {
+    out.putString(key);
+    out.putString(value);
+  }
+  return std::move(out.data());
+}
+
+std::map<std::string, std::string> decodeMetadata(std::string_view data) {
+  Decoder in(data, "metadata");
+  std::map<std::string, std::string> metadata;
+  const auto n = in.get<std::uint32_t>();
+  for (std::uint32_t i = 0; i < n; ++i) {
+    auto key = in.getString();
+    metadata[key] = in.getString();
+  }
+  if (!in.done())
+    throw std::runtime_error("Unexpected data at the end of the metadata section");
+  return metadata;
+}
+
+} // namespace
+
+std::uint32_t ModelBundle::crc32(const void* data, size_t size, std::uint32_t crc) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i)
+    crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+std::uint32_t ModelBundle::write(const std::string& path, const ModelBundleContents& contents) {
+  const std::vector<std::pair<Section, std::string>> sections = {
+      {kModel, contents.model},
+      {kPreprocessing, encodePreprocessing(contents.preprocessing)},
+      {kVariables, encodeStrings(contents.variables)},
+      {kFlavors, encodeFlavors(contents.flavors)},
+      {kMetadata, encodeMetadata(contents.metadata)}};
+
+  // header, section table, then the aligned sections
+  Encoder table;
+  size_t offset = align(kHeaderSize + sections.size() * kSectionEntrySize);
+  std::vector<size_t> offsets;
+  for (const auto& [type, data] : sections) {
+    table.put<std::uint32_t>(type);
+    table.put<std::uint32_t>(0);
+    table.put<std::uint64_t>(offset);
+    table.put<std::uint64_t>(data.size());
+    offsets.push_back(offset);
+    offset = align(offset + data.size());
+  }
+  std::string image(offset, '\0');
+  std::memcpy(image.data() + kHeaderSize, table.data().data(), table.data().size());
+  for (size_t i = 0; i < sections.size(); ++i)
+    std::memcpy(image.data() + offsets[i], sections[i].second.data(), sections[i].second.size());
+
+  const std::uint32_t checksum = crc32(image.data() + kHeaderSize, image.size() - kHeaderSize);
+  Encoder header;
+  header.data().append(kMagic, sizeof(kMagic));
+  header.put<std::uint32_t>(kFormatVersion);
+  header.put<std::uint32_t>(sections.size());
+  header.put<std::uint64_t>(image.size());
+  header.put<std::uint32_t>(checksum);
+  std::memcpy(image.data(), header.data().data(), header.data().size());
+
+  // write next to the target and rename, so that a job never maps a half-written bundle
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.write(image.data(), image.size()))
+      throw std::runtime_error("Could not write the model bundle " + tmp_path);
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("Could not move the model bundle to " + path + ": " + std::strerror(errno));
+  return checksum;
+}
+
+std::string ModelBundle::stage(const std::string& path, const std::string& directory) {
+  std::ifstream file(path, std::ios::binary);
+  char header[kHeaderSize];
+  if (!file.read(header, kHeaderSize) || std::memcmp(header, kMagic, sizeof(kMagic)) != 0)
+    throw std::runtime_error("Could not stage " + path + ": not a model bundle");
+  Decoder decoder({header, kHeaderSize}, "header");
+  decoder.get<std::uint64_t>(); // magic
+  decoder.get<std::uint32_t>(); // format version
+  decoder.get<std::uint32_t>(); // number of sections
+  const auto size = decoder.get<std::uint64_t>();
+  const auto checksum = decoder.get<std::uint32_t>();
+
+  // the checksum in the name: a changed bundle gets a new copy instead of replacing one that jobs have mapped
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), "-%08x", checksum);
+  const auto staged = std::filesystem::path(directory) / (std::filesystem::path(path).stem().string() + suffix +
+                                                          std::filesystem::path(path).extension().string());
+  std::error_code error;
+  if (std::filesystem::file_size(staged, error) == size && !error)
+    return staged.string();
+  // jobs starting at the same time copy to their own file, the renames replace a copy by an identical one
+  const auto tmp = staged.string() + ".tmp." + std::to_string(::getpid());
+  if (!std::filesystem::copy_file(path, tmp, std::filesystem::copy_options::overwrite_existing, error) ||
+      std::rename(tmp.c_str(), staged.c_str()) != 0) {
+    std::filesystem::remove(tmp, error);
+    throw std::runtime_error("Could not stage the model bundle " + path + " in " + directory);
+  }
+  return staged.string();
+}
+
+bool ModelBundle::isOrtFormat(std::string_view model) {
+  // ORT-format models are flatbuffers with the file identifier "ORTM" after the root offset
+  return model.size() >= 8 && model.substr(4, 4) == "ORTM";
+}
+
+ModelBundle::ModelBundle(const std::string& path, bool verify_checksum) : m_path(path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Could not open the model bundle " + path + ": " + std::strerror(errno));
+  struct stat status;
+  if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(kHeaderSize)) {
+    ::close(fd);
+    throw std::runtime_error("The model bundle " + path + " is too short");
+  }
+  m_size = status.st_size;
+  void* mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Could not map the model bundle " + path + ": " + std::strerror(errno));
+  m_data = static_cast<const char*>(mapping);
+
+  try {
+    Decoder header({m_data, kHeaderSize}, "header");
+    if (std::memcmp(m_data, kMagic, sizeof(kMagic)) != 0)
+      throw std::runtime_error("not a model bundle (wrong magic number)");
+    header.get<std::uint64_t>(); // magic
+    m_formatVersion = header.get<std::uint32_t>();
+    if (m_formatVersion == 0 || m_formatVersion > kFormatVersion)
+      throw std::runtime_error("format version " + std::to_string(m_formatVersion) + " is not supported (at most " +
+                               std::to_string(kFormatVersion) + ")");
+    const auto n_sections = header.get<std::uint32_t>();
+    if (header.get<std::uint64_t>() != m_size)
+      throw std::runtime_error("the file size does not match the header, the file is truncated");
+    m_checksum = header.get<std::uint32_t>();
+    if (verify_checksum && crc32(m_data + kHeaderSize, m_size - kHeaderSize) != m_checksum)
+      throw std::runtime_error("checksum mismatch, the file is corrupted");
+
+    const size_t table_end = kHeaderSize + static_cast<size_t>(n_sections) * kSectionEntrySize;
+    if (table_end > m_size)
+      throw std::runtime_error("the section table is truncated");
+    Decoder table({m_data + kHeaderSize, table_end - kHeaderSize}, "section table");
+    std::map<std::uint32_t, std::string_view> sections;
+    for (std::uint32_t i = 0; i < n_sections; ++i) {
+      const auto type = table.get<std::uint32_t>();
+      table.get<std::uint32_t>(); // reserved
+      const auto offset = table.get<std::uint64_t>();
+      const auto size = table.get<std::uint64_t>();
+      if (offset < table_end || offset > m_size || size > m_size - offset)
+        throw std::runtime_error("section " + std::to_string(type) + " lies outside of the file");
+      if (!sections.emplace(type, std::string_view(m_data + offset, size)).second)
+        throw std::runtime_error("section " + std::to_string(type) + " appears twice");
+    }
+    const auto section = [&sections](Section type, const char* name) {
+      const auto it = sections.find(type);
+      if (it == sections.end())
+        throw std::runtime_error(std::string("the ") + name + " section is missing");
+      return it->second;
+    };
+
+    m_model = section(kModel, "model");
+    m_preprocessing = decodePreprocessing(section(kPreprocessing, "preprocessing"));
+    m_variables = decodeStrings(section(kVariables, "variables"), "variables");
+    m_flavors = decodeFlavors(section(kFlavors, "flavors"));
+    if (sections.count(kMetadata))
+      m_metadata = decodeMetadata(sections.at(kMetadata));
+
+    if (m_model.empty() || m_preprocessing.empty() || m_flavors.empty())
+      throw std::runtime_error("the model, the preprocessing or the flavors are empty");
+    // every input variable must be provided by the JetTagger, except the masks which the preprocessing creates
+    for (const auto& group : m_preprocessing) {
+      for (const auto& name : group.var_names) {
+        if (name.find("_mask") == std::string::npos &&
+            std::find(m_variables.begin(), m_variables.end(), name) == m_variables.end())
+          throw std::runtime_error("input variable '" + name + "' of group '" + group.name +
+                                   "' is missing from the variables");
+      }
+    }
+  } catch (const std::runtime_error& e) {
+    ::munmap(const_cast<char*>(m_data), m_size);
+    throw std::runtime_error("Invalid model bundle " + path + ": " + e.what());
+  }
+}
+
+ModelBundle::~ModelBundle() {
+  if (m_data)
+    ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+std::vector<std::string> ModelBundle::flavorNames() const {
+  std::vector<std::string> names;
+  for (const auto& flavor : m_flavors)
+    names.push_back(flavor.name);
+  return names;
+}
+
+std::vector<int> ModelBundle::pdgCodes() const {
+  std::vector<int> codes;
+  for (const auto& flavor : m_flavors)
+    codes.push_back(flavor.pdg);
+  return codes;
+}
+
+std::vector<std::string> ModelBundle::collectionNames() const {
+  std::vector<std::string> names;
+  for (const auto& flavor : m_flavors)
+    names.push_back(flavor.collection);
+  return names;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MODELBUNDLE_H
+#define MODELBUNDLE_H
+
+#include "WeaverPreprocessor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// One output of the network: the flavor name in the model, its PDG code and the output collection of the JetTagger.
+struct BundleFlavor {
+  std::string name;       ///< e.g. recojet_isB
+  int pdg{0};             ///< e.g. 5
+  std::string collection; ///< e.g. RefinedJetTag_B
+};
+
+/// Everything a ModelBundle holds, as written by ModelBundle::write().
+struct ModelBundleContents {
+  std::string model;                                               ///< bytes of the ONNX or ORT-format model
+  std::vector<WeaverPreprocessor::PreprocessParams> preprocessing; ///< input groups, in model order
+  std::vector<std::string> variables;                              ///< constituent variables, in input order
+  std::vector<BundleFlavor> flavors;                               ///< outputs of the network, in model order
+  std::map<std::string, std::string> metadata;                     ///< free-form, e.g. the source files
+};
+
+/**
+ * @class ModelBundle
+ * @brief A deployed tagger in one file: the ONNX model, its preprocessing, the variable order and the flavor mapping.
+ *
+ * The file starts with a fixed header (magic, format version, file size, CRC-32 of everything after the header),
+ * followed by a table of sections and the sections, each aligned to 64 bytes:
+ * - model: the bytes of the ONNX model, handed to ONNX Runtime directly from the mapped file. A model in ORT format
+ *   can be used in place, so that the processes of a node mapping the same file share its weights,
+ * - preprocessing: the parameters of every input group (lengths and center, scale, bounds and padding of every
+ *   variable), in binary form so that loading does not parse any JSON,
+ * - variables: the constituent variables in the order the JetTagger hands them to the preprocessing,
+ * - flavors: the network outputs with their PDG codes and output collection names,
+ * - metadata: key-value strings, e.g. the source files and the creation time.
+ * All integers and floats are little-endian, strings are a uint32 length followed by the characters.
+ *
+ * The constructor maps the file read-only, checks the header, the section table and the checksum, and decodes the small
+ * sections. The model stays in the mapping, which lives as long as the ModelBundle. The bundles are created with the
+ * k4MLJetTagger_bundle tool. A bundle with a newer format version is rejected.
+ */
+class ModelBundle {
+public:
+  static constexpr char kMagic[8] = {'K', '4', 'J', 'T', 'B', 'N', 'D', 'L'};
+  static constexpr std::uint32_t kFormatVersion = 1;
+
+  /// Types of the sections.
+  enum Section : std::uint32_t { kModel = 1, kPreprocessing = 2, kVariables = 3, kFlavors = 4, kMetadata = 5 };
+
+  /**
+   * @brief Maps a bundle file and validates it.
+   *
+   * @param path Path to the bundle.
+   * @param verify_checksum Whether to compute the CRC-32 of the file, which reads all of it once.
+   * Throws std::runtime_error if the file cannot be mapped or is not a valid bundle.
+   */
+  explicit ModelBundle(const std::string& path, bool verify_checksum = true);
+  ~ModelBundle();
+
+  ModelBundle(const ModelBundle&) = delete;
+  ModelBundle& operator=(const ModelBundle&) = delete;
+
+  /**
+   * @brief Writes a bundle. Throws std::runtime_error if the file cannot be written.
+   *
+   * @return The CRC-32 stored in the header.
+   */
+  static std::uint32_t write(const std::string& path, const ModelBundleContents& contents);
+
+  /// CRC-32 (IEEE 802.3, as zlib) of a buffer, continuing from crc.
+  static std::uint32_t crc32(const void* data, size_t size, std::uint32_t crc = 0);
+
+  /**
+   * @brief Copies a bundle into a directory, e.g. /dev/shm, unless an identical copy is already there.
+   *
+   * The copy is named after the bundle and its checksum, so that the jobs of a node map the same file. Throws
+   * std::runtime_error if the file is not a bundle or cannot be copied.
+   *
+   * @return The path of the copy.
+   */
+  static std::string stage(const std::string& path, const std::string& directory);
+
+  /// Whether model bytes are an ORT-format model (which ONNX Runtime can use in place) rather than an ONNX model.
+  static bool isOrtFormat(std::string_view model);
+
+  const std::string& path() const { return m_path; }
+  std::uint32_t formatVersion() const { return m_formatVersion; }
+  std::uint32_t checksum() const { return m_checksum; }
+  size_t fileSize() const { return m_size; }
+
+  /// The ONNX or ORT-format model, pointing into the mapped file.
+  std::string_view model() const { return m_model; }
+  bool modelIsOrtFormat() const { return isOrtFormat(m_model); }
+  const std::vector<WeaverPreprocessor::PreprocessParams>& preprocessing() const { return m_preprocessing; }
+  const std::vector<std::string>& variables() const { return m_variables; }
+  const std::vector<BundleFlavor>& flavors() const { return m_flavors; }
+  const std::map<std::string, std::string>& metadata() const { return m_metadata; }
+
+  /// Flavor names, PDG codes and collection names as separate lists, in model order.
+  std::vector<std::string> flavorNames() const;
+  std::vector<int> pdgCodes() const;
+  std::vector<std::string> collectionNames() const;
+
+private:
+  std::string m_path;
+  const char* m_data{nullptr}; ///< the mapped file
+  size_t m_size{0};
+  std::uint32_t m_formatVersion{0};
+  std::uint32_t m_checksum{0};
+
+  std::string_view m_model;
+  std::vector<WeaverPreprocessor::PreprocessParams> m_preprocessing;
+  std::vector<std::string> m_variables;
+  std::vector<BundleFlavor> m_flavors;
+  std::map<std::string, std::string> m_metadata;
+};
+
+#endif // MODELBUNDLE_H
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "NpyWriter.h"
+
+#include <stdexcept>
+
+namespace {
+// magic string (6) + version (2) + header length (2) + header dict; the total must be a multiple of 64
+constexpr size_t kPreambleSize = 10;
+constexpr size_t kHeaderSize = 128;
+} // namespace
+
+NpyArrayWriter::NpyArrayWriter(const std::string& path, const std::string& dtype, const std::vector<size_t>& row_shape)
+    : m_path(path), m_dtype(dtype), m_rowShape(row_shape) {
+  if (m_dtype != kFloat32 && m_dtype != kInt32)
+    throw std::invalid_argument("Unsupported npy dtype '" + m_dtype + "'");
+  for (const auto dim : m_rowShape)
+    m_rowSize *= dim;
+
+  m_file.open(m_path, std::ios::binary | std::ios::trunc);
+  if (!m_file.is_open())
+    throw std::runtime_error("Failed to open npy file for writing: " + m_path);
+  writeHeader(); // placeholder, patched in close()
+}
+
+NpyArrayWriter::~NpyArrayWriter() {
+  try {
+    close();
+  } catch (...) {
+    // never throw from a destructor
+  }
+}
+
+void NpyArrayWriter::append(const std::vector<float>& values) {
+  if (m_dtype != kFloat32)
+    throw std::invalid_argument("Cannot append float values to npy file of type " + m_dtype);
+  appendBytes(reinterpret_cast<const char*>(values.data()), values.size(), sizeof(float));
+}
+
+void NpyArrayWriter::append(const std::vector<std::int32_t>& values) {
+  if (m_dtype != kInt32)
+    throw std::invalid_argument("Cannot append int values to npy file of type " + m_dtype);
+  appendBytes(reinterpret_cast<const char*>(values.data()), values.size(), sizeof(std::int32_t));
+}
+
+void NpyArrayWriter::appendBytes(const char* data, size_t n_values, size_t value_size) {
+  if (!m_file.is_open())
+    throw std::runtime_error("npy file already closed: " + m_path);
+  if (m_rowSize == 0 || n_values % m_rowSize != 0)
+    throw std::invalid_argument("Number of values (" + std::to_string(n_values) +
+                                ") is not a multiple of the row size (" + std::to_string(m_rowSize) + ")");
+  m_file.write(data, n_values * value_size);
+  m_rows += n_values / m_rowSize;
+}
+
+void NpyArrayWriter::close() {
+  if (!m_file.is_open())
+    return;
+  m_file.seekp(0);
+  writeHeader();
+  m_file.close();
+}
+
+void NpyArrayWriter::writeHeader() {
+  std::string shape = "(" + std::to_string(m_rows) + ",";
+  for (size_t i = 0; i < m_rowShape.size(); ++i)
+    shape += (i == 0 ? " " : ", ") + std::to_string(m_rowShape[i]);
+  shape += ")";
+
+  std::string dict = "{'descr': '" + m_dtype + "', 'fortran_order': False, 'shape': " + shape + ", }";
+  const size_t dict_size = kHeaderSize - kPreambleSize;
+  if (dict.size() + 1 > dict_size)
+    throw std::runtime_error("npy header too long for " + m_path);
+  dict.append(dict_size - dict.size() - 1, ' ');
+  dict += '\n';
+
+  const char magic[] = {'\x93', 'N', 'U', 'M', 'P', 'Y', '\x01', '\x00'};
+  const char header_len[] = {static_cast<char>(dict_size & 0xff), static_cast<char>((dict_size >> 8) & 0xff)};
+  m_file.write(magic, sizeof(magic));
+  m_file.write(header_len, sizeof(header_len));
+  m_file.write(dict.data(), dict.size());
+  if (!m_file.good())
+    throw std::runtime_error("Failed to write npy header to " + m_path);
+  m_file.seekp(0, std::ios::end);
+}
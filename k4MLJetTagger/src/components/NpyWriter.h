@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NPYWRITER_H
+#define NPYWRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/**
+ * @class NpyArrayWriter
+ * @brief Streams rows of a C-ordered array into a NumPy .npy file (format version 1.0).
+ *
+ * The leading dimension (number of rows) does not need to be known in advance: the header is written with a fixed
+ * size of 128 bytes and patched with the final number of rows in close(). The data section is therefore 64-byte
+ * aligned and can be opened with numpy.load(..., mmap_mode="r") without copying.
+ *
+ * Only little-endian float32 ("<f4") and int32 ("<i4") arrays are supported, which is the native layout of all
+ * platforms we run on.
+ *
+ * Example:
+ *   NpyArrayWriter writer("features.npy", NpyArrayWriter::kFloat32, {n_vars, length});
+ *   writer.append(values); // values.size() must be a multiple of n_vars * length
+ *   writer.close();
+ */
+class NpyArrayWriter {
+public:
+  static constexpr const char* kFloat32 = "<f4"; ///< numpy dtype descriptor of float
+  static constexpr const char* kInt32 = "<i4";   ///< numpy dtype descriptor of std::int32_t
+
+  /**
+   * @brief Opens the file and writes a placeholder header.
+   *
+   * @param path Path of the .npy file to create (overwritten if it exists).
+   * @param dtype numpy dtype descriptor, kFloat32 or kInt32.
+   * @param row_shape Shape of one row, i.e. all dimensions but the leading one.
+   */
+  NpyArrayWriter(const std::string& path, const std::string& dtype, const std::vector<size_t>& row_shape);
+
+  /// Closes the file if this was not done explicitly.
+  ~NpyArrayWriter();
+
+  NpyArrayWriter(const NpyArrayWriter&) = delete;
+  NpyArrayWriter& operator=(const NpyArrayWriter&) = delete;
+
+  /// Appends complete rows of float values. The size must be a multiple of the row size.
+  void append(const std::vector<float>& values);
+  /// Appends complete rows of int values. The size must be a multiple of the row size.
+  void append(const std::vector<std::int32_t>& values);
+
+  /// Patches the header with the number of rows written and closes the file.
+  void close();
+
+  /// Number of rows written so far.
+  size_t rows() const { return m_rows; }
+  /// Path of the file.
+  const std::string& path() const { return m_path; }
+
+private:
+  void appendBytes(const char* data, size_t n_values, size_t value_size);
+  void writeHeader();
+
+  std::string m_path;
+  std::string m_dtype;
+  std::vector<size_t> m_rowShape;
+  size_t m_rowSize{1}; ///< number of values per row
+  size_t m_rows{0};
+  std::ofstream m_file;
+};
+
+#endif // NPYWRITER_H
@@ -22,17 +22,75 @@
 // #include "experimental_onnxruntime_cxx_api.h"
 
 #include <algorithm>
+#include <limits>
+#include <mutex>
 #include <numeric>
+#include <stdexcept>
+#include <utility>
 
-ONNXRuntime::ONNXRuntime(const std::string& model_path, const std::vector<std::string>& input_names)
-    : m_env(new Ort::Env(OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "onnx_runtime")), m_allocator(),
+/**
+ * ONNX Runtime has one environment per process: every Ort::Env is a handle to it. An arena registered in it is used
+ * by all sessions with session.use_env_allocators, and registering a second CPU arena fails. All instances therefore
+ * share one SharedEnv, which remembers the settings of the registered arena. It lives as long as an instance uses it,
+ * so that a new environment (without arena) is made once all of them are gone.
+ */
+struct ONNXRuntime::SharedEnv {
+  Ort::Env env{OrtLoggingLevel::ORT_LOGGING_LEVEL_WARNING, "onnx_runtime"};
+  std::mutex mutex;
+  std::string arena; ///< MemoryOptions::arenaSettings() of the registered arena, empty if none
+
+  static std::shared_ptr<SharedEnv> get() {
+    static std::mutex mutex;
+    static std::weak_ptr<SharedEnv> instance;
+    std::lock_guard lock(mutex);
+    auto env = instance.lock();
+    if (!env) {
+      env = std::make_shared<SharedEnv>();
+      instance = env;
+    }
+    return env;
+  }
+};
+
+std::string ONNXRuntime::MemoryOptions::arenaSettings() const {
+  return "budget " + std::to_string(budget_bytes) + " bytes, initial chunk " +
+         std::to_string(arena_initial_chunk_bytes) + " bytes, " + arena_extend_strategy;
+}
+
+ONNXRuntime::ONNXRuntime(const std::string& model_path, const std::vector<std::string>& input_names,
+                         const MemoryOptions& memory_options)
+    : m_modelPath(model_path), m_memoryOptions(memory_options), m_env(SharedEnv::get()), m_allocator(),
       m_inputNames(input_names) {
   if (model_path.empty())
     throw std::runtime_error("Path to ONNX model cannot be empty!");
-  Ort::SessionOptions options;
-  options.SetIntraOpNumThreads(1);
-  std::string model{model_path}; // fixes a poor Ort experimental API
-  m_session = std::make_unique<Ort::Session>(*m_env, model.c_str(), options);
+  setUp();
+}
+
+ONNXRuntime::ONNXRuntime(std::string_view model_data, std::shared_ptr<const void> model_owner,
+                         const std::vector<std::string>& input_names, const MemoryOptions& memory_options)
+    : m_modelData(model_data), m_modelOwner(std::move(model_owner)), m_memoryOptions(memory_options),
+      m_env(SharedEnv::get()), m_allocator(), m_inputNames(input_names) {
+  if (model_data.empty())
+    throw std::runtime_error("The ONNX model in memory cannot be empty!");
+  setUp();
+}
+
+void ONNXRuntime::setUp() {
+  if (m_memoryOptions.share_model_bytes && m_modelData.empty())
+    throw std::invalid_argument("Sharing the model weights needs a model in memory, e.g. from a model bundle");
+  if (m_memoryOptions.arena_extend_strategy != "NextPowerOfTwo" &&
+      m_memoryOptions.arena_extend_strategy != "SameAsRequested")
+    throw std::invalid_argument("Unknown arena extend strategy '" + m_memoryOptions.arena_extend_strategy +
+                                "', must be NextPowerOfTwo or SameAsRequested");
+  if (m_memoryOptions.budget_bytes > 0 && !m_memoryOptions.cpu_arena)
+    throw std::invalid_argument("A memory budget needs the CPU arena, without it the memory cannot be capped");
+  if (m_memoryOptions.arena_initial_chunk_bytes > static_cast<size_t>(std::numeric_limits<int>::max()))
+    throw std::invalid_argument("The initial arena chunk must be below 2 GB, ONNX Runtime takes its size as an int");
+  if (m_memoryOptions.customArena())
+    registerArena();
+  const auto memory_before = read_memory_usage();
+  m_session = createSession();
+  m_loadMemory = {memory_before, read_memory_usage()};
 
   // Get input names and shapes
   m_inputNodeStrings.clear();
@@ -68,6 +126,95 @@ ONNXRuntime::ONNXRuntime(const std::string& model_path, const std::vector<std::s
 
 ONNXRuntime::~ONNXRuntime() {}
 
+void ONNXRuntime::registerArena() {
+  const auto settings = m_memoryOptions.arenaSettings();
+  std::lock_guard lock(m_env->mutex);
+  if (m_env->arena.empty()) {
+    // an arena with the given limits, shared by the sessions of the process (also the profiling ones);
+    // -1 keeps the ONNX Runtime default
+    const size_t chunk_bytes = m_memoryOptions.arena_initial_chunk_bytes;
+    const int initial_chunk = chunk_bytes > 0 ? static_cast<int>(chunk_bytes) : -1;
+    const int extend_strategy = m_memoryOptions.arena_extend_strategy == "SameAsRequested" ? 1 : 0;
+    const Ort::ArenaCfg arena_cfg(m_memoryOptions.budget_bytes, extend_strategy, initial_chunk, -1);
+    m_env->env.CreateAndRegisterAllocator(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault), arena_cfg);
+    m_env->arena = settings;
+  } else if (m_env->arena != settings) {
+    throw std::invalid_argument("ONNX Runtime has one CPU arena per process, it is already registered with " +
+                                m_env->arena + " and cannot also have " + settings);
+  }
+}
+
+std::unique_ptr<Ort::Session> ONNXRuntime::createSession(const std::string& profile_prefix) const {
+  Ort::SessionOptions options;
+  options.SetIntraOpNumThreads(1);
+  if (!m_memoryOptions.cpu_arena)
+    options.DisableCpuMemArena();
+  if (!m_memoryOptions.memory_pattern)
+    options.DisableMemPattern();
+  if (m_memoryOptions.customArena())
+    options.AddConfigEntry("session.use_env_allocators", "1");
+  if (m_memoryOptions.share_model_bytes) {
+    // no copy of the ORT-format model: the session and its initializers use m_modelData as long as they live.
+    // Prepacking would copy the MatMul weights into a private layout again (and crashes on borrowed initializers)
+    options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+    options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+    options.AddConfigEntry("session.disable_prepacking", "1");
+  }
+  if (!profile_prefix.empty())
+    options.EnableProfiling(profile_prefix.c_str());
+  if (!m_modelData.empty())
+    return std::make_unique<Ort::Session>(m_env->env, m_modelData.data(), m_modelData.size(), options);
+  return std::make_unique<Ort::Session>(m_env->env, m_modelPath.c_str(), options);
+}
+
+void ONNXRuntime::startProfiling(const std::string& file_prefix, const Tensor<long>& warm_up_shapes) {
+  if (m_profilingSession)
+    throw std::runtime_error("ONNX Runtime profiling is already running");
+  if (file_prefix.empty())
+    throw std::runtime_error("The prefix of the ONNX Runtime profile file cannot be empty!");
+  m_profilingSession = createSession(file_prefix);
+
+  // the first run of a session allocates and initializes what it keeps for later runs; do it on zeros here, so that
+  // the first profiled event is as warm as the others
+  Tensor<long> shapes = warm_up_shapes;
+  if (shapes.empty()) {
+    for (const auto& name : m_inputNames) {
+      const auto dims = m_inputNodeDims.find(name);
+      shapes.emplace_back(1, 1);
+      if (dims != m_inputNodeDims.end())
+        shapes.back().assign(dims->second.begin(), dims->second.end());
+      for (auto& dim : shapes.back())
+        dim = dim < 0 ? 1 : dim;
+      shapes.back()[0] = 1;
+    }
+  }
+  Tensor<float> zeros;
+  for (const auto& shape : shapes)
+    zeros.emplace_back(std::accumulate(shape.begin(), shape.end(), 1L, std::multiplies<long>()), 0.f);
+  try {
+    run<float>(zeros, shapes, shapes.empty() ? 1 : shapes.front().front());
+  } catch (...) {
+    m_profilingSession.reset();
+    throw;
+  }
+}
+
+bool ONNXRuntime::isAllocationFailure(const std::exception& exception) {
+  // ONNX Runtime has no error code for this, the arena reports e.g. "Failed to allocate memory for requested buffer"
+  // or "Available memory of ... is smaller than requested bytes of ..."
+  const std::string message = exception.what();
+  return message.find("allocate memory") != std::string::npos ||
+         message.find("is smaller than requested bytes") != std::string::npos;
+}
+
+std::string ONNXRuntime::endProfiling() {
+  if (!m_profilingSession)
+    return "";
+  const std::string profile_file = m_profilingSession->EndProfilingAllocated(m_allocator).get();
+  m_profilingSession.reset();
+  return profile_file;
+}
+
 template <typename T>
 ONNXRuntime::Tensor<T> ONNXRuntime::run(Tensor<T>& input, const Tensor<long>& input_shapes,
                                         unsigned long long batch_size) const {
@@ -111,9 +258,14 @@ ONNXRuntime::Tensor<T> ONNXRuntime::run(Tensor<T>& input, const Tensor<long>& in
     output_node_names.push_back(name_j.c_str());
   }
 
-  // run the inference
-  auto output_tensors = m_session->Run(Ort::RunOptions{nullptr}, input_node_names.data(), tensors_in.data(),
-                                       tensors_in.size(), output_node_names.data(), output_node_names.size());
+  // run the inference, the memory taken by the first run is mostly the arena of the intermediate tensors
+  const bool first_run = !m_ranOnce.exchange(true);
+  const auto memory_before = first_run ? read_memory_usage() : MemorySnapshot{};
+  auto& session = m_profilingSession ? *m_profilingSession : *m_session;
+  auto output_tensors = session.Run(Ort::RunOptions{nullptr}, input_node_names.data(), tensors_in.data(),
+                                    tensors_in.size(), output_node_names.data(), output_node_names.size());
+  if (first_run)
+    m_firstRunMemory = {memory_before, read_memory_usage()};
   // convert output tensor to values
   Tensor<T> outputs;
   size_t i = 0;
@@ -22,11 +22,14 @@
 // From: https://github.com/HEP-FCC/FCCAnalyses/tree/b9b84221837da8868158f5592b48a9af69f0f6e3/addons/ONNXRuntime
 // AI generated documentation
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "MemoryUsage.h"
 #include "onnxruntime_cxx_api.h"
 
 namespace Ort {
@@ -44,13 +47,65 @@ class Session; ///< Wrapper class for ONNX Runtime session handling.
  */
 class ONNXRuntime {
 public:
+  /**
+   * @struct MemoryOptions
+   * @brief Memory settings of the ONNX Runtime session, e.g. to stay within the memory of a grid slot.
+   *
+   * The defaults are those of ONNX Runtime. With a budget, the CPU arena of the session is capped: a run that would
+   * need more memory fails with an exception (see isAllocationFailure()) instead of growing the process. The budget
+   * needs the arena (cpu_arena).
+   *
+   * An arena with settings of its own (customArena()) is registered in the ONNX Runtime environment, of which there is
+   * one per process. It is registered once and shared by all sessions with the same settings, which then share the
+   * budget too. A session asking for an arena with other settings while it exists is refused.
+   *
+   * With share_model_bytes, a model in memory (ORT format only) is not copied into the session: the initializers
+   * point into the model bytes. If these are a read-only file mapping (a ModelBundle), all processes of a node using
+   * the same file share the pages of the weights. The weights are then not prepacked for the matrix multiplications,
+   * which can make large models somewhat slower.
+   */
+  struct MemoryOptions {
+    size_t budget_bytes{0};                              ///< Maximum size of the CPU arena, 0 for no limit.
+    bool cpu_arena{true};                                ///< Pool the tensors in an arena instead of malloc/free.
+    std::string arena_extend_strategy{"NextPowerOfTwo"}; ///< Growth of the arena: NextPowerOfTwo or SameAsRequested.
+    size_t arena_initial_chunk_bytes{0};                 ///< Size of the first arena chunk, 0 for the default.
+    bool memory_pattern{true};                           ///< Preallocate the intermediate tensors per input shape.
+    bool share_model_bytes{false};                       ///< Use the weights in place in the model in memory.
+
+    /// Whether the arena needs settings of its own (otherwise every session creates a default arena).
+    bool customArena() const {
+      return cpu_arena &&
+             (budget_bytes > 0 || arena_initial_chunk_bytes > 0 || arena_extend_strategy != "NextPowerOfTwo");
+    }
+
+    /// The settings of the custom arena, e.g. for messages.
+    std::string arenaSettings() const;
+  };
+
   /**
    * @brief Constructor to initialize the ONNXRuntime environment and session.
    *
    * @param model_path Path to the ONNX model file.
    * @param input_names List of input variable names to bind during inference.
+   * @param memory_options Arena and memory planning settings of the session.
+   * Throws std::invalid_argument for an unknown arena extend strategy, a budget without cpu_arena, an initial arena
+   * chunk of 2 GB or more, share_model_bytes (needs a model in memory) or a custom arena that differs from the one
+   * already registered in the process.
+   */
+  explicit ONNXRuntime(const std::string& model_path = "", const std::vector<std::string>& input_names = {},
+                       const MemoryOptions& memory_options = {});
+
+  /**
+   * @brief Constructor creating the session from a model in memory, e.g. in a memory-mapped ModelBundle.
+   *
+   * @param model_data The bytes of the ONNX or ORT-format model.
+   * @param model_owner Keeps the bytes alive: they are read again when the profiling starts, and used by the
+   * session itself with share_model_bytes.
+   * @param input_names List of input variable names to bind during inference.
+   * @param memory_options Arena and memory planning settings of the session.
    */
-  explicit ONNXRuntime(const std::string& model_path = "", const std::vector<std::string>& input_names = {});
+  ONNXRuntime(std::string_view model_data, std::shared_ptr<const void> model_owner,
+              const std::vector<std::string>& input_names, const MemoryOptions& memory_options = {});
 
   /**
    * @brief Destructor to clean up the ONNXRuntime environment and session.
@@ -78,9 +133,63 @@ public:
    */
   const std::vector<std::string>& inputNames() const { return m_inputNames; }
 
+  /**
+   * @brief Starts the built-in profiling of ONNX Runtime.
+   *
+   * A second session of the model is created with profiling enabled and used by run() until endProfiling(), so only
+   * the runs in between end up in the profile (and not e.g. the warm-up of the first session). The new session is
+   * warmed up with one run on zeros, so that its one-off allocations and initializations are not in the first
+   * profiled event. This run is the first one in the profile (summarize_ort_profile.py skips it). Throws
+   * std::runtime_error if the profiling is already running.
+   *
+   * @param file_prefix Prefix (may include a directory) of the Chrome-trace JSON file written by ONNX Runtime.
+   * @param warm_up_shapes Shapes of the inputs of the warm-up run, in the order of the input names. If empty, the
+   * input dimensions of the model with a batch of 1 and 1 for the other dynamic dimensions.
+   */
+  void startProfiling(const std::string& file_prefix, const Tensor<long>& warm_up_shapes = {});
+
+  /**
+   * @brief Stops the profiling started with startProfiling() and writes the profile.
+   *
+   * @return Path of the Chrome-trace JSON file, empty if the profiling was not running.
+   */
+  std::string endProfiling();
+
+  /**
+   * @brief Whether the profiling is running.
+   */
+  bool isProfiling() const { return m_profilingSession != nullptr; }
+
+  /**
+   * @brief Memory settings of the session.
+   */
+  const MemoryOptions& memoryOptions() const { return m_memoryOptions; }
+
+  /**
+   * @brief Whether an exception thrown by run() is a failed allocation, e.g. because the arena reached the budget.
+   *
+   * The session can still be used after such a failure, e.g. with a smaller batch.
+   */
+  static bool isAllocationFailure(const std::exception& exception);
+
+  /**
+   * @brief Memory taken by loading the model into the session (weights, graph and its optimizations).
+   */
+  const MemoryDelta& loadMemory() const { return m_loadMemory; }
+
+  /**
+   * @brief Memory taken by the first run, mostly the growth of the ONNX Runtime arena for the intermediate tensors.
+   *
+   * Not valid before the first run. Later runs with larger inputs (e.g. batches) can grow the arena further.
+   */
+  const MemoryDelta& firstRunMemory() const { return m_firstRunMemory; }
+
   /**
    * @brief Runs inference on the provided input tensor and returns the output tensor.
    *
+   * Can be called from several threads at once (the session is thread-safe), but not while the profiling is started
+   * or stopped.
+   *
    * @tparam T Data type of the tensor elements.
    * @param input_tensor Input tensor containing the data for inference.
    * @param input_shape Optional tensor specifying the input shape dimensions.
@@ -100,15 +209,42 @@ private:
    */
   size_t variablePos(const std::string& var_name) const;
 
-  std::unique_ptr<Ort::Env> m_env;              ///< Pointer to the ONNX Runtime environment object.
-  std::unique_ptr<Ort::Session> m_session;      ///< Pointer to the ONNX Runtime session object.
-  Ort::AllocatorWithDefaultOptions m_allocator; ///< Allocator for ONNX Runtime tensors.
+  /**
+   * @brief Creates a session of the model, with profiling if a file prefix is given.
+   */
+  std::unique_ptr<Ort::Session> createSession(const std::string& profile_prefix = "") const;
+
+  /**
+   * @brief Checks the memory options, creates the session and reads the input and output nodes.
+   */
+  void setUp();
+
+  /**
+   * @brief Registers the custom arena in the environment of the process, or checks that it is already registered
+   * with the same settings.
+   */
+  void registerArena();
+
+  struct SharedEnv; ///< The ONNX Runtime environment of the process and its registered arena.
+
+  std::string m_modelPath;                          ///< Path to the ONNX model file, empty for a model in memory.
+  std::string_view m_modelData;                     ///< The model in memory, if not read from m_modelPath.
+  std::shared_ptr<const void> m_modelOwner;         ///< Keeps m_modelData alive.
+  MemoryOptions m_memoryOptions;                    ///< Arena and memory planning settings.
+  std::shared_ptr<SharedEnv> m_env;                 ///< The ONNX Runtime environment, shared by all instances.
+  std::unique_ptr<Ort::Session> m_session;          ///< Pointer to the ONNX Runtime session object.
+  std::unique_ptr<Ort::Session> m_profilingSession; ///< Session used instead of m_session while profiling.
+  Ort::AllocatorWithDefaultOptions m_allocator;     ///< Allocator for ONNX Runtime tensors.
 
   std::vector<std::string> m_inputNodeStrings;                  ///< List of input node names.
   std::vector<std::string> m_outputNodeStrings;                 ///< List of output node names.
   std::vector<std::string> m_inputNames;                        ///< List of model input names.
   std::map<std::string, std::vector<int64_t>> m_inputNodeDims;  ///< Dimensions of input nodes.
   std::map<std::string, std::vector<int64_t>> m_outputNodeDims; ///< Dimensions of output nodes.
+
+  MemoryDelta m_loadMemory;                   ///< RSS around the creation of the session.
+  mutable MemoryDelta m_firstRunMemory;       ///< RSS around the first run.
+  mutable std::atomic<bool> m_ranOnce{false}; ///< Whether run() was called before.
 };
 
 #endif
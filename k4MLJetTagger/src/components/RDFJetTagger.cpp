@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "RDFJetTagger.h"
+
+#include "Helpers.h"
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+unsigned slot_count(unsigned n_slots) { return n_slots > 0 ? n_slots : std::max(1u, ROOT::GetThreadPoolSize()); }
+
+} // namespace
+
+RDFJetTagger::RDFJetTagger(std::shared_ptr<const WeaverInterface> weaver, unsigned n_slots, size_t max_batch_size)
+    : m_weaver(std::move(weaver)), m_maxBatchSize(std::max<size_t>(1, max_batch_size)), m_slots(slot_count(n_slots)) {
+  const auto& vars = m_weaver->preprocessor().variables();
+  m_vars.assign(vars.begin(), vars.end());
+}
+
+RDFJetTagger::RDFJetTagger(const std::string& bundle_path, unsigned n_slots, size_t max_batch_size)
+    : RDFJetTagger(std::make_shared<const ModelBundle>(bundle_path), n_slots, max_batch_size) {}
+
+RDFJetTagger::RDFJetTagger(std::shared_ptr<const ModelBundle> bundle, unsigned n_slots, size_t max_batch_size)
+    : RDFJetTagger(std::make_shared<const WeaverInterface>(bundle), n_slots, max_batch_size) {
+  m_flavorNames = bundle->flavorNames();
+}
+
+RDFJetTagger::RDFJetTagger(const std::string& onnx_path, const std::string& json_path,
+                           const std::vector<std::string>& vars, unsigned n_slots, size_t max_batch_size)
+    : m_maxBatchSize(std::max<size_t>(1, max_batch_size)), m_slots(slot_count(n_slots)) {
+  const auto json_config = loadJsonFile(json_path);
+  if (json_config.is_null())
+    throw std::runtime_error("Could not load the JSON configuration file " + json_path);
+  const rv::RVec<std::string> var_names(vars.begin(), vars.end());
+  m_weaver = std::make_shared<const WeaverInterface>(onnx_path, WeaverPreprocessor(json_config, var_names));
+  m_vars = vars;
+  m_flavorNames = json_config.at("output_names").get<std::vector<std::string>>();
+}
+
+rv::RVec<rv::RVec<float>> RDFJetTagger::operator()(unsigned slot, const rv::RVec<Column>& vars) {
+  std::vector<const Column*> columns;
+  columns.reserve(vars.size());
+  for (const auto& column : vars)
+    columns.push_back(&column);
+  return tagColumns(slot, columns.data(), columns.size());
+}
+
+std::string RDFJetTagger::defineExpression(const std::string& functor, const std::string& column_prefix) const {
+  std::string expression = functor + ".tag(rdfslot_";
+  for (const auto& var : m_vars)
+    expression += ", " + column_prefix + var;
+  return expression + ")";
+}
+
+rv::RVec<rv::RVec<float>> RDFJetTagger::tagColumns(unsigned slot, const Column* const* vars, size_t n_vars) {
+  if (slot >= m_slots.size())
+    throw std::out_of_range("RDFJetTagger: slot " + std::to_string(slot) + " of " + std::to_string(m_slots.size()) +
+                            ", create it after ROOT::EnableImplicitMT or with the number of slots of the RDataFrame");
+  if (n_vars != m_vars.size())
+    throw std::invalid_argument("RDFJetTagger: " + std::to_string(n_vars) + " columns given, the model needs " +
+                                std::to_string(m_vars.size()));
+  const size_t n_jets = n_vars > 0 ? vars[0]->size() : 0;
+  for (size_t v = 0; v < n_vars; ++v) {
+    if (vars[v]->size() != n_jets)
+      throw std::invalid_argument("RDFJetTagger: the column of " + m_vars[v] + " has " +
+                                  std::to_string(vars[v]->size()) + " jets instead of " + std::to_string(n_jets));
+  }
+
+  auto& buffers = m_slots[slot];
+  const auto& preprocessor = m_weaver->preprocessor();
+  rv::RVec<rv::RVec<float>> scores;
+  scores.reserve(n_jets);
+  for (size_t begin = 0; begin < n_jets; begin += m_maxBatchSize) {
+    const size_t n = std::min(m_maxBatchSize, n_jets - begin);
+    buffers.batch.resize(preprocessor.inputNames().size());
+    for (auto& input : buffers.batch)
+      input.clear();
+    for (size_t i = begin; i < begin + n; ++i) {
+      buffers.jet.clear();
+      for (size_t v = 0; v < n_vars; ++v) {
+        // an RVec adopting the memory of the column, which is only read
+        auto& values = (*vars[v])[i];
+        buffers.jet.emplace_back(const_cast<float*>(values.data()), values.size());
+      }
+      preprocessor.preprocess(buffers.jet, buffers.data, true);
+      for (size_t g = 0; g < buffers.data.size(); ++g)
+        buffers.batch[g].insert(buffers.batch[g].end(), buffers.data[g].begin(), buffers.data[g].end());
+    }
+    const auto outputs = m_weaver->runPadded(buffers.batch, n);
+    const size_t n_outputs = outputs.size() / n;
+    for (size_t i = 0; i < n; ++i)
+      scores.emplace_back(outputs.begin() + i * n_outputs, outputs.begin() + (i + 1) * n_outputs);
+  }
+  return scores;
+}
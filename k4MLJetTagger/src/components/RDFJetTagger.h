@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef RDFJETTAGGER_H
+#define RDFJETTAGGER_H
+
+#include "ModelBundle.h"
+#include "ROOT/RVec.hxx"
+#include "WeaverInterface.h"
+#include "WeaverPreprocessor.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rv = ROOT::VecOps;
+
+/**
+ * @class RDFJetTagger
+ * @brief Tags the jets of an event inside an RDataFrame with implicit multithreading (e.g. in FCCAnalyses).
+ *
+ * The inputs are columns in the FCCAnalyses layout: one column per constituent variable, holding the values of all
+ * jets of the event ([jet][constituent]), in the order of variables(). All jets of an event are run in batches of up
+ * to max_batch_size jets. Every RDataFrame slot has its own preprocessing buffers, while all slots run the same ONNX
+ * Runtime session (WeaverInterface::runPadded()), so the model is loaded once and the tagging scales with
+ * ROOT::EnableImplicitMT. The variables of a jet are read in place from the columns, without copies.
+ *
+ * With a functor declared to the interpreter (e.g. as `tagger`), defineExpression() gives the expression to Define:
+ * @code
+ *   ROOT::EnableImplicitMT(8);
+ *   ROOT::RDataFrame df("events", "file.root");
+ *   gInterpreter->Declare("RDFJetTagger tagger(\"model.k4jtb\");"); // after EnableImplicitMT, for its slot count
+ *   auto tagged = df.Define("jet_scores", tagger.defineExpression("tagger", "jet_constituents_"));
+ * @endcode
+ * Compiled code can use DefineSlot with a lambda calling tag(), or operator() with all variables in one column.
+ */
+class RDFJetTagger {
+public:
+  using Column = rv::RVec<rv::RVec<float>>; ///< One variable of all jets of an event, [jet][constituent].
+
+  /**
+   * @brief Functor over a WeaverInterface, which may also be used elsewhere (only its thread-safe runPadded() is used).
+   *
+   * @param n_slots Number of RDataFrame slots, 0 for the size of the implicit multithreading pool (at least 1).
+   * @param max_batch_size Maximum number of jets per ONNX Runtime run.
+   */
+  RDFJetTagger(std::shared_ptr<const WeaverInterface> weaver, unsigned n_slots = 0, size_t max_batch_size = 64);
+
+  /// Functor for the model of a bundle made with k4MLJetTagger_bundle, with its variables and flavors.
+  explicit RDFJetTagger(const std::string& bundle_path, unsigned n_slots = 0, size_t max_batch_size = 64);
+
+  /// As above, for a bundle that is already loaded.
+  explicit RDFJetTagger(std::shared_ptr<const ModelBundle> bundle, unsigned n_slots = 0, size_t max_batch_size = 64);
+
+  /**
+   * @brief Functor for an ONNX model and its weaver JSON configuration.
+   *
+   * @param vars The constituent variables (e.g. pfcand_erel_log), in the order of the columns given to tag().
+   */
+  RDFJetTagger(const std::string& onnx_path, const std::string& json_path, const std::vector<std::string>& vars,
+               unsigned n_slots = 0, size_t max_batch_size = 64);
+
+  /**
+   * @brief Tags all jets of an event.
+   *
+   * @param slot The RDataFrame slot (rdfslot_ in a jitted expression).
+   * @param columns One Column per variable, in the order of variables().
+   * @return The probabilities of the flavors for every jet, [jet][flavor].
+   * Throws std::out_of_range for a slot beyond nSlots(), std::invalid_argument if the columns do not match.
+   */
+  template <typename... Columns>
+  rv::RVec<rv::RVec<float>> tag(unsigned slot, const Columns&... columns) {
+    const std::array<const Column*, sizeof...(Columns)> vars{&columns...};
+    return tagColumns(slot, vars.data(), vars.size());
+  }
+
+  /// As tag(), with all variables in one column, [variable][jet][constituent].
+  rv::RVec<rv::RVec<float>> operator()(unsigned slot, const rv::RVec<Column>& vars);
+
+  /**
+   * @brief Expression calling tag() on the columns <column_prefix><variable>, for RDataFrame::Define.
+   *
+   * @param functor Name of this functor in the interpreter.
+   * @param column_prefix Prefix of the column names, e.g. jet_constituents_.
+   */
+  std::string defineExpression(const std::string& functor, const std::string& column_prefix = "") const;
+
+  const std::vector<std::string>& variables() const { return m_vars; }
+  const std::vector<std::string>& flavorNames() const { return m_flavorNames; } ///< empty if not known
+  unsigned nSlots() const { return m_slots.size(); }
+  size_t maxBatchSize() const { return m_maxBatchSize; }
+
+private:
+  /// Buffers of one slot, on cache lines of their own.
+  struct alignas(64) Slot {
+    rv::RVec<WeaverPreprocessor::ConstituentVars> jet; ///< views of the variables of one jet into the columns
+    WeaverPreprocessor::Tensor data;                   ///< preprocessed inputs of one jet
+    WeaverPreprocessor::Tensor batch;                  ///< padded inputs of a batch, one tensor per input group
+  };
+
+  rv::RVec<rv::RVec<float>> tagColumns(unsigned slot, const Column* const* vars, size_t n_vars);
+
+  std::shared_ptr<const WeaverInterface> m_weaver;
+  std::vector<std::string> m_vars;
+  std::vector<std::string> m_flavorNames;
+  size_t m_maxBatchSize;
+  std::vector<Slot> m_slots;
+};
+
+#endif // RDFJETTAGGER_H
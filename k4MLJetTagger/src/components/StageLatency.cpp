@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "StageLatency.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+size_t LatencyHistogram::binIndex(std::uint64_t ns) {
+  if (ns < kSubBins)
+    return ns;
+  // position of the most significant bit (>= 3), the 3 bits below it select the sub-bin
+  const int msb = std::bit_width(ns) - 1;
+  return (msb - 2) * kSubBins + ((ns >> (msb - 3)) & (kSubBins - 1));
+}
+
+double LatencyHistogram::binCenterNs(size_t index) {
+  if (index < static_cast<size_t>(kSubBins))
+    return index;
+  const int shift = static_cast<int>(index / kSubBins) - 1; // msb - 3
+  const double lower = std::ldexp(kSubBins + index % kSubBins, shift);
+  return lower + std::ldexp(0.5, shift);
+}
+
+double LatencyHistogram::percentileNs(double q) const {
+  const std::uint64_t n = count();
+  if (n == 0)
+    return 0.;
+  const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(q * n)));
+  std::uint64_t cumulative = 0;
+  for (size_t i = 0; i < kNBins; ++i) {
+    cumulative += m_bins[i].load(std::memory_order_relaxed);
+    if (cumulative >= rank)
+      return binCenterNs(i);
+  }
+  // entries recorded while reading: the count is ahead of the bins
+  for (size_t i = kNBins; i-- > 0;) {
+    if (m_bins[i].load(std::memory_order_relaxed) > 0)
+      return binCenterNs(i);
+  }
+  return 0.;
+}
+
+StageLatency::StageLatency(std::vector<std::string> stage_names, std::vector<int> multiplicity_edges)
+    : m_stageNames(std::move(stage_names)), m_edges(std::move(multiplicity_edges)) {
+  if (m_stageNames.empty() || m_stageNames.size() > StageClock::kMaxStages) {
+    throw std::invalid_argument("StageLatency: need between 1 and " + std::to_string(StageClock::kMaxStages) +
+                                " stages, got " + std::to_string(m_stageNames.size()));
+  }
+  for (size_t i = 0; i < m_edges.size(); ++i) {
+    if (m_edges[i] < 1 || (i > 0 && m_edges[i] <= m_edges[i - 1])) {
+      throw std::invalid_argument("StageLatency: the multiplicity edges must be positive and increasing");
+    }
+  }
+  m_jetHists.resize(nClasses() * (nStages() + 1));
+  m_eventHists.resize(nStages() + 1);
+}
+
+size_t StageLatency::multiplicityClass(size_t n_constituents) const {
+  return std::lower_bound(m_edges.begin(), m_edges.end(), static_cast<int>(n_constituents)) - m_edges.begin();
+}
+
+std::string StageLatency::classLabel(size_t mult_class) const {
+  if (m_edges.empty())
+    return "all";
+  if (mult_class == m_edges.size())
+    return ">" + std::to_string(m_edges.back());
+  const int lower = mult_class == 0 ? 0 : m_edges[mult_class - 1] + 1;
+  return std::to_string(lower) + "-" + std::to_string(m_edges[mult_class]);
+}
+
+void StageLatency::recordJet(size_t n_constituents, const std::array<std::uint64_t, StageClock::kMaxStages>& stage_ns) {
+  const size_t offset = multiplicityClass(n_constituents) * (nStages() + 1);
+  std::uint64_t total = 0;
+  for (size_t s = 0; s < nStages(); ++s) {
+    m_jetHists[offset + s].record(stage_ns[s]);
+    total += stage_ns[s];
+  }
+  m_jetHists[offset + nStages()].record(total);
+}
+
+void StageLatency::recordEvent(const std::array<std::uint64_t, StageClock::kMaxStages>& stage_ns) {
+  std::uint64_t total = 0;
+  for (size_t s = 0; s < nStages(); ++s) {
+    m_eventHists[s].record(stage_ns[s]);
+    total += stage_ns[s];
+  }
+  m_eventHists[nStages()].record(total);
+}
+
+namespace {
+void appendRow(std::string& out, const char* label, const std::string& stage, const LatencyHistogram& hist) {
+  char line[160];
+  std::snprintf(line, sizeof(line), "  %-10s %-20s %10llu %10.1f %10.1f %10.1f %10.1f\n", label, stage.c_str(),
+                static_cast<unsigned long long>(hist.count()), hist.percentileNs(0.5) / 1e3,
+                hist.percentileNs(0.9) / 1e3, hist.percentileNs(0.99) / 1e3, hist.meanNs() / 1e3);
+  out += line;
+}
+} // namespace
+
+std::string StageLatency::report() const {
+  std::string out;
+  char line[160];
+  std::snprintf(line, sizeof(line), "  %-10s %-20s %10s %10s %10s %10s %10s\n", "nconst", "stage", "entries",
+                "p50 [us]", "p90 [us]", "p99 [us]", "mean [us]");
+  out += "Latency per jet:\n";
+  out += line;
+  std::uint64_t all_jets = 0;
+  std::uint64_t all_ns = 0;
+  for (size_t c = 0; c < nClasses(); ++c) {
+    const LatencyHistogram& total = jetHistogram(nStages(), c);
+    if (total.count() == 0)
+      continue;
+    const std::string label = classLabel(c);
+    for (size_t s = 0; s < nStages(); ++s)
+      appendRow(out, label.c_str(), m_stageNames[s], jetHistogram(s, c));
+    appendRow(out, label.c_str(), "total", total);
+    std::snprintf(line, sizeof(line), "  %-10s %-20s %.1f jets/s\n", label.c_str(), "throughput",
+                  total.sumNs() > 0 ? 1e9 * total.count() / total.sumNs() : 0.);
+    out += line;
+    all_jets += total.count();
+    all_ns += total.sumNs();
+  }
+  out += "Latency per event:\n";
+  for (size_t s = 0; s < nStages(); ++s)
+    appendRow(out, "", m_stageNames[s], m_eventHists[s]);
+  appendRow(out, "", "total", m_eventHists[nStages()]);
+  std::snprintf(line, sizeof(line), "Throughput: %llu jets in %.3f s of tagging: %.1f jets/s\n",
+                static_cast<unsigned long long>(all_jets), all_ns / 1e9, all_ns > 0 ? 1e9 * all_jets / all_ns : 0.);
+  out += line;
+  return out;
+}
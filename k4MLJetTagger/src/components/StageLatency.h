@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef STAGELATENCY_H
+#define STAGELATENCY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @class LatencyHistogram
+ * @brief Lock-free histogram of latencies in ns with a relative bin width of 1/8 (log-linear bins).
+ *
+ * Values below 8 ns get their own bin, every power of two above is split into 8 bins, so percentiles are exact to
+ * about 6% over the whole range up to 2^64 ns. record() is one relaxed atomic increment per bin, count and sum, so
+ * several threads can fill the same histogram without locks.
+ */
+class LatencyHistogram {
+public:
+  static constexpr int kSubBins = 8;
+  static constexpr size_t kNBins = 62 * kSubBins;
+
+  void record(std::uint64_t ns) {
+    m_bins[binIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  std::uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+  std::uint64_t sumNs() const { return m_sumNs.load(std::memory_order_relaxed); }
+  double meanNs() const { return count() > 0 ? static_cast<double>(sumNs()) / count() : 0.; }
+  /// Latency below which a fraction q (0-1) of the entries lie (center of the bin), 0 if empty.
+  double percentileNs(double q) const;
+
+  static size_t binIndex(std::uint64_t ns);
+  static double binCenterNs(size_t index);
+
+private:
+  std::array<std::atomic<std::uint64_t>, kNBins> m_bins{};
+  std::atomic<std::uint64_t> m_count{0};
+  std::atomic<std::uint64_t> m_sumNs{0};
+};
+
+/**
+ * @class StageClock
+ * @brief Measures the time of consecutive stages of a computation with one clock reading per stage.
+ *
+ * Example:
+ *   StageClock clock(enabled);
+ *   extract();   clock.lap(kFeatures);
+ *   transpose(); clock.lap(kTranspose);
+ * Laps of the same stage add up. A disabled clock does not read the time at all.
+ */
+class StageClock {
+public:
+  static constexpr size_t kMaxStages = 8;
+  using Clock = std::chrono::steady_clock;
+
+  explicit StageClock(bool enabled = true) : m_enabled(enabled) {
+    if (m_enabled)
+      m_last = Clock::now();
+  }
+
+  /// Attributes the time since the previous lap (or the construction) to a stage.
+  void lap(size_t stage) {
+    if (!m_enabled)
+      return;
+    const auto now = Clock::now();
+    m_ns[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count();
+    m_last = now;
+  }
+
+  /// Starts timing again from now, e.g. after other work in between, without attributing the time to any stage.
+  void restart() {
+    if (m_enabled)
+      m_last = Clock::now();
+  }
+
+  /// Attributes a time measured elsewhere to a stage, e.g. a share of a batch.
+  void add(size_t stage, std::uint64_t ns) {
+    if (m_enabled)
+      m_ns[stage] += ns;
+  }
+
+  bool enabled() const { return m_enabled; }
+  const std::array<std::uint64_t, kMaxStages>& ns() const { return m_ns; }
+
+private:
+  bool m_enabled;
+  Clock::time_point m_last;
+  std::array<std::uint64_t, kMaxStages> m_ns{};
+};
+
+/**
+ * @class StageLatency
+ * @brief Latency histograms of the stages of an algorithm, per jet (by constituent multiplicity) and per event.
+ *
+ * The jets are grouped into classes of constituent multiplicity given by the upper edges of the classes (e.g. {10, 30}
+ * gives 1-10, 11-30, >30). Per jet, every stage and the sum of all stages are histogrammed for the class of the jet;
+ * per event, the same for the sums over all jets of the event. All histograms are lock-free (LatencyHistogram).
+ */
+class StageLatency {
+public:
+  /**
+   * @param stage_names Names of the stages, at most StageClock::kMaxStages.
+   * @param multiplicity_edges Increasing upper edges of the multiplicity classes.
+   * Throws std::invalid_argument if the arguments are inconsistent.
+   */
+  StageLatency(std::vector<std::string> stage_names, std::vector<int> multiplicity_edges);
+
+  size_t nStages() const { return m_stageNames.size(); }
+  const std::string& stageName(size_t stage) const { return m_stageNames[stage]; }
+  size_t nClasses() const { return m_edges.size() + 1; }
+  /// Multiplicity class of a jet with n_constituents.
+  size_t multiplicityClass(size_t n_constituents) const;
+  /// Label of a multiplicity class, e.g. "11-30" or ">30".
+  std::string classLabel(size_t mult_class) const;
+
+  /// Records the stage times of one jet (the first nStages() entries of stage_ns).
+  void recordJet(size_t n_constituents, const std::array<std::uint64_t, StageClock::kMaxStages>& stage_ns);
+  /// Records the stage times summed over the jets of one event.
+  void recordEvent(const std::array<std::uint64_t, StageClock::kMaxStages>& stage_ns);
+
+  /// Histogram of one stage for the jets of a class; stage nStages() is the sum of all stages.
+  const LatencyHistogram& jetHistogram(size_t stage, size_t mult_class) const {
+    return m_jetHists[mult_class * (nStages() + 1) + stage];
+  }
+  /// Histogram of one stage per event; stage nStages() is the sum of all stages.
+  const LatencyHistogram& eventHistogram(size_t stage) const { return m_eventHists[stage]; }
+
+  /// Table of the p50/p90/p99 and mean latencies and the jets/s, per multiplicity class and per event.
+  std::string report() const;
+
+private:
+  std::vector<std::string> m_stageNames;
+  std::vector<int> m_edges;
+  std::deque<LatencyHistogram> m_jetHists;   ///< [class][stage], atomics cannot be moved
+  std::deque<LatencyHistogram> m_eventHists; ///< [stage]
+};
+
+#endif // STAGELATENCY_H
@@ -43,7 +43,7 @@ struct Pfcand {
   int pfcand_type;
   int pfcand_charge;
   int pfcand_isEl, pfcand_isMu, pfcand_isGamma, pfcand_isChargedHad, pfcand_isNeutralHad;
-  int pfcand_dndx, pfcand_tof; // dummy, filled with 0
+  float pfcand_dndx, pfcand_tof; // dummy, filled with 0
 
   // track params
   // cov matrix - 15 values related to 5 Helix (see struct) parameters
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "SyntheticEventGenerator.h"
+
+#include <edm4hep/TrackState.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kCurvature = 0.299792458e-3; ///< c in GeV / (T mm), omega = q * kCurvature * Bz / pt
+
+// masses in GeV
+constexpr double kMassPion = 0.13957;
+constexpr double kMassElectron = 0.000511;
+constexpr double kMassMuon = 0.105658;
+constexpr double kMassK0L = 0.497611;
+
+// CLD-like track resolution: sigma_IP = a (+) b / (p sin^3/2 theta), sigma_pt / pt^2 = c
+constexpr double kIPResolutionA = 0.003; // mm
+constexpr double kIPResolutionB = 0.015; // mm GeV
+constexpr double kPtResolution = 2e-5;   // 1 / GeV
+constexpr double kAngleResolution = 1e-4;
+constexpr double kCorrelation = -0.5; ///< correlation of d0 with phi and of z0 with tanLambda
+constexpr double kMinMomentum = 0.2;  ///< GeV, softer particles are not reconstructed
+
+using Vec3 = std::array<double, 3>;
+
+/// Independent, well mixed seed for every event (splitmix64 finalizer).
+std::uint64_t eventSeed(std::uint64_t seed, std::uint64_t event_number) {
+  std::uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (event_number + 1);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+Vec3 normalized(const Vec3& v) {
+  const double norm = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  return {v[0] / norm, v[1] / norm, v[2] / norm};
+}
+
+Vec3 cross(const Vec3& a, const Vec3& b) {
+  return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+/// Index of element (i, j) in the packed lower triangle of the track state covariance matrix.
+constexpr int covIndex(int i, int j) { return i >= j ? i * (i + 1) / 2 + j : j * (j + 1) / 2 + i; }
+} // namespace
+
+MultiplicityDistribution to_multiplicity_distribution(const std::string& name) {
+  if (name == "Fixed")
+    return MultiplicityDistribution::kFixed;
+  if (name == "Poisson")
+    return MultiplicityDistribution::kPoisson;
+  if (name == "Uniform")
+    return MultiplicityDistribution::kUniform;
+  throw std::invalid_argument("Unknown multiplicity distribution '" + name + "', expected Fixed, Poisson or Uniform");
+}
+
+SyntheticEventGenerator::SyntheticEventGenerator(const SyntheticEventConfig& config) : m_config(config) {
+  const auto is_fraction = [](double f) { return f >= 0. && f <= 1.; };
+  if (config.n_jets < 1)
+    throw std::invalid_argument("The number of jets per event must be at least 1");
+  if (config.jet_energy <= 0.)
+    throw std::invalid_argument("The jet energy must be positive");
+  if (config.min_multiplicity < 1 || config.min_multiplicity > config.max_multiplicity)
+    throw std::invalid_argument("The multiplicity range must satisfy 1 <= min <= max");
+  if (config.mean_multiplicity < config.min_multiplicity || config.mean_multiplicity > config.max_multiplicity)
+    throw std::invalid_argument("The mean multiplicity must lie within [min, max]");
+  if (!is_fraction(config.charged_fraction) || !is_fraction(config.lepton_fraction) ||
+      !is_fraction(config.photon_fraction) || !is_fraction(config.displaced_fraction))
+    throw std::invalid_argument("Fractions must lie within [0, 1]");
+  if (config.cone_sigma <= 0. || config.mean_displacement < 0. || config.bz <= 0.)
+    throw std::invalid_argument(
+        "The cone width and the magnetic field must be positive, the displacement must not be negative");
+}
+
+int SyntheticEventGenerator::drawMultiplicity(std::mt19937_64& rng) const {
+  switch (m_config.multiplicity_distribution) {
+  case MultiplicityDistribution::kFixed:
+    return static_cast<int>(std::lround(m_config.mean_multiplicity));
+  case MultiplicityDistribution::kPoisson: {
+    std::poisson_distribution<int> poisson(m_config.mean_multiplicity);
+    return std::clamp(poisson(rng), m_config.min_multiplicity, m_config.max_multiplicity);
+  }
+  case MultiplicityDistribution::kUniform:
+    return std::uniform_int_distribution<int>(m_config.min_multiplicity, m_config.max_multiplicity)(rng);
+  }
+  return m_config.min_multiplicity;
+}
+
+void SyntheticEventGenerator::addTrack(std::mt19937_64& rng, edm4hep::MutableReconstructedParticle& particle,
+                                       edm4hep::TrackCollection& tracks, const std::array<double, 3>& pv) const {
+  std::normal_distribution<double> gauss(0., 1.);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+
+  const auto& mom = particle.getMomentum();
+  const double pt = std::hypot(mom.x, mom.y);
+  const double p = std::sqrt(pt * pt + mom.z * mom.z);
+  const double sin_theta = std::max(pt / p, 1e-3);
+  const double phi = std::atan2(mom.y, mom.x);
+  const double tan_lambda = mom.z / pt;
+  const double omega = particle.getCharge() * kCurvature * m_config.bz / pt;
+
+  // resolutions
+  const double sigma_ip = std::hypot(kIPResolutionA, kIPResolutionB / (p * std::pow(sin_theta, 1.5)));
+  const double sigma_omega = std::abs(omega) * std::hypot(kPtResolution * pt, 1e-3);
+  const double sigma_phi = std::hypot(kAngleResolution, 1e-3 / p);
+  const double sigma_tan_lambda = sigma_phi / (sin_theta * sin_theta);
+
+  // straight line approximation of the track through the primary vertex near the origin
+  const double along = pv[0] * std::cos(phi) + pv[1] * std::sin(phi);
+  double d0 = -pv[0] * std::sin(phi) + pv[1] * std::cos(phi) + sigma_ip * gauss(rng);
+  double z0 = pv[2] - tan_lambda * along + sigma_ip * gauss(rng);
+  if (uniform(rng) < m_config.displaced_fraction) {
+    std::exponential_distribution<double> flight(1. / std::max(m_config.mean_displacement, 1e-9));
+    d0 += (uniform(rng) < 0.5 ? -1. : 1.) * flight(rng);
+    z0 += (uniform(rng) < 0.5 ? -1. : 1.) * flight(rng);
+  }
+
+  edm4hep::TrackState state{};
+  state.location = edm4hep::TrackState::AtIP;
+  state.D0 = d0;
+  state.phi = phi;
+  state.omega = omega;
+  state.Z0 = z0;
+  state.tanLambda = tan_lambda;
+  state.referencePoint = edm4hep::Vector3f(0, 0, 0);
+  // parameter order d0, phi, omega, z0, tanLambda
+  const std::array<double, 5> sigma{sigma_ip, sigma_phi, sigma_omega, sigma_ip, sigma_tan_lambda};
+  for (int i = 0; i < 5; ++i)
+    state.covMatrix[covIndex(i, i)] = sigma[i] * sigma[i];
+  state.covMatrix[covIndex(1, 0)] = kCorrelation * sigma[0] * sigma[1];
+  state.covMatrix[covIndex(4, 3)] = kCorrelation * sigma[3] * sigma[4];
+
+  auto track = tracks.create();
+  std::chi_squared_distribution<double> chi2(8.);
+  track.setChi2(chi2(rng));
+  track.setNdf(8);
+  track.addToTrackStates(state);
+  particle.addToTracks(track);
+}
+
+SyntheticEvent SyntheticEventGenerator::generate(std::uint64_t event_number) const {
+  std::mt19937_64 rng(eventSeed(m_config.seed, event_number));
+  std::normal_distribution<double> gauss(0., 1.);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::exponential_distribution<double> share(1.);
+
+  SyntheticEvent event;
+
+  const std::array<double, 3> pv{m_config.beam_spot[0] * gauss(rng), m_config.beam_spot[1] * gauss(rng),
+                                 m_config.beam_spot[2] * gauss(rng)};
+  auto vertex = event.vertices.create();
+  vertex.setPosition(edm4hep::Vector3f(pv[0], pv[1], pv[2]));
+
+  Vec3 axis{};
+  std::vector<double> shares;
+  for (int j = 0; j < m_config.n_jets; ++j) {
+    if (j == 1 && m_config.n_jets == 2) {
+      axis = {-axis[0], -axis[1], -axis[2]}; // back-to-back dijet
+    } else {
+      const double cos_theta = 1.8 * uniform(rng) - 0.9; // within the tracker acceptance
+      const double sin_theta = std::sqrt(1. - cos_theta * cos_theta);
+      const double phi = 2. * kPi * uniform(rng) - kPi;
+      axis = {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+    }
+    // orthonormal basis around the jet axis
+    const Vec3 u = normalized(cross(axis, std::abs(axis[2]) < 0.9 ? Vec3{0, 0, 1} : Vec3{1, 0, 0}));
+    const Vec3 v = cross(axis, u);
+
+    const int n_constituents = drawMultiplicity(rng);
+    shares.resize(n_constituents);
+    double share_sum = 0.;
+    for (auto& s : shares) {
+      s = share(rng);
+      share_sum += s;
+    }
+
+    auto jet = event.jets.create();
+    double jet_e = 0., jet_px = 0., jet_py = 0., jet_pz = 0.;
+    float jet_charge = 0.;
+    for (const double s : shares) {
+      const double a = m_config.cone_sigma * gauss(rng);
+      const double b = m_config.cone_sigma * gauss(rng);
+      const Vec3 dir = normalized({axis[0] + a * u[0] + b * v[0], axis[1] + a * u[1] + b * v[1],
+                                   axis[2] + a * u[2] + b * v[2]});
+      const double p = kMinMomentum + std::max(m_config.jet_energy - n_constituents * kMinMomentum, 0.) * s / share_sum;
+
+      int pdg = 0;
+      double mass = 0.;
+      int charge = 0;
+      if (uniform(rng) < m_config.charged_fraction) {
+        charge = uniform(rng) < 0.5 ? -1 : 1;
+        const double kind = uniform(rng);
+        if (kind < 0.5 * m_config.lepton_fraction) {
+          pdg = -11 * charge;
+          mass = kMassElectron;
+        } else if (kind < m_config.lepton_fraction) {
+          pdg = -13 * charge;
+          mass = kMassMuon;
+        } else {
+          pdg = 211 * charge;
+          mass = kMassPion;
+        }
+      } else if (uniform(rng) < m_config.photon_fraction) {
+        pdg = 22;
+      } else {
+        pdg = 130;
+        mass = kMassK0L;
+      }
+
+      auto particle = event.particles.create();
+      particle.setPDG(pdg);
+      particle.setCharge(charge);
+      particle.setMass(mass);
+      particle.setEnergy(std::sqrt(p * p + mass * mass));
+      particle.setMomentum(edm4hep::Vector3f(p * dir[0], p * dir[1], p * dir[2]));
+      particle.setReferencePoint(edm4hep::Vector3f(0, 0, 0));
+      if (charge != 0)
+        addTrack(rng, particle, event.tracks, pv);
+      jet.addToParticles(particle);
+
+      jet_e += particle.getEnergy();
+      jet_px += p * dir[0];
+      jet_py += p * dir[1];
+      jet_pz += p * dir[2];
+      jet_charge += charge;
+    }
+    jet.setEnergy(jet_e);
+    jet.setMomentum(edm4hep::Vector3f(jet_px, jet_py, jet_pz));
+    jet.setMass(std::sqrt(std::max(0., jet_e * jet_e - jet_px * jet_px - jet_py * jet_py - jet_pz * jet_pz)));
+    jet.setCharge(jet_charge);
+  }
+  return event;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SYNTHETICEVENTGENERATOR_H
+#define SYNTHETICEVENTGENERATOR_H
+
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <edm4hep/TrackCollection.h>
+#include <edm4hep/VertexCollection.h>
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <string>
+
+/// Distribution of the number of constituents of a synthetic jet.
+enum class MultiplicityDistribution {
+  kFixed,   ///< always the mean multiplicity
+  kPoisson, ///< Poisson distribution around the mean, clamped to [min, max]
+  kUniform  ///< uniform in [min, max]
+};
+
+/// Parses "Fixed", "Poisson" or "Uniform". Throws std::invalid_argument for anything else.
+MultiplicityDistribution to_multiplicity_distribution(const std::string& name);
+
+/// Settings of the SyntheticEventGenerator. Lengths in mm, energies in GeV, magnetic field in T.
+struct SyntheticEventConfig {
+  std::uint64_t seed{42};
+  int n_jets{2};             ///< two jets are generated back-to-back, more jets in random directions
+  double jet_energy{120.};   ///< sum of the constituent momenta of a jet (approximately)
+  MultiplicityDistribution multiplicity_distribution{MultiplicityDistribution::kPoisson};
+  double mean_multiplicity{35.};
+  int min_multiplicity{1};
+  int max_multiplicity{150};
+  double charged_fraction{0.6};    ///< fraction of charged constituents (with a track)
+  double lepton_fraction{0.04};    ///< fraction of electrons and muons among the charged constituents
+  double photon_fraction{0.75};    ///< fraction of photons among the neutral constituents, the rest are K0L
+  double cone_sigma{0.15};         ///< angular spread (rad) of the constituents around the jet axis
+  double displaced_fraction{0.1};  ///< fraction of tracks from displaced (heavy flavor) decays
+  double mean_displacement{0.5};   ///< mean additional |d0| and |z0| of displaced tracks
+  double bz{2.0};                  ///< magnetic field for the track curvature
+  std::array<double, 3> beam_spot{0.006, 0.00004, 0.3}; ///< Gaussian width of the primary vertex in x, y, z
+};
+
+/// Collections of one synthetic event.
+struct SyntheticEvent {
+  edm4hep::ReconstructedParticleCollection jets;
+  edm4hep::ReconstructedParticleCollection particles; ///< jet constituents
+  edm4hep::TrackCollection tracks;                    ///< tracks of the charged constituents
+  edm4hep::VertexCollection vertices;                 ///< the primary vertex
+};
+
+/**
+ * @class SyntheticEventGenerator
+ * @brief Generates reconstructed jets with everything the JetObservablesRetriever reads, without any input file.
+ *
+ * Every event has one primary vertex (smeared with the beam spot) and n_jets jets. The number of constituents of a
+ * jet is drawn from the multiplicity distribution, the constituent momenta are 0.2 GeV plus exponentially distributed
+ * shares of the rest of the jet energy, spread around the jet axis with cone_sigma. Charged constituents are pions,
+ * electrons and muons with one track each: a track state at the IP with D0, phi, omega, Z0 and tanLambda consistent
+ * with the momentum and the primary vertex, smeared with a CLD-like resolution, and the matching covariance matrix. A
+ * fraction of the tracks is displaced, as expected from heavy flavor decays. Neutral constituents are photons and K0L
+ * without tracks. The jet four-momentum is the sum of its constituents.
+ *
+ * The events are meant for benchmarking and stress tests, not for physics. Event i only depends on the seed and i, so
+ * events can be generated in any order and from several threads (generate() is const).
+ */
+class SyntheticEventGenerator {
+public:
+  /// Throws std::invalid_argument if the configuration is inconsistent.
+  explicit SyntheticEventGenerator(const SyntheticEventConfig& config);
+
+  /// Generates event number event_number.
+  SyntheticEvent generate(std::uint64_t event_number) const;
+
+  const SyntheticEventConfig& config() const { return m_config; }
+
+private:
+  int drawMultiplicity(std::mt19937_64& rng) const;
+  void addTrack(std::mt19937_64& rng, edm4hep::MutableReconstructedParticle& particle, edm4hep::TrackCollection& tracks,
+                const std::array<double, 3>& pv) const;
+
+  SyntheticEventConfig m_config;
+};
+
+#endif // SYNTHETICEVENTGENERATOR_H
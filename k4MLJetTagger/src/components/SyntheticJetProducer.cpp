@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Gaudi/Property.h"
+#include "GaudiKernel/MsgStream.h"
+#include "k4FWCore/Producer.h"
+
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <edm4hep/TrackCollection.h>
+#include <edm4hep/VertexCollection.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "MemoryUsage.h"
+#include "SyntheticEventGenerator.h"
+
+/**
+ * @class SyntheticJetProducer
+ * @brief Gaudi producer of synthetic reconstructed jets, their constituents, tracks and the primary vertex.
+ *
+ * Replaces the input file for benchmarks and stress tests of the JetTagger, JetObsWriter and the other algorithms
+ * reading jets: the output collections have the default names of the CLD reconstruction that these algorithms read.
+ * The events are generated by SyntheticEventGenerator (see there for the model); the multiplicity distribution, the
+ * charged/neutral mix and the other settings are properties. Together with the tiny model in extras/tiny_model, the
+ * full tagging chain runs without any external data (see options/syntheticJetTagging.py).
+ *
+ * The events are reproducible: event i only depends on Seed and i.
+ *
+ * @author Sara Aumiller
+ */
+struct SyntheticJetProducer final
+    : k4FWCore::Producer<std::tuple<edm4hep::ReconstructedParticleCollection, edm4hep::ReconstructedParticleCollection,
+                                    edm4hep::TrackCollection, edm4hep::VertexCollection>()> {
+  SyntheticJetProducer(const std::string& name, ISvcLocator* svcLoc)
+      : Producer(name, svcLoc, {},
+                 {KeyValues("OutputJets", {"RefinedVertexJets"}), KeyValues("OutputParticles", {"PandoraPFOs"}),
+                  KeyValues("OutputTracks", {"SiTracks_Refitted"}),
+                  KeyValues("OutputPrimaryVertices", {"PrimaryVertices"})}) {}
+
+  StatusCode initialize() override {
+    const auto memory_before = read_memory_usage();
+    SyntheticEventConfig config;
+    config.seed = m_seed;
+    config.n_jets = m_nJets;
+    config.jet_energy = m_jetEnergy;
+    config.mean_multiplicity = m_meanMultiplicity;
+    config.min_multiplicity = m_minMultiplicity;
+    config.max_multiplicity = m_maxMultiplicity;
+    config.charged_fraction = m_chargedFraction;
+    config.lepton_fraction = m_leptonFraction;
+    config.photon_fraction = m_photonFraction;
+    config.cone_sigma = m_coneSigma;
+    config.displaced_fraction = m_displacedFraction;
+    config.mean_displacement = m_meanDisplacement;
+    config.bz = m_bz;
+    if (m_beamSpot.value().size() != 3) {
+      error() << "BeamSpot needs three widths (x, y, z)" << endmsg;
+      return StatusCode::FAILURE;
+    }
+    std::copy(m_beamSpot.value().begin(), m_beamSpot.value().end(), config.beam_spot.begin());
+    try {
+      config.multiplicity_distribution = to_multiplicity_distribution(m_multiplicityDistribution);
+      m_generator = std::make_unique<SyntheticEventGenerator>(config);
+    } catch (const std::invalid_argument& e) {
+      error() << e.what() << endmsg;
+      return StatusCode::FAILURE;
+    }
+    info() << "Generating " << m_nJets.value() << " synthetic jets per event with "
+           << m_multiplicityDistribution.value() << " multiplicity (mean " << m_meanMultiplicity.value()
+           << ") and a charged fraction of " << m_chargedFraction.value() << endmsg;
+    m_initMemory = {memory_before, read_memory_usage()};
+    return StatusCode::SUCCESS;
+  }
+
+  StatusCode finalize() override {
+    info() << "Memory taken by initialize(): " << m_initMemory.toString() << endmsg;
+    return Producer::finalize();
+  }
+
+  std::tuple<edm4hep::ReconstructedParticleCollection, edm4hep::ReconstructedParticleCollection,
+             edm4hep::TrackCollection, edm4hep::VertexCollection>
+  operator()() const override {
+    auto event = m_generator->generate(m_eventNumber++);
+    debug() << "Generated " << event.jets.size() << " jets with " << event.particles.size() << " constituents and "
+            << event.tracks.size() << " tracks" << endmsg;
+    return std::make_tuple(std::move(event.jets), std::move(event.particles), std::move(event.tracks),
+                           std::move(event.vertices));
+  }
+
+private:
+  std::unique_ptr<SyntheticEventGenerator> m_generator;
+  mutable std::atomic<std::uint64_t> m_eventNumber{0};
+  MemoryDelta m_initMemory; ///< RSS taken by initialize()
+
+  Gaudi::Property<std::uint64_t> m_seed{this, "Seed", 42, "Seed of the generator, event i only depends on it and i"};
+  Gaudi::Property<int> m_nJets{this, "JetsPerEvent", 2, "Number of jets per event (two jets are back-to-back)"};
+  Gaudi::Property<double> m_jetEnergy{this, "JetEnergy", 120., "Energy of every jet in GeV"};
+  Gaudi::Property<std::string> m_multiplicityDistribution{
+      this, "MultiplicityDistribution", "Poisson",
+      "Distribution of the number of constituents per jet: Fixed, Poisson or Uniform"};
+  Gaudi::Property<double> m_meanMultiplicity{this, "MeanMultiplicity", 35., "Mean number of constituents per jet"};
+  Gaudi::Property<int> m_minMultiplicity{this, "MinMultiplicity", 1, "Minimum number of constituents per jet"};
+  Gaudi::Property<int> m_maxMultiplicity{this, "MaxMultiplicity", 150, "Maximum number of constituents per jet"};
+  Gaudi::Property<double> m_chargedFraction{this, "ChargedFraction", 0.6,
+                                            "Fraction of charged constituents (with a track)"};
+  Gaudi::Property<double> m_leptonFraction{this, "LeptonFraction", 0.04,
+                                           "Fraction of electrons and muons among the charged constituents"};
+  Gaudi::Property<double> m_photonFraction{this, "PhotonFraction", 0.75,
+                                           "Fraction of photons among the neutral constituents, the rest are K0L"};
+  Gaudi::Property<double> m_coneSigma{this, "ConeSigma", 0.15,
+                                      "Angular spread (rad) of the constituents around the jet axis"};
+  Gaudi::Property<double> m_displacedFraction{this, "DisplacedFraction", 0.1,
+                                              "Fraction of tracks from displaced (heavy flavor) decays"};
+  Gaudi::Property<double> m_meanDisplacement{this, "MeanDisplacement", 0.5,
+                                             "Mean additional |d0| and |z0| of displaced tracks in mm"};
+  Gaudi::Property<double> m_bz{this, "Bz", 2.0, "Magnetic field in T for the track curvature"};
+  Gaudi::Property<std::vector<double>> m_beamSpot{
+      this, "BeamSpot", {0.006, 0.00004, 0.3}, "Gaussian width of the primary vertex in x, y, z in mm"};
+};
+
+DECLARE_COMPONENT(SyntheticJetProducer)
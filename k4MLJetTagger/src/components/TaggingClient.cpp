@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TaggingClient.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+/// Connects to the socket, retrying while the server is not listening yet.
+int connect_socket(const std::string& path, double timeout_s) {
+  const auto address = socket_address(path);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_s);
+  while (true) {
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      throw std::runtime_error(std::string("Could not create a socket: ") + std::strerror(errno));
+    if (::connect(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) == 0)
+      return fd;
+    const int error = errno;
+    ::close(fd);
+    if ((error != ENOENT && error != ECONNREFUSED && error != EAGAIN) || std::chrono::steady_clock::now() > deadline)
+      throw std::runtime_error("Could not connect to the tagging server at " + path + ": " + std::strerror(error));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
+} // namespace
+
+TaggingClient::TaggingClient(const std::string& socket_path, std::shared_ptr<const ModelBundle> bundle,
+                             double connect_timeout_s)
+    : m_socketPath(socket_path), m_bundle(std::move(bundle)),
+      m_preprocessor(m_bundle->preprocessing(),
+                     rv::RVec<std::string>(m_bundle->variables().begin(), m_bundle->variables().end())) {
+  m_stream = std::make_unique<SocketStream>(connect_socket(socket_path, connect_timeout_s));
+  m_stream->write(tagging_protocol::kMagic, sizeof(tagging_protocol::kMagic));
+  m_stream->writeU32(tagging_protocol::kVersion);
+  m_stream->writeU32(m_bundle->checksum());
+  if (const auto status = m_stream->readU32(); status != tagging_protocol::kOk)
+    throw std::runtime_error("The tagging server at " + socket_path + " refused the model " + m_bundle->path() +
+                             ": " + m_stream->readString());
+  m_stream->readModelInfo(m_modelInfo);
+
+  // the server must run the model on the tensors this client fills
+  TaggingModelInfo expected;
+  for (const auto& name : m_preprocessor.inputNames()) {
+    const auto& params = m_preprocessor.params(name);
+    expected.inputs.push_back({name, static_cast<std::uint32_t>(params.var_names.size()),
+                               static_cast<std::uint32_t>(params.max_length)});
+  }
+  if (m_modelInfo.inputs != expected.inputs || m_modelInfo.n_outputs != m_bundle->flavors().size())
+    throw std::runtime_error("The tagging server at " + socket_path + " serves a model with other inputs or outputs "
+                             "than " + m_bundle->path());
+}
+
+std::vector<rv::RVec<float>> TaggingClient::tag(const std::vector<rv::RVec<ConstituentVars>>& jets,
+                                                WeaverInterface::BatchTiming* timing) {
+  using Clock = std::chrono::steady_clock;
+  const auto elapsed_ns = [](Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+  };
+  std::vector<rv::RVec<float>> results;
+  if (jets.empty())
+    return results;
+  if (jets.size() > tagging_protocol::kMaxJetsPerRequest)
+    throw std::invalid_argument("Too many jets for one request: " + std::to_string(jets.size()));
+
+  // [n, n_vars, max_length] per input group, as in WeaverInterface::runBatch()
+  const auto start_preprocess = Clock::now();
+  m_batchData.resize(m_modelInfo.inputs.size());
+  for (auto& input : m_batchData)
+    input.clear();
+  for (const auto& jet : jets) {
+    m_preprocessor.preprocess(jet, m_data, true);
+    for (size_t g = 0; g < m_data.size(); ++g)
+      m_batchData[g].insert(m_batchData[g].end(), m_data[g].begin(), m_data[g].end());
+  }
+  if (timing)
+    timing->preprocess_ns += elapsed_ns(start_preprocess);
+
+  const auto start_request = Clock::now();
+  m_stream->writeU32(tagging_protocol::kTag);
+  m_stream->writeU32(jets.size());
+  for (const auto& input : m_batchData)
+    m_stream->writeFloats(input.data(), input.size());
+  if (const auto status = m_stream->readU32(); status != tagging_protocol::kOk)
+    throw std::runtime_error("The tagging server at " + m_socketPath + " failed: " + m_stream->readString());
+  const auto n_jets = m_stream->readU32();
+  const auto n_outputs = m_stream->readU32();
+  if (n_jets != jets.size() || n_outputs != m_modelInfo.n_outputs)
+    throw std::runtime_error("The tagging server at " + m_socketPath + " returned " + std::to_string(n_jets) +
+                             " jets with " + std::to_string(n_outputs) + " scores");
+  m_scores.resize(static_cast<size_t>(n_jets) * n_outputs);
+  m_stream->readFloats(m_scores.data(), m_scores.size());
+  if (timing)
+    timing->inference_ns += elapsed_ns(start_request);
+
+  results.reserve(n_jets);
+  for (size_t i = 0; i < n_jets; ++i)
+    results.emplace_back(m_scores.begin() + i * n_outputs, m_scores.begin() + (i + 1) * n_outputs);
+  return results;
+}
+
+size_t TaggingClient::inputTensorBytes() const {
+  size_t bytes = m_scores.capacity() * sizeof(float);
+  for (const auto* tensor : {&m_data, &m_batchData}) {
+    bytes += tensor->capacity() * sizeof((*tensor)[0]);
+    for (const auto& input : *tensor)
+      bytes += input.capacity() * sizeof(float);
+  }
+  return bytes;
+}
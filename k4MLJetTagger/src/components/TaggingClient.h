@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TAGGINGCLIENT_H
+#define TAGGINGCLIENT_H
+
+#include "ModelBundle.h"
+#include "ROOT/RVec.hxx"
+#include "TaggingProtocol.h"
+#include "WeaverInterface.h"
+#include "WeaverPreprocessor.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rv = ROOT::VecOps;
+
+/**
+ * @class TaggingClient
+ * @brief Tags jets with a model hosted by a TaggingServer on the same node, instead of a session of its own.
+ *
+ * The client preprocesses the jets itself, with the preprocessing of the model bundle it is given, and sends the padded
+ * input tensors of all jets of a call in one request. The server identifies the model by the checksum of the bundle,
+ * batches the requests of all its clients and returns the flavor probabilities. The bundle is only used for its small
+ * sections, the model bytes in it are never read by the client.
+ */
+class TaggingClient {
+public:
+  using ConstituentVars = WeaverInterface::ConstituentVars;
+
+  /**
+   * @brief Connects to the server and checks that it serves the model of the bundle with the same inputs.
+   *
+   * @param socket_path Path of the Unix domain socket of the server.
+   * @param bundle The model bundle the server was started with (or an identical copy).
+   * @param connect_timeout_s How long to retry while the socket does not accept connections yet, e.g. because the
+   * server is still starting.
+   * Throws std::runtime_error if the connection or the handshake fails.
+   */
+  TaggingClient(const std::string& socket_path, std::shared_ptr<const ModelBundle> bundle,
+                double connect_timeout_s = 30.);
+
+  /**
+   * @brief Tags jets: preprocesses them, sends them in one request and waits for the probabilities.
+   *
+   * @param jets Per-constituent variables of every jet.
+   * @param timing If given, the preprocessing and the round trip to the server (as inference) are added to it.
+   * @return The probabilities of the flavors for every jet, in the order of the jets.
+   * Throws std::runtime_error if the server fails or the connection is lost.
+   */
+  std::vector<rv::RVec<float>> tag(const std::vector<rv::RVec<ConstituentVars>>& jets,
+                                   WeaverInterface::BatchTiming* timing = nullptr);
+
+  const std::string& socketPath() const { return m_socketPath; }
+  const WeaverPreprocessor& preprocessor() const { return m_preprocessor; }
+  const TaggingModelInfo& modelInfo() const { return m_modelInfo; }
+
+  /// Heap memory held by the input tensors of the requests, in bytes.
+  size_t inputTensorBytes() const;
+
+private:
+  std::string m_socketPath;
+  std::shared_ptr<const ModelBundle> m_bundle;
+  WeaverPreprocessor m_preprocessor;
+  std::unique_ptr<SocketStream> m_stream;
+  TaggingModelInfo m_modelInfo;
+  WeaverPreprocessor::Tensor m_data;      ///< preprocessed inputs of one jet
+  WeaverPreprocessor::Tensor m_batchData; ///< padded inputs of all jets of a request, one tensor per input group
+  std::vector<float> m_scores;
+};
+
+#endif // TAGGINGCLIENT_H
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TaggingEngine.h"
+
+#include "Helpers.h"
+#include "WeaverPreprocessor.h"
+
+#include <stdexcept>
+#include <utility>
+
+TaggingEngine::TaggingEngine(std::shared_ptr<const ModelBundle> bundle, const Options& options)
+    : m_options(options) {
+  m_flavorNames = bundle->flavorNames();
+  m_pdgCodes = bundle->pdgCodes();
+  m_collectionNames = bundle->collectionNames();
+  m_vars = rv::RVec<std::string>(bundle->variables().begin(), bundle->variables().end());
+  m_weaver = std::make_unique<WeaverInterface>(std::move(bundle), m_options.memory);
+  setUp();
+}
+
+TaggingEngine::TaggingEngine(const std::string& model_path, const std::string& json_path, const Options& options,
+                             const std::string& collection_prefix)
+    : m_options(options) {
+  const auto json_config = loadJsonFile(json_path);
+  if (json_config.is_null())
+    throw std::runtime_error("Could not load the JSON configuration file " + json_path);
+  for (const auto& name : json_config.at("output_names")) {
+    const auto flavor = name.get<std::string>();
+    const auto pdg = to_PDGflavor.find(flavor);
+    if (pdg == to_PDGflavor.end())
+      throw std::runtime_error("No PDG code known for the output " + flavor);
+    m_flavorNames.push_back(flavor);
+    m_pdgCodes.push_back(pdg->second);
+    m_collectionNames.push_back(collection_prefix + flavor.substr(flavor.find_last_of('_') + 3)); // recojet_isB -> B
+  }
+  // same order as the JetTagger: pf_features, then pf_vectors (pf_points are part of pf_features)
+  for (const auto& var : json_config["pf_features"]["var_names"])
+    m_vars.push_back(var.get<std::string>());
+  for (const auto& var : json_config["pf_vectors"]["var_names"])
+    m_vars.push_back(var.get<std::string>());
+  m_weaver = std::make_unique<WeaverInterface>(model_path, WeaverPreprocessor(json_config, m_vars), m_options.memory);
+  setUp();
+}
+
+void TaggingEngine::setUp() {
+  if (m_options.max_batch_size > 1)
+    m_options.max_batch_size = m_weaver->setMaxBatchSize(m_options.max_batch_size);
+  m_retriever.Bz = m_options.bz;
+  m_retriever.groups = JetObservablesRetriever::needed_groups(std::vector<std::string>(m_vars.begin(), m_vars.end()));
+}
+
+std::vector<rv::RVec<float>> TaggingEngine::tag(const edm4hep::ReconstructedParticleCollection& jets,
+                                                const edm4hep::VertexCollection& primary_vertices) {
+  m_jetInputs.clear();
+  m_jetInputs.reserve(jets.size());
+  for (const auto& jet : jets) {
+    Jet observables = m_retriever.retrieve_input_observables(jet, primary_vertices);
+    m_jetInputs.push_back(from_Jet_to_onnx_input(observables, m_vars));
+  }
+  return run(m_jetInputs);
+}
+
+std::vector<rv::RVec<float>> TaggingEngine::run(const std::vector<rv::RVec<WeaverInterface::ConstituentVars>>& jets) {
+  if (m_options.max_batch_size > 1)
+    return m_weaver->runBatch(jets);
+  std::vector<rv::RVec<float>> probabilities;
+  probabilities.reserve(jets.size());
+  for (const auto& jet : jets)
+    probabilities.push_back(m_weaver->run(jet));
+  return probabilities;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TAGGINGENGINE_H
+#define TAGGINGENGINE_H
+
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <edm4hep/VertexCollection.h>
+
+#include "JetObservablesRetriever.h"
+#include "ModelBundle.h"
+#include "ONNXRuntime.h"
+#include "ROOT/RVec.hxx"
+#include "WeaverInterface.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rv = ROOT::VecOps;
+
+/**
+ * @struct TaggingEngineOptions
+ * @brief Settings of a TaggingEngine.
+ */
+struct TaggingEngineOptions {
+  size_t max_batch_size{1};          ///< Jets per ONNX Runtime run, 1 to run the jets one by one.
+  double bz{2.0};                    ///< Magnetic field along z in Tesla, for the track parameters.
+  ONNXRuntime::MemoryOptions memory; ///< Memory settings of the ONNX Runtime session.
+};
+
+/**
+ * @class TaggingEngine
+ * @brief Tags the jets of an event without Gaudi: feature extraction, preprocessing and inference.
+ *
+ * The steps of the JetTagger in one object, for the tools (k4MLJetTagger_tag) and for programs that embed the tagger.
+ * The model comes from a ModelBundle or from an ONNX model with its weaver JSON configuration, and the engine knows
+ * the flavors, their PDG codes and the names of their output collections.
+ *
+ * An engine is not thread-safe, use one per thread. Engines made from the same bundle share the mapped file (and,
+ * with memory.share_model_bytes, the model weights).
+ */
+class TaggingEngine {
+public:
+  using Options = TaggingEngineOptions;
+
+  /**
+   * @brief Engine for the model of a bundle.
+   *
+   * Throws the exceptions of the WeaverInterface if the session cannot be created.
+   */
+  explicit TaggingEngine(std::shared_ptr<const ModelBundle> bundle, const Options& options = {});
+
+  /**
+   * @brief Engine for an ONNX model and its weaver JSON configuration.
+   *
+   * @param collection_prefix The output collection of a flavor recojet_isX is collection_prefix + X.
+   * Throws std::runtime_error if the JSON cannot be read or has an output without a known PDG code.
+   */
+  TaggingEngine(const std::string& model_path, const std::string& json_path, const Options& options = {},
+                const std::string& collection_prefix = "RefinedJetTag_");
+
+  /**
+   * @brief Tags the jets of an event.
+   *
+   * @param jets The jets, with their constituents.
+   * @param primary_vertices The primary vertex collection of the event (at most one vertex, the origin if empty).
+   * @return The probabilities of the flavors for every jet, in the order of flavorNames().
+   * Throws std::invalid_argument if there is more than one primary vertex.
+   */
+  std::vector<rv::RVec<float>> tag(const edm4hep::ReconstructedParticleCollection& jets,
+                                   const edm4hep::VertexCollection& primary_vertices);
+
+  /// Runs the network on the network inputs of several jets, as made by from_Jet_to_onnx_input().
+  std::vector<rv::RVec<float>> run(const std::vector<rv::RVec<WeaverInterface::ConstituentVars>>& jets);
+
+  const std::vector<std::string>& flavorNames() const { return m_flavorNames; } ///< e.g. recojet_isB
+  const std::vector<int>& pdgCodes() const { return m_pdgCodes; }
+  const std::vector<std::string>& collectionNames() const { return m_collectionNames; }
+  const rv::RVec<std::string>& variables() const { return m_vars; } ///< constituent variables, in input order
+  const Options& options() const { return m_options; }
+
+  WeaverInterface& weaver() { return *m_weaver; }
+  JetObservablesRetriever& retriever() { return m_retriever; }
+
+private:
+  void setUp();
+
+  Options m_options;
+  std::vector<std::string> m_flavorNames;
+  std::vector<int> m_pdgCodes;
+  std::vector<std::string> m_collectionNames;
+  rv::RVec<std::string> m_vars;
+  std::unique_ptr<WeaverInterface> m_weaver;
+  JetObservablesRetriever m_retriever;
+  std::vector<rv::RVec<WeaverInterface::ConstituentVars>> m_jetInputs; ///< network inputs of the jets of an event
+};
+
+#endif // TAGGINGENGINE_H
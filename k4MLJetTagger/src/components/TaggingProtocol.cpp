@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TaggingProtocol.h"
+
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static_assert(std::endian::native == std::endian::little, "The tagging protocol sends little-endian data directly");
+
+size_t TaggingModelInfo::floatsPerJet() const {
+  size_t n = 0;
+  for (const auto& input : inputs)
+    n += static_cast<size_t>(input.n_vars) * input.max_length;
+  return n;
+}
+
+SocketStream::~SocketStream() {
+  if (m_fd >= 0)
+    ::close(m_fd);
+}
+
+void SocketStream::read(void* data, size_t size) {
+  auto* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    const auto n = ::recv(m_fd, bytes, size, 0);
+    if (n == 0)
+      throw std::runtime_error("The connection was closed");
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("Could not read from the socket: ") + std::strerror(errno));
+    }
+    bytes += n;
+    size -= n;
+  }
+}
+
+void SocketStream::write(const void* data, size_t size) {
+  const auto* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const auto n = ::send(m_fd, bytes, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("Could not write to the socket: ") + std::strerror(errno));
+    }
+    bytes += n;
+    size -= n;
+  }
+}
+
+std::uint32_t SocketStream::readU32() {
+  std::uint32_t value;
+  read(&value, sizeof(value));
+  return value;
+}
+
+void SocketStream::writeU32(std::uint32_t value) { write(&value, sizeof(value)); }
+
+std::string SocketStream::readString() {
+  const auto size = readU32();
+  if (size > (1u << 20))
+    throw std::runtime_error("A string of " + std::to_string(size) + " bytes was announced, the stream is corrupted");
+  std::string value(size, '\0');
+  read(value.data(), size);
+  return value;
+}
+
+void SocketStream::writeString(const std::string& value) {
+  writeU32(value.size());
+  write(value.data(), value.size());
+}
+
+void SocketStream::readModelInfo(TaggingModelInfo& info) {
+  info.inputs.resize(readU32());
+  for (auto& input : info.inputs) {
+    input.name = readString();
+    input.n_vars = readU32();
+    input.max_length = readU32();
+  }
+  info.n_outputs = readU32();
+}
+
+void SocketStream::writeModelInfo(const TaggingModelInfo& info) {
+  writeU32(info.inputs.size());
+  for (const auto& input : info.inputs) {
+    writeString(input.name);
+    writeU32(input.n_vars);
+    writeU32(input.max_length);
+  }
+  writeU32(info.n_outputs);
+}
+
+struct sockaddr_un socket_address(const std::string& path) {
+  struct sockaddr_un address {};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path))
+    throw std::invalid_argument("The socket path '" + path + "' is empty or longer than " +
+                                std::to_string(sizeof(address.sun_path) - 1) + " characters");
+  std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return address;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TAGGINGPROTOCOL_H
+#define TAGGINGPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/un.h>
+
+/**
+ * Messages between the TaggingServer and its TaggingClients over a Unix domain socket (SOCK_STREAM). All integers and
+ * floats are little-endian, strings are a uint32 length followed by the characters.
+ *
+ * - hello (client): kMagic, kVersion, CRC-32 of the model bundle the client was configured with.
+ * - hello reply (server): kOk and the model (TaggingModelInfo), or an error code and a message.
+ * - tag request (client): kTag, the number of jets n, then for every input group in model order the padded,
+ *   preprocessed tensor [n, n_vars, max_length] as floats.
+ * - tag reply (server): kOk, n, the number of outputs k and the [n, k] scores, or an error code and a message.
+ * A connection serves one model; the client sends the next request after the reply to the previous one.
+ */
+namespace tagging_protocol {
+
+constexpr char kMagic[8] = {'K', '4', 'J', 'T', 'S', 'R', 'V', '1'};
+constexpr std::uint32_t kVersion = 1;
+
+/// Type of a request.
+enum Request : std::uint32_t { kTag = 1 };
+
+/// Status of a reply.
+enum Status : std::uint32_t { kOk = 0, kUnknownModel = 1, kBadRequest = 2, kInferenceFailed = 3 };
+
+/// Upper limit of the jets of one request, against corrupted sizes.
+constexpr std::uint32_t kMaxJetsPerRequest = 1u << 16;
+
+} // namespace tagging_protocol
+
+/// An input group of a served model: the tensor of a jet is [n_vars, max_length].
+struct TaggingInputInfo {
+  std::string name;
+  std::uint32_t n_vars{0};
+  std::uint32_t max_length{0};
+
+  bool operator==(const TaggingInputInfo&) const = default;
+};
+
+/// What the server tells a client about the model of its connection.
+struct TaggingModelInfo {
+  std::vector<TaggingInputInfo> inputs; ///< in model order
+  std::uint32_t n_outputs{0};
+
+  /// Number of floats of the inputs of one jet.
+  size_t floatsPerJet() const;
+};
+
+/**
+ * @class SocketStream
+ * @brief Blocking reads and writes of whole values on a connected socket, which it owns.
+ *
+ * Every read and write throws std::runtime_error if the connection fails or is closed by the other side. Writes do not
+ * raise SIGPIPE.
+ */
+class SocketStream {
+public:
+  explicit SocketStream(int fd) : m_fd(fd) {}
+  ~SocketStream();
+
+  SocketStream(const SocketStream&) = delete;
+  SocketStream& operator=(const SocketStream&) = delete;
+
+  int fd() const { return m_fd; }
+
+  void read(void* data, size_t size);
+  void write(const void* data, size_t size);
+
+  std::uint32_t readU32();
+  void writeU32(std::uint32_t value);
+  std::string readString();
+  void writeString(const std::string& value);
+  void readFloats(float* data, size_t n) { read(data, n * sizeof(float)); }
+  void writeFloats(const float* data, size_t n) { write(data, n * sizeof(float)); }
+
+  void readModelInfo(TaggingModelInfo& info);
+  void writeModelInfo(const TaggingModelInfo& info);
+
+private:
+  int m_fd;
+};
+
+/// Address of a Unix domain socket. Throws std::invalid_argument if the path is too long.
+struct sockaddr_un socket_address(const std::string& path);
+
+#endif // TAGGINGPROTOCOL_H
@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TaggingServer.h"
+
+#include "WeaverInterface.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+/// A served model with its queue of requests and the thread running them in batches.
+struct TaggingServer::Model {
+  std::shared_ptr<const ModelBundle> bundle;
+  std::unique_ptr<WeaverInterface> weaver;
+  TaggingModelInfo info;
+  std::string name;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Request*> queue;
+  size_t queuedJets{0};
+  size_t nClients{0}; ///< connected clients of this model
+  bool stopping{false};
+  std::thread worker;
+
+  // statistics, written by the worker only
+  size_t nRequests{0};
+  size_t nJets{0};
+  size_t nBatches{0};
+  size_t maxBatchJets{0};
+  std::uint64_t inferenceNs{0};
+};
+
+/// The inputs of one request of a client and the promise of its scores.
+struct TaggingServer::Request {
+  size_t nJets{0};
+  WeaverPreprocessor::Tensor inputs; ///< [nJets, n_vars, max_length] per input group
+  Clock::time_point arrival;
+  std::promise<std::vector<float>> scores;
+};
+
+struct TaggingServer::Connection {
+  explicit Connection(int fd) : stream(fd) {}
+  SocketStream stream;
+  std::thread thread;
+  std::atomic<bool> done{false};
+};
+
+TaggingServer::TaggingServer() : TaggingServer(Options()) {}
+
+TaggingServer::TaggingServer(const Options& options) : m_options(options) {
+  m_options.max_batch_size = std::max<size_t>(1, m_options.max_batch_size);
+}
+
+TaggingServer::~TaggingServer() { stopWorkers(); }
+
+void TaggingServer::addModel(std::shared_ptr<const ModelBundle> bundle,
+                             const ONNXRuntime::MemoryOptions& memory_options) {
+  for (const auto& model : m_models) {
+    if (model->bundle->checksum() == bundle->checksum())
+      throw std::invalid_argument("The model of " + bundle->path() + " is already served (from " +
+                                  model->bundle->path() + ")");
+  }
+  auto model = std::make_unique<Model>();
+  model->weaver = std::make_unique<WeaverInterface>(bundle, memory_options);
+  const auto& preprocessor = model->weaver->preprocessor();
+  for (const auto& name : preprocessor.inputNames()) {
+    const auto& params = preprocessor.params(name);
+    model->info.inputs.push_back({name, static_cast<std::uint32_t>(params.var_names.size()),
+                                  static_cast<std::uint32_t>(params.max_length)});
+  }
+  model->info.n_outputs = bundle->flavors().size();
+  const auto name = bundle->metadata().find("name");
+  model->name = name != bundle->metadata().end() ? name->second : bundle->path();
+  model->bundle = std::move(bundle);
+  m_models.push_back(std::move(model));
+}
+
+void TaggingServer::serve(const std::string& socket_path, const std::atomic<bool>& stop) {
+  if (m_models.empty())
+    throw std::runtime_error("The tagging server has no model to serve");
+  const auto address = socket_address(socket_path);
+  const auto* sockaddr = reinterpret_cast<const struct sockaddr*>(&address);
+
+  // a socket file without a server behind it is left over from a server that was killed
+  if (::access(socket_path.c_str(), F_OK) == 0) {
+    const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const bool answered = probe >= 0 && ::connect(probe, sockaddr, sizeof(address)) == 0;
+    if (probe >= 0)
+      ::close(probe);
+    if (answered)
+      throw std::runtime_error("Another tagging server listens on " + socket_path);
+    ::unlink(socket_path.c_str());
+  }
+  const int listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0 || ::bind(listen_fd, sockaddr, sizeof(address)) != 0 || ::listen(listen_fd, 128) != 0) {
+    const int error = errno;
+    if (listen_fd >= 0)
+      ::close(listen_fd);
+    throw std::runtime_error("Could not listen on " + socket_path + ": " + std::strerror(error));
+  }
+
+  startWorkers();
+  const auto reap = [this](bool all) {
+    std::lock_guard lock(m_connectionsMutex);
+    for (auto it = m_connections.begin(); it != m_connections.end();) {
+      if (all)
+        ::shutdown(it->stream.fd(), SHUT_RDWR); // wakes up the thread blocked in a read
+      if (all || it->done) {
+        it->thread.join();
+        it = m_connections.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+  while (!stop) {
+    struct pollfd pfd {listen_fd, POLLIN, 0};
+    const int ready = ::poll(&pfd, 1, 200); // wakes up regularly to check stop
+    reap(false);
+    if (ready <= 0)
+      continue;
+    const int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      continue;
+    std::lock_guard lock(m_connectionsMutex);
+    auto& connection = m_connections.emplace_back(fd);
+    connection.thread = std::thread([this, &connection] { handleConnection(connection); });
+    ++m_nConnections;
+  }
+  reap(true);
+  stopWorkers();
+  ::close(listen_fd);
+  ::unlink(socket_path.c_str());
+}
+
+void TaggingServer::handleConnection(Connection& connection) {
+  auto& stream = connection.stream;
+  Model* model = nullptr;
+  try {
+    char magic[sizeof(tagging_protocol::kMagic)];
+    stream.read(magic, sizeof(magic));
+    const auto version = stream.readU32();
+    const auto checksum = stream.readU32();
+    if (std::memcmp(magic, tagging_protocol::kMagic, sizeof(magic)) != 0 || version != tagging_protocol::kVersion) {
+      stream.writeU32(tagging_protocol::kBadRequest);
+      stream.writeString("unknown protocol or protocol version " + std::to_string(version));
+      connection.done = true;
+      return;
+    }
+    for (const auto& served : m_models) {
+      if (served->bundle->checksum() == checksum)
+        model = served.get();
+    }
+    if (!model) {
+      char text[64];
+      std::snprintf(text, sizeof(text), "no model bundle with the checksum %08x is served", checksum);
+      stream.writeU32(tagging_protocol::kUnknownModel);
+      stream.writeString(text);
+      connection.done = true;
+      return;
+    }
+    stream.writeU32(tagging_protocol::kOk);
+    stream.writeModelInfo(model->info);
+    {
+      std::lock_guard lock(model->mutex);
+      ++model->nClients;
+    }
+
+    while (true) {
+      const auto type = stream.readU32();
+      const auto n_jets = type == tagging_protocol::kTag ? stream.readU32() : 0;
+      if (n_jets == 0 || n_jets > tagging_protocol::kMaxJetsPerRequest) {
+        stream.writeU32(tagging_protocol::kBadRequest);
+        stream.writeString("bad request type " + std::to_string(type) + " or number of jets " +
+                           std::to_string(n_jets));
+        break;
+      }
+      Request request;
+      request.nJets = n_jets;
+      request.inputs.resize(model->info.inputs.size());
+      for (size_t g = 0; g < model->info.inputs.size(); ++g) {
+        const auto& input = model->info.inputs[g];
+        request.inputs[g].resize(static_cast<size_t>(n_jets) * input.n_vars * input.max_length);
+        stream.readFloats(request.inputs[g].data(), request.inputs[g].size());
+      }
+      request.arrival = Clock::now();
+      auto scores = request.scores.get_future();
+      {
+        std::lock_guard lock(model->mutex);
+        model->queue.push_back(&request);
+        model->queuedJets += n_jets;
+      }
+      model->cv.notify_all();
+
+      try {
+        const auto result = scores.get();
+        stream.writeU32(tagging_protocol::kOk);
+        stream.writeU32(n_jets);
+        stream.writeU32(model->info.n_outputs);
+        stream.writeFloats(result.data(), result.size());
+      } catch (const std::runtime_error&) {
+        throw; // the connection, not the inference
+      } catch (const std::exception& e) {
+        stream.writeU32(tagging_protocol::kInferenceFailed);
+        stream.writeString(e.what());
+      }
+    }
+  } catch (const std::exception&) {
+    // the client closed the connection (or the server is stopping)
+  }
+  if (model) {
+    {
+      std::lock_guard lock(model->mutex);
+      --model->nClients;
+    }
+    model->cv.notify_all(); // the batch may no longer need to wait for this client
+  }
+  connection.done = true;
+}
+
+void TaggingServer::runBatches(Model& model) {
+  const auto window = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double, std::milli>(m_options.batch_window_ms));
+  WeaverPreprocessor::Tensor batch(model.info.inputs.size());
+  std::unique_lock lock(model.mutex);
+  while (true) {
+    model.cv.wait(lock, [&model] { return model.stopping || !model.queue.empty(); });
+    if (model.queue.empty())
+      return; // stopping
+    // wait for the requests of the other clients, unless the batch is full or all of them are queued
+    model.cv.wait_until(lock, model.queue.front()->arrival + window, [&] {
+      return model.stopping || model.queuedJets >= m_options.max_batch_size || model.queue.size() >= model.nClients;
+    });
+    std::vector<Request*> requests;
+    size_t n_jets = 0;
+    while (!model.queue.empty() &&
+           (requests.empty() || n_jets + model.queue.front()->nJets <= m_options.max_batch_size)) {
+      requests.push_back(model.queue.front());
+      n_jets += requests.back()->nJets;
+      model.queuedJets -= requests.back()->nJets;
+      model.queue.pop_front();
+    }
+    lock.unlock();
+
+    for (size_t g = 0; g < batch.size(); ++g) {
+      batch[g].clear();
+      for (const auto* request : requests)
+        batch[g].insert(batch[g].end(), request->inputs[g].begin(), request->inputs[g].end());
+    }
+    const auto start = Clock::now();
+    try {
+      const auto scores = model.weaver->runPadded(batch, n_jets);
+      const size_t n_outputs = model.info.n_outputs;
+      if (scores.size() != n_jets * n_outputs)
+        throw std::logic_error("The model returned " + std::to_string(scores.size()) + " scores for " +
+                               std::to_string(n_jets) + " jets");
+      size_t offset = 0;
+      for (auto* request : requests) {
+        // the request lives on the stack of its connection thread, which returns once the value is set
+        const size_t n = request->nJets;
+        request->scores.set_value(
+            std::vector<float>(scores.begin() + offset * n_outputs, scores.begin() + (offset + n) * n_outputs));
+        offset += n;
+      }
+    } catch (const std::exception& e) {
+      // reported to the clients as a failed inference, which they do not confuse with a lost connection
+      const auto failure = std::make_exception_ptr(std::logic_error(e.what()));
+      for (auto* request : requests)
+        request->scores.set_exception(failure);
+    }
+    model.inferenceNs += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    model.nRequests += requests.size();
+    model.nJets += n_jets;
+    ++model.nBatches;
+    model.maxBatchJets = std::max(model.maxBatchJets, n_jets);
+    lock.lock();
+  }
+}
+
+void TaggingServer::startWorkers() {
+  for (auto& model : m_models) {
+    model->stopping = false;
+    model->worker = std::thread([this, &model = *model] { runBatches(model); });
+  }
+}
+
+void TaggingServer::stopWorkers() {
+  for (auto& model : m_models) {
+    {
+      std::lock_guard lock(model->mutex);
+      model->stopping = true;
+    }
+    model->cv.notify_all();
+    if (model->worker.joinable())
+      model->worker.join();
+  }
+}
+
+std::string TaggingServer::report() const {
+  std::string out;
+  char line[256];
+  std::snprintf(line, sizeof(line), "%zu connections served\n", m_nConnections.load());
+  out += line;
+  for (const auto& model : m_models) {
+    const double mean = model->nBatches > 0 ? static_cast<double>(model->nJets) / model->nBatches : 0.;
+    std::snprintf(line, sizeof(line),
+                  "  %-24s %10zu requests %12zu jets %10zu batches (mean %.1f, max %zu jets), %.1f ms inference\n",
+                  model->name.c_str(), model->nRequests, model->nJets, model->nBatches, mean, model->maxBatchJets,
+                  model->inferenceNs / 1e6);
+    out += line;
+  }
+  return out;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TAGGINGSERVER_H
+#define TAGGINGSERVER_H
+
+#include "ModelBundle.h"
+#include "ONNXRuntime.h"
+#include "TaggingProtocol.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class TaggingServer
+ * @brief Serves one or more models to the TaggingClients (JetTaggers with ServerSocket) of a node over a Unix socket.
+ *
+ * Every model comes from a ModelBundle and is identified by its checksum, so a client is served the model of the
+ * bundle it was configured with. The clients send the preprocessed, padded input tensors of their jets; one thread per
+ * model collects the requests of all clients into batches of up to max_batch_size jets and runs them in one ONNX
+ * Runtime session. A batch waits at most batch_window_ms for more requests, and not at all once every connected client
+ * of the model has a request queued. So the node holds a single copy of every model, and the runs are as large as the
+ * concurrency of the jobs allows.
+ *
+ * Every connection is handled by a thread of its own, which waits for the result of its request before reading the
+ * next one.
+ */
+class TaggingServer {
+public:
+  /**
+   * @struct Options
+   * @brief Batching across the requests of the clients.
+   */
+  struct Options {
+    size_t max_batch_size{64};  ///< Maximum number of jets per ONNX Runtime run (a larger request is run alone).
+    double batch_window_ms{2.}; ///< How long the oldest request waits for others to fill the batch.
+  };
+
+  TaggingServer();
+  explicit TaggingServer(const Options& options);
+  ~TaggingServer();
+
+  TaggingServer(const TaggingServer&) = delete;
+  TaggingServer& operator=(const TaggingServer&) = delete;
+
+  /**
+   * @brief Loads a model to serve. Must be called before serve().
+   *
+   * Throws std::invalid_argument if a bundle with the same checksum is already served, and the exceptions of the
+   * WeaverInterface if the session cannot be created.
+   */
+  void addModel(std::shared_ptr<const ModelBundle> bundle, const ONNXRuntime::MemoryOptions& memory_options = {});
+
+  /**
+   * @brief Listens on the socket and serves the clients until stop is set, then closes all connections.
+   *
+   * A stale socket file (no server answering) is replaced, the socket file is removed at the end. Throws
+   * std::runtime_error if the socket cannot be created or another server listens on it.
+   */
+  void serve(const std::string& socket_path, const std::atomic<bool>& stop);
+
+  /// One line per model with the requests, jets and batches served so far.
+  std::string report() const;
+
+private:
+  struct Model;
+  struct Request;
+  struct Connection;
+
+  void handleConnection(Connection& connection);
+  void runBatches(Model& model);
+  void startWorkers();
+  void stopWorkers();
+
+  Options m_options;
+  std::vector<std::unique_ptr<Model>> m_models;
+  std::list<Connection> m_connections;
+  mutable std::mutex m_connectionsMutex;
+  std::atomic<size_t> m_nConnections{0}; ///< served so far
+};
+
+#endif // TAGGINGSERVER_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "TreeIOSettings.h"
+
+#include "Compression.h"
+#include "TBranch.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace {
+// default levels as used by ROOT::RCompressionSetting::EDefaults for the individual algorithms
+int defaultLevel(ROOT::RCompressionSetting::EAlgorithm::EValues algorithm) {
+  switch (algorithm) {
+  case ROOT::RCompressionSetting::EAlgorithm::kLZMA:
+    return ROOT::RCompressionSetting::ELevel::kDefaultLZMA;
+  case ROOT::RCompressionSetting::EAlgorithm::kLZ4:
+    return ROOT::RCompressionSetting::ELevel::kDefaultLZ4;
+  case ROOT::RCompressionSetting::EAlgorithm::kZSTD:
+    return ROOT::RCompressionSetting::ELevel::kDefaultZSTD;
+  default:
+    return ROOT::RCompressionSetting::ELevel::kDefaultZLIB;
+  }
+}
+} // namespace
+
+std::string TreeIOSettings::toString() const {
+  return "compression=" + (compressionAlgorithm.empty() ? std::string("inherit") : compressionAlgorithm) +
+         " level=" + (compressionLevel < 0 ? std::string("default") : std::to_string(compressionLevel)) +
+         " basketSize=" + (basketSize > 0 ? std::to_string(basketSize) : std::string("default")) +
+         " autoFlush=" + (autoFlush ? std::to_string(autoFlush) : std::string("default"));
+}
+
+int toRootCompressionSettings(const std::string& algorithm, int level) {
+  if (level < -1 || level > 9)
+    throw std::invalid_argument("Compression level must be within [0, 9] (or -1 for the default), got " +
+                                std::to_string(level));
+
+  std::string name = algorithm;
+  std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+
+  ROOT::RCompressionSetting::EAlgorithm::EValues algo;
+  if (name.empty())
+    algo = ROOT::RCompressionSetting::EAlgorithm::kUseGlobal;
+  else if (name == "ZLIB")
+    algo = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+  else if (name == "LZMA")
+    algo = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+  else if (name == "LZ4")
+    algo = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+  else if (name == "ZSTD")
+    algo = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+  else
+    throw std::invalid_argument("Unknown compression algorithm '" + algorithm + "' (use ZLIB, LZMA, LZ4 or ZSTD)");
+
+  return ROOT::CompressionSettings(algo, level < 0 ? defaultLevel(algo) : level);
+}
+
+void applyTreeIOSettings(TTree* tree, const TreeIOSettings& settings) {
+  if (!tree)
+    throw std::invalid_argument("Cannot apply I/O settings to a null tree");
+
+  if (!settings.compressionAlgorithm.empty() || settings.compressionLevel >= 0) {
+    const int compress = toRootCompressionSettings(settings.compressionAlgorithm, settings.compressionLevel);
+    // TBranch::SetCompressionSettings also propagates to the sub-branches
+    for (auto* obj : *tree->GetListOfBranches()) {
+      static_cast<TBranch*>(obj)->SetCompressionSettings(compress);
+    }
+  }
+  if (settings.basketSize > 0)
+    tree->SetBasketSize("*", settings.basketSize);
+  if (settings.autoFlush)
+    tree->SetAutoFlush(settings.autoFlush);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TREEIOSETTINGS_H
+#define TREEIOSETTINGS_H
+
+#include <string>
+
+class TTree;
+
+/**
+ * @struct TreeIOSettings
+ * @brief I/O tuning of the output TTrees of the writers (JetObsWriter, JetTagWriter).
+ *
+ * Every setting has a neutral value that keeps what the output file (i.e. THistSvc) or ROOT would use otherwise, so
+ * that an unconfigured writer behaves exactly as before.
+ */
+struct TreeIOSettings {
+  std::string compressionAlgorithm{""}; ///< "ZLIB", "LZMA", "LZ4", "ZSTD" or "" to inherit the setting of the file.
+  int compressionLevel{-1};             ///< 0 (uncompressed) to 9, or -1 for the default level of the algorithm.
+  int basketSize{0};                    ///< Basket size in bytes of every branch, or 0 for the ROOT default (32 kB).
+  long long autoFlush{0};               ///< >0: flush every N entries, <0: every -N bytes, 0: ROOT default (30 MB).
+
+  /// Whether all settings have their neutral value.
+  bool isDefault() const {
+    return compressionAlgorithm.empty() && compressionLevel < 0 && basketSize <= 0 && autoFlush == 0;
+  }
+  /// Human readable summary, e.g. for the log.
+  std::string toString() const;
+};
+
+/**
+ * Convert a compression algorithm name (case insensitive) and level into the ROOT compression settings integer
+ * (100 * algorithm + level).
+ * @param algorithm: "ZLIB", "LZMA", "LZ4", "ZSTD" or "" for the ROOT default algorithm
+ * @param level: compression level 0-9, or -1 for the default level of the algorithm
+ * @return: the ROOT compression settings
+ * @throws std::invalid_argument for unknown algorithms or levels outside [-1, 9]
+ */
+int toRootCompressionSettings(const std::string& algorithm, int level);
+
+/**
+ * Apply the I/O settings to all branches of a tree. Has to be called after the branches are created and before the
+ * first Fill().
+ * @param tree: the tree to configure
+ * @param settings: the settings to apply
+ * @throws std::invalid_argument for invalid compression settings
+ */
+void applyTreeIOSettings(TTree* tree, const TreeIOSettings& settings);
+
+#endif // TREEIOSETTINGS_H
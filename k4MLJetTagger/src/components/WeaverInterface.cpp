@@ -18,124 +18,153 @@
  */
 #include "WeaverInterface.h"
 
-#include "nlohmann/json.hpp"
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
 
 WeaverInterface::WeaverInterface(const std::string& onnx_filename, const std::string& json_filename,
-                                 const rv::RVec<std::string>& vars)
-    : m_variablesNames(vars.begin(), vars.end()) {
+                                 const rv::RVec<std::string>& vars, const ONNXRuntime::MemoryOptions& memory_options)
+    : WeaverInterface(onnx_filename, WeaverPreprocessor(json_filename, vars), memory_options) {}
+
+WeaverInterface::WeaverInterface(const std::string& onnx_filename, WeaverPreprocessor preprocessor,
+                                 const ONNXRuntime::MemoryOptions& memory_options)
+    : m_preprocessor(std::move(preprocessor)) {
   if (onnx_filename.empty())
     throw std::runtime_error("ONNX model input file not specified!");
-  if (json_filename.empty())
-    throw std::runtime_error("JSON preprocessed input file not specified!");
-
-  // the preprocessing JSON was found ; extract the variables listing and all useful information
-  std::ifstream json_file(json_filename);
-  std::vector<std::string> input_names;
-  try {
-    const auto json = nlohmann::json::parse(json_file);
-    json.at("input_names")
-        .get_to(input_names); // input_names is a vector of strings: pf_points pf_features pf_vectors pf_mask
-
-    for (const auto& input : input_names) {      // loops over pf_points pf_features pf_vectors pf_mask
-      const auto& group_params = json.at(input); // group params is then the dictionary of the input name; look in json.
-                                                 // It always has has three keys: var_names, var_infos, var_length
-      auto& info = m_prepInfoMap[input];
-      info.name = input;
-      group_params.at("var_names").get_to(info.var_names);
-      if (group_params.contains("var_length")) {
-        info.min_length = info.max_length = group_params.at("var_length");
-        m_inputShapes.push_back({1, (int64_t)info.var_names.size(), (int64_t)info.min_length});
-      } else {
-        info.min_length = group_params.at("min_length");
-        info.max_length = group_params.at("max_length");
-        m_inputShapes.push_back({1, (int64_t)info.var_names.size(), -1});
-      }
-      // for all variables, retrieve the allowed range
-      const auto& var_info_params = group_params.at("var_infos");
-      for (const auto& name : info.var_names) {
-        const auto& var_params = var_info_params.at(name);
-        info.var_info_map[name] = PreprocessParams::VarInfo(
-            var_params.at("median"), var_params.at("norm_factor"), var_params.at("replace_inf_value"),
-            var_params.at("lower_bound"), var_params.at("upper_bound"),
-            var_params.contains("pad") ? (double)var_params.at("pad") : 0.);
-      }
-      // create data storage with a fixed size vector initialised with 0's
-      const auto& len = m_inputSizes.emplace_back(info.max_length * info.var_names.size());
-      m_data.emplace_back(len, 0);
-    }
-  } catch (const nlohmann::json::exception& exc) {
-    throw std::runtime_error("Failed to parse input JSON file '" + json_filename + "'.\n" + exc.what());
+
+  m_inputShapes = m_preprocessor.inputShapes();
+  m_onnx = std::make_unique<ONNXRuntime>(onnx_filename, m_preprocessor.inputNames(), memory_options);
+}
+
+WeaverInterface::WeaverInterface(std::shared_ptr<const ModelBundle> bundle,
+                                 const ONNXRuntime::MemoryOptions& memory_options)
+    : m_preprocessor(bundle->preprocessing(),
+                     rv::RVec<std::string>(bundle->variables().begin(), bundle->variables().end())) {
+  if (memory_options.share_model_bytes && !bundle->modelIsOrtFormat())
+    throw std::invalid_argument("The model in " + bundle->path() +
+                                " is not in ORT format, which is needed to share its weights. Convert it with "
+                                "python -m onnxruntime.tools.convert_onnx_models_to_ort and create the bundle again");
+  m_inputShapes = m_preprocessor.inputShapes();
+  const auto model = bundle->model();
+  m_onnx = std::make_unique<ONNXRuntime>(model, std::move(bundle), m_preprocessor.inputNames(), memory_options);
+}
+
+rv::RVec<float> WeaverInterface::run(
+    const rv::RVec<ConstituentVars>& constituents) { // constituents is the collection of all jet constituents. Each
+                                                     // constituent is a collection of observables (ConstituentVars).
+  preprocess(constituents);
+  return infer();
+}
+
+void WeaverInterface::preprocess(const rv::RVec<ConstituentVars>& constituents) {
+  m_preprocessor.preprocess(constituents, m_data);
+}
+
+size_t WeaverInterface::inputTensorBytes() const {
+  size_t bytes = 0;
+  for (const auto* tensor : {&m_data, &m_batchData}) {
+    bytes += tensor->capacity() * sizeof((*tensor)[0]);
+    for (const auto& input : *tensor)
+      bytes += input.capacity() * sizeof(float);
   }
+  return bytes;
+}
 
-  m_onnx = std::make_unique<ONNXRuntime>(onnx_filename, input_names);
+size_t WeaverInterface::inputBytesPerJet() const {
+  size_t bytes = 0;
+  for (const auto size : m_preprocessor.inputSizes())
+    bytes += size * sizeof(float);
+  return bytes;
 }
 
-std::vector<float> WeaverInterface::center_norm_pad(const rv::RVec<float>& input, float center, float scale,
-                                                    size_t min_length, size_t max_length, float pad_value,
-                                                    float replace_inf_value, float min, float max) {
-  if (min > pad_value || pad_value > max)
-    throw std::runtime_error("Pad value not within (min, max) range");
-  if (min_length > max_length)
-    throw std::runtime_error("Variable length mismatch (min_length >= max_length)");
-
-  auto ensure_finitude = [](const float in, const float replace_val) {
-    if (!std::isfinite(in))
-      return replace_val;
-    return in;
+size_t WeaverInterface::setMaxBatchSize(size_t max_batch_size) {
+  m_maxBatchSize = std::max<size_t>(1, max_batch_size);
+  const size_t budget = m_onnx->memoryOptions().budget_bytes;
+  if (budget > 0)
+    m_maxBatchSize = std::clamp<size_t>(budget / 4 / std::max<size_t>(1, inputBytesPerJet()), 1, m_maxBatchSize);
+  return m_maxBatchSize;
+}
+
+std::vector<rv::RVec<float>> WeaverInterface::runBatch(const std::vector<rv::RVec<ConstituentVars>>& jets,
+                                                       BatchTiming* timing) {
+  using Clock = std::chrono::steady_clock;
+  const auto elapsed_ns = [](Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
   };
+  const auto& input_names = m_preprocessor.inputNames();
+  std::vector<rv::RVec<float>> results;
+  results.reserve(jets.size());
+  size_t begin = 0;
+  while (begin < jets.size()) {
+    const size_t n = std::min(m_maxBatchSize, jets.size() - begin);
+
+    // [n, n_vars, max_length] per input group
+    const auto start_preprocess = Clock::now();
+    m_batchData.resize(input_names.size());
+    for (auto& input : m_batchData)
+      input.clear();
+    for (size_t i = begin; i < begin + n; ++i) {
+      m_preprocessor.preprocess(jets[i], m_data, true);
+      for (size_t g = 0; g < m_data.size(); ++g)
+        m_batchData[g].insert(m_batchData[g].end(), m_data[g].begin(), m_data[g].end());
+    }
+    if (timing)
+      timing->preprocess_ns += elapsed_ns(start_preprocess);
+
+    const auto start_inference = Clock::now();
+    std::vector<float> outputs;
+    try {
+      outputs = runPadded(m_batchData, n);
+    } catch (const std::exception& exception) {
+      if (timing)
+        timing->inference_ns += elapsed_ns(start_inference);
+      if (n == 1 || !ONNXRuntime::isAllocationFailure(exception))
+        throw;
+      m_maxBatchSize = n / 2; // degrade instead of failing, the jets of this batch are run again
+      ++m_nBatchReductions;
+      continue;
+    }
+    if (timing)
+      timing->inference_ns += elapsed_ns(start_inference);
 
-  size_t target_length = std::clamp(input.size(), min_length, max_length);
-  std::vector<float> out(target_length, pad_value);
-  for (size_t i = 0; i < input.size() && i < target_length; ++i)
-    out[i] = std::clamp((ensure_finitude(input[i], replace_inf_value) - center) * scale, min, max);
-  return out;
+    const size_t n_outputs = outputs.size() / n;
+    for (size_t i = 0; i < n; ++i)
+      results.emplace_back(outputs.begin() + i * n_outputs, outputs.begin() + (i + 1) * n_outputs);
+    begin += n;
+  }
+  return results;
 }
 
-size_t WeaverInterface::variablePos(const std::string& var_name) const {
-  auto var_it = std::find(m_variablesNames.begin(), m_variablesNames.end(), var_name);
-  if (var_it == m_variablesNames.end())
-    throw std::runtime_error("Unable to find variable with name '" + var_name +
-                             "' in the list of registered variables");
-  return var_it - m_variablesNames.begin();
+std::vector<float> WeaverInterface::runPadded(ONNXRuntime::Tensor<float>& inputs, size_t n_jets) const {
+  return std::move(m_onnx->run<float>(inputs, paddedInputShapes(n_jets), n_jets)[0]);
 }
 
-rv::RVec<float> WeaverInterface::run(
-    const rv::RVec<ConstituentVars>& constituents) { // constituents is the collection of all jet constituents. Each
-                                                     // constituent is a collection of observables (ConstituentVars).
-  size_t i = 0;
-  for (const auto& name : m_onnx->inputNames()) {
-    const auto& params = m_prepInfoMap.at(name);
-    auto& values = m_data[i];
-    values.resize(m_inputSizes.at(i));
-    std::fill(values.begin(), values.end(), 0);
-    size_t it_pos = 0;
-    ConstituentVars jc;
-    for (size_t j = 0; j < params.var_names.size(); ++j) { // transform and add the proper amount of padding
-      const auto& var_name = params.var_names.at(j);
-      // if (std::find(m_variablesNames.begin(), m_variablesNames.end(), "pfcand_mask") == m_variablesNames.end())
-      //   jc = ConstituentVars(constituents.at(0).size(), 1.f);
-
-      if (var_name.find("_mask") != std::string::npos) {
-        jc = ConstituentVars(constituents.at(0).size(), 1.f);
-      }
-
-      else
-        jc = constituents.at(variablePos(var_name));
-      const auto& var_info = params.info(var_name);
-      auto val = center_norm_pad(jc, var_info.center, var_info.norm_factor, params.min_length, params.max_length,
-                                 var_info.pad, var_info.replace_inf_value, var_info.lower_bound, var_info.upper_bound);
-      std::copy(val.begin(), val.end(), values.begin() + it_pos);
-      it_pos += val.size();
-    }
-    values.resize(it_pos);
-    ++i;
+ONNXRuntime::Tensor<long> WeaverInterface::paddedInputShapes(size_t n_jets) const {
+  ONNXRuntime::Tensor<long> shapes;
+  for (const auto& name : m_preprocessor.inputNames()) {
+    const auto& params = m_preprocessor.params(name);
+    shapes.push_back({static_cast<long>(n_jets), static_cast<long>(params.var_names.size()),
+                      static_cast<long>(params.max_length)});
   }
-  return m_onnx->run<float>(m_data, m_inputShapes)[0]; // this runs the interference on the preprocessed data
+  return shapes;
 }
 
-void WeaverInterface::PreprocessParams::dumpVars() const {
-  std::cout << "List of variables for preprocessing parameter '" << name
-            << "': " << rv::RVec<std::string>(var_names.begin(), var_names.end()) << "." << std::endl;
+std::vector<float> WeaverInterface::runContiguous(const float* values, const std::int64_t* lengths, size_t n_jets,
+                                                  size_t max_constituents, size_t max_batch_size) const {
+  const size_t jet_size = m_preprocessor.variables().size() * max_constituents;
+  const size_t batch_size = std::max<size_t>(1, max_batch_size);
+  std::vector<float> scores;
+  ONNXRuntime::Tensor<float> batch;
+  for (size_t begin = 0; begin < n_jets; begin += batch_size) {
+    const size_t n = std::min(batch_size, n_jets - begin);
+    m_preprocessor.preprocessBatch(values + begin * jet_size, lengths + begin, n, max_constituents, batch);
+    const auto outputs = runPadded(batch, n);
+    scores.insert(scores.end(), outputs.begin(), outputs.end());
+  }
+  return scores;
+}
+
+rv::RVec<float> WeaverInterface::infer() {
+  return m_onnx->run<float>(m_data, m_inputShapes)[0]; // this runs the interference on the preprocessed data
 }
@@ -22,8 +22,14 @@
 // From: https://github.com/HEP-FCC/FCCAnalyses/tree/b9b84221837da8868158f5592b48a9af69f0f6e3/addons/ONNXRuntime
 // AI generated documentation
 
+#include "ModelBundle.h"
 #include "ONNXRuntime.h"
 #include "ROOT/RVec.hxx"
+#include "WeaverPreprocessor.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace rv = ROOT::VecOps;
 
@@ -38,7 +44,16 @@ namespace rv = ROOT::VecOps;
  */
 class WeaverInterface {
 public:
-  using ConstituentVars = rv::RVec<float>; ///< Alias for a vector of float variables.
+  using ConstituentVars = WeaverPreprocessor::ConstituentVars; ///< Alias for a vector of float variables.
+
+  /**
+   * @struct BatchTiming
+   * @brief Time spent in runBatch(), summed over all batches.
+   */
+  struct BatchTiming {
+    std::uint64_t preprocess_ns{0}; ///< Preprocessing and copying into the batch tensor.
+    std::uint64_t inference_ns{0};  ///< ONNX Runtime runs, including failed ones.
+  };
 
   /**
    * @brief Constructor to initialize the WeaverInterface.
@@ -46,9 +61,32 @@ public:
    * @param onnx_filename Path to the ONNX model file.
    * @param json_filename Path to the JSON file containing preprocessing parameters.
    * @param vars List of variable names to describe jet constituent observables (e.g. pfcand_isEl).
+   * @param memory_options Memory settings of the ONNX Runtime session; the budget also limits the batch size.
    */
   explicit WeaverInterface(const std::string& onnx_filename = "", const std::string& json_filename = "",
-                           const rv::RVec<std::string>& vars = {});
+                           const rv::RVec<std::string>& vars = {},
+                           const ONNXRuntime::MemoryOptions& memory_options = {});
+
+  /**
+   * @brief Constructor from a preprocessor built by the caller, e.g. from a JSON configuration it already parsed.
+   *
+   * @param onnx_filename Path to the ONNX model file.
+   * @param preprocessor Preprocessing of the inputs, defines the input names of the model.
+   * @param memory_options Memory settings of the ONNX Runtime session; the budget also limits the batch size.
+   */
+  WeaverInterface(const std::string& onnx_filename, WeaverPreprocessor preprocessor,
+                  const ONNXRuntime::MemoryOptions& memory_options = {});
+
+  /**
+   * @brief Constructor from a model bundle: the preprocessing and the variable order come from the bundle and the
+   * session is created from the model bytes in the mapped file.
+   *
+   * @param bundle The loaded bundle, kept alive by the WeaverInterface.
+   * @param memory_options Memory settings of the ONNX Runtime session; the budget also limits the batch size.
+   * Throws std::invalid_argument if share_model_bytes is set and the model is not in ORT format.
+   */
+  explicit WeaverInterface(std::shared_ptr<const ModelBundle> bundle,
+                           const ONNXRuntime::MemoryOptions& memory_options = {});
 
   /**
    * @brief Runs inference on the input variables for a list of jet constituents.
@@ -58,99 +96,126 @@ public:
    */
   rv::RVec<float> run(const rv::RVec<ConstituentVars>& constituent_vars);
 
-private:
   /**
-   * @struct PreprocessParams
-   * @brief Struct to hold preprocessing parameters for input variables.
-   *
-   * This struct defines preprocessing steps like normalization, padding,
-   * and bounds checking for input variables.
-   */
-  struct PreprocessParams {
-    /**
-     * @struct VarInfo
-     * @brief Holds preprocessing parameters for a single variable.
-     */
-    struct VarInfo {
-      /**
-       * @brief Default constructor.
-       */
-      VarInfo() {}
-
-      /**
-       * @brief Constructor with parameter initialization.
-       *
-       * @param imedian The median or center value for normalization.
-       * @param inorm_factor The scaling factor for normalization.
-       * @param ireplace_inf_value The value to replace infinity with.
-       * @param ilower_bound The lower bound for variable values.
-       * @param iupper_bound The upper bound for variable values.
-       * @param ipad The value to use for padding.
-       */
-      VarInfo(float imedian, float inorm_factor, float ireplace_inf_value, float ilower_bound, float iupper_bound,
-              float ipad)
-          : center(imedian), norm_factor(inorm_factor), replace_inf_value(ireplace_inf_value),
-            lower_bound(ilower_bound), upper_bound(iupper_bound), pad(ipad) {}
-
-      float center{0.};            ///< Center value for normalization.
-      float norm_factor{1.};       ///< Scaling factor for normalization.
-      float replace_inf_value{0.}; ///< Value to replace infinity with.
-      float lower_bound{-5.};      ///< Lower bound for variable values.
-      float upper_bound{5.};       ///< Upper bound for variable values.
-      float pad{0.};               ///< Value to use for padding.
-    };
-
-    std::string name;                                      ///< Name of the preprocessing configuration.
-    size_t min_length{0}, max_length{0};                   ///< Minimum and maximum lengths for input vectors.
-    std::vector<std::string> var_names;                    ///< List of variable names for preprocessing.
-    std::unordered_map<std::string, VarInfo> var_info_map; ///< Map of variable names to VarInfo.
-
-    /**
-     * @brief Retrieve preprocessing information for a variable.
-     *
-     * @param name The name of the variable.
-     * @return The VarInfo object for the specified variable.
-     */
-    VarInfo info(const std::string& name_info) const { return var_info_map.at(name_info); }
-
-    /**
-     * @brief Dumps variable names and preprocessing details to the console.
-     */
-    void dumpVars() const;
-  };
+   * @brief First half of run(): standardizes and pads the variables of a jet into the input tensor.
+   *
+   * @param constituent_vars A vector of per-constituent variables of a jet.
+   */
+  void preprocess(const rv::RVec<ConstituentVars>& constituent_vars);
+
+  /**
+   * @brief Second half of run(): runs the model on the input tensor filled by the last preprocess().
+   *
+   * @return A vector of probabilities for different jet flavors.
+   */
+  rv::RVec<float> infer();
+
+  /**
+   * @brief Runs inference on several jets at once, in batches of at most maxBatchSize() jets.
+   *
+   * Every jet is padded to the maximum length of each input group, so that the memory of a batch does not depend on
+   * the jets. If a run fails because ONNX Runtime cannot allocate memory (e.g. the arena reached the memory budget),
+   * the batch size is halved for this and all later calls and the batch is run again. Only a failure with a single
+   * jet is rethrown.
+   *
+   * @param jets Per-constituent variables of every jet.
+   * @param timing If given, the time spent is added to it.
+   * @return The probabilities of the flavors for every jet, in the order of the jets.
+   */
+  std::vector<rv::RVec<float>> runBatch(const std::vector<rv::RVec<ConstituentVars>>& jets,
+                                        BatchTiming* timing = nullptr);
+
+  /**
+   * @brief Runs the model on inputs that are already preprocessed and padded to the maximum lengths, e.g. as received
+   * by the TaggingServer.
+   *
+   * Uses no buffer of the WeaverInterface, so it can be called from several threads at once with inputs of their own
+   * (e.g. by the RDFJetTagger).
+   *
+   * @param inputs One tensor [n_jets, n_vars, max_length] per input group, in the order of the preprocessor.
+   * @param n_jets Number of jets in the tensors.
+   * @return The flavor probabilities of the jets, [n_jets, n_flavors].
+   */
+  std::vector<float> runPadded(ONNXRuntime::Tensor<float>& inputs, size_t n_jets) const;
+
+  /**
+   * @brief Shapes of the input tensors of runPadded(), e.g. for the warm-up run of ONNXRuntime::startProfiling().
+   *
+   * @param n_jets Number of jets in the tensors.
+   * @return One shape [n_jets, n_vars, max_length] per input group, in the order of the preprocessor.
+   */
+  ONNXRuntime::Tensor<long> paddedInputShapes(size_t n_jets) const;
 
   /**
-   * @brief Preprocesses input variables by normalizing, padding, and bounding.
+   * @brief Preprocesses and runs jets given as one contiguous array, in batches of at most max_batch_size jets.
+   *
+   * For callers holding the inputs of many jets in one array, e.g. the Python bindings. The preprocessing is
+   * WeaverPreprocessor::preprocessBatch(). Like runPadded(), it uses no buffer of the WeaverInterface.
    *
-   * @param input Input vector of variables.
-   * @param center Center value for normalization.
-   * @param scale Scaling factor for normalization.
-   * @param min_length Minimum length of the output vector (padded if necessary).
-   * @param max_length Maximum length of the output vector (truncated if necessary).
-   * @param pad_value Value to use for padding.
-   * @param replace_inf_value Value to replace infinity in the input.
-   * @param min Minimum allowable value.
-   * @param max Maximum allowable value.
-   * @return A preprocessed vector of variables.
+   * @param values Variables of the jets, [n_jets, variables of the preprocessor, max_constituents] in row-major order.
+   * @param lengths Number of constituents of every jet.
+   * @param n_jets Number of jets.
+   * @param max_constituents Size of the last dimension of values.
+   * @param max_batch_size Maximum number of jets per ONNX Runtime run.
+   * @return The flavor probabilities of the jets, [n_jets, n_flavors].
    */
-  std::vector<float> center_norm_pad(const rv::RVec<float>& input, float center, float scale, size_t min_length,
-                                     size_t max_length, float pad_value = 0, float replace_inf_value = 0, float min = 0,
-                                     float max = -1);
+  std::vector<float> runContiguous(const float* values, const std::int64_t* lengths, size_t n_jets,
+                                   size_t max_constituents, size_t max_batch_size) const;
 
   /**
-   * @brief Finds the position of a variable in the list of input variable names.
+   * @brief Sets the maximum number of jets per run of runBatch().
    *
-   * @param var_name Name of the variable.
-   * @return The position of the variable in the input list.
+   * With a memory budget, the input tensors of a batch (which live outside the ONNX Runtime arena) are limited to a
+   * quarter of the budget, which can lower the batch size further.
+   *
+   * @return The batch size actually used.
+   */
+  size_t setMaxBatchSize(size_t max_batch_size);
+
+  /**
+   * @brief Current maximum number of jets per run of runBatch(), after any reduction.
    */
-  size_t variablePos(const std::string& var_name) const;
+  size_t maxBatchSize() const { return m_maxBatchSize; }
 
-  std::unique_ptr<ONNXRuntime> m_onnx;                             ///< Pointer to the ONNX runtime object.
-  std::vector<std::string> m_variablesNames;                       ///< List of input variable names.
-  ONNXRuntime::Tensor<long> m_inputShapes;                         ///< Tensor describing input shapes.
-  std::vector<unsigned int> m_inputSizes;                          ///< List of input sizes for each dimension.
-  std::unordered_map<std::string, PreprocessParams> m_prepInfoMap; ///< Map of preprocessing parameters.
-  ONNXRuntime::Tensor<float> m_data;                               ///< Tensor for input data.
+  /**
+   * @brief Number of times runBatch() halved the batch size after a failed allocation.
+   */
+  size_t nBatchReductions() const { return m_nBatchReductions; }
+
+  /**
+   * @brief Size of the input tensors of one jet padded to the maximum lengths, in bytes.
+   */
+  size_t inputBytesPerJet() const;
+
+  /**
+   * @brief Access to the preprocessing applied to the inputs before inference.
+   *
+   * @return The preprocessor built from the JSON configuration file.
+   */
+  const WeaverPreprocessor& preprocessor() const { return m_preprocessor; }
+
+  /**
+   * @brief Access to the ONNX Runtime session wrapper, e.g. to start and stop its profiling.
+   *
+   * @return The ONNXRuntime object running the model.
+   */
+  ONNXRuntime& onnxRuntime() { return *m_onnx; }
+
+  /**
+   * @brief Heap memory held by the input tensors filled by preprocess() and runBatch().
+   *
+   * @return The capacity of the input tensors in bytes.
+   */
+  size_t inputTensorBytes() const;
+
+private:
+  std::unique_ptr<ONNXRuntime> m_onnx;     ///< Pointer to the ONNX runtime object.
+  WeaverPreprocessor m_preprocessor;       ///< Standardization and padding of the input variables.
+  ONNXRuntime::Tensor<long> m_inputShapes; ///< Tensor describing input shapes.
+  ONNXRuntime::Tensor<float> m_data;       ///< Tensor for input data.
+  ONNXRuntime::Tensor<float> m_batchData;  ///< Tensor for the input data of a batch.
+  size_t m_maxBatchSize{1};                ///< Maximum number of jets per run of runBatch().
+  size_t m_nBatchReductions{0};            ///< Times the batch size was halved after a failed allocation.
 };
 
 #endif
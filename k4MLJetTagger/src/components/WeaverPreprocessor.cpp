@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "WeaverPreprocessor.h"
+
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+WeaverPreprocessor::WeaverPreprocessor(const std::string& json_filename, const rv::RVec<std::string>& vars)
+    : m_variablesNames(vars.begin(), vars.end()) {
+  if (json_filename.empty())
+    throw std::runtime_error("JSON preprocessed input file not specified!");
+
+  // the preprocessing JSON was found ; extract the variables listing and all useful information
+  std::ifstream json_file(json_filename);
+  try {
+    configure(nlohmann::json::parse(json_file));
+  } catch (const nlohmann::json::exception& exc) {
+    throw std::runtime_error("Failed to parse input JSON file '" + json_filename + "'.\n" + exc.what());
+  }
+}
+
+WeaverPreprocessor::WeaverPreprocessor(const nlohmann::json& json_config, const rv::RVec<std::string>& vars)
+    : m_variablesNames(vars.begin(), vars.end()) {
+  try {
+    configure(json_config);
+  } catch (const nlohmann::json::exception& exc) {
+    throw std::runtime_error(std::string("Invalid preprocessing JSON configuration.\n") + exc.what());
+  }
+}
+
+WeaverPreprocessor::WeaverPreprocessor(const std::vector<PreprocessParams>& groups, const rv::RVec<std::string>& vars)
+    : m_variablesNames(vars.begin(), vars.end()) {
+  for (const auto& params : groups)
+    addGroup(params);
+}
+
+void WeaverPreprocessor::configure(const nlohmann::json& json) {
+  std::vector<std::string> input_names;
+  json.at("input_names")
+      .get_to(input_names); // input_names is a vector of strings: pf_points pf_features pf_vectors pf_mask
+
+  for (const auto& input : input_names) {        // loops over pf_points pf_features pf_vectors pf_mask
+    const auto& group_params = json.at(input); // group params is then the dictionary of the input name; look in json.
+                                               // It always has has three keys: var_names, var_infos, var_length
+    PreprocessParams info;
+    info.name = input;
+    group_params.at("var_names").get_to(info.var_names);
+    if (group_params.contains("var_length")) {
+      info.min_length = info.max_length = group_params.at("var_length");
+      info.fixed_length = true;
+    } else {
+      info.min_length = group_params.at("min_length");
+      info.max_length = group_params.at("max_length");
+    }
+    // for all variables, retrieve the allowed range
+    const auto& var_info_params = group_params.at("var_infos");
+    for (const auto& name : info.var_names) {
+      const auto& var_params = var_info_params.at(name);
+      info.var_info_map[name] = PreprocessParams::VarInfo(
+          var_params.at("median"), var_params.at("norm_factor"), var_params.at("replace_inf_value"),
+          var_params.at("lower_bound"), var_params.at("upper_bound"),
+          var_params.contains("pad") ? (double)var_params.at("pad") : 0.);
+    }
+    addGroup(info);
+  }
+}
+
+void WeaverPreprocessor::addGroup(const PreprocessParams& params) {
+  m_inputNames.push_back(params.name);
+  m_inputShapes.push_back(
+      {1, (int64_t)params.var_names.size(), params.fixed_length ? (int64_t)params.min_length : (int64_t)-1});
+  m_inputSizes.emplace_back(params.max_length * params.var_names.size());
+  m_prepInfoMap[params.name] = params;
+}
+
+std::vector<size_t> WeaverPreprocessor::preprocess(const rv::RVec<ConstituentVars>& constituents, Tensor& data,
+                                                   bool pad_to_max) const {
+  data.resize(m_inputNames.size());
+  std::vector<size_t> lengths;
+  lengths.reserve(m_inputNames.size());
+  size_t i = 0;
+  for (const auto& name : m_inputNames) {
+    const auto& params = m_prepInfoMap.at(name);
+    const size_t min_length = pad_to_max ? params.max_length : params.min_length;
+    auto& values = data[i];
+    values.resize(m_inputSizes.at(i));
+    std::fill(values.begin(), values.end(), 0);
+    size_t it_pos = 0;
+    ConstituentVars jc;
+    for (size_t j = 0; j < params.var_names.size(); ++j) { // transform and add the proper amount of padding
+      const auto& var_name = params.var_names.at(j);
+      if (var_name.find("_mask") != std::string::npos)
+        jc = ConstituentVars(constituents.at(0).size(), 1.f);
+      else
+        jc = constituents.at(variablePos(var_name));
+      const auto& var_info = params.info(var_name);
+      auto val = center_norm_pad(jc, var_info.center, var_info.norm_factor, min_length, params.max_length,
+                                 var_info.pad, var_info.replace_inf_value, var_info.lower_bound, var_info.upper_bound);
+      std::copy(val.begin(), val.end(), values.begin() + it_pos);
+      it_pos += val.size();
+    }
+    values.resize(it_pos);
+    lengths.push_back(params.var_names.empty() ? 0 : it_pos / params.var_names.size());
+    ++i;
+  }
+  return lengths;
+}
+
+void WeaverPreprocessor::preprocessBatch(const float* values, const std::int64_t* lengths, size_t n_jets,
+                                         size_t max_constituents, Tensor& batch) const {
+  const size_t n_vars = m_variablesNames.size();
+  batch.resize(m_inputNames.size());
+  for (size_t g = 0; g < batch.size(); ++g) {
+    batch[g].clear();
+    batch[g].reserve(n_jets * m_inputSizes[g]);
+  }
+  rv::RVec<ConstituentVars> jet;
+  Tensor data;
+  for (size_t i = 0; i < n_jets; ++i) {
+    if (lengths[i] < 0 || static_cast<size_t>(lengths[i]) > max_constituents)
+      throw std::invalid_argument("Jet " + std::to_string(i) + " has " + std::to_string(lengths[i]) +
+                                  " constituents, the array holds at most " + std::to_string(max_constituents));
+    jet.clear();
+    for (size_t v = 0; v < n_vars; ++v) {
+      // an RVec adopting the memory of the array, which is only read
+      jet.emplace_back(const_cast<float*>(values + (i * n_vars + v) * max_constituents), lengths[i]);
+    }
+    preprocess(jet, data, true);
+    for (size_t g = 0; g < data.size(); ++g)
+      batch[g].insert(batch[g].end(), data[g].begin(), data[g].end());
+  }
+}
+
+std::vector<float> WeaverPreprocessor::center_norm_pad(const rv::RVec<float>& input, float center, float scale,
+                                                       size_t min_length, size_t max_length, float pad_value,
+                                                       float replace_inf_value, float min, float max) {
+  if (min > pad_value || pad_value > max)
+    throw std::runtime_error("Pad value not within (min, max) range");
+  if (min_length > max_length)
+    throw std::runtime_error("Variable length mismatch (min_length >= max_length)");
+
+  auto ensure_finitude = [](const float in, const float replace_val) {
+    if (!std::isfinite(in))
+      return replace_val;
+    return in;
+  };
+
+  size_t target_length = std::clamp(input.size(), min_length, max_length);
+  std::vector<float> out(target_length, pad_value);
+  for (size_t i = 0; i < input.size() && i < target_length; ++i)
+    out[i] = std::clamp((ensure_finitude(input[i], replace_inf_value) - center) * scale, min, max);
+  return out;
+}
+
+size_t WeaverPreprocessor::variablePos(const std::string& var_name) const {
+  auto var_it = std::find(m_variablesNames.begin(), m_variablesNames.end(), var_name);
+  if (var_it == m_variablesNames.end())
+    throw std::runtime_error("Unable to find variable with name '" + var_name +
+                             "' in the list of registered variables");
+  return var_it - m_variablesNames.begin();
+}
+
+void WeaverPreprocessor::PreprocessParams::dumpVars() const {
+  std::cout << "List of variables for preprocessing parameter '" << name
+            << "': " << rv::RVec<std::string>(var_names.begin(), var_names.end()) << "." << std::endl;
+}
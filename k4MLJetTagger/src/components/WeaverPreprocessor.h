@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ONNXRuntime_WeaverPreprocessor_h
+#define ONNXRuntime_WeaverPreprocessor_h
+
+// Preprocessing part of the WeaverInterface from:
+// https://github.com/HEP-FCC/FCCAnalyses/tree/b9b84221837da8868158f5592b48a9af69f0f6e3/addons/ONNXRuntime
+
+#include "ROOT/RVec.hxx"
+#include <nlohmann/json_fwd.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rv = ROOT::VecOps;
+
+/**
+ * @class WeaverPreprocessor
+ * @brief Standardization and padding of jet constituent variables as done by Weaver during training.
+ *
+ * The preprocessing parameters (center, scale, bounds, padding and lengths of every input group) are read from the
+ * preprocessing JSON file that Weaver writes next to the exported ONNX model. The same object is used for inference
+ * (WeaverInterface) and for exporting training tensors (JetTensorWriter), which guarantees that both see identical
+ * inputs.
+ */
+class WeaverPreprocessor {
+public:
+  using ConstituentVars = rv::RVec<float>;        ///< Alias for a vector of float variables.
+  using Tensor = std::vector<std::vector<float>>; ///< One flat buffer per input group.
+  using Shapes = std::vector<std::vector<long>>;  ///< One shape per input group.
+
+  /**
+   * @struct PreprocessParams
+   * @brief Struct to hold preprocessing parameters for input variables.
+   *
+   * This struct defines preprocessing steps like normalization, padding,
+   * and bounds checking for input variables.
+   */
+  struct PreprocessParams {
+    /**
+     * @struct VarInfo
+     * @brief Holds preprocessing parameters for a single variable.
+     */
+    struct VarInfo {
+      /**
+       * @brief Default constructor.
+       */
+      VarInfo() {}
+
+      /**
+       * @brief Constructor with parameter initialization.
+       *
+       * @param imedian The median or center value for normalization.
+       * @param inorm_factor The scaling factor for normalization.
+       * @param ireplace_inf_value The value to replace infinity with.
+       * @param ilower_bound The lower bound for variable values.
+       * @param iupper_bound The upper bound for variable values.
+       * @param ipad The value to use for padding.
+       */
+      VarInfo(float imedian, float inorm_factor, float ireplace_inf_value, float ilower_bound, float iupper_bound,
+              float ipad)
+          : center(imedian), norm_factor(inorm_factor), replace_inf_value(ireplace_inf_value),
+            lower_bound(ilower_bound), upper_bound(iupper_bound), pad(ipad) {}
+
+      float center{0.};            ///< Center value for normalization.
+      float norm_factor{1.};       ///< Scaling factor for normalization.
+      float replace_inf_value{0.}; ///< Value to replace infinity with.
+      float lower_bound{-5.};      ///< Lower bound for variable values.
+      float upper_bound{5.};       ///< Upper bound for variable values.
+      float pad{0.};               ///< Value to use for padding.
+    };
+
+    std::string name;                                      ///< Name of the preprocessing configuration.
+    size_t min_length{0}, max_length{0};                   ///< Minimum and maximum lengths for input vectors.
+    bool fixed_length{false};                              ///< Length given as var_length, fixed in the input shape.
+    std::vector<std::string> var_names;                    ///< List of variable names for preprocessing.
+    std::unordered_map<std::string, VarInfo> var_info_map; ///< Map of variable names to VarInfo.
+
+    /**
+     * @brief Retrieve preprocessing information for a variable.
+     *
+     * @param name The name of the variable.
+     * @return The VarInfo object for the specified variable.
+     */
+    VarInfo info(const std::string& name_info) const { return var_info_map.at(name_info); }
+
+    /**
+     * @brief Dumps variable names and preprocessing details to the console.
+     */
+    void dumpVars() const;
+  };
+
+  /**
+   * @brief Constructor reading the preprocessing parameters from the Weaver JSON file.
+   *
+   * @param json_filename Path to the JSON file containing preprocessing parameters.
+   * @param vars List of variable names to describe jet constituent observables (e.g. pfcand_isEl), in the order in
+   * which they are handed to preprocess().
+   */
+  explicit WeaverPreprocessor(const std::string& json_filename = "", const rv::RVec<std::string>& vars = {});
+
+  /**
+   * @brief Constructor from the already parsed Weaver JSON, e.g. when the caller also reads the output names from it.
+   *
+   * @param json_config Content of the preprocessing JSON file.
+   * @param vars List of variable names to describe jet constituent observables, as for the other constructor.
+   */
+  WeaverPreprocessor(const nlohmann::json& json_config, const rv::RVec<std::string>& vars);
+
+  /**
+   * @brief Constructor from preprocessing parameters that were already read, e.g. from a ModelBundle.
+   *
+   * @param groups Parameters of every input group, in the order expected by the model.
+   * @param vars List of variable names to describe jet constituent observables, as for the other constructors.
+   */
+  WeaverPreprocessor(const std::vector<PreprocessParams>& groups, const rv::RVec<std::string>& vars);
+
+  /**
+   * @brief Standardizes and pads the variables of one jet into one flat buffer per input group.
+   *
+   * @param constituents Per-variable vectors of the jet constituents ({var -> {constit1, constit2, ...}}).
+   * @param data Output buffers, one per input group, resized as needed.
+   * @param pad_to_max If true, every group is padded to its max_length (fixed shape, e.g. for training tensors).
+   * Otherwise the length is clamp(n_constituents, min_length, max_length), as done for inference.
+   * @return The length (last dimension) used for each input group.
+   */
+  std::vector<size_t> preprocess(const rv::RVec<ConstituentVars>& constituents, Tensor& data,
+                                 bool pad_to_max = false) const;
+
+  /**
+   * @brief Standardizes and pads several jets given as one contiguous array (e.g. a NumPy array) into a batch.
+   *
+   * Runs preprocess() with pad_to_max on every jet, reading the variables in place instead of copying them.
+   *
+   * @param values Variables of the jets, [n_jets, variables(), max_constituents] in row-major order.
+   * @param lengths Number of constituents of every jet, the values beyond it are ignored.
+   * @param n_jets Number of jets.
+   * @param max_constituents Size of the last dimension of values.
+   * @param batch Output buffers, one [n_jets, n_vars, max_length] tensor per input group, resized as needed.
+   * Throws std::invalid_argument if a length is negative or larger than max_constituents.
+   */
+  void preprocessBatch(const float* values, const std::int64_t* lengths, size_t n_jets, size_t max_constituents,
+                       Tensor& batch) const;
+
+  /**
+   * @brief Preprocesses input variables by normalizing, padding, and bounding.
+   *
+   * @param input Input vector of variables.
+   * @param center Center value for normalization.
+   * @param scale Scaling factor for normalization.
+   * @param min_length Minimum length of the output vector (padded if necessary).
+   * @param max_length Maximum length of the output vector (truncated if necessary).
+   * @param pad_value Value to use for padding.
+   * @param replace_inf_value Value to replace infinity in the input.
+   * @param min Minimum allowable value.
+   * @param max Maximum allowable value.
+   * @return A preprocessed vector of variables.
+   */
+  static std::vector<float> center_norm_pad(const rv::RVec<float>& input, float center, float scale,
+                                            size_t min_length, size_t max_length, float pad_value = 0,
+                                            float replace_inf_value = 0, float min = 0, float max = -1);
+
+  /// Constituent variables in the order in which they are handed to preprocess().
+  const std::vector<std::string>& variables() const { return m_variablesNames; }
+  /// Names of the input groups in the order expected by the model (e.g. pf_points, pf_features, ...).
+  const std::vector<std::string>& inputNames() const { return m_inputNames; }
+  /// Preprocessing parameters of one input group.
+  const PreprocessParams& params(const std::string& input_name) const { return m_prepInfoMap.at(input_name); }
+  /// Input shapes for a batch of one jet; the last dimension is -1 if the group has a variable length.
+  const Shapes& inputShapes() const { return m_inputShapes; }
+  /// Maximum flat size of every input group for one jet (n_vars * max_length).
+  const std::vector<unsigned int>& inputSizes() const { return m_inputSizes; }
+
+private:
+  /**
+   * @brief Reads the input groups and their preprocessing parameters. Throws nlohmann::json::exception.
+   */
+  void configure(const nlohmann::json& json_config);
+
+  /**
+   * @brief Appends an input group with its preprocessing parameters.
+   */
+  void addGroup(const PreprocessParams& params);
+
+  /**
+   * @brief Finds the position of a variable in the list of input variable names.
+   *
+   * @param var_name Name of the variable.
+   * @return The position of the variable in the input list.
+   */
+  size_t variablePos(const std::string& var_name) const;
+
+  std::vector<std::string> m_variablesNames;                       ///< List of input variable names.
+  std::vector<std::string> m_inputNames;                           ///< Input groups, in model order.
+  Shapes m_inputShapes;                                            ///< Tensor describing input shapes.
+  std::vector<unsigned int> m_inputSizes;                          ///< List of input sizes for each dimension.
+  std::unordered_map<std::string, PreprocessParams> m_prepInfoMap; ///< Map of preprocessing parameters.
+};
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Tags the jets of EDM4hep files without Gaudi: reads the events with podio, tags them with the TaggingEngine on
+ * several threads and writes every event with the jet tags added, in the layout of the JetTagger (one ParticleID
+ * collection per flavor, or with --compact one collection holding the scores of all flavors per jet). The events are
+ * written in their input order.
+ *
+ * One thread reads, one writes and --threads workers tag, each with a TaggingEngine of its own (engines of the same
+ * bundle share it). At most 2 x threads events are in flight.
+ *
+ * Usage: k4MLJetTagger_tag --input file.root [--input file2.root ...] --output out.root
+ *                          (--bundle file.k4jtb | --model file.onnx --json file.json)
+ *                          [--threads 1] [--max-batch-size 1] [--jets RefinedVertexJets] [--vertices PrimaryVertices]
+ *                          [--collections a,b,...] [--compact] [--num-events -1] [--bz 2.0] [--shared-model-weights]
+ */
+
+#include "JetTagReader.h"
+#include "ModelBundle.h"
+#include "TaggingEngine.h"
+
+#include <edm4hep/Constants.h>
+#include <edm4hep/ParticleIDCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+#include <edm4hep/VertexCollection.h>
+#include <edm4hep/utils/ParticleIDUtils.h>
+#include <podio/Frame.h>
+#include <podio/FrameCategories.h>
+#include <podio/Reader.h>
+#include <podio/Writer.h>
+
+#include <TROOT.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct TagOptions {
+  std::vector<std::string> inputs;
+  std::string output;
+  std::string bundle;
+  std::string model;
+  std::string json;
+  std::string jets{"RefinedVertexJets"};
+  std::string vertices{"PrimaryVertices"};
+  std::vector<std::string> collections;
+  bool compact{false};
+  size_t threads{1};
+  long num_events{-1};
+  TaggingEngine::Options engine;
+};
+
+void printUsage(const char* program) {
+  std::cout << "Usage: " << program
+            << " --input file.root [--input file2.root ...] --output out.root\n"
+               "       (--bundle file.k4jtb | --model file.onnx --json file.json) [--threads 1] [--max-batch-size 1]\n"
+               "       [--jets RefinedVertexJets] [--vertices PrimaryVertices] [--collections a,b,...] [--compact]\n"
+               "       [--num-events -1] [--bz 2.0] [--shared-model-weights]"
+            << std::endl;
+}
+
+std::vector<std::string> parseList(const std::string& arg) {
+  std::vector<std::string> values;
+  std::stringstream stream(arg);
+  for (std::string value; std::getline(stream, value, ',');)
+    values.push_back(value);
+  return values;
+}
+
+TagOptions parseOptions(int argc, char** argv) {
+  TagOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--compact") {
+      options.compact = true;
+      continue;
+    }
+    if (arg == "--shared-model-weights") {
+      options.engine.memory.share_model_bytes = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      throw std::invalid_argument("Missing value for " + arg);
+    const std::string value = argv[++i];
+    if (arg == "--input")
+      options.inputs.push_back(value);
+    else if (arg == "--output")
+      options.output = value;
+    else if (arg == "--bundle")
+      options.bundle = value;
+    else if (arg == "--model")
+      options.model = value;
+    else if (arg == "--json")
+      options.json = value;
+    else if (arg == "--jets")
+      options.jets = value;
+    else if (arg == "--vertices")
+      options.vertices = value;
+    else if (arg == "--collections")
+      options.collections = parseList(value);
+    else if (arg == "--threads")
+      options.threads = std::stoul(value);
+    else if (arg == "--max-batch-size")
+      options.engine.max_batch_size = std::stoul(value);
+    else if (arg == "--num-events")
+      options.num_events = std::stol(value);
+    else if (arg == "--bz")
+      options.engine.bz = std::stod(value);
+    else
+      throw std::invalid_argument("Unknown option " + arg);
+  }
+  if (options.inputs.empty() || options.output.empty())
+    throw std::invalid_argument("--input and --output are needed");
+  if (options.bundle.empty() == (options.model.empty() || options.json.empty()))
+    throw std::invalid_argument("Either --bundle or --model and --json are needed");
+  if (options.engine.memory.share_model_bytes && options.bundle.empty())
+    throw std::invalid_argument("--shared-model-weights needs --bundle");
+  if (options.threads == 0)
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+  return options;
+}
+
+/// Fills the tags of the jets of an event like the JetTagger: one collection per flavor, or one compact collection.
+std::vector<edm4hep::ParticleIDCollection> makeTags(const TaggingEngine& engine,
+                                                    const edm4hep::ReconstructedParticleCollection& jets,
+                                                    const std::vector<rv::RVec<float>>& probabilities,
+                                                    const edm4hep::utils::ParticleIDMeta* compact_meta) {
+  const auto& pdg_codes = engine.pdgCodes();
+  std::vector<edm4hep::ParticleIDCollection> tags(compact_meta ? 1 : pdg_codes.size());
+  for (size_t i_jet = 0; i_jet < jets.size(); ++i_jet) {
+    const auto& scores = probabilities[i_jet];
+    if (scores.size() != pdg_codes.size())
+      throw std::runtime_error("The model returned " + std::to_string(scores.size()) + " scores for " +
+                               std::to_string(pdg_codes.size()) + " flavors");
+    if (compact_meta) {
+      const auto max_index = std::distance(scores.begin(), std::max_element(scores.begin(), scores.end()));
+      auto tag = tags[0].create();
+      tag.setParticle(jets[i_jet]);
+      tag.setAlgorithmType(compact_meta->algoType());
+      tag.setLikelihood(scores[max_index]);
+      tag.setPDG(pdg_codes[max_index]);
+      for (const auto score : scores)
+        tag.addToParameters(score);
+    } else {
+      for (size_t i = 0; i < pdg_codes.size(); ++i) {
+        auto tag = tags[i].create();
+        tag.setParticle(jets[i_jet]);
+        tag.setLikelihood(scores[i]);
+        tag.setPDG(pdg_codes[i]);
+      }
+    }
+  }
+  return tags;
+}
+
+/**
+ * The events between the reader, the workers and the writer. The reader waits while the window of events in flight
+ * is full, the writer takes the tagged events in their input order.
+ */
+struct EventQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::pair<size_t, podio::Frame>> to_tag;
+  std::map<size_t, podio::Frame> tagged;
+  size_t n_read{0};
+  size_t n_written{0};
+  bool reading_done{false};
+  std::exception_ptr failure;
+
+  void fail(std::exception_ptr error) {
+    std::lock_guard lock(mutex);
+    if (!failure)
+      failure = std::move(error);
+    changed.notify_all();
+  }
+};
+
+/// Statistics of one worker.
+struct WorkerStats {
+  size_t events{0};
+  size_t jets{0};
+  double tag_ms{0};
+};
+
+void work(TaggingEngine& engine, const TagOptions& options, const std::vector<std::string>& collections,
+          const edm4hep::utils::ParticleIDMeta* compact_meta, EventQueue& queue, WorkerStats& stats) {
+  try {
+    while (true) {
+      std::unique_lock lock(queue.mutex);
+      queue.changed.wait(lock, [&] { return queue.failure || !queue.to_tag.empty() || queue.reading_done; });
+      if (queue.failure || queue.to_tag.empty())
+        return;
+      auto [index, frame] = std::move(queue.to_tag.front());
+      queue.to_tag.pop_front();
+      lock.unlock();
+
+      if (!frame.get(options.jets) || !frame.get(options.vertices))
+        throw std::runtime_error("Event " + std::to_string(index) + " has no collection " + options.jets + " or " +
+                                 options.vertices);
+      const auto& jets = frame.get<edm4hep::ReconstructedParticleCollection>(options.jets);
+      const auto& vertices = frame.get<edm4hep::VertexCollection>(options.vertices);
+      const auto start = std::chrono::steady_clock::now();
+      const auto probabilities = engine.tag(jets, vertices);
+      auto tags = makeTags(engine, jets, probabilities, compact_meta);
+      stats.tag_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+      ++stats.events;
+      stats.jets += jets.size();
+      for (size_t i = 0; i < tags.size(); ++i)
+        frame.put(std::move(tags[i]), collections[i]);
+
+      lock.lock();
+      queue.tagged.emplace(index, std::move(frame));
+      queue.changed.notify_all();
+    }
+  } catch (...) {
+    queue.fail(std::current_exception());
+  }
+}
+
+void writeEvents(podio::Writer& writer, EventQueue& queue) {
+  try {
+    while (true) {
+      std::unique_lock lock(queue.mutex);
+      queue.changed.wait(lock, [&] {
+        return queue.failure || queue.tagged.count(queue.n_written) ||
+               (queue.reading_done && queue.n_written == queue.n_read);
+      });
+      if (queue.failure || !queue.tagged.count(queue.n_written))
+        return;
+      auto node = queue.tagged.extract(queue.n_written);
+      lock.unlock();
+      writer.writeFrame(node.mapped(), podio::Category::Event);
+      lock.lock();
+      ++queue.n_written;
+      queue.changed.notify_all();
+    }
+  } catch (...) {
+    queue.fail(std::current_exception());
+  }
+}
+
+int run(const TagOptions& options) {
+  ROOT::EnableThreadSafety(); // the reader and the writer run in different threads
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::unique_ptr<TaggingEngine>> engines;
+  std::shared_ptr<const ModelBundle> bundle;
+  if (!options.bundle.empty())
+    bundle = std::make_shared<const ModelBundle>(options.bundle);
+  for (size_t i = 0; i < options.threads; ++i) {
+    engines.push_back(bundle ? std::make_unique<TaggingEngine>(bundle, options.engine)
+                             : std::make_unique<TaggingEngine>(options.model, options.json, options.engine));
+  }
+  const auto& engine = *engines.front();
+  auto collections = options.collections;
+  if (collections.empty())
+    collections = options.compact ? std::vector<std::string>{"RefinedJetTags"} : engine.collectionNames();
+  if (collections.size() != (options.compact ? 1 : engine.flavorNames().size()))
+    throw std::invalid_argument("--collections must name " +
+                                std::to_string(options.compact ? 1 : engine.flavorNames().size()) + " collections");
+  std::unique_ptr<edm4hep::utils::ParticleIDMeta> compact_meta;
+  if (options.compact)
+    compact_meta = std::make_unique<edm4hep::utils::ParticleIDMeta>(kJetTaggerAlgoName, engine.flavorNames());
+  const double setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  auto reader = podio::makeReader(options.inputs);
+  auto writer = podio::makeWriter(options.output);
+  size_t n_events = reader.getEntries(podio::Category::Event);
+  if (options.num_events >= 0)
+    n_events = std::min(n_events, static_cast<size_t>(options.num_events));
+  std::printf("Tagging %zu events with %zu threads (%s)\n", n_events, options.threads,
+              bundle ? options.bundle.c_str() : options.model.c_str());
+  std::fflush(stdout);
+
+  EventQueue queue;
+  std::vector<WorkerStats> stats(options.threads);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < options.threads; ++i) {
+    workers.emplace_back(work, std::ref(*engines[i]), std::cref(options), std::cref(collections), compact_meta.get(),
+                         std::ref(queue), std::ref(stats[i]));
+  }
+  std::thread writer_thread(writeEvents, std::ref(writer), std::ref(queue));
+
+  const size_t window = 2 * options.threads;
+  try {
+    for (size_t index = 0; index < n_events; ++index) {
+      {
+        std::unique_lock lock(queue.mutex);
+        queue.changed.wait(lock, [&] { return queue.failure || queue.n_read - queue.n_written < window; });
+        if (queue.failure)
+          break;
+      }
+      auto frame = reader.readFrame(podio::Category::Event, index);
+      std::lock_guard lock(queue.mutex);
+      queue.to_tag.emplace_back(index, std::move(frame));
+      ++queue.n_read;
+      queue.changed.notify_all();
+    }
+  } catch (...) {
+    queue.fail(std::current_exception());
+  }
+  {
+    std::lock_guard lock(queue.mutex);
+    queue.reading_done = true;
+    queue.changed.notify_all();
+  }
+  for (auto& worker : workers)
+    worker.join();
+  writer_thread.join();
+  if (queue.failure)
+    std::rethrow_exception(queue.failure);
+
+  // the other categories (e.g. runs) are copied, the metadata gets the flavor order of the compact collection
+  for (const auto category : reader.getAvailableCategories()) {
+    const std::string name(category);
+    if (name == podio::Category::Event || name == podio::Category::Metadata)
+      continue;
+    for (size_t i = 0; i < reader.getEntries(name); ++i)
+      writer.writeFrame(reader.readFrame(name, i), name);
+  }
+  auto metadata = reader.getEntries(podio::Category::Metadata) > 0 ? reader.readFrame(podio::Category::Metadata, 0)
+                                                                   : podio::Frame();
+  if (compact_meta) {
+    const auto& coll = collections.front();
+    metadata.putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDAlgoName), compact_meta->algoName);
+    metadata.putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDAlgoType), compact_meta->algoType());
+    metadata.putParameter(podio::collMetadataParamName(coll, edm4hep::labels::PIDParameterNames),
+                          compact_meta->paramNames);
+  }
+  writer.writeFrame(metadata, podio::Category::Metadata);
+  writer.finish();
+
+  const double total_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t n_jets = 0;
+  for (size_t i = 0; i < stats.size(); ++i) {
+    n_jets += stats[i].jets;
+    std::printf("  thread %2zu: %6zu events, %7zu jets, %9.1f ms tagging\n", i, stats[i].events, stats[i].jets,
+                stats[i].tag_ms);
+  }
+  std::printf("Tagged %zu jets in %zu events in %.2f s (%.1f events/s, setup %.0f ms), wrote %s\n", n_jets,
+              queue.n_written, total_s, queue.n_written / total_s, setup_ms, options.output.c_str());
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string first = argc > 1 ? argv[1] : "";
+  if (first == "-h" || first == "--help") {
+    printUsage(argv[0]);
+    return 0;
+  }
+  try {
+    return run(parseOptions(argc, argv));
+  } catch (const std::invalid_argument& e) {
+    std::cerr << e.what() << std::endl;
+    printUsage(argv[0]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  }
+  return 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Creates and inspects model bundles (ModelBundle): one file with the ONNX model, its preprocessing, the variable
+ * order and the flavor mapping, to be given to the JetTagger as bundle_path.
+ *
+ * create: reads the ONNX model and the preprocessing JSON written by Weaver. The preprocessing is compiled with the
+ * same code as in the JetTagger (WeaverPreprocessor), the variables are those of pf_features and pf_vectors, the PDG
+ * codes come from the flavor names (recojet_isX) and the output collections are <prefix>X, unless given. The model can
+ * also be in ORT format (converted with python -m onnxruntime.tools.convert_onnx_models_to_ort), which the JetTagger
+ * can use in place with SharedModelWeights.
+ * info: validates a bundle (including its checksum) and prints its contents.
+ *
+ * Usage: k4MLJetTagger_bundle create --model file.onnx|file.ort --json file.json --output file.k4jtb
+ *                                   [--collection-prefix RefinedJetTag_] [--collections a,b,...] [--name text]
+ *        k4MLJetTagger_bundle info file.k4jtb
+ */
+
+#include "Helpers.h"
+#include "ModelBundle.h"
+#include "WeaverPreprocessor.h"
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct CreateOptions {
+  std::string model;
+  std::string json;
+  std::string output;
+  std::string collection_prefix{"RefinedJetTag_"};
+  std::vector<std::string> collections;
+  std::string name;
+};
+
+void printUsage(const char* program) {
+  std::cout << "Usage: " << program
+            << " create --model file.onnx|file.ort --json file.json --output file.k4jtb"
+               " [--collection-prefix RefinedJetTag_] [--collections a,b,...] [--name text]\n"
+            << "       " << program << " info file.k4jtb" << std::endl;
+}
+
+std::vector<std::string> parseList(const std::string& arg) {
+  std::vector<std::string> values;
+  std::stringstream stream(arg);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    values.push_back(item);
+  return values;
+}
+
+CreateOptions parseCreateOptions(int argc, char** argv) {
+  CreateOptions options;
+  for (int i = 2; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::invalid_argument("Missing value for " + arg);
+    const std::string value = argv[++i];
+    if (arg == "--model")
+      options.model = value;
+    else if (arg == "--json")
+      options.json = value;
+    else if (arg == "--output")
+      options.output = value;
+    else if (arg == "--collection-prefix")
+      options.collection_prefix = value;
+    else if (arg == "--collections")
+      options.collections = parseList(value);
+    else if (arg == "--name")
+      options.name = value;
+    else
+      throw std::invalid_argument("Unknown option " + arg);
+  }
+  if (options.model.empty() || options.json.empty() || options.output.empty())
+    throw std::invalid_argument("create needs --model, --json and --output");
+  return options;
+}
+
+std::string readFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    throw std::runtime_error("Could not open " + path);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+std::string utcNow() {
+  const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+  char text[32];
+  std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+  return text;
+}
+
+int create(const CreateOptions& options) {
+  ModelBundleContents contents;
+  contents.model = readFile(options.model);
+
+  auto json_config = loadJsonFile(options.json);
+  if (json_config.is_null())
+    throw std::runtime_error("Could not load the preprocessing JSON file " + options.json);
+  // the same variables as the JetTagger (pf_points are included in pf_features)
+  for (const auto& var : json_config["pf_features"]["var_names"])
+    contents.variables.push_back(var.get<std::string>());
+  for (const auto& var : json_config["pf_vectors"]["var_names"])
+    contents.variables.push_back(var.get<std::string>());
+  const rv::RVec<std::string> vars(contents.variables.begin(), contents.variables.end());
+  const WeaverPreprocessor preprocessor(json_config, vars);
+  for (const auto& input : preprocessor.inputNames())
+    contents.preprocessing.push_back(preprocessor.params(input));
+
+  const auto flavor_names = json_config.at("output_names").get<std::vector<std::string>>();
+  if (!options.collections.empty() && options.collections.size() != flavor_names.size())
+    throw std::invalid_argument("--collections has " + std::to_string(options.collections.size()) +
+                                " names, the model has " + std::to_string(flavor_names.size()) + " outputs");
+  for (size_t i = 0; i < flavor_names.size(); ++i) {
+    const auto& name = flavor_names[i];
+    const auto pdg = to_PDGflavor.find(name);
+    if (pdg == to_PDGflavor.end())
+      throw std::runtime_error("No PDG code known for the output " + name);
+    const auto flavor = name.substr(name.find_last_of('_') + 3); // recojet_isTAU -> TAU
+    contents.flavors.push_back(
+        {name, pdg->second, options.collections.empty() ? options.collection_prefix + flavor : options.collections[i]});
+  }
+
+  contents.metadata["name"] = options.name.empty() ? options.model : options.name;
+  contents.metadata["source_model"] = options.model;
+  contents.metadata["source_json"] = options.json;
+  contents.metadata["model_format"] = ModelBundle::isOrtFormat(contents.model) ? "ORT" : "ONNX";
+  contents.metadata["created"] = utcNow();
+  contents.metadata["created_by"] = "k4MLJetTagger_bundle " K4MLJETTAGGER_VERSION;
+
+  const auto checksum = ModelBundle::write(options.output, contents);
+  // read it back, so that a broken bundle is noticed here and not in the first job
+  const ModelBundle bundle(options.output);
+  std::printf("Wrote %s: %zu bytes, CRC-32 %08x, model of %zu bytes, %zu input groups, %zu outputs\n",
+              options.output.c_str(), bundle.fileSize(), checksum, bundle.model().size(),
+              bundle.preprocessing().size(), bundle.flavors().size());
+  return 0;
+}
+
+int info(const std::string& path) {
+  const ModelBundle bundle(path);
+  std::printf("%s: format version %u, %zu bytes, CRC-32 %08x (verified)\n", path.c_str(), bundle.formatVersion(),
+              bundle.fileSize(), bundle.checksum());
+  for (const auto& [key, value] : bundle.metadata())
+    std::printf("  %-12s %s\n", key.c_str(), value.c_str());
+  std::printf("Model: %zu bytes, %s format\n", bundle.model().size(), bundle.modelIsOrtFormat() ? "ORT" : "ONNX");
+  std::printf("Input groups:\n");
+  for (const auto& group : bundle.preprocessing()) {
+    std::printf("  %-12s %3zu variables, length %zu-%zu%s\n", group.name.c_str(), group.var_names.size(),
+                group.min_length, group.max_length, group.fixed_length ? " (fixed)" : "");
+  }
+  std::printf("Variables (%zu):", bundle.variables().size());
+  for (const auto& var : bundle.variables())
+    std::printf(" %s", var.c_str());
+  std::printf("\nOutputs:\n");
+  for (const auto& flavor : bundle.flavors())
+    std::printf("  %-16s PDG %4d -> %s\n", flavor.name.c_str(), flavor.pdg, flavor.collection.c_str());
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string command = argc > 1 ? argv[1] : "";
+  if (command == "-h" || command == "--help") {
+    printUsage(argv[0]);
+    return 0;
+  }
+  try {
+    if (command == "create")
+      return create(parseCreateOptions(argc, argv));
+    if (command == "info" && argc == 3)
+      return info(argv[2]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  printUsage(argv[0]);
+  return 1;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Serves model bundles to the JetTaggers of a node (property ServerSocket) over a Unix domain socket, batching the
+ * jets of all of them (TaggingServer).
+ *
+ * Without a command, the server runs until SIGINT or SIGTERM. With a command after --, the server runs it (e.g. a
+ * script starting several jobs) and stops when it ends, returning its exit code.
+ *
+ * Usage: k4MLJetTagger_server --socket path --bundle file.k4jtb [--bundle file2.k4jtb ...] [--max-batch-size 64]
+ *                             [--batch-window-ms 2] [--shared-model-weights] [-- command args...]
+ */
+
+#include "ModelBundle.h"
+#include "TaggingServer.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void requestStop(int) { g_stop = true; }
+
+struct ServerOptions {
+  std::string socket;
+  std::vector<std::string> bundles;
+  TaggingServer::Options batching;
+  bool shared_model_weights{false};
+  std::vector<std::string> command;
+};
+
+void printUsage(const char* program) {
+  std::cout << "Usage: " << program
+            << " --socket path --bundle file.k4jtb [--bundle file2.k4jtb ...] [--max-batch-size 64]"
+               " [--batch-window-ms 2] [--shared-model-weights] [-- command args...]"
+            << std::endl;
+}
+
+ServerOptions parseOptions(int argc, char** argv) {
+  ServerOptions options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--") {
+      options.command.assign(argv + i + 1, argv + argc);
+      break;
+    }
+    if (arg == "--shared-model-weights") {
+      options.shared_model_weights = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      throw std::invalid_argument("Missing value for " + arg);
+    const std::string value = argv[++i];
+    if (arg == "--socket")
+      options.socket = value;
+    else if (arg == "--bundle")
+      options.bundles.push_back(value);
+    else if (arg == "--max-batch-size")
+      options.batching.max_batch_size = std::stoul(value);
+    else if (arg == "--batch-window-ms")
+      options.batching.batch_window_ms = std::stod(value);
+    else
+      throw std::invalid_argument("Unknown option " + arg);
+  }
+  if (options.socket.empty() || options.bundles.empty())
+    throw std::invalid_argument("--socket and at least one --bundle are needed");
+  if (!options.command.empty() && options.command.front().empty())
+    throw std::invalid_argument("Empty command after --");
+  return options;
+}
+
+/// Starts the command, returns its pid. Throws std::runtime_error if it cannot be started.
+pid_t spawn(const std::vector<std::string>& command) {
+  std::vector<char*> args;
+  for (const auto& arg : command)
+    args.push_back(const_cast<char*>(arg.c_str()));
+  args.push_back(nullptr);
+  pid_t pid;
+  if (const int error = ::posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ); error != 0)
+    throw std::runtime_error("Could not start " + command.front() + ": " + std::strerror(error));
+  return pid;
+}
+
+int run(const ServerOptions& options) {
+  TaggingServer server(options.batching);
+  ONNXRuntime::MemoryOptions memory_options;
+  memory_options.share_model_bytes = options.shared_model_weights;
+  for (const auto& path : options.bundles) {
+    server.addModel(std::make_shared<const ModelBundle>(path), memory_options);
+    std::printf("Serving %s\n", path.c_str());
+  }
+
+  struct sigaction action {};
+  action.sa_handler = requestStop;
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+
+  int exit_code = 0;
+  pid_t pid = 0;
+  std::thread waiter;
+  if (!options.command.empty()) {
+    pid = spawn(options.command);
+    waiter = std::thread([pid, &exit_code] {
+      int status = 0;
+      while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+      }
+      exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+      g_stop = true;
+    });
+  }
+  std::printf("Listening on %s (batches of up to %zu jets, window %.1f ms)\n", options.socket.c_str(),
+              options.batching.max_batch_size, options.batching.batch_window_ms);
+  std::fflush(stdout);
+  try {
+    server.serve(options.socket, g_stop);
+  } catch (...) {
+    if (waiter.joinable()) {
+      ::kill(pid, SIGTERM); // its jobs could not be served anyway
+      waiter.join();
+    }
+    throw;
+  }
+  if (waiter.joinable())
+    waiter.join();
+  std::printf("Tagging server statistics: %s", server.report().c_str());
+  return exit_code;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  const std::string first = argc > 1 ? argv[1] : "";
+  if (first == "-h" || first == "--help") {
+    printUsage(argv[0]);
+    return 0;
+  }
+  try {
+    return run(parseOptions(argc, argv));
+  } catch (const std::invalid_argument& e) {
+    std::cerr << e.what() << std::endl;
+    printUsage(argv[0]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  }
+  return 1;
+}
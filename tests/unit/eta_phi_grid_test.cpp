@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Unit test of EtaPhiGrid: the points within Delta R of a position, found through forEachCandidate(), must be exactly
+ * those of a brute-force search over all points, and every point must be visited at most once per search.
+ *
+ * Covers grids with many cells and with fewer than three phi cells (where the neighbours wrap onto the same cells),
+ * points beyond max_eta, phi at the wrap-around, an empty grid and rebuilding a grid with a different number of points.
+ *
+ * Usage: k4MLJetTagger_test_eta_phi_grid (returns 1 if a search differs)
+ */
+
+#include "EtaPhiGrid.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Case {
+  const char* name;
+  double cell_size;
+  double max_eta;
+  size_t n_points;
+};
+
+int n_failures = 0;
+
+void fail(const Case& c, const char* what, double eta, double phi) {
+  ++n_failures;
+  std::printf("FAILED %s: %s at (eta %g, phi %g)\n", c.name, what, eta, phi);
+}
+
+/// Compares the grid search around (eta, phi) with a brute-force search over all points.
+void check(const Case& c, const EtaPhiGrid& grid, const std::vector<float>& etas, const std::vector<float>& phis,
+           double eta, double phi) {
+  const double max_dr2 = c.cell_size * c.cell_size;
+  std::vector<int> visits(etas.size(), 0);
+  grid.forEachCandidate(eta, phi, [&](size_t i) { ++visits[i]; });
+  for (size_t i = 0; i < etas.size(); ++i) {
+    const double deta = etas[i] - eta;
+    const double dphi = std::remainder(phis[i] - phi, 2. * M_PI);
+    const bool inside = deta * deta + dphi * dphi < max_dr2;
+    if (visits[i] > 1)
+      fail(c, "point visited more than once", eta, phi);
+    if (inside && visits[i] == 0)
+      fail(c, "point within Delta R not visited", eta, phi);
+    if (std::abs(grid.deltaR2(i, eta, phi) - (deta * deta + dphi * dphi)) > 1e-9)
+      fail(c, "deltaR2 differs from the brute-force Delta R", eta, phi);
+  }
+}
+
+void run(const Case& c, EtaPhiGrid& grid, std::mt19937& rng) {
+  // a fraction of the points beyond max_eta and at phi = +-pi, where the binning is clamped and wraps around
+  std::uniform_real_distribution<float> eta_dist(-1.2 * c.max_eta, 1.2 * c.max_eta);
+  std::uniform_real_distribution<float> phi_dist(-M_PI, M_PI);
+  std::vector<float> etas(c.n_points), phis(c.n_points);
+  for (size_t i = 0; i < c.n_points; ++i) {
+    etas[i] = eta_dist(rng);
+    phis[i] = i % 10 == 0 ? (i % 20 == 0 ? M_PI : -M_PI) : phi_dist(rng);
+  }
+  grid.build(etas, phis);
+  if (grid.size() != c.n_points)
+    fail(c, "wrong number of points", 0., 0.);
+
+  // searches around the points themselves (the densest neighbourhoods) and at random positions
+  for (size_t i = 0; i < c.n_points; ++i)
+    check(c, grid, etas, phis, etas[i], phis[i]);
+  for (int k = 0; k < 200; ++k)
+    check(c, grid, etas, phis, eta_dist(rng), phi_dist(rng));
+  check(c, grid, etas, phis, 0., M_PI);
+  check(c, grid, etas, phis, 0., -M_PI);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937 rng(42);
+  const Case cases[] = {
+      {"jet cone", 0.4, 10., 500},      // many cells
+      {"large Delta R", 1.0, 10., 300}, // as MaxDeltaR of the JetMCTagger
+      {"two phi cells", 2.5, 3., 200},  // fewer than three phi cells
+      {"one cell", 7., 3., 100},        // a single phi cell and a single eta cell
+      {"beyond max eta", 0.3, 1., 200}, // most points in the outermost cells
+      {"empty", 0.4, 10., 0},
+  };
+  for (const auto& c : cases) {
+    EtaPhiGrid grid(c.cell_size, c.max_eta);
+    run(c, grid, rng);
+    // rebuilding with fewer points reuses the memory of the first build
+    run({c.name, c.cell_size, c.max_eta, c.n_points / 3}, grid, rng);
+  }
+
+  if (n_failures > 0) {
+    std::printf("%d failed checks\n", n_failures);
+    return 1;
+  }
+  std::printf("EtaPhiGrid agrees with the brute-force Delta R search\n");
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020-2024 Key4hep-Project.
+ *
+ * This file is part of Key4hep.
+ * See https://key4hep.github.io/key4hep-doc/ for further info.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Unit test of the MC jet labellings of EventMCTruth on small fixed events with known flavors.
+ *
+ * - HiggsDaughters: H -> bb, H -> cc, H -> gg, and events where the flavor cannot be determined.
+ * - DeltaR: b, c, tau and gluon jets, a jet next to the c jet whose particles are all closer to the c jet, a b jet
+ *   across the phi wrap-around, the precedence of hadrons over (more energetic) partons and jets without any flavor
+ *   particle.
+ * - Links: the same jets labelled from the links of their constituents, with constituents linked to several MC
+ *   particles (shared by the link weights), MC particles linked from several jets (walked once and looked up in the
+ *   cache of the event), a b fraction below the minimum fraction, constituents without links and two link collections.
+ *
+ * Usage: k4MLJetTagger_test_event_mc_truth (returns 1 if a label differs)
+ */
+
+#include "EventMCTruth.h"
+
+#include <edm4hep/MCParticleCollection.h>
+#include <edm4hep/RecoMCParticleLinkCollection.h>
+#include <edm4hep/ReconstructedParticleCollection.h>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+int n_failures = 0;
+
+void check(bool ok, const std::string& what) {
+  if (ok)
+    return;
+  ++n_failures;
+  std::printf("FAILED %s\n", what.c_str());
+}
+
+void expect(const std::string& what, const std::vector<int>& labels, const std::vector<int>& expected) {
+  if (labels == expected)
+    return;
+  ++n_failures;
+  std::printf("FAILED %s:", what.c_str());
+  for (size_t i = 0; i < labels.size(); ++i)
+    std::printf(" %d", labels[i]);
+  std::printf(" (expected");
+  for (size_t i = 0; i < expected.size(); ++i)
+    std::printf(" %d", expected[i]);
+  std::printf(")\n");
+}
+
+/// Momentum of a massless particle with the given energy and direction.
+edm4hep::Vector3f momentum(float energy, float eta, float phi) {
+  const float pt = energy / std::cosh(eta);
+  return {pt * std::cos(phi), pt * std::sin(phi), pt * std::sinh(eta)};
+}
+
+edm4hep::MutableMCParticle addMC(edm4hep::MCParticleCollection& mc, int pdg, float energy, float eta, float phi,
+                                 const std::vector<edm4hep::MutableMCParticle>& parents = {}) {
+  auto particle = mc.create();
+  particle.setPDG(pdg);
+  particle.setEnergy(energy);
+  const auto p = momentum(energy, eta, phi);
+  particle.setMomentum({p.x, p.y, p.z});
+  for (auto parent : parents) {
+    particle.addToParents(parent);
+    parent.addToDaughters(particle);
+  }
+  return particle;
+}
+
+/// Higgs boson decaying to two particles with the given PDGs.
+void addHiggs(edm4hep::MCParticleCollection& mc, int pdg1, int pdg2) {
+  const auto higgs = addMC(mc, 25, 125., 0., 0.);
+  addMC(mc, pdg1, 62.5, 0., 0., {higgs});
+  addMC(mc, pdg2, 62.5, 0., M_PI, {higgs});
+}
+
+void testHiggsDaughters() {
+  const struct {
+    const char* name;
+    int pdg1, pdg2;
+    int flavor;
+  } cases[] = {
+      {"H -> bb", 5, -5, 5},
+      {"H -> cc", 4, -4, 4},
+      {"H -> gg", 21, 21, 21},
+      {"H -> bc", 5, -4, 0},
+      {"H -> ZZ", 23, -23, 0}, // unexpected PDG
+  };
+  for (const auto& c : cases) {
+    edm4hep::MCParticleCollection mc;
+    addHiggs(mc, c.pdg1, c.pdg2);
+    const EventMCTruth truth(mc);
+    expect(std::string("HiggsDaughters ") + c.name, {truth.jetFlavor()}, {c.flavor});
+    check(truth.higgsDaughterProblem().empty() == (c.flavor != 0),
+          std::string("HiggsDaughters problem of ") + c.name + ": '" + truth.higgsDaughterProblem() + "'");
+  }
+
+  edm4hep::MCParticleCollection no_higgs;
+  addMC(no_higgs, 5, 50., 0., 0.);
+  const EventMCTruth truth(no_higgs);
+  expect("HiggsDaughters without a Higgs boson", {truth.jetFlavor()}, {0});
+  check(!truth.higgsDaughterProblem().empty(), "HiggsDaughters problem without a Higgs boson");
+}
+
+/// Jets of the fixed event, in the order of the jet collection.
+enum Jet { kB, kBWrap, kC, kNextToC, kGluon, kTau, kEmpty, kLowB, kNJets };
+
+struct JetDirection {
+  float eta, phi;
+};
+const JetDirection kJets[kNJets] = {
+    {0., 0.},              // kB
+    {0., M_PI - 0.05},     // kBWrap: its b hadron is at -pi + 0.05
+    {0., M_PI / 2},        // kC
+    {0., M_PI / 2 + 0.35}, // kNextToC: the c quark and c hadron are within 0.4, but closer to kC
+    {0., -M_PI / 2},       // kGluon
+    {1.5, M_PI / 4},       // kTau
+    {-2., -3 * M_PI / 4},  // kEmpty: no MC particle nearby, constituent without link
+    {-1., 0.},             // kLowB: 4% of the energy from the b hadron of kB
+};
+
+/// MC particles and jets of an event with b, c, gluon and tau jets.
+struct FixedEvent {
+  edm4hep::MCParticleCollection mc;
+  edm4hep::ReconstructedParticleCollection jets;
+  std::vector<edm4hep::MutableReconstructedParticle> jet_handles;
+  // decay products, no flavor particles themselves, linked from the constituents in testLinks()
+  edm4hep::MutableMCParticle b_pion1, b_pion2, b_kaon, c_pion, hard_gluon_pion, gluon_pion, u_pion, tau_pion;
+
+  FixedEvent() {
+    mc.setID(1);
+    jets.setID(3);
+    // H -> bb: the b hadrons of the two b jets
+    const auto higgs = addMC(mc, 25, 125., 0., 0.);
+    const auto b = addMC(mc, 5, 60., 0., 0.02, {higgs});
+    const auto bbar = addMC(mc, -5, 60., 0., -M_PI + 0.1, {higgs});
+    const auto b0 = addMC(mc, 511, 50., 0., 0.01, {b});
+    b_pion1 = addMC(mc, 211, 20., 0.05, 0., {b0});
+    b_pion2 = addMC(mc, -211, 25., -0.05, 0.02, {b0});
+    const auto bminus = addMC(mc, -521, 50., 0., -M_PI + 0.05, {bbar});
+    b_kaon = addMC(mc, 321, 30., 0., -M_PI + 0.06, {bminus});
+    // c jet with a harder gluon: the c hadron takes precedence
+    const auto c = addMC(mc, 4, 20., 0., M_PI / 2);
+    const auto d0 = addMC(mc, 421, 15., 0., M_PI / 2 + 0.05, {c});
+    c_pion = addMC(mc, 211, 10., 0., M_PI / 2 + 0.05, {d0});
+    const auto hard_gluon = addMC(mc, 21, 80., 0.1, M_PI / 2);
+    hard_gluon_pion = addMC(mc, 111, 30., 0.1, M_PI / 2, {hard_gluon});
+    // gluon jet with a softer u quark
+    const auto gluon = addMC(mc, 21, 40., 0., -M_PI / 2);
+    gluon_pion = addMC(mc, 211, 10., 0., -M_PI / 2, {gluon});
+    const auto u = addMC(mc, 2, 10., 0.1, -M_PI / 2);
+    u_pion = addMC(mc, -211, 10., 0.1, -M_PI / 2, {u});
+    // tau jet
+    const auto tau = addMC(mc, 15, 30., 1.5, M_PI / 4);
+    tau_pion = addMC(mc, -211, 20., 1.5, M_PI / 4, {tau});
+    // gluon far from all jets
+    addMC(mc, 21, 10., 3., 2.);
+
+    for (const auto& direction : kJets) {
+      auto jet = jets.create();
+      jet.setEnergy(50.);
+      jet.setMomentum(momentum(50., direction.eta, direction.phi));
+      jet_handles.push_back(jet);
+    }
+  }
+};
+
+void testDeltaR() {
+  const FixedEvent event;
+  const EventMCTruth truth(event.mc);
+  expect("HiggsDaughters of the fixed event", {truth.jetFlavor()}, {5});
+  // labels in the order of the jets: kB, kBWrap, kC, kNextToC, kGluon, kTau, kEmpty, kLowB
+  expect("DeltaR", truth.jetFlavorsDeltaR(event.jets, 0.4), {5, 5, 4, 0, 21, 15, 0, 0});
+  // only the b hadron of kB and the partons along the jet axes are within 0.03
+  expect("DeltaR with a small cone", truth.jetFlavorsDeltaR(event.jets, 0.03), {5, 0, 4, 0, 21, 15, 0, 0});
+  expect("DeltaR without jets", truth.jetFlavorsDeltaR(edm4hep::ReconstructedParticleCollection(), 0.4), {});
+}
+
+void testLinks() {
+  FixedEvent event;
+  edm4hep::ReconstructedParticleCollection particles;
+  particles.setID(2);
+  auto addConstituent = [&](Jet jet, float energy) {
+    auto particle = particles.create();
+    particle.setEnergy(energy);
+    particle.setMomentum(momentum(energy, kJets[jet].eta, kJets[jet].phi));
+    event.jet_handles[jet].addToParticles(particle);
+    return particle;
+  };
+
+  edm4hep::RecoMCParticleLinkCollection links, tau_links;
+  links.setID(4);
+  tau_links.setID(5);
+  auto link = [](edm4hep::RecoMCParticleLinkCollection& coll, const edm4hep::MutableReconstructedParticle& from,
+                 const edm4hep::MutableMCParticle& to, float weight) {
+    auto l = coll.create();
+    l.setFrom(from);
+    l.setTo(to);
+    l.setWeight(weight);
+  };
+  link(links, addConstituent(kB, 20.), event.b_pion1, 1.);
+  link(links, addConstituent(kB, 25.), event.b_pion2, 1.);
+  link(links, addConstituent(kBWrap, 30.), event.b_kaon, 1.);
+  // 10 of 40 GeV from the c hadron
+  link(links, addConstituent(kC, 10.), event.c_pion, 1.);
+  link(links, addConstituent(kC, 30.), event.hard_gluon_pion, 1.);
+  // the pion of the c hadron again, from another jet
+  link(links, addConstituent(kNextToC, 10.), event.c_pion, 1.);
+  // the gluon jet has 10 + 0.1 * 40 GeV from the gluon and 0.9 * 40 GeV from the u quark: with equal shares instead of
+  // the link weights, it would be labelled 21
+  link(links, addConstituent(kGluon, 10.), event.gluon_pion, 1.);
+  const auto shared = addConstituent(kGluon, 40.);
+  link(links, shared, event.gluon_pion, 0.1);
+  link(links, shared, event.u_pion, 0.9);
+  link(tau_links, addConstituent(kTau, 20.), event.tau_pion, 1.);
+  addConstituent(kEmpty, 5.);
+  // 2 of 50 GeV from the b hadron of kB, below the minimum fraction
+  link(links, addConstituent(kLowB, 2.), event.b_pion1, 1.);
+  link(links, addConstituent(kLowB, 48.), event.gluon_pion, 1.);
+
+  const auto& jets = event.jets;
+  // labels in the order of the jets: kB, kBWrap, kC, kNextToC, kGluon, kTau, kEmpty, kLowB
+  expect("Links", EventMCTruth::jetFlavorsFromLinks(jets, {&links, &tau_links}, 0.1), {5, 5, 4, 4, 2, 15, 0, 21});
+  expect("Links without the tau links", EventMCTruth::jetFlavorsFromLinks(jets, {&links}, 0.1),
+         {5, 5, 4, 4, 2, 0, 0, 21});
+  expect("Links with a low minimum fraction", EventMCTruth::jetFlavorsFromLinks(jets, {&links, &tau_links}, 0.01),
+         {5, 5, 4, 4, 2, 15, 0, 5});
+  expect("Links with a high minimum fraction", EventMCTruth::jetFlavorsFromLinks(jets, {&links, &tau_links}, 0.5),
+         {5, 5, 21, 4, 2, 15, 0, 21});
+}
+
+} // namespace
+
+int main() {
+  testHiggsDaughters();
+  testDeltaR();
+  testLinks();
+
+  if (n_failures > 0) {
+    std::printf("%d failed checks\n", n_failures);
+    return 1;
+  }
+  std::printf("All MC jet labels as expected\n");
+  return 0;
+}